@@ -149,3 +149,51 @@ int main(void) {
   return 0;
 }"
   OME_HAVE_SNPRINTF)
+
+# Positioned reads for reading uncompressed TIFF image data without
+# using (and serialising on) the libtiff file handle:
+check_cxx_source_compiles("
+#include <unistd.h>
+int main(void) {
+  char buf[10];
+  ssize_t n = pread(0, buf, 10, 0);
+  return n < 0 ? 1 : 0;
+}"
+  OME_HAVE_PREAD)
+
+# Positioned writes for coalesced TIFF output:
+check_cxx_source_compiles("
+#include <unistd.h>
+int main(void) {
+  char buf[10] = {0};
+  ssize_t n = pwrite(1, buf, 10, 0);
+  return n < 0 ? 1 : 0;
+}"
+  OME_HAVE_PWRITE)
+
+# Preallocation of TIFF output files:
+check_cxx_source_compiles("
+#include <fcntl.h>
+int main(void) {
+  return posix_fallocate(1, 0, 4096);
+}"
+  OME_HAVE_POSIX_FALLOCATE)
+
+# Sub-second file modification times for metadata cache validation:
+check_cxx_source_compiles("
+#include <sys/stat.h>
+int main(void) {
+  struct stat st;
+  if (stat(\"test\", &st) != 0)
+    return 1;
+  return st.st_mtim.tv_nsec < 0 ? 1 : 0;
+}"
+  OME_HAVE_STAT_ST_MTIM)
+
+# Direct (uncached) writes of TIFF output:
+check_cxx_source_compiles("
+#include <fcntl.h>
+int main(void) {
+  return open(\"test\", O_WRONLY | O_DIRECT) < 0 ? 1 : 0;
+}"
+  OME_HAVE_O_DIRECT)
@@ -35,4 +35,5 @@
 # #L%
 
 find_package(TIFF 4.0.3 REQUIRED)
+find_package(ZLIB REQUIRED)
 find_package(PNG REQUIRED)
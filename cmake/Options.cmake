@@ -15,6 +15,9 @@ option(fatal-warnings "Compiler warnings are errors" OFF)
 option(test "Enable unit tests (requires gtest)" ON)
 option(extended-tests "Enable extended tests (more comprehensive, longer run time)" ON)
 
+# Performance benchmarks.
+option(benchmarks "Build performance benchmarks (ome-files-bench)" ON)
+
 # The installation is relocatable; this affects path lookups (if OFF,
 # paths are assumed to be their configured absolute install location;
 # paths will still be introspected as a fallback); if ON paths will be
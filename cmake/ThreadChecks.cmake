@@ -87,3 +87,19 @@ endfunction(thread_test)
 if(NOT CMAKE_VERSION VERSION_LESS 3.8)
   thread_test()
 endif()
+
+# Processor affinity for executor worker threads:
+include(CheckCXXSourceCompiles)
+set(CMAKE_REQUIRED_LIBRARIES_SAVE ${CMAKE_REQUIRED_LIBRARIES})
+set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES} ${CMAKE_THREAD_LIBS_INIT})
+check_cxx_source_compiles("
+#include <pthread.h>
+#include <sched.h>
+int main(void) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(0, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}"
+  OME_HAVE_PTHREAD_SETAFFINITY_NP)
+set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES_SAVE})
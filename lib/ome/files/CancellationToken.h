@@ -0,0 +1,146 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_CANCELLATIONTOKEN_H
+#define OME_FILES_CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <boost/optional.hpp>
+
+namespace ome
+{
+  namespace files
+  {
+
+    /**
+     * Cancellation token for interruptible operations.
+     *
+     * A token may be passed to operations such as
+     * FormatReader::openBytes() to allow them to be stopped before
+     * completion.  The operation checks the token at convenient
+     * points, for example between reading tiles, and throws a
+     * CancelledException if the token has been cancelled or its
+     * deadline has passed.  Any resources used by the operation are
+     * released as the exception propagates.
+     *
+     * Copies of a token share their cancellation state, so that a
+     * token may be cancelled from another thread while an operation
+     * using a copy is in progress.  cancel() and check() are
+     * thread-safe.
+     */
+    class CancellationToken
+    {
+    public:
+      /// Clock used for deadlines.
+      typedef std::chrono::steady_clock clock_type;
+
+      /// Constructor (no deadline).
+      CancellationToken();
+
+      /**
+       * Constructor with deadline.
+       *
+       * @param deadline the time after which operations will be
+       * cancelled.
+       */
+      explicit
+      CancellationToken(clock_type::time_point deadline);
+
+      /// Destructor.
+      ~CancellationToken();
+
+      /**
+       * Cancel operations using this token (and all copies).
+       */
+      void
+      cancel();
+
+      /**
+       * Check if this token has been cancelled.
+       *
+       * @returns @c true if cancel() has been called, @c false
+       * otherwise.
+       */
+      bool
+      isCancelled() const;
+
+      /**
+       * Check if the deadline of this token has passed.
+       *
+       * @returns @c true if a deadline is set and has passed, @c
+       * false otherwise.
+       */
+      bool
+      isExpired() const;
+
+      /**
+       * Get the deadline.
+       *
+       * @returns the deadline, if set.
+       */
+      const boost::optional<clock_type::time_point>&
+      getDeadline() const;
+
+      /**
+       * Check if the operation should stop.
+       *
+       * @throws CancelledException if cancelled or the deadline has
+       * passed.
+       */
+      void
+      check() const;
+
+    private:
+      /// Cancellation state shared between copies.
+      std::shared_ptr<std::atomic<bool>> cancelled;
+      /// Deadline.
+      boost::optional<clock_type::time_point> deadline;
+    };
+
+  }
+}
+
+#endif // OME_FILES_CANCELLATIONTOKEN_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,489 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/format.hpp>
+
+#include <ome/common/log.h>
+
+#include <ome/files/Executor.h>
+#include <ome/files/config-internal.h>
+
+#ifdef OME_HAVE_PTHREAD_SETAFFINITY_NP
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+namespace ome
+{
+  namespace files
+  {
+
+    namespace
+    {
+
+      /// Lock for the shared executors.
+      std::mutex shared_mutex;
+      /// The shared executor, if set or created.
+      std::shared_ptr<Executor> shared_executor;
+      /// The shared I/O executor, if set or created.
+      std::shared_ptr<Executor> shared_io_executor;
+
+      /**
+       * Parse a Linux CPU list, e.g. "0-3,8,10-11".
+       *
+       * @param list the list to parse.
+       * @returns the CPUs in the list.
+       */
+      std::vector<unsigned int>
+      parse_cpu_list(const std::string& list)
+      {
+        std::vector<unsigned int> cpus;
+        std::istringstream is(list);
+        std::string range;
+
+        while (std::getline(is, range, ','))
+          {
+            if (range.empty())
+              continue;
+            std::istringstream rs(range);
+            unsigned int first, last;
+            char sep;
+            if (!(rs >> first))
+              {
+                boost::format fmt("Invalid CPU list ‘%1%’");
+                fmt % list;
+                throw std::runtime_error(fmt.str());
+              }
+            last = first;
+            if (rs >> sep && sep == '-' && !(rs >> last))
+              {
+                boost::format fmt("Invalid CPU list ‘%1%’");
+                fmt % list;
+                throw std::runtime_error(fmt.str());
+              }
+            for (unsigned int cpu = first; cpu <= last; ++cpu)
+              cpus.push_back(cpu);
+          }
+
+        return cpus;
+      }
+
+    }
+
+    Executor::Executor()
+    {
+    }
+
+    Executor::~Executor()
+    {
+    }
+
+    std::shared_ptr<Executor>
+    Executor::shared()
+    {
+      std::lock_guard<std::mutex> lock(shared_mutex);
+      if (!shared_executor)
+        shared_executor = std::make_shared<ThreadPoolExecutor>();
+      return shared_executor;
+    }
+
+    void
+    Executor::setShared(std::shared_ptr<Executor> executor)
+    {
+      std::shared_ptr<Executor> previous;
+      {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        previous = shared_executor;
+        shared_executor = executor;
+      }
+      // Any previous executor is released outside the lock, since
+      // its destruction may wait for queued tasks to complete.
+    }
+
+    std::shared_ptr<Executor>
+    Executor::sharedIO()
+    {
+      std::lock_guard<std::mutex> lock(shared_mutex);
+      if (!shared_io_executor)
+        shared_io_executor = std::make_shared<ThreadPoolExecutor>();
+      return shared_io_executor;
+    }
+
+    void
+    Executor::setSharedIO(std::shared_ptr<Executor> executor)
+    {
+      std::shared_ptr<Executor> previous;
+      {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        previous = shared_io_executor;
+        shared_io_executor = executor;
+      }
+    }
+
+    ThreadPoolExecutor::Options::Options():
+      threads(0U),
+      cpus(),
+      numaNode()
+    {
+    }
+
+    /**
+     * Internal implementation details of ThreadPoolExecutor.
+     *
+     * This is shared with the worker threads, so that it remains
+     * valid should the executor be destroyed by one of its own
+     * tasks.
+     */
+    class ThreadPoolExecutor::Impl
+    {
+    public:
+      /// Worker thread and its task queue.
+      struct Worker
+      {
+        /// Lock for the task queue.
+        std::mutex mutex;
+        /// Task queue.
+        std::deque<task_type> tasks;
+        /// Thread.
+        std::thread thread;
+      };
+
+      /// Message logger.
+      ome::common::Logger logger;
+      /// Processors to run on (empty for any).
+      std::vector<unsigned int> cpus;
+      /// Worker threads.
+      std::vector<std::unique_ptr<Worker>> workers;
+      /// Lock for tasks submitted from outside the pool.
+      std::mutex injectMutex;
+      /// Tasks submitted from outside the pool.
+      std::deque<task_type> inject;
+      /// Number of queued tasks in all queues.
+      std::atomic<dimension_size_type> pending;
+      /// Lock for sleeping and stopping.
+      std::mutex sleepMutex;
+      /// Signalled when a task is queued or on stop.
+      std::condition_variable wake;
+      /// Stop once all queues are empty.
+      bool stop;
+
+      /// The pool of the current thread, if a worker thread.
+      static thread_local const Impl *currentPool;
+      /// The worker index of the current thread, if a worker thread.
+      static thread_local dimension_size_type currentWorker;
+
+      Impl():
+        logger(ome::common::createLogger("ThreadPoolExecutor")),
+        cpus(),
+        workers(),
+        injectMutex(),
+        inject(),
+        pending(0U),
+        sleepMutex(),
+        wake(),
+        stop(false)
+      {
+      }
+
+      /**
+       * Queue a task.
+       *
+       * @param task the task to queue.
+       */
+      void
+      submit(task_type&& task)
+      {
+        if (currentPool == this)
+          {
+            Worker& w(*workers[currentWorker]);
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.tasks.push_back(std::move(task));
+            ++pending;
+          }
+        else
+          {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            inject.push_back(std::move(task));
+            ++pending;
+          }
+
+        // Taking the lock ensures a worker about to sleep will see
+        // the new task, or be waiting when notified.
+        {
+          std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+      }
+
+      /**
+       * Take a task to run.
+       *
+       * The worker's own queue is checked first (newest task
+       * first), followed by tasks submitted from outside the pool
+       * and then the queues of the other workers (oldest task
+       * first).
+       *
+       * @param index the worker index.
+       * @param task the task taken.
+       * @returns @c true if a task was taken, @c false otherwise.
+       */
+      bool
+      take(dimension_size_type index,
+           task_type&          task)
+      {
+        {
+          Worker& w(*workers[index]);
+          std::lock_guard<std::mutex> lock(w.mutex);
+          if (!w.tasks.empty())
+            {
+              task = std::move(w.tasks.back());
+              w.tasks.pop_back();
+              --pending;
+              return true;
+            }
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(injectMutex);
+          if (!inject.empty())
+            {
+              task = std::move(inject.front());
+              inject.pop_front();
+              --pending;
+              return true;
+            }
+        }
+
+        for (dimension_size_type i = 1U; i < workers.size(); ++i)
+          {
+            Worker& victim(*workers[(index + i) % workers.size()]);
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+              {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --pending;
+                return true;
+              }
+          }
+
+        return false;
+      }
+
+      /// Restrict the current thread to the configured processors.
+      void
+      setAffinity()
+      {
+        if (cpus.empty())
+          return;
+
+#ifdef OME_HAVE_PTHREAD_SETAFFINITY_NP
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto& cpu : cpus)
+          {
+            if (cpu < CPU_SETSIZE)
+              CPU_SET(cpu, &set);
+          }
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error)
+          {
+            BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+              << "Failed to set worker thread processor affinity";
+          }
+#endif
+      }
+
+      /**
+       * Run tasks until stopped (worker thread).
+       *
+       * @param self the pool implementation.
+       * @param index the worker index.
+       */
+      static void
+      run(std::shared_ptr<Impl> self,
+          dimension_size_type   index)
+      {
+        currentPool = self.get();
+        currentWorker = index;
+        self->setAffinity();
+
+        while (true)
+          {
+            task_type task;
+            if (self->take(index, task))
+              {
+                try
+                  {
+                    task();
+                  }
+                catch (const std::exception& e)
+                  {
+                    BOOST_LOG_SEV(self->logger, ome::logging::trivial::error)
+                      << "Uncaught exception in task: " << e.what();
+                  }
+                catch (...)
+                  {
+                    BOOST_LOG_SEV(self->logger, ome::logging::trivial::error)
+                      << "Uncaught exception in task";
+                  }
+                continue;
+              }
+
+            std::unique_lock<std::mutex> lock(self->sleepMutex);
+            self->wake.wait(lock, [&self]
+                            {
+                              return self->stop || self->pending > 0U;
+                            });
+            if (self->stop && self->pending == 0U)
+              break;
+          }
+
+        currentPool = nullptr;
+      }
+    };
+
+    thread_local const ThreadPoolExecutor::Impl *ThreadPoolExecutor::Impl::currentPool = nullptr;
+    thread_local dimension_size_type ThreadPoolExecutor::Impl::currentWorker = 0U;
+
+    ThreadPoolExecutor::ThreadPoolExecutor(const Options& options):
+      Executor(),
+      impl(std::make_shared<Impl>())
+    {
+      impl->cpus = options.cpus;
+      if (options.numaNode)
+        {
+          std::vector<unsigned int> nodecpus(numaNodeCPUs(*options.numaNode));
+          impl->cpus.insert(impl->cpus.end(), nodecpus.begin(), nodecpus.end());
+        }
+
+      dimension_size_type threads = options.threads;
+      if (!threads)
+        threads = impl->cpus.size();
+      if (!threads)
+        threads = std::thread::hardware_concurrency();
+      if (!threads)
+        threads = 1U;
+
+      // All workers must exist before any is started, since each
+      // may steal from the others.
+      for (dimension_size_type i = 0U; i < threads; ++i)
+        impl->workers.emplace_back(new Impl::Worker());
+
+      try
+        {
+          for (dimension_size_type i = 0U; i < threads; ++i)
+            impl->workers[i]->thread = std::thread(&Impl::run, impl, i);
+        }
+      catch (...)
+        {
+          stopWorkers();
+          throw;
+        }
+    }
+
+    ThreadPoolExecutor::~ThreadPoolExecutor()
+    {
+      stopWorkers();
+    }
+
+    void
+    ThreadPoolExecutor::stopWorkers()
+    {
+      {
+        std::lock_guard<std::mutex> lock(impl->sleepMutex);
+        impl->stop = true;
+      }
+      impl->wake.notify_all();
+
+      for (auto& worker : impl->workers)
+        {
+          if (!worker->thread.joinable())
+            continue;
+          // A worker can not join itself; it will exit once the
+          // queues are empty, retaining the implementation until
+          // then.
+          if (worker->thread.get_id() == std::this_thread::get_id())
+            worker->thread.detach();
+          else
+            worker->thread.join();
+        }
+    }
+
+    void
+    ThreadPoolExecutor::submit(task_type task)
+    {
+      impl->submit(std::move(task));
+    }
+
+    dimension_size_type
+    ThreadPoolExecutor::concurrency() const
+    {
+      return impl->workers.size();
+    }
+
+    std::vector<unsigned int>
+    ThreadPoolExecutor::numaNodeCPUs(unsigned int node)
+    {
+      boost::format path("/sys/devices/system/node/node%1%/cpulist");
+      path % node;
+
+      boost::filesystem::ifstream in(path.str());
+      std::string list;
+      if (!in || !std::getline(in, list))
+        {
+          boost::format fmt("NUMA node %1% not found");
+          fmt % node;
+          throw std::runtime_error(fmt.str());
+        }
+
+      return parse_cpu_list(list);
+    }
+
+  }
+}
@@ -0,0 +1,273 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_EXECUTOR_H
+#define OME_FILES_EXECUTOR_H
+
+#include <ome/files/Types.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+namespace ome
+{
+  namespace files
+  {
+
+    /**
+     * Executor for asynchronous work.
+     *
+     * An executor runs tasks submitted to it, typically on a pool
+     * of worker threads.  All asynchronous work in this library is
+     * run using a shared executor, rather than by creating threads
+     * directly.  Processing work, such as codec work, uses the
+     * shared executor (see shared()), while tasks which block on
+     * I/O, such as writing queued planes or reading uncompressed
+     * tiles directly from a file, use the shared I/O executor (see
+     * sharedIO()), so that they do not hold workers needed for
+     * processing.  This allows an application to share
+     * a single pool of threads between this library and its own
+     * work, to avoid oversubscribing the available processors.
+     *
+     * The default shared executors are ThreadPoolExecutors.  An
+     * application may provide its own executors by implementing
+     * this interface and calling setShared() or setSharedIO().
+     *
+     * Tasks must not throw exceptions; they should report errors by
+     * other means, such as storing a @c std::exception_ptr.  Tasks
+     * may run in any order and concurrently with each other, but a
+     * task will not be run until submit() has returned.
+     */
+    class Executor
+    {
+    public:
+      /// Task type.
+      typedef std::function<void ()> task_type;
+
+    protected:
+      /// Constructor.
+      Executor();
+
+    public:
+      /// Destructor.
+      virtual
+      ~Executor();
+
+      /// @cond SKIP
+      Executor (const Executor&) = delete;
+
+      Executor&
+      operator= (const Executor&) = delete;
+      /// @endcond SKIP
+
+      /**
+       * Submit a task for execution.
+       *
+       * @param task the task to run.
+       */
+      virtual
+      void
+      submit(task_type task) = 0;
+
+      /**
+       * Get the number of tasks which may run concurrently.
+       *
+       * This is a hint for callers splitting work into tasks.
+       *
+       * @returns the maximum concurrency (at least 1).
+       */
+      virtual
+      dimension_size_type
+      concurrency() const = 0;
+
+      /**
+       * Get the shared process-wide executor.
+       *
+       * If no executor has been set with setShared(), a default
+       * ThreadPoolExecutor is created on first use.
+       *
+       * @returns the shared executor.
+       */
+      static std::shared_ptr<Executor>
+      shared();
+
+      /**
+       * Set the shared process-wide executor.
+       *
+       * Work already submitted to the previous executor is not
+       * affected.  Users of the executor which hold a reference to
+       * it, such as writers with queued planes, will continue to use
+       * the previous executor until their work is complete.
+       *
+       * @param executor the executor to use; null to restore the
+       * default.
+       */
+      static void
+      setShared(std::shared_ptr<Executor> executor);
+
+      /**
+       * Get the shared process-wide executor for blocking I/O.
+       *
+       * If no executor has been set with setSharedIO(), a default
+       * ThreadPoolExecutor is created on first use.
+       *
+       * @returns the shared I/O executor.
+       */
+      static std::shared_ptr<Executor>
+      sharedIO();
+
+      /**
+       * Set the shared process-wide executor for blocking I/O.
+       *
+       * As for setShared(), work already submitted to the previous
+       * executor is not affected.  This may be the same executor as
+       * the shared executor, since callers waiting for I/O tasks do
+       * the work themselves rather than wait for tasks which can not
+       * run.
+       *
+       * @param executor the executor to use; null to restore the
+       * default.
+       */
+      static void
+      setSharedIO(std::shared_ptr<Executor> executor);
+    };
+
+    /**
+     * Work-stealing thread pool executor.
+     *
+     * Each worker thread has its own task queue.  Tasks submitted
+     * from a worker thread are queued on that worker, and run in
+     * last-in first-out order to make best use of the cache;
+     * tasks submitted from other threads are distributed between
+     * the workers.  Idle workers steal tasks from the other queues,
+     * oldest first.
+     *
+     * The worker threads may be restricted to a set of processors,
+     * or to the processors of a NUMA node.  This is only supported
+     * on platforms providing @c pthread_setaffinity_np (e.g. Linux);
+     * on other platforms, the affinity options have no effect.
+     *
+     * On destruction, all queued tasks are run before the worker
+     * threads exit.
+     */
+    class ThreadPoolExecutor : public Executor
+    {
+    public:
+      /// Thread pool options.
+      struct Options
+      {
+        /**
+         * The number of worker threads.
+         *
+         * If zero, the number of processors in the affinity set is
+         * used, or the number of hardware threads if no affinity set
+         * is specified.
+         */
+        dimension_size_type threads;
+        /**
+         * Processors to run worker threads on.
+         *
+         * If empty, the threads may run on any processor.
+         */
+        std::vector<unsigned int> cpus;
+        /**
+         * NUMA node to run worker threads on.
+         *
+         * If set, the processors of this node are added to the
+         * affinity set.
+         */
+        boost::optional<unsigned int> numaNode;
+
+        /// Constructor.
+        Options();
+      };
+
+      /**
+       * Constructor.
+       *
+       * @param options the thread pool options.
+       * @throws std::runtime_error if the NUMA node does not exist.
+       */
+      explicit
+      ThreadPoolExecutor(const Options& options = Options());
+
+      /// Destructor.
+      virtual
+      ~ThreadPoolExecutor();
+
+      // Documented in superclass.
+      void
+      submit(task_type task);
+
+      // Documented in superclass.
+      dimension_size_type
+      concurrency() const;
+
+      /**
+       * Get the processors of a NUMA node.
+       *
+       * @param node the NUMA node.
+       * @returns the processors of the node.
+       * @throws std::runtime_error if the node does not exist or the
+       * platform does not provide NUMA topology information.
+       */
+      static std::vector<unsigned int>
+      numaNodeCPUs(unsigned int node);
+
+    private:
+      class Impl;
+      /// Private implementation details.
+      std::shared_ptr<Impl> impl;
+
+      /// Stop the worker threads after running all queued tasks.
+      void
+      stopWorkers();
+    };
+
+  }
+}
+
+#endif // OME_FILES_EXECUTOR_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -39,7 +39,9 @@
 #define OME_FILES_FORMATREADER_H
 
 #include <array>
+#include <istream>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <map>
@@ -48,11 +50,13 @@
 
 #include <ome/compat/memory.h>
 
+#include <ome/files/CancellationToken.h>
 #include <ome/files/CoreMetadata.h>
 #include <ome/files/FileInfo.h>
 #include <ome/files/FormatHandler.h>
 #include <ome/files/MetadataConfigurable.h>
 #include <ome/files/MetadataMap.h>
+#include <ome/files/TileSchedule.h>
 #include <ome/files/Types.h>
 
 #include <ome/xml/meta/MetadataStore.h>
@@ -582,12 +586,109 @@ namespace ome
                 dimension_size_type w,
                 dimension_size_type h) const = 0;
 
+      /**
+       * Obtain an image plane, allowing cancellation.
+       *
+       * As openBytes(dimension_size_type,VariantPixelBuffer&) const,
+       * but the read may be stopped early by cancelling @p token or
+       * by its deadline passing.  The token is checked between
+       * reading each tile or strip, where supported by the reader,
+       * and at least once before reading starts.  If cancelled, the
+       * content of @p buf is unspecified.
+       *
+       * @param plane the plane index within the series.
+       * @param buf the destination pixel buffer.
+       * @param token the cancellation token.
+       * @throws FormatException if there was a problem parsing the
+       *   metadata of the file.
+       * @throws CancelledException if the read was cancelled.
+       */
+      virtual
+      void
+      openBytes(dimension_size_type      plane,
+                VariantPixelBuffer&      buf,
+                const CancellationToken& token) const = 0;
+
+      /**
+       * Obtain a sub-image of an image plane, allowing cancellation.
+       *
+       * As
+       * openBytes(dimension_size_type,VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type) const,
+       * but the read may be stopped early by cancelling @p token or
+       * by its deadline passing.  The token is checked between
+       * reading each tile or strip, where supported by the reader,
+       * and at least once before reading starts.  If cancelled, the
+       * content of @p buf is unspecified.
+       *
+       * @param plane the plane index within the series.
+       * @param buf the destination pixel buffer.
+       * @param x the @c X coordinate of the upper-left corner of the sub-image.
+       * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+       * @param w the width of the sub-image.
+       * @param h the height of the sub-image.
+       * @param token the cancellation token.
+       * @throws FormatException if there was a problem parsing the metadata of the
+       *   file.
+       * @throws CancelledException if the read was cancelled.
+       */
+      virtual
+      void
+      openBytes(dimension_size_type      plane,
+                VariantPixelBuffer&      buf,
+                dimension_size_type      x,
+                dimension_size_type      y,
+                dimension_size_type      w,
+                dimension_size_type      h,
+                const CancellationToken& token) const = 0;
+
+      /**
+       * Obtain a sub-image of an image plane, in a specified tile
+       * order, allowing cancellation.
+       *
+       * As
+       * openBytes(dimension_size_type,VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type,const CancellationToken&) const,
+       * but the tiles covering the region are read in the order
+       * specified by @p schedule, where supported by the reader,
+       * and the schedule callback (if set) is invoked as each tile
+       * is completed.  This allows the most important part of the
+       * region to be displayed first.
+       *
+       * @param plane the plane index within the series.
+       * @param buf the destination pixel buffer.
+       * @param x the @c X coordinate of the upper-left corner of the sub-image.
+       * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+       * @param w the width of the sub-image.
+       * @param h the height of the sub-image.
+       * @param schedule the tile schedule.
+       * @param token the cancellation token.
+       * @throws FormatException if there was a problem parsing the metadata of the
+       *   file.
+       * @throws CancelledException if the read was cancelled.
+       */
+      virtual
+      void
+      openBytes(dimension_size_type      plane,
+                VariantPixelBuffer&      buf,
+                dimension_size_type      x,
+                dimension_size_type      y,
+                dimension_size_type      w,
+                dimension_size_type      h,
+                const TileSchedule&      schedule,
+                const CancellationToken& token) const = 0;
+
       /**
        * Obtain a thumbnail of an image plane.
        *
        * Obtail and copy the thumbnail for the specified image plane
        * from the current series into a VariantPixelBuffer.
        *
+       * The thumbnail has the dimensions returned by getThumbSize()
+       * and the same pixel type and subchannel count as the plane.
+       * It is generated by area-averaging from the smallest
+       * resolution no smaller than the thumbnail, reading the source
+       * plane in bands so that the full plane is never held in
+       * memory at once.
+       *
        * @param plane the plane index within the series.
        * @param buf the destination pixel buffer.
        */
@@ -678,6 +779,11 @@ namespace ome
        * Specifies whether or not to save proprietary metadata
        * in the MetadataStore.
        *
+       * The metadata of every series is collected on the first call
+       * to getMetadataStore(), which therefore requires all series to
+       * be initialised by readers which would otherwise initialise
+       * series on first use.
+       *
        * @param populate @c true to save or @c false to discard.
        */
       virtual
@@ -1267,6 +1373,78 @@ namespace ome
       virtual
       void
       setFlattenedResolutions(bool flatten) = 0;
+
+      /**
+       * Create a lightweight view of this reader.
+       *
+       * The view shares all of the state parsed by setId() (core
+       * metadata, metadata store, global metadata and any open file
+       * handles and indexes) with this reader, but has its own
+       * series, resolution and plane selection.  Creating a view
+       * does not re-read or re-parse the dataset.
+       *
+       * A reader may not be used concurrently from multiple
+       * threads, because selecting a series or plane alters its
+       * state.  Instead, create a view for each thread.  Views are
+       * independent of each other and of this reader: closing either
+       * does not close the other.
+       *
+       * @returns a new reader view.
+       * @throws std::logic_error if no file is open, or
+       * std::runtime_error if this reader does not support views.
+       */
+      virtual
+      std::shared_ptr<FormatReader>
+      createView() const = 0;
+
+      /**
+       * Save the state of this reader.
+       *
+       * The state parsed by setId() (core metadata, global and
+       * series metadata, metadata store content, used files and any
+       * format-specific indexes) is written to the stream in a
+       * compact binary form.  Together with the size and
+       * modification time of each used file, this permits the
+       * dataset to be reopened later with loadState() without
+       * parsing it again.
+       *
+       * The saved state is specific to the reader type, library
+       * version and platform.  Any series which are initialised on
+       * first use will be initialised before saving.
+       *
+       * @param stream the stream to write the state to.
+       * @throws std::logic_error if no file is open,
+       * std::runtime_error if this reader does not support saving
+       * state, or FormatException on failure.
+       */
+      virtual
+      void
+      saveState(std::ostream& stream) const = 0;
+
+      /**
+       * Open a dataset from saved state.
+       *
+       * This is equivalent to setId() with the file saved by
+       * saveState(), but restores the saved state rather than
+       * parsing the dataset.  If any used file has changed size or
+       * modification time since the state was saved, or is missing,
+       * the state is stale; the reader is left closed and @c false
+       * is returned, and the caller should use setId() instead.
+       *
+       * Metadata store content is restored only if a metadata store
+       * which retains metadata (not the default DummyMetadata) has
+       * been set.
+       *
+       * @param stream the stream to read the state from.
+       * @returns @c true if the state was loaded, or @c false if
+       * the state is stale.
+       * @throws std::runtime_error if this reader does not support
+       * saving state, or FormatException if the state is invalid or
+       * was saved by a different reader type.
+       */
+      virtual
+      bool
+      loadState(std::istream& stream) = 0;
     };
 
   }
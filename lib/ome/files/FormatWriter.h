@@ -168,6 +168,32 @@ namespace ome
                 dimension_size_type w,
                 dimension_size_type h) = 0;
 
+      /**
+       * Save all image planes of the current series.
+       *
+       * Write every plane of the current series from a single
+       * VariantPixelBuffer with the @c X, @c Y, @c Z, @c T, @c C and
+       * subchannel dimensions set to the series dimensions
+       * (getSizeX(), getSizeY(), getSizeZ(), getSizeT(),
+       * getEffectiveSizeC() and getRGBChannelCount()).  The
+       * buffer's dimension order need not match the output
+       * dimension order, but its storage order must keep each plane
+       * contiguous (the @c X, @c Y and subchannel dimensions must be
+       * stored first).
+       *
+       * Planes are written in output order, without copying each
+       * plane out of the buffer.  The current plane must be the
+       * first plane of the series.
+       *
+       * @param buf the source pixel buffer.
+       * @throws std::logic_error if the buffer dimensions or storage
+       * order are unsuitable.
+       * @throws FormatException if any of the parameters are invalid.
+       */
+      virtual
+      void
+      saveVolume(VariantPixelBuffer& buf) = 0;
+
       /**
        * Set the active series.
        *
@@ -392,6 +418,39 @@ namespace ome
       bool
       getWriteSequentially() const = 0;
 
+      /**
+       * Set the layout profile.
+       *
+       * The layout profile is a hint describing how the written data
+       * will be accessed.  Writers supporting layout profiles use it
+       * to choose the strip or tile size from the image size, pixel
+       * type and compression type; explicitly requested tile sizes
+       * take precedence over the profile.  Writers without support
+       * for layout profiles will ignore the hint.
+       *
+       * If subchannel interleaving has not already been set with
+       * setInterleaved(), the profile also sets the interleaving it
+       * prefers: interleaved for sequential and random access, so
+       * that all samples are read from a single strip or tile, and
+       * planar for archival, which compresses better.  Check
+       * getInterleaved() for the storage order required by
+       * saveBytes().
+       *
+       * @param profile the layout profile.
+       */
+      virtual
+      void
+      setLayoutProfile(LayoutProfile profile) = 0;
+
+      /**
+       * Get the layout profile.
+       *
+       * @returns the layout profile.
+       */
+      virtual
+      LayoutProfile
+      getLayoutProfile() const = 0;
+
       /**
        * Set the requested tile width.
        *
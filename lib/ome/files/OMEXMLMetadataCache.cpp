@@ -0,0 +1,274 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <chrono>
+
+#include <ome/common/config.h>
+
+#include <ome/files/config-internal.h>
+
+#ifdef OME_HAVE_STAT_ST_MTIM
+#include <sys/stat.h>
+#endif
+
+#include <boost/filesystem/operations.hpp>
+
+#include <ome/files/OMEXMLMetadataCache.h>
+
+namespace ome
+{
+  namespace files
+  {
+
+    namespace
+    {
+
+      const std::int64_t nanoseconds = 1000000000;
+
+      /**
+       * Get the modification time and size of a file.
+       *
+       * @param file the file to query.
+       * @param mtime the modification time, in nanoseconds since
+       * the epoch.
+       * @param resolution the resolution of the modification time,
+       * in nanoseconds.
+       * @param size the file size.
+       * @returns @c true on success, @c false if the file could not
+       * be queried.
+       */
+      bool
+      fileStamp(const boost::filesystem::path& file,
+                std::int64_t&                  mtime,
+                std::int64_t&                  resolution,
+                std::uintmax_t&                size)
+      {
+#ifdef OME_HAVE_STAT_ST_MTIM
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0)
+          return false;
+        mtime = (static_cast<std::int64_t>(st.st_mtim.tv_sec) * nanoseconds) +
+          static_cast<std::int64_t>(st.st_mtim.tv_nsec);
+        size = static_cast<std::uintmax_t>(st.st_size);
+        // Filesystems without sub-second timestamps report whole
+        // seconds.  Otherwise, timestamps are taken from a coarse
+        // kernel clock, which ticks every few milliseconds.
+        resolution = st.st_mtim.tv_nsec ? nanoseconds / 20 : 2 * nanoseconds;
+        return true;
+#else // ! OME_HAVE_STAT_ST_MTIM
+        boost::system::error_code ec;
+        std::time_t seconds = boost::filesystem::last_write_time(file, ec);
+        if (ec)
+          return false;
+        size = boost::filesystem::file_size(file, ec);
+        if (ec)
+          return false;
+        mtime = static_cast<std::int64_t>(seconds) * nanoseconds;
+        // Some filesystems only store times to the nearest 2 seconds.
+        resolution = 2 * nanoseconds;
+        return true;
+#endif // OME_HAVE_STAT_ST_MTIM
+      }
+
+    }
+
+    OMEXMLMetadataCache::OMEXMLMetadataCache(dimension_size_type limit):
+      mutex(),
+      cache(),
+      usage(),
+      total(0U),
+      limit(limit)
+    {
+    }
+
+    OMEXMLMetadataCache::~OMEXMLMetadataCache()
+    {
+    }
+
+    OMEXMLMetadataCache&
+    OMEXMLMetadataCache::shared()
+    {
+      static OMEXMLMetadataCache cache;
+      return cache;
+    }
+
+    bool
+    OMEXMLMetadataCache::insert(const boost::filesystem::path& file,
+                                value_type                     meta,
+                                dimension_size_type            weight)
+    {
+      if (!meta)
+        return false;
+
+      // Query the file outside the lock.
+      Entry entry;
+      entry.meta = meta;
+      entry.weight = weight;
+      std::int64_t resolution;
+      if (!fileStamp(file, entry.mtime, resolution, entry.size))
+        return false;
+
+      // A file rewritten within the same timestamp tick, with the
+      // same size, would be indistinguishable from the cached file.
+      // Only cache files whose timestamp would change on rewriting.
+      const std::int64_t now =
+        std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::system_clock::now().time_since_epoch()).count();
+      if (now - entry.mtime < resolution)
+        return false;
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (weight > limit)
+        return false;
+
+      std::map<key_type, Entry>::iterator i = cache.find(file);
+      if (i != cache.end())
+        {
+          total -= i->second.weight;
+          usage.erase(i->second.lru);
+          cache.erase(i);
+        }
+
+      usage.push_front(file);
+      entry.lru = usage.begin();
+      cache.insert(std::make_pair(file, entry));
+      total += weight;
+
+      evict();
+
+      return true;
+    }
+
+    OMEXMLMetadataCache::value_type
+    OMEXMLMetadataCache::find(const boost::filesystem::path& file)
+    {
+      std::int64_t mtime = 0;
+      std::int64_t resolution = 0;
+      std::uintmax_t size = 0U;
+      const bool found = fileStamp(file, mtime, resolution, size);
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      std::map<key_type, Entry>::iterator i = cache.find(file);
+      if (i == cache.end())
+        return value_type();
+
+      if (!found || i->second.mtime != mtime || i->second.size != size)
+        {
+          // File is missing or has changed; drop the stale entry.
+          total -= i->second.weight;
+          usage.erase(i->second.lru);
+          cache.erase(i);
+          return value_type();
+        }
+
+      // Mark as most recently used.
+      usage.splice(usage.begin(), usage, i->second.lru);
+
+      return i->second.meta;
+    }
+
+    void
+    OMEXMLMetadataCache::erase(const boost::filesystem::path& file)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      std::map<key_type, Entry>::iterator i = cache.find(file);
+      if (i != cache.end())
+        {
+          total -= i->second.weight;
+          usage.erase(i->second.lru);
+          cache.erase(i);
+        }
+    }
+
+    dimension_size_type
+    OMEXMLMetadataCache::size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return cache.size();
+    }
+
+    dimension_size_type
+    OMEXMLMetadataCache::weight() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return total;
+    }
+
+    dimension_size_type
+    OMEXMLMetadataCache::getLimit() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return limit;
+    }
+
+    void
+    OMEXMLMetadataCache::setLimit(dimension_size_type limit)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      this->limit = limit;
+      evict();
+    }
+
+    void
+    OMEXMLMetadataCache::clear()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cache.clear();
+      usage.clear();
+      total = 0U;
+    }
+
+    void
+    OMEXMLMetadataCache::evict()
+    {
+      while (!usage.empty() && (total > limit || limit == 0U))
+        {
+          std::map<key_type, Entry>::iterator i = cache.find(usage.back());
+          if (i != cache.end())
+            {
+              total -= i->second.weight;
+              cache.erase(i);
+            }
+          usage.pop_back();
+        }
+    }
+
+  }
+}
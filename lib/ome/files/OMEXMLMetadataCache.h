@@ -0,0 +1,253 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_OMEXMLMETADATACACHE_H
+#define OME_FILES_OMEXMLMETADATACACHE_H
+
+#include <ome/files/Types.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <boost/filesystem/path.hpp>
+
+namespace ome
+{
+  namespace xml
+  {
+    namespace meta
+    {
+      class OMEXMLMetadata;
+    }
+  }
+
+  namespace files
+  {
+
+    /**
+     * Cache of parsed OME-XML metadata.
+     *
+     * Parsing the OME-XML document of a large dataset is costly,
+     * and in a multi-file dataset each file contains (or refers to)
+     * the same metadata.  This cache allows parsed metadata to be
+     * shared between readers, indexed by file.  Each entry records
+     * the modification time (with sub-second resolution where the
+     * platform provides it) and size of the file at the time it was
+     * parsed; if either has since changed, the entry is discarded
+     * on lookup.  Files modified too recently for a further change
+     * to be certain to alter the modification time are not cached.
+     *
+     * The cache is bounded by the total size of the XML text from
+     * which the cached documents were parsed.  When the limit is
+     * exceeded, the least recently used entries are evicted.  A
+     * limit of zero disables the cache entirely.
+     *
+     * All methods are thread-safe.  Cached metadata is shared
+     * between all users of the cache, and so must be treated as
+     * read-only; callers which need to modify the metadata must
+     * make their own copy.
+     */
+    class OMEXMLMetadataCache
+    {
+    public:
+      /// Cached metadata type.
+      typedef std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> value_type;
+
+      /**
+       * Constructor.
+       *
+       * @param limit the maximum total XML size, in bytes.
+       */
+      OMEXMLMetadataCache(dimension_size_type limit = 0U);
+
+      /// Destructor.
+      virtual ~OMEXMLMetadataCache();
+
+      // To avoid unintentional and expensive copies, copying and
+      // assignment of caches is prevented.
+
+      /// @cond SKIP
+      OMEXMLMetadataCache (const OMEXMLMetadataCache&) = delete;
+
+      OMEXMLMetadataCache&
+      operator= (const OMEXMLMetadataCache&) = delete;
+      /// @endcond SKIP
+
+      /**
+       * Get the shared process-wide metadata cache.
+       *
+       * This cache is used by all OMETIFFReader instances.  It is
+       * disabled by default; call setLimit() to enable it.
+       *
+       * @returns the shared metadata cache.
+       */
+      static OMEXMLMetadataCache&
+      shared();
+
+      /**
+       * Insert metadata into the cache.
+       *
+       * Any existing entry for the file will be replaced.  If the
+       * cache is disabled, or the file can not be queried, or the
+       * file was modified within the resolution of its modification
+       * time, or the metadata is larger than the cache limit, the
+       * metadata will not be cached.
+       *
+       * @param file the file from which the metadata was read.
+       * @param meta the parsed metadata; must not be null.
+       * @param weight the size of the XML text, in bytes.
+       * @returns @c true if the insert succeeded, @c false otherwise.
+       */
+      bool
+      insert(const boost::filesystem::path& file,
+             value_type                     meta,
+             dimension_size_type            weight);
+
+      /**
+       * Find metadata in the cache.
+       *
+       * If the file has been modified since the metadata was
+       * cached, the stale entry is removed.
+       *
+       * @param file the file from which the metadata was read.
+       * @returns the cached metadata, or null if not found.
+       */
+      value_type
+      find(const boost::filesystem::path& file);
+
+      /**
+       * Remove metadata from the cache.
+       *
+       * @param file the file to remove.
+       */
+      void
+      erase(const boost::filesystem::path& file);
+
+      /**
+       * Get the number of cached entries.
+       *
+       * @returns the number of cached entries.
+       */
+      dimension_size_type
+      size() const;
+
+      /**
+       * Get the total size of the cached XML text.
+       *
+       * @returns the total size, in bytes.
+       */
+      dimension_size_type
+      weight() const;
+
+      /**
+       * Get the cache size limit.
+       *
+       * @returns the maximum total XML size, in bytes.
+       */
+      dimension_size_type
+      getLimit() const;
+
+      /**
+       * Set the cache size limit.
+       *
+       * If the limit is reduced, entries will be evicted until the
+       * cache fits within the new limit.
+       *
+       * @param limit the maximum total XML size, in bytes; zero to
+       * disable caching.
+       */
+      void
+      setLimit(dimension_size_type limit);
+
+      /**
+       * Clear the cache.
+       */
+      void
+      clear();
+
+    private:
+      /// Cache key (canonical file path).
+      typedef boost::filesystem::path key_type;
+
+      /// Cache entry.
+      struct Entry
+      {
+        /// Parsed metadata.
+        value_type meta;
+        /// File modification time (nanoseconds since the epoch).
+        std::int64_t mtime;
+        /// File size.
+        std::uintmax_t size;
+        /// XML text size.
+        dimension_size_type weight;
+        /// Position in the usage list.
+        std::list<key_type>::iterator lru;
+      };
+
+      /**
+       * Evict least recently used entries to fit the limit.
+       *
+       * The cache mutex must be held by the caller.
+       */
+      void
+      evict();
+
+      /// Mutex to serialise cache access.
+      mutable std::mutex mutex;
+      /// Mapping of file to entry.
+      std::map<key_type, Entry> cache;
+      /// Usage order, most recently used first.
+      std::list<key_type> usage;
+      /// Total XML text size.
+      dimension_size_type total;
+      /// Maximum total XML text size.
+      dimension_size_type limit;
+    };
+
+  }
+}
+
+#endif // OME_FILES_OMEXMLMETADATACACHE_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,124 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_TILESCHEDULE_H
+#define OME_FILES_TILESCHEDULE_H
+
+#include <functional>
+
+#include <ome/files/PlaneRegion.h>
+#include <ome/files/Types.h>
+
+namespace ome
+{
+  namespace files
+  {
+
+    /**
+     * Tile schedule for reading an image region.
+     *
+     * Image data is commonly stored as tiles or strips.  By default,
+     * the tiles covering a region are read in storage order.  For
+     * interactive use, it may be preferable to read the tiles
+     * closest to a point of interest (such as the centre of the
+     * visible area) first, so that the most important content is
+     * available soonest; or to read the tiles in file order, to
+     * minimise seeking.  A callback may be set to be notified as
+     * each tile is completed.
+     *
+     * Readers which do not read by tile will ignore the order, and
+     * invoke the callback once for the whole region.
+     */
+    struct TileSchedule
+    {
+      /// Tile read order.
+      enum Order
+        {
+          STORAGE, ///< Storage (tile index) order.
+          CENTER,  ///< Closest to the centre point first.
+          OFFSET   ///< File offset order.
+        };
+
+      /**
+       * Tile completion callback.
+       *
+       * The callback is passed the part of the region (in plane
+       * coordinates) which has been read into the destination
+       * buffer.  If samples are stored in separate planes, the
+       * callback is invoked for each sample in turn; with
+       * CENTER order, all samples of a tile are read consecutively.
+       * The callback is invoked on the thread reading the region,
+       * and must not call the reader.
+       */
+      typedef std::function<void (const PlaneRegion& region)> callback_type;
+
+      /// Tile read order.
+      Order order;
+      /// The @c X coordinate of the centre point (CENTER order).
+      dimension_size_type centerX;
+      /// The @c Y coordinate of the centre point (CENTER order).
+      dimension_size_type centerY;
+      /// Tile completion callback (optional).
+      callback_type callback;
+
+      /**
+       * Construct with read order.
+       *
+       * @param order the tile read order.
+       * @param centerX the @c X coordinate of the centre point.
+       * @param centerY the @c Y coordinate of the centre point.
+       */
+      TileSchedule(Order               order = STORAGE,
+                   dimension_size_type centerX = 0U,
+                   dimension_size_type centerY = 0U):
+        order(order),
+        centerX(centerX),
+        centerY(centerY),
+        callback()
+      {}
+    };
+
+  }
+}
+
+#endif // OME_FILES_TILESCHEDULE_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
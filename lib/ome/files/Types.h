@@ -71,6 +71,21 @@ namespace ome
         ENDIAN_NATIVE  ///< Native endian.
       };
 
+    /**
+     * Pixel data layout profile for writers.
+     *
+     * A hint describing how written data will mostly be accessed,
+     * used by writers to choose the strip or tile size and planar
+     * configuration when these have not been set explicitly.
+     */
+    enum LayoutProfile
+      {
+        LAYOUT_DEFAULT,       ///< Writer default layout.
+        LAYOUT_SEQUENTIAL,    ///< Whole planes read in order (large strips).
+        LAYOUT_RANDOM_ACCESS, ///< Small regions read in any order (small tiles).
+        LAYOUT_ARCHIVAL       ///< Best compression (large tiles).
+      };
+
   }
 }
 
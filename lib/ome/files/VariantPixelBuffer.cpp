@@ -322,6 +322,12 @@ namespace ome
       boost::apply_visitor(v, buffer.buffer);
     }
 
+    VariantPixelBuffer::VariantPixelBuffer(VariantPixelBuffer&& buffer):
+      buffer()
+    {
+      this->buffer.swap(buffer.buffer);
+    }
+
     bool
     VariantPixelBuffer::valid() const
     {
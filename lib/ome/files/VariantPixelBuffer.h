@@ -211,6 +211,17 @@ namespace ome
       explicit
       VariantPixelBuffer(const VariantPixelBuffer& buffer);
 
+      /**
+       * Move constructor.
+       *
+       * Ownership of the pixel data is transferred without copying.
+       * The moved-from buffer is left without any pixel data, and
+       * must be reinitialised with setBuffer() before further use.
+       *
+       * @param buffer the buffer to move.
+       */
+      VariantPixelBuffer(VariantPixelBuffer&& buffer);
+
       /**
        * Construct from existing pixel buffer.  Use for referencing external data.
        *
@@ -35,8 +35,14 @@
  * #L%
  */
 
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <ctime>
 #include <fstream>
+#include <set>
+#include <type_traits>
+#include <vector>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
@@ -53,7 +59,9 @@
 #include <ome/files/PixelProperties.h>
 #include <ome/files/VariantPixelBuffer.h>
 #include <ome/files/detail/FormatReader.h>
+#include <ome/files/detail/ReaderState.h>
 
+#include <ome/xml/meta/Convert.h>
 #include <ome/xml/meta/DummyMetadata.h>
 #include <ome/xml/meta/FilterMetadata.h>
 #include <ome/xml/meta/MetadataStore.h>
@@ -75,6 +83,192 @@ namespace ome
       {
         // Default thumbnail width and height.
         const dimension_size_type THUMBNAIL_DIMENSION = 128;
+
+        // Minimum number of source rows to read per thumbnail band.
+        const dimension_size_type THUMBNAIL_MIN_BAND_HEIGHT = 64;
+
+        // Saved reader state identifier.
+        const char STATE_MAGIC[8] = {'O', 'M', 'E', 'F', 'S', 'T', 'A', 'T'};
+
+        // Saved reader state format version.
+        const uint32_t STATE_VERSION = 1U;
+
+        // Saved reader state byte order marker.
+        const uint32_t STATE_BYTE_ORDER = 0x01020304U;
+
+        // Accumulator type for area averaging of a pixel type.
+        template<typename T>
+        struct ThumbAccumulator
+        {
+          typedef double type;
+        };
+
+        // Complex types average real and imaginary parts together.
+        template<typename T>
+        struct ThumbAccumulator<std::complex<T>>
+        {
+          typedef std::complex<double> type;
+        };
+
+        // Convert an average to an integer pixel value (round to nearest).
+        template<typename T>
+        inline
+        typename std::enable_if<std::is_integral<T>::value &&
+                                !std::is_same<T, bool>::value, T>::type
+        thumbValue(double v)
+        {
+          return static_cast<T>(std::floor(v + 0.5));
+        }
+
+        // Convert an average to a floating point pixel value.
+        template<typename T>
+        inline
+        typename std::enable_if<std::is_floating_point<T>::value, T>::type
+        thumbValue(double v)
+        {
+          return static_cast<T>(v);
+        }
+
+        // Convert an average to a bit pixel value (set if half or more are set).
+        template<typename T>
+        inline
+        typename std::enable_if<std::is_same<T, bool>::value, T>::type
+        thumbValue(double v)
+        {
+          return v >= 0.5;
+        }
+
+        // Convert an average to a complex pixel value.
+        template<typename T>
+        inline
+        typename std::enable_if<!std::is_arithmetic<T>::value, T>::type
+        thumbValue(const std::complex<double>& v)
+        {
+          typedef typename T::value_type component_type;
+          return T(static_cast<component_type>(v.real()),
+                   static_cast<component_type>(v.imag()));
+        }
+
+        /*
+         * Area-average a plane into a thumbnail.
+         *
+         * The destination buffer is visited, and the source plane is
+         * read from the reader in horizontal bands of full width.
+         * Each source pixel contributes to exactly one destination
+         * pixel, so the whole plane is resampled in a single pass
+         * with memory bounded by the band size.  The inner loops use
+         * plain strided pointer access to permit auto-vectorisation.
+         */
+        struct ThumbnailVisitor : public boost::static_visitor<>
+        {
+          const ::ome::files::FormatReader& reader;
+          dimension_size_type plane;
+          dimension_size_type sizeX;
+          dimension_size_type sizeY;
+          dimension_size_type bandHeight;
+          VariantPixelBuffer& band;
+
+          ThumbnailVisitor(const ::ome::files::FormatReader& reader,
+                           dimension_size_type                plane,
+                           dimension_size_type                sizeX,
+                           dimension_size_type                sizeY,
+                           dimension_size_type                bandHeight,
+                           VariantPixelBuffer&                band):
+            reader(reader),
+            plane(plane),
+            sizeX(sizeX),
+            sizeY(sizeY),
+            bandHeight(bandHeight),
+            band(band)
+          {}
+
+          template<typename T>
+          void
+          operator()(T& dest)
+          {
+            typedef typename T::element_type::value_type value_type;
+            typedef typename ThumbAccumulator<value_type>::type accum_type;
+
+            const VariantPixelBuffer::size_type *dshape = dest->shape();
+            const boost::multi_array_types::index *dstrides = dest->strides();
+            const dimension_size_type thumbX = dshape[DIM_SPATIAL_X];
+            const dimension_size_type thumbY = dshape[DIM_SPATIAL_Y];
+            const dimension_size_type samples = dshape[DIM_SUBCHANNEL];
+
+            // Destination column for each source column, and the
+            // number of source columns contributing to each.
+            std::vector<dimension_size_type> colmap(sizeX);
+            std::vector<dimension_size_type> colcount(thumbX, 0);
+            for (dimension_size_type x = 0; x < sizeX; ++x)
+              {
+                colmap[x] = (x * thumbX) / sizeX;
+                ++colcount[colmap[x]];
+              }
+
+            // Sums for the current destination row, sample-interleaved.
+            std::vector<accum_type> sums(thumbX * samples, accum_type(0));
+            dimension_size_type rows = 0;
+            dimension_size_type current = 0;
+
+            value_type *ddata = dest->data();
+
+            auto flush = [&](dimension_size_type dy)
+              {
+                if (rows == 0)
+                  return;
+                for (dimension_size_type dx = 0; dx < thumbX; ++dx)
+                  {
+                    const double area = static_cast<double>(colcount[dx] * rows);
+                    for (dimension_size_type s = 0; s < samples; ++s)
+                      {
+                        accum_type& sum(sums[dx * samples + s]);
+                        ddata[dx * dstrides[DIM_SPATIAL_X] +
+                              dy * dstrides[DIM_SPATIAL_Y] +
+                              s * dstrides[DIM_SUBCHANNEL]] =
+                          thumbValue<value_type>(sum / area);
+                        sum = accum_type(0);
+                      }
+                  }
+                rows = 0;
+              };
+
+            for (dimension_size_type y0 = 0; y0 < sizeY; y0 += bandHeight)
+              {
+                const dimension_size_type h = std::min(bandHeight, sizeY - y0);
+                // The first band is read by the caller to determine
+                // the pixel type and sample count.
+                if (y0 != 0)
+                  reader.openBytes(plane, band, 0, y0, sizeX, h);
+
+                const T& src = boost::get<T>(band.vbuffer());
+                const boost::multi_array_types::index *sstrides = src->strides();
+                const value_type *sdata = src->data();
+                const boost::multi_array_types::index sx = sstrides[DIM_SPATIAL_X];
+                const boost::multi_array_types::index ss = sstrides[DIM_SUBCHANNEL];
+
+                for (dimension_size_type row = 0; row < h; ++row)
+                  {
+                    const dimension_size_type dy = ((y0 + row) * thumbY) / sizeY;
+                    if (dy != current)
+                      {
+                        flush(current);
+                        current = dy;
+                      }
+
+                    const value_type *srow = sdata + row * sstrides[DIM_SPATIAL_Y];
+                    for (dimension_size_type s = 0; s < samples; ++s)
+                      {
+                        const value_type *sp = srow + s * ss;
+                        accum_type *sum = &sums[s];
+                        for (dimension_size_type x = 0; x < sizeX; ++x)
+                          sum[colmap[x] * samples] += static_cast<accum_type>(sp[x * sx]);
+                      }
+                    ++rows;
+                  }
+              }
+            flush(current);
+          }
+        };
       }
 
       FormatReader::FormatReader(const ReaderProperties& readerProperties):
@@ -99,6 +293,7 @@ namespace ome
         group(true),
         domains(),
         metadataStore(std::make_shared<DummyMetadata>()),
+        originalMetadataPending(),
         metadataOptions()
       {
         assertId(currentId, false);
@@ -158,7 +353,7 @@ namespace ome
 
         // reinitialize the MetadataStore
         // NB: critical for metadata conversion to work properly!
-        getMetadataStore()->createRoot();
+        metadataStore->createRoot();
       }
 
       bool
@@ -744,15 +939,120 @@ namespace ome
       }
 
       void
-      FormatReader::openThumbBytes(dimension_size_type /* plane */,
-                                   VariantPixelBuffer& /* buf */) const
+      FormatReader::openBytes(dimension_size_type      plane,
+                              VariantPixelBuffer&      buf,
+                              const CancellationToken& token) const
+      {
+        openBytes(plane, buf, 0, 0, getSizeX(), getSizeY(), token);
+      }
+
+      void
+      FormatReader::openBytes(dimension_size_type      plane,
+                              VariantPixelBuffer&      buf,
+                              dimension_size_type      x,
+                              dimension_size_type      y,
+                              dimension_size_type      w,
+                              dimension_size_type      h,
+                              const CancellationToken& token) const
+      {
+        openBytes(plane, buf, x, y, w, h, TileSchedule(), token);
+      }
+
+      void
+      FormatReader::openBytes(dimension_size_type      plane,
+                              VariantPixelBuffer&      buf,
+                              dimension_size_type      x,
+                              dimension_size_type      y,
+                              dimension_size_type      w,
+                              dimension_size_type      h,
+                              const TileSchedule&      schedule,
+                              const CancellationToken& token) const
+      {
+        setPlane(plane);
+        openBytesScheduledImpl(plane, buf, x, y, w, h, schedule, token);
+      }
+
+      void
+      FormatReader::openBytesScheduledImpl(dimension_size_type      plane,
+                                           VariantPixelBuffer&      buf,
+                                           dimension_size_type      x,
+                                           dimension_size_type      y,
+                                           dimension_size_type      w,
+                                           dimension_size_type      h,
+                                           const TileSchedule&      schedule,
+                                           const CancellationToken& token) const
+      {
+        token.check();
+        openBytesImpl(plane, buf, x, y, w, h);
+        if (schedule.callback)
+          schedule.callback(PlaneRegion(x, y, w, h));
+      }
+
+      void
+      FormatReader::openThumbBytes(dimension_size_type plane,
+                                   VariantPixelBuffer& buf) const
       {
         assertId(currentId, true);
-        /**
-         * @todo Implement openThumbBytes.  This requires implementing
-         * image rescaling/resampling.
-         */
-        throw std::runtime_error("Thumbnail rescaling is not currently implemented");
+
+        const std::array<dimension_size_type, 2> thumbSize(getThumbSize());
+
+        SaveSeries sentry(*this);
+
+        // Use the smallest resolution which is no smaller than the
+        // thumbnail; sub-resolutions follow the full resolution image
+        // in core index order and decrease in size.
+        const dimension_size_type base = getCoreIndex();
+        const dimension_size_type resolutions = getCoreMetadata(base).resolutionCount;
+        dimension_size_type source = base;
+        for (dimension_size_type r = 1; r < resolutions; ++r)
+          {
+            const CoreMetadata& rcore(getCoreMetadata(base + r));
+            if (rcore.sizeX >= thumbSize[0] && rcore.sizeY >= thumbSize[1])
+              source = base + r;
+            else
+              break;
+          }
+        if (source != base)
+          setCoreIndex(source);
+
+        const dimension_size_type sizeX = getSizeX();
+        const dimension_size_type sizeY = getSizeY();
+
+        if (thumbSize[0] > sizeX || thumbSize[1] > sizeY)
+          {
+            boost::format fmt("Thumbnail size %1%×%2% exceeds image size %3%×%4%");
+            fmt % thumbSize[0] % thumbSize[1] % sizeX % sizeY;
+            throw std::logic_error(fmt.str());
+          }
+
+        if (sizeX == thumbSize[0] && sizeY == thumbSize[1])
+          {
+            openBytes(plane, buf);
+            return;
+          }
+
+        // Read whole rows of tiles or strips at a time, but enough
+        // rows to keep the per-read overhead low.
+        dimension_size_type tileHeight = std::max(getOptimalTileHeight(),
+                                                  static_cast<dimension_size_type>(1U));
+        dimension_size_type bandHeight = tileHeight;
+        if (bandHeight < THUMBNAIL_MIN_BAND_HEIGHT)
+          bandHeight = ((THUMBNAIL_MIN_BAND_HEIGHT + tileHeight - 1) / tileHeight) * tileHeight;
+        bandHeight = std::min(bandHeight, sizeY);
+
+        VariantPixelBuffer band;
+        openBytes(plane, band, 0, 0, sizeX, bandHeight);
+
+        std::array<VariantPixelBuffer::size_type, 9> shape;
+        const VariantPixelBuffer::size_type *bandShape(band.shape());
+        std::copy(bandShape, bandShape + PixelBufferBase::dimensions,
+                  shape.begin());
+        shape[DIM_SPATIAL_X] = thumbSize[0];
+        shape[DIM_SPATIAL_Y] = thumbSize[1];
+        buf.setBuffer(shape, band.pixelType(), band.storage_order());
+
+        ThumbnailVisitor v(*this, plane, sizeX, sizeY, bandHeight, band);
+        boost::apply_visitor(v, buf.vbuffer());
       }
 
       void
@@ -765,6 +1065,7 @@ namespace ome
             currentId = boost::none;
             coreIndex = series = resolution = plane = 0;
             core.clear();
+            originalMetadataPending.reset();
           }
       }
 
@@ -1074,15 +1375,63 @@ namespace ome
       const std::shared_ptr<::ome::xml::meta::MetadataStore>&
       FormatReader::getMetadataStore() const
       {
+        populateOriginalMetadata();
         return metadataStore;
       }
 
       std::shared_ptr<::ome::xml::meta::MetadataStore>&
       FormatReader::getMetadataStore()
       {
+        populateOriginalMetadata();
         return metadataStore;
       }
 
+      void
+      FormatReader::populateOriginalMetadata() const
+      {
+        if (!originalMetadataPending)
+          return;
+
+        std::call_once(*originalMetadataPending, [this]{
+            const std::shared_ptr<::ome::xml::meta::OMEXMLMetadata>& store =
+              std::dynamic_pointer_cast<::ome::xml::meta::OMEXMLMetadata>(metadataStore);
+            if (!store)
+              return;
+
+            MetadataMap allMetadata(metadata);
+
+            {
+              SaveSeries sentry(*this);
+              for (dimension_size_type series = 0;
+                   series < getSeriesCount();
+                   ++series)
+                {
+                  boost::format fmt("Series %1%");
+                  fmt % series;
+                  std::string name(fmt.str());
+
+                  try
+                    {
+                      std::string imageName = store->getImageName(series);
+                      if (!imageName.empty() && ome::common::trim(imageName).size() != 0)
+                        name = imageName;
+                    }
+                  catch (const std::exception&)
+                    {
+                    }
+                  setSeries(series);
+                  const MetadataMap& sm(getSeriesMetadata());
+                  for (MetadataMap::const_iterator i = sm.begin();
+                       i != sm.end();
+                       ++i)
+                    allMetadata.set(name + " " + i->first, i->second);
+                }
+            }
+
+            fillOriginalMetadata(*store, allMetadata);
+          });
+      }
+
       std::vector<std::shared_ptr<::ome::files::FormatReader>>
       FormatReader::getUnderlyingReaders() const
       {
@@ -1324,6 +1673,229 @@ namespace ome
         flattenedResolutions = flatten;
       }
 
+      std::shared_ptr<::ome::files::FormatReader>
+      FormatReader::createView() const
+      {
+        assertId(currentId, true);
+
+        std::shared_ptr<FormatReader> view(createReader());
+        shareView(*view);
+        return view;
+      }
+
+      std::shared_ptr<FormatReader>
+      FormatReader::createReader() const
+      {
+        boost::format fmt("%1% reader does not support views");
+        fmt % getFormat();
+        throw std::runtime_error(fmt.str());
+      }
+
+      void
+      FormatReader::saveState(std::ostream& stream) const
+      {
+        assertId(currentId, true);
+
+        // Initialises any series which are initialised on first use.
+        const coremetadata_list_type& coreList(getCoreMetadataList());
+
+        std::set<path> files;
+        files.insert(*currentId);
+        for (const auto& file : getUsedFiles())
+          files.insert(file);
+
+        stream.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+        writeState(stream, STATE_VERSION);
+        writeState(stream, STATE_BYTE_ORDER);
+        writeState(stream, getFormat());
+        writeState(stream, *currentId);
+
+        // Size and modification time of each used file, to detect
+        // stale state when loading.
+        writeState(stream, static_cast<uint64_t>(files.size()));
+        for (const auto& file : files)
+          {
+            boost::system::error_code ec;
+            std::time_t mtime = boost::filesystem::last_write_time(file, ec);
+            std::uintmax_t size = 0U;
+            if (!ec)
+              size = boost::filesystem::file_size(file, ec);
+            if (ec)
+              {
+                boost::format fmt("Failed to save reader state: ‘%1%’ is not accessible");
+                fmt % file.string();
+                throw FormatException(fmt.str());
+              }
+            writeState(stream, file);
+            writeState(stream, static_cast<uint64_t>(size));
+            writeState(stream, static_cast<int64_t>(mtime));
+          }
+
+        writeState(stream, metadata);
+
+        writeState(stream, static_cast<uint64_t>(coreList.size()));
+        for (const auto& cm : coreList)
+          {
+            if (!cm)
+              throw std::logic_error("CoreMetadata null");
+            writeState(stream, *cm);
+          }
+
+        // Metadata store content, if retained.
+        std::string xml;
+        std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> omexml
+          (std::dynamic_pointer_cast<::ome::xml::meta::OMEXMLMetadata>(metadataStore));
+        if (omexml)
+          xml = omexml->dumpXML();
+        writeState(stream, xml);
+
+        saveReaderState(stream);
+
+        if (!stream)
+          throw FormatException("Failed to write reader state");
+      }
+
+      bool
+      FormatReader::loadState(std::istream& stream)
+      {
+        close();
+
+        char magic[sizeof(STATE_MAGIC)];
+        if (!stream.read(magic, sizeof(magic)) ||
+            !std::equal(magic, magic + sizeof(magic), STATE_MAGIC))
+          throw FormatException("Invalid reader state");
+
+        uint32_t version;
+        readState(stream, version);
+        if (version != STATE_VERSION)
+          {
+            boost::format fmt("Unsupported reader state version %1%");
+            fmt % version;
+            throw FormatException(fmt.str());
+          }
+
+        uint32_t order;
+        readState(stream, order);
+        if (order != STATE_BYTE_ORDER)
+          throw FormatException("Reader state byte order does not match this platform");
+
+        std::string format;
+        readState(stream, format);
+        if (format != getFormat())
+          {
+            boost::format fmt("Reader state for %1% format can not be loaded by %2% reader");
+            fmt % format % getFormat();
+            throw FormatException(fmt.str());
+          }
+
+        path id;
+        readState(stream, id);
+
+        uint64_t fileCount;
+        readState(stream, fileCount);
+        bool stale = false;
+        for (uint64_t i = 0; i < fileCount; ++i)
+          {
+            path file;
+            uint64_t size;
+            int64_t mtime;
+            readState(stream, file);
+            readState(stream, size);
+            readState(stream, mtime);
+
+            if (stale)
+              continue;
+
+            boost::system::error_code ec;
+            std::time_t currentMtime = boost::filesystem::last_write_time(file, ec);
+            std::uintmax_t currentSize = 0U;
+            if (!ec)
+              currentSize = boost::filesystem::file_size(file, ec);
+            if (ec ||
+                static_cast<int64_t>(currentMtime) != mtime ||
+                static_cast<uint64_t>(currentSize) != size)
+              stale = true;
+          }
+        if (stale)
+          return false;
+
+        try
+          {
+            currentId = id;
+
+            readState(stream, metadata);
+
+            uint64_t coreCount;
+            readState(stream, coreCount);
+            core.clear();
+            for (uint64_t i = 0; i < coreCount; ++i)
+              {
+                std::shared_ptr<CoreMetadata> cm(std::make_shared<CoreMetadata>());
+                readState(stream, *cm);
+                core.push_back(cm);
+              }
+
+            // Only parse the metadata store content if it will be
+            // retained.
+            std::string xml;
+            readState(stream, xml);
+            if (!xml.empty() && !std::dynamic_pointer_cast<DummyMetadata>(metadataStore))
+              {
+                std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> meta(createOMEXMLMetadata(xml));
+                metadataStore->createRoot();
+                ome::xml::meta::convert(*meta, *metadataStore);
+              }
+
+            loadReaderState(stream);
+          }
+        catch (...)
+          {
+            close();
+            throw;
+          }
+
+        return true;
+      }
+
+      void
+      FormatReader::saveReaderState(std::ostream& /* stream */) const
+      {
+        boost::format fmt("%1% reader does not support saving state");
+        fmt % getFormat();
+        throw std::runtime_error(fmt.str());
+      }
+
+      void
+      FormatReader::loadReaderState(std::istream& /* stream */)
+      {
+        boost::format fmt("%1% reader does not support saving state");
+        fmt % getFormat();
+        throw std::runtime_error(fmt.str());
+      }
+
+      void
+      FormatReader::shareView(FormatReader& view) const
+      {
+        // The input stream is not shared; it has its own position.
+        view.currentId = currentId;
+        view.metadata = metadata;
+        view.coreIndex = coreIndex;
+        view.series = series;
+        view.plane = plane;
+        view.core = core;
+        view.resolution = resolution;
+        view.flattenedResolutions = flattenedResolutions;
+        view.datasetDescription = datasetDescription;
+        view.normalizeData = normalizeData;
+        view.filterMetadata = filterMetadata;
+        view.saveOriginalMetadata = saveOriginalMetadata;
+        view.indexedAsRGB = indexedAsRGB;
+        view.group = group;
+        view.metadataStore = metadataStore;
+        view.originalMetadataPending = originalMetadataPending;
+        view.metadataOptions = metadataOptions;
+      }
+
       dimension_size_type
       FormatReader::getCoreIndex() const
       {
@@ -1364,65 +1936,23 @@ namespace ome
             initFile(canonicalpath);
 
             const std::shared_ptr<::ome::xml::meta::OMEXMLMetadata>& store =
-              std::dynamic_pointer_cast<::ome::xml::meta::OMEXMLMetadata>(getMetadataStore());
+              std::dynamic_pointer_cast<::ome::xml::meta::OMEXMLMetadata>(metadataStore);
             if(store)
               {
+                // Collecting the series metadata would initialise
+                // every series, so is deferred until the metadata
+                // store is used.
                 if(saveOriginalMetadata)
-                  {
-                    MetadataMap allMetadata(metadata);
-
-                    setSeries(0);
-                    {
-                      SaveSeries(*this);
-                      for (dimension_size_type series = 0;
-                           series < getSeriesCount();
-                           ++series)
-                        {
-                          boost::format fmt("Series %1%");
-                          fmt % series;
-                          std::string name(fmt.str());
-
-                          try
-                            {
-                              std::string imageName = store->getImageName(series);
-                              if (!imageName.empty() && ome::common::trim(imageName).size() != 0)
-                                name = imageName;
-                            }
-                          catch (const std::exception&)
-                            {
-                            }
-                          setSeries(series);
-                          const MetadataMap& sm(getSeriesMetadata());
-                          for (MetadataMap::const_iterator i = sm.begin();
-                               i != sm.end();
-                               ++i)
-                            allMetadata.set(name + " " + i->first, i->second);
-                        }
-                    }
-
-                    fillOriginalMetadata(*store, allMetadata);
-                  }
-
-                setSeries(0);
-                {
-                  SaveSeries(*this);
-
-                  for (dimension_size_type series = 0;
-                       series < getSeriesCount();
-                       ++series)
-                    {
-                      setSeries(series);
-
-                      if (getModuloZ().size() > 0 || getModuloC().size() > 0 ||
-                          getModuloT().size() > 0)
-                        {
-                          /**
-                           * @todo Implement addModuloAlong.  Requires bits of MetadataTools OMEXMLServiceImpl.
-                           */
-                          // addModuloAlong(store, core.get(series), series);
-                        }
-                    }
-                }
+                  originalMetadataPending = std::make_shared<std::once_flag>();
+
+                /**
+                 * @todo Implement addModuloAlong for each series with
+                 * modulo annotations.  Requires bits of MetadataTools
+                 * OMEXMLServiceImpl.  Note that this should not visit
+                 * every series unless required, since readers may
+                 * initialise series on first use.
+                 */
+                // addModuloAlong(store, core.get(series), series);
               }
           }
       }
@@ -41,6 +41,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 
 #include <ome/files/FormatReader.h>
 #include <ome/files/FormatHandler.h>
@@ -204,6 +205,13 @@ namespace ome
          */
         std::shared_ptr<::ome::xml::meta::MetadataStore> metadataStore;
 
+        /**
+         * Pending population of the original metadata in the
+         * metadata store, shared with reader views.  Set by setId()
+         * and completed once by getMetadataStore().
+         */
+        std::shared_ptr<std::once_flag> originalMetadataPending;
+
         /// Metadata parsing options.
         MetadataOptions metadataOptions;
 
@@ -241,6 +249,79 @@ namespace ome
         void
         initFile(const boost::filesystem::path& id);
 
+        /**
+         * Populate the metadata store with the original metadata.
+         *
+         * This collects the metadata of every series, so is deferred
+         * from setId() until the metadata store is first used.
+         */
+        void
+        populateOriginalMetadata() const;
+
+        /**
+         * Create a new reader of the same type as this reader.
+         *
+         * This is used by createView() to create a reader to share
+         * state with.  The default implementation throws, so readers
+         * must override this method to support views.
+         *
+         * @returns a new, uninitialised, reader.
+         * @throws std::runtime_error if views are not supported.
+         */
+        virtual
+        std::shared_ptr<FormatReader>
+        createReader() const;
+
+        /**
+         * Share parsed state with a reader view.
+         *
+         * The view will have been created with createReader().  All
+         * state set up by initFile() is shared (or copied where not
+         * shareable), along with the current series, resolution and
+         * plane selection.  Derived readers must call this
+         * implementation and then share their own state.
+         *
+         * @param view the view to share state with.
+         */
+        virtual
+        void
+        shareView(FormatReader& view) const;
+
+        /**
+         * Save reader-specific state.
+         *
+         * This is used by saveState() to save any state set up by
+         * initFile() in addition to the core metadata, metadata and
+         * metadata store saved by this class.  The default
+         * implementation throws, so readers must override this method
+         * to support saving state.  Derived readers which add state
+         * must call their superclass implementation and then save
+         * their own state, using the detail::writeState() functions.
+         *
+         * @param stream the stream to write the state to.
+         * @throws std::runtime_error if saving state is not supported.
+         */
+        virtual
+        void
+        saveReaderState(std::ostream& stream) const;
+
+        /**
+         * Load reader-specific state.
+         *
+         * This is used by loadState() to restore the state saved by
+         * saveReaderState(), after the core metadata, metadata and
+         * metadata store have been restored.  Derived readers must
+         * call their superclass implementation and then load their
+         * own state, in the same order as it was saved.
+         *
+         * @param stream the stream to read the state from.
+         * @throws std::runtime_error if saving state is not
+         * supported, or FormatException if the state is invalid.
+         */
+        virtual
+        void
+        loadReaderState(std::istream& stream);
+
         /**
          * Check if a file is in the used files list.
          *
@@ -570,6 +651,33 @@ namespace ome
                   dimension_size_type w,
                   dimension_size_type h) const;
 
+        // Documented in superclass.
+        void
+        openBytes(dimension_size_type      plane,
+                  VariantPixelBuffer&      buf,
+                  const CancellationToken& token) const;
+
+        // Documented in superclass.
+        void
+        openBytes(dimension_size_type      plane,
+                  VariantPixelBuffer&      buf,
+                  dimension_size_type      x,
+                  dimension_size_type      y,
+                  dimension_size_type      w,
+                  dimension_size_type      h,
+                  const CancellationToken& token) const;
+
+        // Documented in superclass.
+        void
+        openBytes(dimension_size_type      plane,
+                  VariantPixelBuffer&      buf,
+                  dimension_size_type      x,
+                  dimension_size_type      y,
+                  dimension_size_type      w,
+                  dimension_size_type      h,
+                  const TileSchedule&      schedule,
+                  const CancellationToken& token) const;
+
       protected:
         /**
          * @copydoc ome::files::FormatReader::openBytes(dimension_size_type,VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type)const
@@ -583,6 +691,26 @@ namespace ome
                       dimension_size_type w,
                       dimension_size_type h) const = 0;
 
+        /**
+         * @copydoc ome::files::FormatReader::openBytes(dimension_size_type,VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type,const TileSchedule&,const CancellationToken&)const
+         *
+         * The default implementation checks the token, calls
+         * openBytesImpl(), and then invokes the schedule callback
+         * for the whole region, so the read can only be cancelled
+         * before it starts.  Readers should override this to read
+         * in the scheduled order and check the token while reading.
+         */
+        virtual
+        void
+        openBytesScheduledImpl(dimension_size_type      plane,
+                               VariantPixelBuffer&      buf,
+                               dimension_size_type      x,
+                               dimension_size_type      y,
+                               dimension_size_type      w,
+                               dimension_size_type      h,
+                               const TileSchedule&      schedule,
+                               const CancellationToken& token) const;
+
       public:
         // Documented in superclass.
         void
@@ -792,6 +920,18 @@ namespace ome
         void
         setFlattenedResolutions(bool flatten);
 
+        // Documented in superclass.
+        std::shared_ptr<::ome::files::FormatReader>
+        createView() const;
+
+        // Documented in superclass.
+        void
+        saveState(std::ostream& stream) const;
+
+        // Documented in superclass.
+        bool
+        loadState(std::istream& stream);
+
         // Documented in superclass.
         void
         setId(const boost::filesystem::path& id);
@@ -35,11 +35,14 @@
  * #L%
  */
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <fstream>
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/format.hpp>
 
 #include <ome/common/filesystem.h>
 #include <ome/common/mstream.h>
@@ -75,6 +78,42 @@ namespace ome
       {
         // Default thumbnail width and height.
         const dimension_size_type THUMBNAIL_DIMENSION = 128;
+
+        /**
+         * Create a buffer referencing the pixel data of another
+         * buffer, starting at an origin.
+         */
+        struct ViewVisitor : public boost::static_visitor<>
+        {
+          /// Origin of the view in the source buffer.
+          const VariantPixelBuffer::indices_type& origin;
+          /// Shape of the view.
+          const std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions>& shape;
+          /// Storage order of the view.
+          const PixelBufferBase::storage_order_type& order;
+          /// The view to set.
+          VariantPixelBuffer& view;
+
+          ViewVisitor(const VariantPixelBuffer::indices_type&                                       origin,
+                      const std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions>& shape,
+                      const PixelBufferBase::storage_order_type&                                    order,
+                      VariantPixelBuffer&                                                           view):
+            origin(origin),
+            shape(shape),
+            order(order),
+            view(view)
+          {}
+
+          template<typename T>
+          void
+          operator()(const std::shared_ptr<T>& buffer)
+          {
+            std::shared_ptr<T> plane(std::make_shared<T>(&buffer->at(origin), shape,
+                                                         buffer->pixelType(), buffer->endianType(),
+                                                         order));
+            view.vbuffer() = plane;
+          }
+        };
       }
 
       FormatWriter::FormatWriter(const WriterProperties& writerProperties):
@@ -86,6 +125,7 @@ namespace ome
         compression(boost::none),
         interleaved(boost::none),
         sequential(false),
+        layout(LAYOUT_DEFAULT),
         framesPerSecond(0),
         tile_size_x(boost::none),
         tile_size_y(boost::none),
@@ -175,6 +215,80 @@ namespace ome
         saveBytes(plane, buf, 0, 0, width, height);
       }
 
+      void
+      FormatWriter::saveVolume(VariantPixelBuffer& buf)
+      {
+        assertId(currentId, true);
+
+        VariantPixelBuffer view;
+        for (dimension_size_type p = 0U; p < getImageCount(); ++p)
+          {
+            getPlaneView(buf, p, view);
+            saveBytes(p, view);
+          }
+      }
+
+      void
+      FormatWriter::getPlaneView(const VariantPixelBuffer& volume,
+                                 dimension_size_type       plane,
+                                 VariantPixelBuffer&       view) const
+      {
+        assertId(currentId, true);
+
+        if (plane >= getImageCount())
+          {
+            boost::format fmt("Invalid plane: %1%");
+            fmt % plane;
+            throw std::logic_error(fmt.str());
+          }
+
+        std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions> expected;
+        expected[DIM_SPATIAL_X] = getSizeX();
+        expected[DIM_SPATIAL_Y] = getSizeY();
+        expected[DIM_SPATIAL_Z] = getSizeZ();
+        expected[DIM_TEMPORAL_T] = getSizeT();
+        expected[DIM_CHANNEL] = getEffectiveSizeC();
+        expected[DIM_SUBCHANNEL] = getRGBChannelCount(0U);
+        expected[DIM_MODULO_Z] = expected[DIM_MODULO_T] = expected[DIM_MODULO_C] = 1U;
+
+        const VariantPixelBuffer::size_type *shape(volume.shape());
+        if (!std::equal(expected.begin(), expected.end(), shape))
+          {
+            boost::format fmt("VariantPixelBuffer dimensions (%1%×%2%×%3%, %4%t, %5%c, %6% samples) incompatible with series dimensions (%7%×%8%×%9%, %10%t, %11%c, %12% samples)");
+            fmt % shape[DIM_SPATIAL_X] % shape[DIM_SPATIAL_Y] % shape[DIM_SPATIAL_Z];
+            fmt % shape[DIM_TEMPORAL_T] % shape[DIM_CHANNEL] % shape[DIM_SUBCHANNEL];
+            fmt % expected[DIM_SPATIAL_X] % expected[DIM_SPATIAL_Y] % expected[DIM_SPATIAL_Z];
+            fmt % expected[DIM_TEMPORAL_T] % expected[DIM_CHANNEL] % expected[DIM_SUBCHANNEL];
+            throw std::logic_error(fmt.str());
+          }
+
+        // Each plane must be contiguous, i.e. X, Y and the
+        // subchannels are stored first.
+        const PixelBufferBase::storage_order_type order(volume.storage_order());
+        const bool interleaved = order.ordering(0) == DIM_SUBCHANNEL;
+        const PixelBufferBase::storage_order_type planeorder(PixelBufferBase::make_storage_order(ome::xml::model::enums::DimensionOrder::XYZTC, interleaved));
+        for (PixelBufferBase::size_type i = 0; i < PixelBufferBase::dimensions; ++i)
+          {
+            if ((i < 3U && order.ordering(i) != planeorder.ordering(i)) ||
+                !order.ascending(i))
+              throw std::logic_error("VariantPixelBuffer storage order does not store planes contiguously");
+          }
+
+        const std::array<dimension_size_type, 3> coords(getZCTCoords(plane));
+
+        VariantPixelBuffer::indices_type origin;
+        origin.fill(0);
+        origin[DIM_SPATIAL_Z] = static_cast<VariantPixelBuffer::indices_type::value_type>(coords[0]);
+        origin[DIM_CHANNEL] = static_cast<VariantPixelBuffer::indices_type::value_type>(coords[1]);
+        origin[DIM_TEMPORAL_T] = static_cast<VariantPixelBuffer::indices_type::value_type>(coords[2]);
+
+        std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions> planeshape(expected);
+        planeshape[DIM_SPATIAL_Z] = planeshape[DIM_TEMPORAL_T] = planeshape[DIM_CHANNEL] = 1U;
+
+        ViewVisitor v(origin, planeshape, planeorder, view);
+        boost::apply_visitor(v, volume.vbuffer());
+      }
+
       void
       FormatWriter::setSeries(dimension_size_type series) const
       {
@@ -547,6 +661,26 @@ namespace ome
         return writerProperties.stacks;
       }
 
+      void
+      FormatWriter::setLayoutProfile(LayoutProfile profile)
+      {
+        layout = profile;
+
+        if (!interleaved)
+          {
+            if (profile == LAYOUT_SEQUENTIAL || profile == LAYOUT_RANDOM_ACCESS)
+              interleaved = true;
+            else if (profile == LAYOUT_ARCHIVAL)
+              interleaved = false;
+          }
+      }
+
+      LayoutProfile
+      FormatWriter::getLayoutProfile() const
+      {
+        return layout;
+      }
+
       dimension_size_type
       FormatWriter::setTileSizeX(boost::optional<dimension_size_type> size)
       {
@@ -133,6 +133,9 @@ namespace ome
         /// Planes are written sequentially.
         bool sequential;
 
+        /// Layout profile.
+        LayoutProfile layout;
+
         /// The frames per second to use when writing.
         frame_rate_type framesPerSecond;
 
@@ -158,6 +161,27 @@ namespace ome
         operator= (const FormatWriter&) = delete;
         /// @endcond SKIP
 
+        /**
+         * Get a view of a single plane of a volume.
+         *
+         * The view references the pixel data of the volume without
+         * copying, and so must not be used after the volume is
+         * destroyed or reallocated.  Its storage order is the @c
+         * XYZTC storage order with the same subchannel interleaving
+         * as the volume.
+         *
+         * @param volume the volume, with the dimensions of the
+         * current series.
+         * @param plane the plane index within the series.
+         * @param view the buffer to set to the plane view.
+         * @throws std::logic_error if the volume dimensions or
+         * storage order are unsuitable, or the plane is invalid.
+         */
+        void
+        getPlaneView(const VariantPixelBuffer& volume,
+                     dimension_size_type       plane,
+                     VariantPixelBuffer&       view) const;
+
       public:
         /// Destructor.
         virtual
@@ -192,6 +216,10 @@ namespace ome
         saveBytes(dimension_size_type plane,
                   VariantPixelBuffer& buf);
 
+        // Documented in superclass.
+        void
+        saveVolume(VariantPixelBuffer& buf);
+
         // Documented in superclass.
         void
         setSeries(dimension_size_type series) const;
@@ -451,6 +479,14 @@ namespace ome
         const std::vector<boost::filesystem::path>&
         getCompressionSuffixes() const;
 
+        // Documented in superclass.
+        void
+        setLayoutProfile(LayoutProfile profile);
+
+        // Documented in superclass.
+        LayoutProfile
+        getLayoutProfile() const;
+
         // Documented in superclass.
         dimension_size_type
         setTileSizeX(boost::optional<dimension_size_type> size);
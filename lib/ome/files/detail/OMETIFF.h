@@ -38,6 +38,13 @@
 #ifndef OME_FILES_DETAIL_OMETIFF_H
 #define OME_FILES_DETAIL_OMETIFF_H
 
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <ome/files/Types.h>
@@ -103,6 +110,342 @@ namespace ome
         }
       };
 
+      /**
+       * Interned set of files within an OME-TIFF file set.
+       *
+       * Each distinct file is stored once, and is referred to by
+       * index.  This avoids storing a copy of the filename for every
+       * plane.
+       */
+      class OMETIFFFileTable
+      {
+      public:
+        /// File index type.
+        typedef std::uint32_t index_type;
+
+        /// Constructor.
+        OMETIFFFileTable():
+          ids(),
+          index()
+        {
+        }
+
+        /**
+         * Get the index for a file, adding it if not already present.
+         *
+         * @param id the file to add.
+         * @returns the file index.
+         */
+        index_type
+        intern(const boost::filesystem::path& id)
+        {
+          std::map<boost::filesystem::path, index_type>::const_iterator i = index.find(id);
+          if (i != index.end())
+            return i->second;
+
+          if (ids.size() >= std::numeric_limits<index_type>::max())
+            throw std::length_error("Too many files in OME-TIFF file set");
+
+          index_type idx = static_cast<index_type>(ids.size());
+          ids.push_back(id);
+          index.insert(std::make_pair(id, idx));
+          return idx;
+        }
+
+        /**
+         * Get the file for an index.
+         *
+         * @param idx the file index.
+         * @returns the file.
+         * @throws std::out_of_range if the index is invalid.
+         */
+        const boost::filesystem::path&
+        at(index_type idx) const
+        {
+          return ids.at(idx);
+        }
+
+        /**
+         * Get the number of files.
+         *
+         * @returns the file count.
+         */
+        index_type
+        size() const
+        {
+          return static_cast<index_type>(ids.size());
+        }
+
+      private:
+        /// Files, by index.
+        std::vector<boost::filesystem::path> ids;
+        /// Indexes, by file.
+        std::map<boost::filesystem::path, index_type> index;
+      };
+
+      /**
+       * Metadata for all planes within a series of an OME-TIFF file set.
+       *
+       * This is the equivalent of a list of OMETIFFPlane, but stored
+       * compactly as separate arrays of file index, IFD and flags,
+       * with files interned in an OMETIFFFileTable which may be
+       * shared between series.
+       */
+      class OMETIFFPlaneTable
+      {
+      public:
+        /// File index type.
+        typedef OMETIFFFileTable::index_type file_index_type;
+        /// IFD index type.
+        typedef std::uint32_t ifd_index_type;
+
+        /// File index for planes with no associated file.
+        static constexpr file_index_type nofile = std::numeric_limits<file_index_type>::max();
+
+        /**
+         * Constructor.
+         *
+         * @param files the file table to use.
+         */
+        explicit
+        OMETIFFPlaneTable(std::shared_ptr<OMETIFFFileTable> files = std::make_shared<OMETIFFFileTable>()):
+          fileTable(files),
+          fileIndex(),
+          ifdIndex(),
+          flags()
+        {
+        }
+
+        /**
+         * Get the number of planes.
+         *
+         * @returns the plane count.
+         */
+        dimension_size_type
+        size() const
+        {
+          return fileIndex.size();
+        }
+
+        /**
+         * Change the number of planes.
+         *
+         * Added planes have no file and a zero IFD; order is
+         * uncertain; status is unknown.
+         *
+         * @param size the new plane count.
+         */
+        void
+        resize(dimension_size_type size)
+        {
+          fileIndex.resize(size, file_index_type(nofile));
+          ifdIndex.resize(size, 0U);
+          flags.resize(size, OMETIFFPlane::UNKNOWN);
+        }
+
+        /// Remove all planes.
+        void
+        clear()
+        {
+          fileIndex.clear();
+          ifdIndex.clear();
+          flags.clear();
+        }
+
+        /**
+         * Get the file table.
+         *
+         * @returns the file table.
+         */
+        const OMETIFFFileTable&
+        files() const
+        {
+          return *fileTable;
+        }
+
+        /**
+         * Check if a plane has an associated file.
+         *
+         * @param plane the plane index.
+         * @returns @c true if a file is set, @c false otherwise.
+         */
+        bool
+        hasFile(dimension_size_type plane) const
+        {
+          return fileIndex.at(plane) != nofile;
+        }
+
+        /**
+         * Get the file index of a plane.
+         *
+         * @param plane the plane index.
+         * @returns the index of the file in the file table, or @c
+         * nofile if no file is set.
+         */
+        file_index_type
+        fileId(dimension_size_type plane) const
+        {
+          return fileIndex.at(plane);
+        }
+
+        /**
+         * Get the file containing a plane.
+         *
+         * @param plane the plane index.
+         * @returns the file, or an empty path if no file is set.
+         */
+        const boost::filesystem::path&
+        file(dimension_size_type plane) const
+        {
+          static const boost::filesystem::path none;
+
+          file_index_type idx = fileIndex.at(plane);
+          return idx == nofile ? none : fileTable->at(idx);
+        }
+
+        /**
+         * Get the IFD index of a plane.
+         *
+         * @param plane the plane index.
+         * @returns the IFD index.
+         */
+        dimension_size_type
+        ifd(dimension_size_type plane) const
+        {
+          return ifdIndex.at(plane);
+        }
+
+        /**
+         * Get the certainty flag of a plane.
+         *
+         * @param plane the plane index.
+         * @returns @c true if certain, @c false otherwise.
+         */
+        bool
+        certain(dimension_size_type plane) const
+        {
+          return (flags.at(plane) & CERTAIN) != 0;
+        }
+
+        /**
+         * Get the file status of a plane.
+         *
+         * @param plane the plane index.
+         * @returns the file status.
+         */
+        OMETIFFPlane::Status
+        status(dimension_size_type plane) const
+        {
+          return static_cast<OMETIFFPlane::Status>(flags.at(plane) & STATUS);
+        }
+
+        /**
+         * Set the file and IFD index of a plane.
+         *
+         * @param plane the plane index.
+         * @param id the file containing the plane.
+         * @param ifd the IFD index.
+         * @throws std::out_of_range if the IFD index is too large to
+         * store.
+         */
+        void
+        set(dimension_size_type            plane,
+            const boost::filesystem::path& id,
+            dimension_size_type            ifd)
+        {
+          if (ifd > std::numeric_limits<ifd_index_type>::max())
+            throw std::out_of_range("IFD index out of range");
+
+          set(plane, fileTable->intern(id), ifd);
+        }
+
+        /**
+         * Set the file and IFD index of a plane.
+         *
+         * Unlike set() with a file path, this does not modify the
+         * file table, and so is safe to use while the table is shared
+         * with other threads.
+         *
+         * @param plane the plane index.
+         * @param id the index of the file containing the plane.
+         * @param ifd the IFD index.
+         * @throws std::out_of_range if the file index is not in the
+         * file table, or the IFD index is too large to store.
+         */
+        void
+        set(dimension_size_type plane,
+            file_index_type     id,
+            dimension_size_type ifd)
+        {
+          if (id >= fileTable->size())
+            throw std::out_of_range("File index out of range");
+          if (ifd > std::numeric_limits<ifd_index_type>::max())
+            throw std::out_of_range("IFD index out of range");
+
+          fileIndex.at(plane) = id;
+          ifdIndex.at(plane) = static_cast<ifd_index_type>(ifd);
+        }
+
+        /**
+         * Set the certainty flag of a plane.
+         *
+         * @param plane the plane index.
+         * @param certain @c true if certain, @c false otherwise.
+         */
+        void
+        setCertain(dimension_size_type plane,
+                   bool                certain)
+        {
+          std::uint8_t& f(flags.at(plane));
+          f = static_cast<std::uint8_t>(certain ? (f | CERTAIN) : (f & ~CERTAIN));
+        }
+
+        /**
+         * Set the file status of a plane.
+         *
+         * @param plane the plane index.
+         * @param status the file status.
+         */
+        void
+        setStatus(dimension_size_type  plane,
+                  OMETIFFPlane::Status status)
+        {
+          std::uint8_t& f(flags.at(plane));
+          f = static_cast<std::uint8_t>((f & ~STATUS) | status);
+        }
+
+        /**
+         * Clear the file and IFD index of a plane.
+         *
+         * The certainty flag and status are unchanged.
+         *
+         * @param plane the plane index.
+         */
+        void
+        reset(dimension_size_type plane)
+        {
+          fileIndex.at(plane) = nofile;
+          ifdIndex.at(plane) = 0U;
+        }
+
+      private:
+        /// Flag bits.
+        enum Flags
+          {
+            STATUS = 0x3,  ///< OMETIFFPlane::Status mask.
+            CERTAIN = 0x4  ///< Certainty flag.
+          };
+
+        /// Interned files (shared between series).
+        std::shared_ptr<OMETIFFFileTable> fileTable;
+        /// File index for each plane.
+        std::vector<file_index_type> fileIndex;
+        /// IFD index for each plane.
+        std::vector<ifd_index_type> ifdIndex;
+        /// Status and certainty flags for each plane.
+        std::vector<std::uint8_t> flags;
+      };
+
     }
   }
 }
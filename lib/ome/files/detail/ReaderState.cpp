@@ -0,0 +1,301 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <sstream>
+
+#include <boost/format.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/size.hpp>
+#include <boost/type.hpp>
+
+#include <ome/files/CoreMetadata.h>
+#include <ome/files/Modulo.h>
+#include <ome/files/detail/ReaderState.h>
+
+namespace ome
+{
+  namespace files
+  {
+    namespace detail
+    {
+
+      namespace
+      {
+
+        // Size of blocks to read strings in, to avoid allocating
+        // arbitrary amounts of memory for a corrupt length.
+        const uint64_t string_block_size = 64U * 1024U;
+
+        // Write the content of a metadata value.
+        struct write_value : public boost::static_visitor<>
+        {
+          std::ostream& stream;
+
+          write_value(std::ostream& stream):
+            stream(stream)
+          {}
+
+          template <typename T>
+          void
+          operator() (const T& value) const
+          {
+            writeState(stream, value);
+          }
+        };
+
+        // Read the content of a metadata value of the type with the
+        // specified variant index.
+        struct read_value
+        {
+          std::istream&            stream;
+          MetadataMap::value_type& value;
+          uint32_t                 which;
+          uint32_t&                index;
+
+          read_value(std::istream&            stream,
+                     MetadataMap::value_type& value,
+                     uint32_t                 which,
+                     uint32_t&                index):
+            stream(stream),
+            value(value),
+            which(which),
+            index(index)
+          {}
+
+          template <typename T>
+          void
+          operator() (boost::type<T>)
+          {
+            if (index++ == which)
+              {
+                T item = T();
+                readState(stream, item);
+                value = item;
+              }
+          }
+        };
+
+        template<typename T>
+        std::string
+        enum_name(const T& value)
+        {
+          std::ostringstream os;
+          os << value;
+          return os.str();
+        }
+
+      }
+
+      void
+      writeState(std::ostream&      stream,
+                 const std::string& value)
+      {
+        writeState(stream, static_cast<uint64_t>(value.size()));
+        stream.write(value.data(), static_cast<std::streamsize>(value.size()));
+      }
+
+      void
+      readState(std::istream& stream,
+                std::string&  value)
+      {
+        uint64_t size;
+        readState(stream, size);
+        value.clear();
+        while (size > 0U)
+          {
+            uint64_t block = std::min(size, string_block_size);
+            std::string::size_type pos = value.size();
+            value.resize(pos + static_cast<std::string::size_type>(block));
+            if (!stream.read(&value[pos], static_cast<std::streamsize>(block)))
+              throw FormatException("Truncated reader state");
+            size -= block;
+          }
+      }
+
+      void
+      writeState(std::ostream&                  stream,
+                 const boost::filesystem::path& value)
+      {
+        writeState(stream, value.string());
+      }
+
+      void
+      readState(std::istream&            stream,
+                boost::filesystem::path& value)
+      {
+        std::string name;
+        readState(stream, name);
+        value = name;
+      }
+
+      void
+      writeState(std::ostream&      stream,
+                 const MetadataMap& value)
+      {
+        writeState(stream, static_cast<uint64_t>(value.size()));
+        for (const auto& item : value)
+          {
+            writeState(stream, item.first);
+            writeState(stream, static_cast<uint32_t>(item.second.which()));
+            boost::apply_visitor(write_value(stream), item.second);
+          }
+      }
+
+      void
+      readState(std::istream& stream,
+                MetadataMap&  value)
+      {
+        typedef MetadataMap::value_type::types types;
+
+        uint64_t size;
+        readState(stream, size);
+        value.clear();
+        for (uint64_t i = 0; i < size; ++i)
+          {
+            MetadataMap::key_type key;
+            readState(stream, key);
+            uint32_t which;
+            readState(stream, which);
+            if (which >= static_cast<uint32_t>(boost::mpl::size<types>::value))
+              {
+                boost::format fmt("Invalid metadata value type %1% in reader state");
+                fmt % which;
+                throw FormatException(fmt.str());
+              }
+
+            MetadataMap::value_type item;
+            uint32_t index = 0U;
+            boost::mpl::for_each<types, boost::type<boost::mpl::_1>>(read_value(stream, item, which, index));
+            value.set(key, item);
+          }
+      }
+
+      void
+      writeState(std::ostream& stream,
+                 const Modulo& value)
+      {
+        writeState(stream, value.parentDimension);
+        writeState(stream, value.start);
+        writeState(stream, value.step);
+        writeState(stream, value.end);
+        writeState(stream, value.parentType);
+        writeState(stream, value.type);
+        writeState(stream, value.typeDescription);
+        writeState(stream, value.unit);
+        writeState(stream, value.labels);
+      }
+
+      void
+      readState(std::istream& stream,
+                Modulo&       value)
+      {
+        readState(stream, value.parentDimension);
+        readState(stream, value.start);
+        readState(stream, value.step);
+        readState(stream, value.end);
+        readState(stream, value.parentType);
+        readState(stream, value.type);
+        readState(stream, value.typeDescription);
+        readState(stream, value.unit);
+        readState(stream, value.labels);
+      }
+
+      void
+      writeState(std::ostream&       stream,
+                 const CoreMetadata& value)
+      {
+        writeState(stream, value.sizeX);
+        writeState(stream, value.sizeY);
+        writeState(stream, value.sizeZ);
+        writeState(stream, value.sizeC);
+        writeState(stream, value.sizeT);
+        writeState(stream, value.thumbSizeX);
+        writeState(stream, value.thumbSizeY);
+        writeState(stream, enum_name(value.pixelType));
+        writeState(stream, value.bitsPerPixel);
+        writeState(stream, value.imageCount);
+        writeState(stream, value.moduloZ);
+        writeState(stream, value.moduloT);
+        writeState(stream, value.moduloC);
+        writeState(stream, enum_name(value.dimensionOrder));
+        writeState(stream, value.orderCertain);
+        writeState(stream, value.littleEndian);
+        writeState(stream, value.interleaved);
+        writeState(stream, value.indexed);
+        writeState(stream, value.falseColor);
+        writeState(stream, value.metadataComplete);
+        writeState(stream, value.seriesMetadata);
+        writeState(stream, value.thumbnail);
+        writeState(stream, value.resolutionCount);
+      }
+
+      void
+      readState(std::istream& stream,
+                CoreMetadata& value)
+      {
+        std::string name;
+
+        readState(stream, value.sizeX);
+        readState(stream, value.sizeY);
+        readState(stream, value.sizeZ);
+        readState(stream, value.sizeC);
+        readState(stream, value.sizeT);
+        readState(stream, value.thumbSizeX);
+        readState(stream, value.thumbSizeY);
+        readState(stream, name);
+        value.pixelType = ome::xml::model::enums::PixelType(name);
+        readState(stream, value.bitsPerPixel);
+        readState(stream, value.imageCount);
+        readState(stream, value.moduloZ);
+        readState(stream, value.moduloT);
+        readState(stream, value.moduloC);
+        readState(stream, name);
+        value.dimensionOrder = ome::xml::model::enums::DimensionOrder(name);
+        readState(stream, value.orderCertain);
+        readState(stream, value.littleEndian);
+        readState(stream, value.interleaved);
+        readState(stream, value.indexed);
+        readState(stream, value.falseColor);
+        readState(stream, value.metadataComplete);
+        readState(stream, value.seriesMetadata);
+        readState(stream, value.thumbnail);
+        readState(stream, value.resolutionCount);
+      }
+
+    }
+  }
+}
@@ -0,0 +1,301 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_DETAIL_READERSTATE_H
+#define OME_FILES_DETAIL_READERSTATE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
+
+#include <ome/files/FormatException.h>
+#include <ome/files/MetadataMap.h>
+#include <ome/files/Types.h>
+
+namespace ome
+{
+  namespace files
+  {
+
+    class CoreMetadata;
+    class Modulo;
+
+    namespace detail
+    {
+
+      /**
+       * @name Reader state serialisation.
+       *
+       * Write and read the values making up a saved reader state
+       * (see ome::files::FormatReader::saveState()).  Values are
+       * stored in native binary form, so a saved state is only
+       * usable on the platform which saved it.  All readers throw
+       * FormatException if the stream is truncated.
+       */
+      ///@{
+
+      /**
+       * Write an arithmetic value.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      template<typename T>
+      inline typename std::enable_if<std::is_arithmetic<T>::value>::type
+      writeState(std::ostream& stream,
+                 const T&      value)
+      {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+      }
+
+      /**
+       * Read an arithmetic value.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      template<typename T>
+      inline typename std::enable_if<std::is_arithmetic<T>::value>::type
+      readState(std::istream& stream,
+                T&            value)
+      {
+        if (!stream.read(reinterpret_cast<char *>(&value), sizeof(T)))
+          throw FormatException("Truncated reader state");
+      }
+
+      /**
+       * Write a string.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      void
+      writeState(std::ostream&      stream,
+                 const std::string& value);
+
+      /**
+       * Read a string.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      void
+      readState(std::istream& stream,
+                std::string&  value);
+
+      /**
+       * Write a path.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      void
+      writeState(std::ostream&                  stream,
+                 const boost::filesystem::path& value);
+
+      /**
+       * Read a path.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      void
+      readState(std::istream&            stream,
+                boost::filesystem::path& value);
+
+      /**
+       * Write a metadata map.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      void
+      writeState(std::ostream&      stream,
+                 const MetadataMap& value);
+
+      /**
+       * Read a metadata map.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      void
+      readState(std::istream& stream,
+                MetadataMap&  value);
+
+      /**
+       * Write modulo annotation.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      void
+      writeState(std::ostream& stream,
+                 const Modulo& value);
+
+      /**
+       * Read modulo annotation.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      void
+      readState(std::istream& stream,
+                Modulo&       value);
+
+      /**
+       * Write core metadata.
+       *
+       * Only the fields of CoreMetadata itself are written; readers
+       * using derived types must write any additional fields.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      void
+      writeState(std::ostream&       stream,
+                 const CoreMetadata& value);
+
+      /**
+       * Read core metadata.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      void
+      readState(std::istream& stream,
+                CoreMetadata& value);
+
+      /**
+       * Write a vector.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      template<typename T>
+      inline void
+      writeState(std::ostream&         stream,
+                 const std::vector<T>& value)
+      {
+        writeState(stream, static_cast<uint64_t>(value.size()));
+        for (const auto& item : value)
+          writeState(stream, static_cast<const T&>(item));
+      }
+
+      /**
+       * Read a vector.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      template<typename T>
+      inline void
+      readState(std::istream&   stream,
+                std::vector<T>& value)
+      {
+        uint64_t size;
+        readState(stream, size);
+        value.clear();
+        // Don't trust the size for allocation; a corrupt stream
+        // will be truncated before the vector grows too large.
+        value.reserve(static_cast<std::size_t>(std::min(size, uint64_t(4096U))));
+        for (uint64_t i = 0; i < size; ++i)
+          {
+            T item = T();
+            readState(stream, item);
+            value.push_back(item);
+          }
+      }
+
+      /**
+       * Write an optional value.
+       *
+       * @param stream the stream to write to.
+       * @param value the value to write.
+       */
+      template<typename T>
+      inline void
+      writeState(std::ostream&             stream,
+                 const boost::optional<T>& value)
+      {
+        writeState(stream, static_cast<bool>(value));
+        if (value)
+          writeState(stream, *value);
+      }
+
+      /**
+       * Read an optional value.
+       *
+       * @param stream the stream to read from.
+       * @param value the value to read.
+       */
+      template<typename T>
+      inline void
+      readState(std::istream&       stream,
+                boost::optional<T>& value)
+      {
+        bool set;
+        readState(stream, set);
+        value = boost::none;
+        if (set)
+          {
+            T item = T();
+            readState(stream, item);
+            value = item;
+          }
+      }
+
+      ///@}
+
+    }
+  }
+}
+
+#endif // OME_FILES_DETAIL_READERSTATE_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
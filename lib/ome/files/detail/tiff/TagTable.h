@@ -0,0 +1,154 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_DETAIL_TIFF_TAGTABLE_H
+#define OME_FILES_DETAIL_TIFF_TAGTABLE_H
+
+#include <atomic>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include <ome/files/tiff/Types.h>
+
+#include <ome/xml/model/enums/PixelType.h>
+
+namespace ome
+{
+  namespace files
+  {
+    namespace detail
+    {
+      namespace tiff
+      {
+
+        /**
+         * In-memory snapshot of the tags of a single IFD.
+         *
+         * libtiff only holds the tags for a single directory at a
+         * time; accessing the tags of any other directory requires
+         * switching directory, which re-reads and re-parses the whole
+         * directory.  When reading, the tags used for image access
+         * are copied into this table once, and shared by all IFD
+         * instances referring to the same directory offset, so that
+         * subsequent queries require no directory switching.
+         *
+         * When writing, each IFD has its own private table which
+         * caches values as they are set.
+         *
+         * A shared table is only filled by IFD::loadTags(), with the
+         * libtiff lock held, and is published by setting @c loaded
+         * with release ordering.  Once loaded, the table is never
+         * modified, and so may be used concurrently without locking
+         * by any thread which has observed @c loaded with acquire
+         * ordering.
+         */
+        struct TagTable
+        {
+          /// Tile type.
+          boost::optional<::ome::files::tiff::TileType> tiletype;
+          /// Image width.
+          boost::optional<uint32_t> imagewidth;
+          /// Image height.
+          boost::optional<uint32_t> imageheight;
+          /// Tile width.
+          boost::optional<uint32_t> tilewidth;
+          /// Tile height.
+          boost::optional<uint32_t> tileheight;
+          /// Pixel type.
+          boost::optional<::ome::xml::model::enums::PixelType> pixeltype;
+          /// Bits per sample.
+          boost::optional<uint16_t> bits;
+          /// Samples per pixel.
+          boost::optional<uint16_t> samples;
+          /// Planar configuration.
+          boost::optional<::ome::files::tiff::PlanarConfiguration> planarconfig;
+          /// Photometric interpretation.
+          boost::optional<::ome::files::tiff::PhotometricInterpretation> photometric;
+          /// Compression scheme.
+          boost::optional<::ome::files::tiff::Compression> compression;
+          /// Tile or strip count.
+          boost::optional<dimension_size_type> tilecount;
+          /// Decoded tile or strip buffer size.
+          boost::optional<dimension_size_type> buffersize;
+          /// Tile or strip offsets.
+          boost::optional<std::vector<uint64_t>> tileoffsets;
+          /// Tile or strip byte counts.
+          boost::optional<std::vector<uint64_t>> tilebytecounts;
+          /// Tile data may be read directly, bypassing libtiff.
+          bool directread;
+          /// The table is shared between IFD instances (reading).
+          bool shared;
+          /// All tags have been loaded from a read-only directory.
+          std::atomic<bool> loaded;
+
+          /// Constructor.
+          TagTable():
+            tiletype(),
+            imagewidth(),
+            imageheight(),
+            tilewidth(),
+            tileheight(),
+            pixeltype(),
+            bits(),
+            samples(),
+            planarconfig(),
+            photometric(),
+            compression(),
+            tilecount(),
+            buffersize(),
+            tileoffsets(),
+            tilebytecounts(),
+            directread(false),
+            shared(false),
+            loaded(false)
+          {
+          }
+        };
+
+      }
+    }
+  }
+}
+
+#endif // OME_FILES_DETAIL_TIFF_TAGTABLE_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -43,12 +43,16 @@
 #include <ome/files/FormatException.h>
 #include <ome/files/FormatTools.h>
 #include <ome/files/MetadataTools.h>
+#include <ome/files/detail/ReaderState.h>
 #include <ome/files/in/MinimalTIFFReader.h>
+#include <ome/files/tiff/Exception.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/TIFF.h>
 #include <ome/files/tiff/Util.h>
 
 using ome::files::detail::ReaderProperties;
+using ome::files::detail::readState;
+using ome::files::detail::writeState;
 using ome::files::tiff::TIFF;
 using ome::files::tiff::IFD;
 using ome::xml::meta::MetadataStore;
@@ -113,6 +117,67 @@ namespace ome
           }
       }
 
+      std::shared_ptr<::ome::files::detail::FormatReader>
+      MinimalTIFFReader::createReader() const
+      {
+        return std::make_shared<MinimalTIFFReader>();
+      }
+
+      void
+      MinimalTIFFReader::shareView(::ome::files::detail::FormatReader& view) const
+      {
+        ::ome::files::detail::FormatReader::shareView(view);
+
+        // The TIFF handle is shared; IFD access is safe for
+        // concurrent use.
+        MinimalTIFFReader& tiffview(dynamic_cast<MinimalTIFFReader&>(view));
+        tiffview.tiff = tiff;
+        tiffview.seriesIFDRange = seriesIFDRange;
+      }
+
+      void
+      MinimalTIFFReader::saveReaderState(std::ostream& stream) const
+      {
+        writeState(stream, static_cast<uint64_t>(seriesIFDRange.size()));
+        for (const auto& range : seriesIFDRange)
+          {
+            writeState(stream, range.filename);
+            writeState(stream, range.begin);
+            writeState(stream, range.end);
+          }
+
+        // Saving the directory offsets avoids scanning all IFDs when
+        // the TIFF is reopened.
+        writeState(stream, tiff->directoryOffsets());
+      }
+
+      void
+      MinimalTIFFReader::loadReaderState(std::istream& stream)
+      {
+        uint64_t rangeCount;
+        readState(stream, rangeCount);
+        seriesIFDRange.clear();
+        for (uint64_t i = 0; i < rangeCount; ++i)
+          {
+            tiff::IFDRange range;
+            readState(stream, range.filename);
+            readState(stream, range.begin);
+            readState(stream, range.end);
+            seriesIFDRange.push_back(range);
+          }
+
+        std::vector<tiff::offset_type> offsets;
+        readState(stream, offsets);
+        tiff = TIFF::open(*currentId, offsets);
+
+        if (!tiff)
+          {
+            boost::format fmt("Failed to open ‘%1%’");
+            fmt % currentId->string();
+            throw FormatException(fmt.str());
+          }
+      }
+
       bool
       MinimalTIFFReader::isFilenameThisTypeImpl(const boost::filesystem::path& name) const
       {
@@ -179,22 +244,71 @@ namespace ome
       MinimalTIFFReader::readIFDs()
       {
         core.clear();
+        seriesIFDRange.clear();
+
+        // Summarise the structure of all IFDs in a single pass over
+        // the raw IFD entries.  This avoids loading every tag of
+        // every IFD with libtiff only to find that consecutive IFDs
+        // are identical, which is the common case.  The summaries
+        // are only used if they match the IFDs found by libtiff.
+        const std::vector<tiff::offset_type>& offsets(tiff->directoryOffsets());
+        std::vector<tiff::IFDSummary> summaries;
+        try
+          {
+            summaries = tiff::readIFDSummaries(*currentId);
+          }
+        catch (const tiff::Exception&)
+          {
+          }
+        if (summaries.size() == offsets.size())
+          {
+            for (std::vector<tiff::IFDSummary>::size_type i = 0U;
+                 i < summaries.size();
+                 ++i)
+              {
+                if (summaries[i].offset != offsets[i])
+                  {
+                    summaries.clear();
+                    break;
+                  }
+              }
+          }
+        else
+          summaries.clear();
 
-        std::shared_ptr<const tiff::IFD> prev_ifd;
         std::shared_ptr<CoreMetadata> prev_core;
 
-        dimension_size_type current_ifd = 0U;
+        const dimension_size_type ifd_count = tiff->directoryCount();
 
-        for (TIFF::const_iterator i = tiff->begin();
-             i != tiff->end();
-             ++i, ++current_ifd)
+        for (dimension_size_type current_ifd = 0U;
+             current_ifd < ifd_count;
+             ++current_ifd)
           {
             // The minimal TIFF reader makes the assumption that if
             // the pixel data is of the same format as the pixel data
             // in the preceding IFD, then this is a following
             // timepoint in a series.  Otherwise, a new series is
-            // started.
-            if (prev_core && prev_ifd && compare_ifd(*prev_ifd, **i))
+            // started.  Identical summaries imply the same format;
+            // otherwise the IFDs are compared in full, since
+            // differing tag values may still result in the same
+            // format.
+            bool same = false;
+            std::shared_ptr<const tiff::IFD> ifd;
+            if (prev_core)
+              {
+                if (!summaries.empty() &&
+                    tiff::sameStructure(summaries[current_ifd - 1], summaries[current_ifd]))
+                  same = true;
+                else
+                  {
+                    std::shared_ptr<const tiff::IFD> prev_ifd
+                      (tiff->getDirectoryByIndex(static_cast<tiff::directory_index_type>(current_ifd - 1)));
+                    ifd = tiff->getDirectoryByIndex(static_cast<tiff::directory_index_type>(current_ifd));
+                    same = compare_ifd(*prev_ifd, *ifd);
+                  }
+              }
+
+            if (same)
               {
                 ++prev_core->sizeT;
                 prev_core->imageCount = prev_core->sizeT;
@@ -202,7 +316,9 @@ namespace ome
               }
             else
               {
-                prev_core = makeCoreMetadata(**i);
+                if (!ifd)
+                  ifd = tiff->getDirectoryByIndex(static_cast<tiff::directory_index_type>(current_ifd));
+                prev_core = makeCoreMetadata(*ifd);
                 core.push_back(prev_core);
 
                 tiff::IFDRange range;
@@ -212,7 +328,6 @@ namespace ome
 
                 seriesIFDRange.push_back(range);
               }
-            prev_ifd = *i;
           }
       }
 
@@ -251,6 +366,23 @@ namespace ome
         ifd->readImage(buf, x, y, w, h);
       }
 
+      void
+      MinimalTIFFReader::openBytesScheduledImpl(dimension_size_type      plane,
+                                                VariantPixelBuffer&      buf,
+                                                dimension_size_type      x,
+                                                dimension_size_type      y,
+                                                dimension_size_type      w,
+                                                dimension_size_type      h,
+                                                const TileSchedule&      schedule,
+                                                const CancellationToken& token) const
+      {
+        assertId(currentId, true);
+
+        const std::shared_ptr<const IFD>& ifd(ifdAtIndex(plane));
+
+        ifd->readImage(buf, x, y, w, h, schedule, token);
+      }
+
       std::shared_ptr<ome::files::tiff::TIFF>
       MinimalTIFFReader::getTIFF()
       {
@@ -95,6 +95,22 @@ namespace ome
         void
         initFile(const boost::filesystem::path& id);
 
+        // Documented in superclass.
+        std::shared_ptr<::ome::files::detail::FormatReader>
+        createReader() const;
+
+        // Documented in superclass.
+        void
+        shareView(::ome::files::detail::FormatReader& view) const;
+
+        // Documented in superclass.
+        void
+        saveReaderState(std::ostream& stream) const;
+
+        // Documented in superclass.
+        void
+        loadReaderState(std::istream& stream);
+
         /**
          * Read metadata from IFDs.
          */
@@ -113,6 +129,7 @@ namespace ome
          * @returns the IFD index.
          * @throws FormatException if out of range.
          */
+        virtual
         const std::shared_ptr<const tiff::IFD>
         ifdAtIndex(dimension_size_type plane) const;
 
@@ -136,6 +153,17 @@ namespace ome
                       dimension_size_type w,
                       dimension_size_type h) const;
 
+        // Documented in superclass.
+        void
+        openBytesScheduledImpl(dimension_size_type      plane,
+                               VariantPixelBuffer&      buf,
+                               dimension_size_type      x,
+                               dimension_size_type      y,
+                               dimension_size_type      w,
+                               dimension_size_type      h,
+                               const TileSchedule&      schedule,
+                               const CancellationToken& token) const;
+
       public:
         /**
          * Get open TIFF file.
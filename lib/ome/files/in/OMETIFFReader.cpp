@@ -38,7 +38,10 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <mutex>
 #include <set>
+#include <typeinfo>
+#include <vector>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -49,12 +52,15 @@
 #include <ome/files/FormatException.h>
 #include <ome/files/FormatTools.h>
 #include <ome/files/MetadataTools.h>
+#include <ome/files/OMEXMLMetadataCache.h>
 #include <ome/files/detail/OMETIFF.h>
+#include <ome/files/detail/ReaderState.h>
 #include <ome/files/in/OMETIFFReader.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/TIFF.h>
 #include <ome/files/tiff/Tags.h>
 #include <ome/files/tiff/Field.h>
+#include <ome/files/tiff/Util.h>
 
 #include <ome/xml/meta/OMEXMLMetadata.h>
 #include <ome/xml/meta/BaseMetadata.h>
@@ -65,6 +71,8 @@ using boost::filesystem::path;
 using ome::common::canonical;
 
 using ome::files::detail::ReaderProperties;
+using ome::files::detail::readState;
+using ome::files::detail::writeState;
 using ome::files::tiff::TIFF;
 using ome::files::tiff::IFD;
 
@@ -139,7 +147,48 @@ namespace ome
             }
         }
 
+        std::string
+        getImageDescription(const path& id)
+        {
+          try
+            {
+              return tiff::readImageDescription(id);
+            }
+          catch (const tiff::Exception&)
+            {
+              throw FormatException("No TIFF ImageDescription found");
+            }
+        }
+
+        // Length of ImageDescription to check when detecting type.
+        const dimension_size_type DESCRIPTION_PREFIX_SIZE = 64U * 1024U;
+
+        /*
+         * Check if a file has OME-XML in its ImageDescription.
+         *
+         * Only the start of the description is read and checked for
+         * the OME namespace; this is intended to cheaply reject
+         * files before parsing the full document.
+         */
+        bool
+        hasOMEXMLDescription(const path& id)
+        {
+          try
+            {
+              std::string prefix(tiff::readImageDescription(id, DESCRIPTION_PREFIX_SIZE));
+              return (!prefix.empty() &&
+                      prefix[0] == '<' &&
+                      prefix.find("openmicroscopy.org/Schemas/OME/") != std::string::npos);
+            }
+          catch (const tiff::Exception&)
+            {
+              return false;
+            }
+        }
+
         typedef ome::files::detail::OMETIFFPlane OMETIFFPlane;
+        typedef ome::files::detail::OMETIFFFileTable OMETIFFFileTable;
+        typedef ome::files::detail::OMETIFFPlaneTable OMETIFFPlaneTable;
 
         /// OME-TIFF-specific core metadata.
         class OMETIFFMetadata : public CoreMetadata
@@ -150,7 +199,7 @@ namespace ome
           /// Tile width.
           std::vector<dimension_size_type> tileHeight;
           /// Per-plane data.
-          std::vector<OMETIFFPlane> tiffPlanes;
+          OMETIFFPlaneTable tiffPlanes;
 
           OMETIFFMetadata():
             CoreMetadata(),
@@ -159,6 +208,21 @@ namespace ome
             tiffPlanes()
           {}
 
+          OMETIFFMetadata(std::shared_ptr<OMETIFFFileTable> files):
+            CoreMetadata(),
+            tileWidth(),
+            tileHeight(),
+            tiffPlanes(files)
+          {}
+
+          OMETIFFMetadata(const CoreMetadata&               copy,
+                          std::shared_ptr<OMETIFFFileTable> files):
+            CoreMetadata(copy),
+            tileWidth(),
+            tileHeight(),
+            tiffPlanes(files)
+          {}
+
           OMETIFFMetadata(const OMETIFFMetadata& copy):
             CoreMetadata(copy),
             tileWidth(copy.tileWidth),
@@ -170,17 +234,60 @@ namespace ome
 
       }
 
+      /// Deferred series initialisation state.
+      struct OMETIFFReader::SeriesInit
+      {
+        /// Lock for series initialisation (shared by reader views).
+        std::mutex mutex;
+        /// Metadata from which to initialise each series.
+        std::shared_ptr<const ::ome::xml::meta::OMEXMLMetadata> meta;
+        /// Series which have been initialised.
+        std::vector<bool> ready;
+
+        /// File referenced by a TiffData element.
+        struct TiffDataFile
+        {
+          /// Index of the file in the file table.
+          OMETIFFFileTable::index_type file;
+          /// File exists (TIFF validity is checked on first use).
+          bool exists;
+        };
+
+        /// Files referenced by each series and TiffData element.
+        std::vector<std::vector<TiffDataFile>> tiffData;
+        /// Index of the current file in the file table.
+        OMETIFFFileTable::index_type currentFile;
+
+        /**
+         * Constructor.
+         *
+         * @param meta the metadata from which to initialise each series.
+         * @param seriesCount the number of series.
+         */
+        SeriesInit(std::shared_ptr<const ::ome::xml::meta::OMEXMLMetadata> meta,
+                   dimension_size_type                                     seriesCount):
+          mutex(),
+          meta(meta),
+          ready(seriesCount, false),
+          tiffData(seriesCount),
+          currentFile(0U)
+        {
+        }
+      };
+
       OMETIFFReader::OMETIFFReader():
         detail::FormatReader(props),
         logger(ome::common::createLogger("OMETIFFReader")),
         files(),
         invalidFiles(),
         tiffs(),
+        tiffOffsets(),
         metadataFile(),
         usedFiles(),
         hasSPW(false),
         cachedMetadata(),
-        cachedMetadataFile()
+        cachedMetadataFile(),
+        seriesInit()
       {
         this->suffixNecessary = false;
         this->suffixSufficient = false;
@@ -200,6 +307,167 @@ namespace ome
           }
       }
 
+      std::shared_ptr<detail::FormatReader>
+      OMETIFFReader::createReader() const
+      {
+        return std::make_shared<OMETIFFReader>();
+      }
+
+      void
+      OMETIFFReader::shareView(detail::FormatReader& view) const
+      {
+        detail::FormatReader::shareView(view);
+
+        // Open TIFF handles are shared; any opened subsequently are
+        // private to the reader which opened them.  The cached
+        // metadata is cleaned before caching and is not modified
+        // thereafter.
+        OMETIFFReader& omeview(dynamic_cast<OMETIFFReader&>(view));
+        omeview.files = files;
+        omeview.invalidFiles = invalidFiles;
+        omeview.tiffs = tiffs;
+        omeview.tiffOffsets = tiffOffsets;
+        omeview.metadataFile = metadataFile;
+        omeview.usedFiles = usedFiles;
+        omeview.hasSPW = hasSPW;
+        omeview.cachedMetadata = cachedMetadata;
+        omeview.cachedMetadataFile = cachedMetadataFile;
+        omeview.seriesInit = seriesInit;
+      }
+
+      void
+      OMETIFFReader::saveReaderState(std::ostream& stream) const
+      {
+        writeState(stream, static_cast<uint64_t>(files.size()));
+        for (const auto& file : files)
+          {
+            writeState(stream, file.first);
+            writeState(stream, file.second);
+          }
+        writeState(stream, metadataFile);
+        writeState(stream, usedFiles);
+        writeState(stream, hasSPW);
+
+        // Directory offsets of all TIFFs opened during
+        // initialisation.
+        writeState(stream, static_cast<uint64_t>(tiffs.size()));
+        for (const auto& entry : tiffs)
+          {
+            boost::optional<std::vector<tiff::offset_type>> offsets;
+            if (entry.second)
+              offsets = entry.second->directoryOffsets();
+            else
+              {
+                tiff_offset_map::const_iterator known = tiffOffsets.find(entry.first);
+                if (known != tiffOffsets.end())
+                  offsets = known->second;
+              }
+            writeState(stream, entry.first);
+            writeState(stream, offsets);
+          }
+
+        // All series share the same file table (see initFile).
+        if (core.empty())
+          writeState(stream, uint64_t(0U));
+        else
+          {
+            const OMETIFFFileTable& planeFiles(dynamic_cast<const OMETIFFMetadata&>(getCoreMetadata(0)).tiffPlanes.files());
+            writeState(stream, static_cast<uint64_t>(planeFiles.size()));
+            for (OMETIFFFileTable::index_type i = 0; i < planeFiles.size(); ++i)
+              writeState(stream, planeFiles.at(i));
+          }
+
+        for (const auto& cm : core)
+          {
+            const OMETIFFMetadata& ometa(dynamic_cast<const OMETIFFMetadata&>(*cm));
+            const OMETIFFPlaneTable& planes(ometa.tiffPlanes);
+
+            writeState(stream, ometa.tileWidth);
+            writeState(stream, ometa.tileHeight);
+            writeState(stream, static_cast<uint64_t>(planes.size()));
+            for (dimension_size_type plane = 0; plane < planes.size(); ++plane)
+              {
+                writeState(stream, planes.fileId(plane));
+                writeState(stream, static_cast<OMETIFFPlaneTable::ifd_index_type>(planes.ifd(plane)));
+                writeState(stream, planes.certain(plane));
+                writeState(stream, static_cast<uint8_t>(planes.status(plane)));
+              }
+          }
+      }
+
+      void
+      OMETIFFReader::loadReaderState(std::istream& stream)
+      {
+        uint64_t count;
+
+        readState(stream, count);
+        for (uint64_t i = 0; i < count; ++i)
+          {
+            std::string uuid;
+            path file;
+            readState(stream, uuid);
+            readState(stream, file);
+            files.insert(std::make_pair(uuid, file));
+          }
+        readState(stream, metadataFile);
+        readState(stream, usedFiles);
+        readState(stream, hasSPW);
+
+        // TIFFs are opened on first use, using the saved offsets.
+        readState(stream, count);
+        for (uint64_t i = 0; i < count; ++i)
+          {
+            path file;
+            boost::optional<std::vector<tiff::offset_type>> offsets;
+            readState(stream, file);
+            readState(stream, offsets);
+            addTIFF(file);
+            if (offsets)
+              tiffOffsets.insert(std::make_pair(file, *offsets));
+          }
+
+        std::shared_ptr<OMETIFFFileTable> planeFiles(std::make_shared<OMETIFFFileTable>());
+        readState(stream, count);
+        for (uint64_t i = 0; i < count; ++i)
+          {
+            path file;
+            readState(stream, file);
+            planeFiles->intern(file);
+          }
+
+        // Replace the restored core metadata with OME-TIFF core
+        // metadata.  All series are already initialised, so
+        // seriesInit is unset.
+        for (auto& cm : core)
+          {
+            std::shared_ptr<OMETIFFMetadata> ometa(std::make_shared<OMETIFFMetadata>(*cm, planeFiles));
+            OMETIFFPlaneTable& planes(ometa->tiffPlanes);
+
+            readState(stream, ometa->tileWidth);
+            readState(stream, ometa->tileHeight);
+            readState(stream, count);
+            planes.resize(count);
+            for (dimension_size_type plane = 0; plane < planes.size(); ++plane)
+              {
+                OMETIFFPlaneTable::file_index_type file;
+                OMETIFFPlaneTable::ifd_index_type ifd;
+                bool certain;
+                uint8_t status;
+                readState(stream, file);
+                readState(stream, ifd);
+                readState(stream, certain);
+                readState(stream, status);
+
+                if (file != OMETIFFPlaneTable::file_index_type(OMETIFFPlaneTable::nofile))
+                  planes.set(plane, planeFiles->at(file), ifd);
+                planes.setCertain(plane, certain);
+                planes.setStatus(plane, static_cast<OMETIFFPlane::Status>(status));
+              }
+
+            cm = ometa;
+          }
+      }
+
       void
       OMETIFFReader::close(bool fileOnly)
       {
@@ -212,6 +480,8 @@ namespace ome
             hasSPW = false;
             usedFiles.clear();
             metadataFile.clear();
+            seriesInit.reset();
+            tiffOffsets.clear();
           }
         tiffs.clear(); // Closes all open TIFFs.
 
@@ -242,16 +512,8 @@ namespace ome
                 nImages += static_cast<dimension_size_type>(z) * static_cast<dimension_size_type>(t) * nChannels;
               }
 
-            std::shared_ptr<tiff::TIFF> tiff = TIFF::open(id, "r");
-
-            if (!tiff)
-              {
-                boost::format fmt("Failed to open ‘%1%’");
-                fmt % id.string();
-                throw FormatException(fmt.str());
-              }
-
-            dimension_size_type nIFD = tiff->directoryCount();
+            // Only count as many IFDs as needed to hold all planes.
+            dimension_size_type nIFD = nImages ? tiff::countDirectories(id, nImages) : 0U;
 
             return nImages > 0 && nImages <= nIFD;
           }
@@ -274,6 +536,10 @@ namespace ome
       bool
       OMETIFFReader::isFilenameThisTypeImpl(const boost::filesystem::path& name) const
       {
+        // Reject files without OME-XML before parsing the document.
+        if (!hasOMEXMLDescription(name))
+          return false;
+
         bool valid = true;
         try
           {
@@ -333,10 +599,10 @@ namespace ome
 
         if (plane < ometa.tiffPlanes.size())
           {
-            const OMETIFFPlane& tiffplane(ometa.tiffPlanes.at(plane));
-            const std::shared_ptr<const TIFF> tiff(getTIFF(tiffplane.id));
+            const OMETIFFPlaneTable& tiffplanes(ometa.tiffPlanes);
+            const std::shared_ptr<const TIFF> tiff(getTIFF(tiffplanes.file(plane)));
             if (tiff)
-              ifd = std::shared_ptr<const IFD>(tiff->getDirectoryByIndex(tiffplane.ifd));
+              ifd = std::shared_ptr<const IFD>(tiff->getDirectoryByIndex(tiffplanes.ifd(plane)));
           }
 
         if (!ifd)
@@ -370,10 +636,19 @@ namespace ome
 
             const OMETIFFMetadata& ometa(dynamic_cast<const OMETIFFMetadata&>(getCoreMetadata(getCoreIndex())));
 
-            for(const auto& plane : ometa.tiffPlanes)
+            const OMETIFFPlaneTable& tiffplanes(ometa.tiffPlanes);
+            // Insert each distinct file once.
+            std::vector<bool> seen(tiffplanes.files().size(), false);
+            for (dimension_size_type plane = 0; plane < tiffplanes.size(); ++plane)
               {
-                if (!plane.id.empty())
-                  fileSet.insert(plane.id);
+                if (!tiffplanes.hasFile(plane))
+                  continue;
+                OMETIFFPlaneTable::file_index_type idx(tiffplanes.fileId(plane));
+                if (!seen.at(idx))
+                  {
+                    seen.at(idx) = true;
+                    fileSet.insert(tiffplanes.files().at(idx));
+                  }
               }
           }
 
@@ -417,6 +692,50 @@ namespace ome
         return ometa.tileHeight.at(channel);
       }
 
+      void
+      OMETIFFReader::setSeries(dimension_size_type series) const
+      {
+        initSeries(seriesToCoreIndex(series));
+        detail::FormatReader::setSeries(series);
+      }
+
+      void
+      OMETIFFReader::setCoreIndex(dimension_size_type index) const
+      {
+        if (index < core.size())
+          initSeries(index);
+        detail::FormatReader::setCoreIndex(index);
+      }
+
+      const std::vector<std::shared_ptr<::ome::files::CoreMetadata>>&
+      OMETIFFReader::getCoreMetadataList() const
+      {
+        assertId(currentId, true);
+
+        for (dimension_size_type i = 0; i < core.size(); ++i)
+          initSeries(i);
+
+        return detail::FormatReader::getCoreMetadataList();
+      }
+
+      const std::shared_ptr<::ome::xml::meta::MetadataStore>&
+      OMETIFFReader::getMetadataStore() const
+      {
+        for (dimension_size_type i = 0; i < core.size(); ++i)
+          initSeries(i);
+
+        return detail::FormatReader::getMetadataStore();
+      }
+
+      std::shared_ptr<::ome::xml::meta::MetadataStore>&
+      OMETIFFReader::getMetadataStore()
+      {
+        for (dimension_size_type i = 0; i < core.size(); ++i)
+          initSeries(i);
+
+        return detail::FormatReader::getMetadataStore();
+      }
+
       void
       OMETIFFReader::initFile(const boost::filesystem::path& id)
       {
@@ -449,7 +768,12 @@ namespace ome
           {
             metadataFile = canonical(path(meta->getBinaryOnlyMetadataFile()), dir);
             if (!metadataFile.empty() && boost::filesystem::exists(metadataFile))
-              meta = readMetadata(metadataFile);
+              {
+                meta = readMetadata(metadataFile);
+                // Clean up any invalid metadata (cacheMetadata
+                // returns metadata which is already clean).
+                cleanMetadata(*meta);
+              }
           }
         catch (const std::exception&)
           {
@@ -466,9 +790,6 @@ namespace ome
           {
           }
 
-        // Clean up any invalid metadata.
-        cleanMetadata(*meta);
-
         // Retrieve original metadata.
         metadata = getOriginalMetadata(*meta);
 
@@ -497,560 +818,508 @@ namespace ome
         index_type seriesCount = meta->getImageCount();
         core.clear();
         core.reserve(seriesCount);
+        // Files referenced by TiffData are shared by all series.
+        std::shared_ptr<OMETIFFFileTable> planeFiles(std::make_shared<OMETIFFFileTable>());
         for (index_type i = 0; i < seriesCount; ++i)
-          core.push_back(std::make_shared<OMETIFFMetadata>());
+          core.push_back(std::make_shared<OMETIFFMetadata>(planeFiles));
 
         // UUID → file mapping and used files.
         findUsedFiles(*meta, *currentId, dir, currentUUID);
 
-        // Process TiffData elements.
+        // Series core metadata and plane maps are filled on first
+        // use by initSeries(); only the first series is initialised
+        // here.  The files for all series are resolved now, so that
+        // the file table is not modified after initialisation.
+        seriesInit = std::make_shared<SeriesInit>(meta, seriesCount);
+        resolveTiffDataFiles(*meta, *planeFiles);
         for (index_type series = 0; series < seriesCount; ++series)
-          {
-            std::shared_ptr<OMETIFFMetadata> coreMeta(std::dynamic_pointer_cast<OMETIFFMetadata>(core.at(series)));
-            assert(coreMeta); // Should never be null.
-
-            BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-              << "Image[" << series << "] {";
-            BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-              << "  id = " << meta->getImageID(series);
-
-            DimensionOrder order(meta->getPixelsDimensionOrder(series));
+          setDefaultCreationDate(*metadataStore, series, *currentId);
+        if (seriesCount)
+          initSeries(0);
 
-            dimension_size_type channelCount = meta->getChannelCount(series);
-            if (meta->getChannelCount(series) > 0)
+        seriesCount = meta->getImageCount();
+        for (index_type series = 0; series < seriesCount; ++series)
+          {
+            index_type planeCount = meta->getPlaneCount(series);
+            for (index_type plane = 0; plane < planeCount; ++plane)
               {
-                coreMeta->sizeC.clear();
-                for (dimension_size_type channel = 0; channel < channelCount; ++channel)
+                // Make sure that TheZ, TheT and TheC are all set on
+                // any existing Planes.  Missing Planes are not added,
+                // and existing TheZ, TheC, and TheT values are not
+                // changed.
+                try
                   {
-                    dimension_size_type samplesPerPixel = 1U;
-                    try
-                      {
-                        samplesPerPixel = static_cast<dimension_size_type>(meta->getChannelSamplesPerPixel(series, 0));
-                      }
-                    catch (const std::exception&)
-                      {
-                      }
-                    coreMeta->sizeC.push_back(samplesPerPixel);
+                    meta->getPlaneTheZ(series, plane);
                   }
-                // At this stage, assume that the OME-XML
-                // channel/samples per pixel data is correct; we'll
-                // check this matches reality below.
-              }
-            else // No Channels specified
-              {
-                dimension_size_type channels = meta->getPixelsSizeC(series);
-                coreMeta->sizeC.clear();
-                for (dimension_size_type channel = 0; channel < channels; ++channel)
-                  coreMeta->sizeC.push_back(1U);
-              }
-
-            PositiveInteger effSizeC = coreMeta->sizeC.size();
-            PositiveInteger sizeT = meta->getPixelsSizeT(series);
-            PositiveInteger sizeZ = meta->getPixelsSizeZ(series);
-            PositiveInteger num = effSizeC * sizeT * sizeZ;
-
-            coreMeta->tiffPlanes.resize(num);
-            index_type tiffDataCount = meta->getTiffDataCount(series);
-            boost::optional<NonNegativeInteger> zIndexStart;
-            boost::optional<NonNegativeInteger> tIndexStart;
-            boost::optional<NonNegativeInteger> cIndexStart;
-
-            seriesIndexStart(*meta, series,
-                             zIndexStart, tIndexStart, cIndexStart);
-
-            for (index_type td = 0; td < tiffDataCount; ++td)
-              {
-                BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                  << "  TiffData[" << td << "] {";
-
-                boost::optional<NonNegativeInteger> tdIFD;
-                NonNegativeInteger numPlanes = 0;
-                NonNegativeInteger firstZ = 0;
-                NonNegativeInteger firstT = 0;
-                NonNegativeInteger firstC = 0;
-
-                if (!getTiffDataValues(*meta, series, td,
-                                       tdIFD, numPlanes,
-                                       firstZ, firstT, firstC))
-                  break;
-
-                // Note: some writers index FirstC, FirstZ, and FirstT from 1.
-                // Subtract index start to correct for this.
-                if (cIndexStart && firstC >= *cIndexStart)
-                  firstC -= *cIndexStart;
-                if (zIndexStart && firstZ >= *zIndexStart)
-                  firstZ -= *zIndexStart;
-                if (tIndexStart && firstT >= *tIndexStart)
-                  firstT -= *tIndexStart;
-
-                if (firstZ >= static_cast<PositiveInteger::value_type>(sizeZ) ||
-                    firstC >= static_cast<PositiveInteger::value_type>(effSizeC) ||
-                    firstT >= static_cast<PositiveInteger::value_type>(sizeT))
+                catch (const std::exception&)
                   {
-                    boost::format fmt("Found invalid TiffData: Z=%1%, C=%2%, T=%3%");
-                    fmt % firstZ % firstC % firstT;
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
-
-                    break;
+                    metadataStore->setPlaneTheZ(0, series, plane);
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                      << "Setting unset Plane TheZ value to 0";
                   }
 
-                dimension_size_type index = ome::files::getIndex(order,
-                                                                      sizeZ, effSizeC, sizeT,
-                                                                      num,
-                                                                      firstZ, firstC, firstT);
-
-                // get reader object for this filename.
-                boost::optional<path> filename;
-                boost::optional<std::string> uuid;
                 try
                   {
-                    filename = path(meta->getUUIDFileName(series, td));
+                    meta->getPlaneTheT(series, plane);
                   }
                 catch (const std::exception&)
                   {
+                    metadataStore->setPlaneTheT(0, series, plane);
                     BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Ignoring null UUID object when retrieving filename";
+                      << "Setting unset Plane TheT value to 0";
                   }
+
                 try
                   {
-                    uuid = meta->getUUIDValue(series, td);
+                    meta->getPlaneTheC(series, plane);
                   }
                 catch (const std::exception&)
                   {
+                    metadataStore->setPlaneTheC(0, series, plane);
                     BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Ignoring null UUID object when retrieving value";
+                      << "Setting unset Plane TheC value to 0";
                   }
+              }
+          }
 
-                if (!filename)
+        for (std::vector<boost::optional<Timestamp>>::const_iterator ts = acquiredDates.begin();
+             ts != acquiredDates.end();
+             ++ts)
+          {
+            index_type series = std::distance<std::vector<boost::optional<Timestamp>>::const_iterator>(acquiredDates.begin(), ts);
+            if (*ts)
+              {
+                try
                   {
-                    if (!uuid)
-                      {
-                        filename = *currentId;
-                      }
-                    else
-                      {
-                        std::map<std::string, path>::const_iterator i(files.find(*uuid));
-                        if (i != files.end())
-                          filename = i->second;
-                      }
+                    metadataStore->setImageAcquisitionDate(**ts, series);
                   }
-                else
+                catch (const std::exception& e)
                   {
-                    // All the other cases will already have a canonical path.
-                    if (fs::exists(dir / *filename))
-                      filename = canonical(dir / *filename, dir);
-                    else
-                      {
-                        invalid_file_map::const_iterator invalid = invalidFiles.find(*filename);
-                        if (invalid != invalidFiles.end())
-                          {
-                            filename = invalid->second;
-                          }
-                        else
-                          {
-                            boost::format fmt("UUID filename %1% not found; falling back to %2%");
-                            fmt % *filename % *currentId;
-                            BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+                    boost::format fmt("Failed to set Image AcquisitionDate for series %1%: %2%");
+                    fmt % series % e.what();
 
-                            invalidFiles.insert(invalid_file_map::value_type(*filename, *currentId));
-                            filename = *currentId;
-                          }
-                      }
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
                   }
+              }
+          }
 
-                addTIFF(*filename);
+        // Set the metadata store Pixels.BigEndian attribute to match
+        // the values we set in the core metadata
+        try
+          {
+            std::shared_ptr<ome::xml::meta::MetadataRetrieve> metadataRetrieve
+              (std::dynamic_pointer_cast<ome::xml::meta::MetadataRetrieve>(metadataStore));
 
-                bool exists = true;
-                if (!fs::exists(*filename))
-                  {
-                    // If an absolute filename, try using a relative
-                    // name.  Old versions of the Java OMETiffWriter
-                    // wrote an absolute path to UUID.FileName, which
-                    // causes problems if the file is moved to a
-                    // different directory.
-                    path relative(dir / (*filename).filename());
-                    if (fs::exists(relative))
-                      {
-                        filename = relative;
-                      }
-                    else
-                      {
-                        filename = *currentId;
-                        exists = usedFiles.size() == 1;
-                      }
-                  }
-                if (exists) // check it's really a valid TIFF
-                  exists = validTIFF(*filename);
+            for (index_type i = 0; i < metadataRetrieve->getImageCount(); ++i)
+              {
+#ifdef BOOST_BIG_ENDIAN
+                metadataStore->setPixelsBigEndian(1, i);
+#else // Little endian
+                metadataStore->setPixelsBigEndian(0, i);
+#endif
+              }
+          }
+        catch(const std::exception&)
+          {
+            // The metadata store doesn't support getImageCount so we
+            // can't meaningfully set anything.
+          }
+      }
 
-                // Fill plane index → IFD mapping
-                for (dimension_size_type q = 0;
-                     q < static_cast<dimension_size_type>(numPlanes);
-                     ++q)
-                  {
-                    dimension_size_type no = index + q;
-                    OMETIFFPlane& plane(coreMeta->tiffPlanes.at(no));
-                    plane.id = *filename;
-                    plane.ifd = static_cast<dimension_size_type>(*tdIFD) + q;
-                    plane.certain = true;
-                    plane.status = exists ? OMETIFFPlane::PRESENT : OMETIFFPlane::ABSENT;
+      void
+      OMETIFFReader::initSeries(dimension_size_type series) const
+      {
+        if (!seriesInit)
+          return;
 
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                      << "    Plane[" << no
-                      << "]: file=" << plane.id.string()
-                      << ", IFD=" << plane.ifd;
+        std::lock_guard<std::mutex> lock(seriesInit->mutex);
+        if (seriesInit->ready.at(series))
+          return;
+
+        const ome::xml::meta::OMEXMLMetadata& meta(*seriesInit->meta);
+
+        std::shared_ptr<OMETIFFMetadata> coreMeta(std::dynamic_pointer_cast<OMETIFFMetadata>(core.at(series)));
+        assert(coreMeta); // Should never be null.
+
+        // Discard any state from a previous failed attempt.
+        coreMeta->tileWidth.clear();
+        coreMeta->tileHeight.clear();
+        coreMeta->tiffPlanes.clear();
+
+        BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+          << "Image[" << series << "] {";
+        BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+          << "  id = " << meta.getImageID(series);
+
+        DimensionOrder order(meta.getPixelsDimensionOrder(series));
+
+        dimension_size_type channelCount = meta.getChannelCount(series);
+        if (meta.getChannelCount(series) > 0)
+          {
+            coreMeta->sizeC.clear();
+            for (dimension_size_type channel = 0; channel < channelCount; ++channel)
+              {
+                dimension_size_type samplesPerPixel = 1U;
+                try
+                  {
+                    samplesPerPixel = static_cast<dimension_size_type>(meta.getChannelSamplesPerPixel(series, 0));
                   }
-                if (numPlanes == 0)
+                catch (const std::exception&)
                   {
-                    // Unknown number of planes (default value); fill down
-                    for (dimension_size_type no = index + 1;
-                         no < static_cast<dimension_size_type>(num);
-                         ++no)
-                      {
-                        OMETIFFPlane& plane(coreMeta->tiffPlanes.at(no));
-                        if (plane.certain)
-                          break;
-                        OMETIFFPlane& previousPlane(coreMeta->tiffPlanes.at(no - 1));
-                        plane.id = *filename;
-                        plane.ifd = previousPlane.ifd + 1;
-                        plane.status = exists ? OMETIFFPlane::PRESENT : OMETIFFPlane::ABSENT;
-
-                        BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                          << "    Plane[" << no
-                          << "]: FILLED";
-                      }
                   }
-                BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                  << "  }";
+                coreMeta->sizeC.push_back(samplesPerPixel);
               }
+            // At this stage, assume that the OME-XML
+            // channel/samples per pixel data is correct; we'll
+            // check this matches reality below.
+          }
+        else // No Channels specified
+          {
+            dimension_size_type channels = meta.getPixelsSizeC(series);
+            coreMeta->sizeC.clear();
+            for (dimension_size_type channel = 0; channel < channels; ++channel)
+              coreMeta->sizeC.push_back(1U);
+          }
 
-            // Clear any unset planes.
-            for (std::vector<OMETIFFPlane>::iterator plane = coreMeta->tiffPlanes.begin();
-                 plane != coreMeta->tiffPlanes.end();
-                 ++plane)
-              {
-                if (plane->status != OMETIFFPlane::UNKNOWN)
-                  continue;
-                plane->id.clear();
-                plane->ifd = 0;
+        PositiveInteger effSizeC = coreMeta->sizeC.size();
+        PositiveInteger sizeT = meta.getPixelsSizeT(series);
+        PositiveInteger sizeZ = meta.getPixelsSizeZ(series);
+        PositiveInteger num = effSizeC * sizeT * sizeZ;
 
-                BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                  << "    Plane[" << plane - coreMeta->tiffPlanes.begin()
-                  << "]: CLEARED";
+        coreMeta->tiffPlanes.resize(num);
+        index_type tiffDataCount = meta.getTiffDataCount(series);
+        boost::optional<NonNegativeInteger> zIndexStart;
+        boost::optional<NonNegativeInteger> tIndexStart;
+        boost::optional<NonNegativeInteger> cIndexStart;
+
+        seriesIndexStart(meta, series,
+                         zIndexStart, tIndexStart, cIndexStart);
+
+        for (index_type td = 0; td < tiffDataCount; ++td)
+          {
+            BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+              << "  TiffData[" << td << "] {";
+
+            boost::optional<NonNegativeInteger> tdIFD;
+            NonNegativeInteger numPlanes = 0;
+            NonNegativeInteger firstZ = 0;
+            NonNegativeInteger firstT = 0;
+            NonNegativeInteger firstC = 0;
+
+            if (!getTiffDataValues(meta, series, td,
+                                   tdIFD, numPlanes,
+                                   firstZ, firstT, firstC))
+              {
+                boost::format fmt("Invalid TiffData for series %1%: PlaneCount is zero");
+                fmt % series;
+                throw FormatException(fmt.str());
               }
 
-            if (!core.at(series))
-              continue;
+            // Note: some writers index FirstC, FirstZ, and FirstT from 1.
+            // Subtract index start to correct for this.
+            if (cIndexStart && firstC >= *cIndexStart)
+              firstC -= *cIndexStart;
+            if (zIndexStart && firstZ >= *zIndexStart)
+              firstZ -= *zIndexStart;
+            if (tIndexStart && firstT >= *tIndexStart)
+              firstT -= *tIndexStart;
+
+            if (firstZ >= static_cast<PositiveInteger::value_type>(sizeZ) ||
+                firstC >= static_cast<PositiveInteger::value_type>(effSizeC) ||
+                firstT >= static_cast<PositiveInteger::value_type>(sizeT))
+              {
+                boost::format fmt("Found invalid TiffData: Z=%1%, C=%2%, T=%3%");
+                fmt % firstZ % firstC % firstT;
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+
+                break;
+              }
 
-            // Verify all planes are available.
-            for (dimension_size_type no = 0;
-                 no < static_cast<dimension_size_type>(num);
-                 ++no)
+            dimension_size_type index = ome::files::getIndex(order,
+                                                                  sizeZ, effSizeC, sizeT,
+                                                                  num,
+                                                                  firstZ, firstC, firstT);
+
+            // File resolved by resolveTiffDataFiles().
+            const SeriesInit::TiffDataFile& tdFile(seriesInit->tiffData.at(series).at(td));
+            const path& filename(coreMeta->tiffPlanes.files().at(tdFile.file));
+            bool exists = tdFile.exists;
+            if (exists) // check it's really a valid TIFF
+              exists = validTIFF(filename);
+
+            // Fill plane index → IFD mapping
+            for (dimension_size_type q = 0;
+                 q < static_cast<dimension_size_type>(numPlanes);
+                 ++q)
               {
-                OMETIFFPlane& plane(coreMeta->tiffPlanes.at(no));
+                dimension_size_type no = index + q;
+                OMETIFFPlaneTable& planes(coreMeta->tiffPlanes);
+                planes.set(no, tdFile.file, static_cast<dimension_size_type>(*tdIFD) + q);
+                planes.setCertain(no, true);
+                planes.setStatus(no, exists ? OMETIFFPlane::PRESENT : OMETIFFPlane::ABSENT);
 
                 BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-                  << "  Verify Plane[" << no
-                  << "]: file=" << plane.id.string()
-                  << ", IFD=" << plane.ifd;
-
-                if (plane.id.empty())
+                  << "    Plane[" << no
+                  << "]: file=" << planes.file(no).string()
+                  << ", IFD=" << planes.ifd(no);
+              }
+            if (numPlanes == 0)
+              {
+                // Unknown number of planes (default value); fill down
+                for (dimension_size_type no = index + 1;
+                     no < static_cast<dimension_size_type>(num);
+                     ++no)
                   {
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Image ID: " << meta->getImageID(series)
-                      << " missing plane #" << no;
-
-                    // Fallback if broken.
-                    dimension_size_type nIFD = tiff->directoryCount();
+                    OMETIFFPlaneTable& planes(coreMeta->tiffPlanes);
+                    if (planes.certain(no))
+                      break;
+                    planes.set(no, tdFile.file, planes.ifd(no - 1) + 1);
+                    planes.setStatus(no, exists ? OMETIFFPlane::PRESENT : OMETIFFPlane::ABSENT);
 
-                    coreMeta->tiffPlanes.clear();
-                    coreMeta->tiffPlanes.resize(nIFD);
-                    for (dimension_size_type p = 0; p < nIFD; ++p)
-                      {
-                        OMETIFFPlane& plane(coreMeta->tiffPlanes.at(p));
-                        plane.id = *currentId;
-                        plane.ifd = p;
-                      }
-                    break;
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+                      << "    Plane[" << no
+                      << "]: FILLED";
                   }
               }
+            BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+              << "  }";
+          }
+
+        // Clear any unset planes.
+        for (dimension_size_type plane = 0;
+             plane < coreMeta->tiffPlanes.size();
+             ++plane)
+          {
+            if (coreMeta->tiffPlanes.status(plane) != OMETIFFPlane::UNKNOWN)
+              continue;
+            coreMeta->tiffPlanes.reset(plane);
 
             BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
-              << "}";
+              << "    Plane[" << plane
+              << "]: CLEARED";
+          }
 
-            // Fill CoreMetadata.
-            try
+        // Verify all planes are available.
+        for (dimension_size_type no = 0;
+             no < static_cast<dimension_size_type>(num);
+             ++no)
+          {
+            const OMETIFFPlaneTable& planes(coreMeta->tiffPlanes);
+
+            BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+              << "  Verify Plane[" << no
+              << "]: file=" << planes.file(no).string()
+              << ", IFD=" << planes.ifd(no);
+
+            if (!planes.hasFile(no))
               {
-                const OMETIFFPlane& plane(coreMeta->tiffPlanes.at(0));
-                const std::shared_ptr<const tiff::TIFF> ptiff(getTIFF(plane.id));
-                const std::shared_ptr<const tiff::IFD> pifd(ptiff->getDirectoryByIndex(plane.ifd));
-
-                uint32_t tiffWidth = pifd->getImageWidth();
-                uint32_t tiffHeight = pifd->getImageHeight();
-                ome::xml::model::enums::PixelType tiffPixelType = pifd->getPixelType();
-                tiff::PhotometricInterpretation photometric = pifd->getPhotometricInterpretation();
-
-                coreMeta->sizeX = meta->getPixelsSizeX(series);
-                coreMeta->sizeY = meta->getPixelsSizeY(series);
-                coreMeta->sizeZ = meta->getPixelsSizeZ(series);
-                coreMeta->sizeT = meta->getPixelsSizeT(series);
-                // coreMeta->sizeC already set
-                coreMeta->pixelType = meta->getPixelsType(series);
-                coreMeta->imageCount = num;
-                coreMeta->dimensionOrder = meta->getPixelsDimensionOrder(series);
-                coreMeta->orderCertain = true;
-                // libtiff converts to the native endianess transparently
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                  << "Image ID: " << meta.getImageID(series)
+                  << " missing plane #" << no;
+
+                // Fallback if broken.
+                dimension_size_type nIFD = getTIFF(*currentId)->directoryCount();
+
+                coreMeta->tiffPlanes.clear();
+                coreMeta->tiffPlanes.resize(nIFD);
+                for (dimension_size_type p = 0; p < nIFD; ++p)
+                  coreMeta->tiffPlanes.set(p, seriesInit->currentFile, p);
+                break;
+              }
+          }
+
+        BOOST_LOG_SEV(logger, ome::logging::trivial::debug)
+          << "}";
+
+        // Fill CoreMetadata.
+        try
+          {
+            const OMETIFFPlaneTable& planes(coreMeta->tiffPlanes);
+            const std::shared_ptr<const tiff::TIFF> ptiff(getTIFF(planes.file(0)));
+            const std::shared_ptr<const tiff::IFD> pifd(ptiff->getDirectoryByIndex(planes.ifd(0)));
+
+            uint32_t tiffWidth = pifd->getImageWidth();
+            uint32_t tiffHeight = pifd->getImageHeight();
+            ome::xml::model::enums::PixelType tiffPixelType = pifd->getPixelType();
+            tiff::PhotometricInterpretation photometric = pifd->getPhotometricInterpretation();
+
+            coreMeta->sizeX = meta.getPixelsSizeX(series);
+            coreMeta->sizeY = meta.getPixelsSizeY(series);
+            coreMeta->sizeZ = meta.getPixelsSizeZ(series);
+            coreMeta->sizeT = meta.getPixelsSizeT(series);
+            // coreMeta->sizeC already set
+            coreMeta->pixelType = meta.getPixelsType(series);
+            coreMeta->imageCount = num;
+            coreMeta->dimensionOrder = meta.getPixelsDimensionOrder(series);
+            coreMeta->orderCertain = true;
+            // libtiff converts to the native endianess transparently
 #ifdef BOOST_BIG_ENDIAN
-                coreMeta->littleEndian = false;
+            coreMeta->littleEndian = false;
 #else // Little endian
-                coreMeta->littleEndian = true;
+            coreMeta->littleEndian = true;
 #endif
 
-                // This doesn't match the reality, but since subchannels are
-                // addressed as planes this is needed.
-                coreMeta->interleaved = (pifd->getPlanarConfiguration() == tiff::CONTIG);
+            // This doesn't match the reality, but since subchannels are
+            // addressed as planes this is needed.
+            coreMeta->interleaved = (pifd->getPlanarConfiguration() == tiff::CONTIG);
 
-                coreMeta->indexed = false;
-                if (photometric == tiff::PALETTE)
-                  {
-                    try
-                      {
-                        std::array<std::vector<uint16_t>, 3> cmap;
-                        pifd->getField(ome::files::tiff::COLORMAP).get(cmap);
-                        coreMeta->indexed = true;
-                      }
-                    catch (const tiff::Exception&)
-                      {
-                      }
-                  }
-                coreMeta->metadataComplete = true;
-                coreMeta->bitsPerPixel = bitsPerPixel(coreMeta->pixelType);
+            coreMeta->indexed = false;
+            if (photometric == tiff::PALETTE)
+              {
                 try
                   {
-                    pixel_size_type bpp =
-                      static_cast<pixel_size_type>(meta->getPixelsSignificantBits(series));
-                    if (bpp <= coreMeta->bitsPerPixel)
-                      {
-                        coreMeta->bitsPerPixel = bpp;
-                      }
-                    else
-                      {
-                        boost::format fmt("BitsPerPixel out of range: OME=%1%, MAX=%2%");
-                        fmt % bpp % coreMeta->bitsPerPixel;
-
-                        BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
-                      }
-                  }
-                catch (const std::exception&)
-                  {
-                  }
-
-                // Check channel sizes and correct if wrong.
-                for (dimension_size_type channel = 0; channel < coreMeta->sizeC.size(); ++channel)
-                  {
-                    dimension_size_type planeIndex =
-                      ome::files::getIndex(coreMeta->dimensionOrder,
-                                                coreMeta->sizeZ,
-                                                coreMeta->sizeC.size(),
-                                                coreMeta->sizeT,
-                                                coreMeta->imageCount,
-                                                0,
-                                                channel,
-                                                0);
-
-                    const OMETIFFPlane& plane(coreMeta->tiffPlanes.at(planeIndex));
-                    const std::shared_ptr<const tiff::TIFF> ctiff(getTIFF(plane.id));
-                    const std::shared_ptr<const tiff::IFD> cifd(ctiff->getDirectoryByIndex(plane.ifd));
-                    const tiff::TileInfo tinfo(cifd->getTileInfo());
-                    const dimension_size_type tiffSamples = cifd->getSamplesPerPixel();
-
-                    if (coreMeta->sizeC.at(channel) != tiffSamples)
-                      {
-                        boost::format fmt("SamplesPerPixel mismatch: OME=%1%, TIFF=%2%");
-                        fmt % coreMeta->sizeC.at(channel) % tiffSamples;
-                        BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
-
-                        coreMeta->sizeC.at(channel) = tiffSamples;
-                      }
-
-                    coreMeta->tileWidth.push_back(tinfo.tileWidth());
-                    coreMeta->tileHeight.push_back(tinfo.tileHeight());
-                  }
-
-                if (coreMeta->sizeX != tiffWidth)
-                  {
-                    boost::format fmt("SizeX mismatch: OME=%1%, TIFF=%2%");
-                    fmt % coreMeta->sizeX % tiffWidth;
-
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+                    std::array<std::vector<uint16_t>, 3> cmap;
+                    pifd->getField(ome::files::tiff::COLORMAP).get(cmap);
+                    coreMeta->indexed = true;
                   }
-                if (coreMeta->sizeY != tiffHeight)
+                catch (const tiff::Exception&)
                   {
-                    boost::format fmt("SizeY mismatch: OME=%1%, TIFF=%2%");
-                    fmt % coreMeta->sizeY % tiffHeight;
-
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
                   }
-                if (std::accumulate(coreMeta->sizeC.begin(), coreMeta->sizeC.end(), dimension_size_type(0)) != static_cast<dimension_size_type>(meta->getPixelsSizeC(series)))
+              }
+            coreMeta->metadataComplete = true;
+            coreMeta->bitsPerPixel = bitsPerPixel(coreMeta->pixelType);
+            try
+              {
+                pixel_size_type bpp =
+                  static_cast<pixel_size_type>(meta.getPixelsSignificantBits(series));
+                if (bpp <= coreMeta->bitsPerPixel)
                   {
-                    boost::format fmt("SizeC mismatch: Channels=%1%, Pixels=%2%");
-                    fmt % std::accumulate(coreMeta->sizeC.begin(), coreMeta->sizeC.end(), dimension_size_type(0));
-                    fmt % meta->getPixelsSizeC(series);
-
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+                    coreMeta->bitsPerPixel = bpp;
                   }
-                if (coreMeta->pixelType != tiffPixelType)
+                else
                   {
-                    boost::format fmt("PixelType mismatch: OME=%1%, TIFF=%2%");
-                    fmt % coreMeta->pixelType % tiffPixelType;
+                    boost::format fmt("BitsPerPixel out of range: OME=%1%, MAX=%2%");
+                    fmt % bpp % coreMeta->bitsPerPixel;
 
                     BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
                   }
-                if (meta->getPixelsBinDataCount(series) > 1U)
-                  {
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Ignoring invalid BinData elements in OME-TIFF Pixels element";
-                  }
-
-                fixOMEROMetadata(*meta, series);
-                fixDimensions(series);
               }
-            catch (const std::exception& e)
+            catch (const std::exception&)
               {
-                boost::format fmt("Incomplete Pixels metadata: %1%");
-                fmt % e.what();
-                throw FormatException(fmt.str());
               }
-          }
 
-        for (coremetadata_list_type::iterator i = core.begin();
-             i != core.end();
-             ++i)
-          {
-            try
+            // Check channel sizes and correct if wrong.
+            for (dimension_size_type channel = 0; channel < coreMeta->sizeC.size(); ++channel)
               {
-                (*i)->moduloZ = getModuloAlongZ(*meta, std::distance(core.begin(), i));
+                dimension_size_type planeIndex =
+                  ome::files::getIndex(coreMeta->dimensionOrder,
+                                            coreMeta->sizeZ,
+                                            coreMeta->sizeC.size(),
+                                            coreMeta->sizeT,
+                                            coreMeta->imageCount,
+                                            0,
+                                            channel,
+                                            0);
+
+                const std::shared_ptr<const tiff::TIFF> ctiff(getTIFF(planes.file(planeIndex)));
+                const std::shared_ptr<const tiff::IFD> cifd(ctiff->getDirectoryByIndex(planes.ifd(planeIndex)));
+                const tiff::TileInfo tinfo(cifd->getTileInfo());
+                const dimension_size_type tiffSamples = cifd->getSamplesPerPixel();
+
+                if (coreMeta->sizeC.at(channel) != tiffSamples)
+                  {
+                    boost::format fmt("SamplesPerPixel mismatch: OME=%1%, TIFF=%2%");
+                    fmt % coreMeta->sizeC.at(channel) % tiffSamples;
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+
+                    coreMeta->sizeC.at(channel) = tiffSamples;
+                  }
+
+                coreMeta->tileWidth.push_back(tinfo.tileWidth());
+                coreMeta->tileHeight.push_back(tinfo.tileHeight());
               }
-            catch (const std::exception&)
+
+            if (coreMeta->sizeX != tiffWidth)
               {
+                boost::format fmt("SizeX mismatch: OME=%1%, TIFF=%2%");
+                fmt % coreMeta->sizeX % tiffWidth;
+
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
               }
-            try
+            if (coreMeta->sizeY != tiffHeight)
               {
-                (*i)->moduloT = getModuloAlongT(*meta, std::distance(core.begin(), i));
+                boost::format fmt("SizeY mismatch: OME=%1%, TIFF=%2%");
+                fmt % coreMeta->sizeY % tiffHeight;
+
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
               }
-            catch (const std::exception&)
+            if (std::accumulate(coreMeta->sizeC.begin(), coreMeta->sizeC.end(), dimension_size_type(0)) != static_cast<dimension_size_type>(meta.getPixelsSizeC(series)))
               {
+                boost::format fmt("SizeC mismatch: Channels=%1%, Pixels=%2%");
+                fmt % std::accumulate(coreMeta->sizeC.begin(), coreMeta->sizeC.end(), dimension_size_type(0));
+                fmt % meta.getPixelsSizeC(series);
+
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
               }
-            try
+            if (coreMeta->pixelType != tiffPixelType)
               {
-                (*i)->moduloC = getModuloAlongC(*meta, std::distance(core.begin(), i));
+                boost::format fmt("PixelType mismatch: OME=%1%, TIFF=%2%");
+                fmt % coreMeta->pixelType % tiffPixelType;
+
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
               }
-            catch (const std::exception&)
+            if (meta.getPixelsBinDataCount(series) > 1U)
               {
+                BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                  << "Ignoring invalid BinData elements in OME-TIFF Pixels element";
               }
-          }
-
-        // Remove null CoreMetadata entries.
-        std::remove(core.begin(), core.end(), std::shared_ptr<OMETIFFMetadata>());
 
-        if (getImageCount() == 1U)
+            fixOMEROMetadata(meta, series);
+            fixDimensions(series);
+          }
+        catch (const std::exception& e)
           {
-            std::shared_ptr<CoreMetadata>& ms0 = core.at(0);
-            ms0->sizeZ = 1U;
-            // Only one channel, but may contain subchannels.
-            dimension_size_type subchannels = ms0->sizeC.at(0);
-            ms0->sizeC.clear();
-            ms0->sizeC.push_back(subchannels);
-            ms0->sizeT = 1U;
+            boost::format fmt("Incomplete Pixels metadata: %1%");
+            fmt % e.what();
+            throw FormatException(fmt.str());
           }
 
-        fillMetadata(*metadataStore, *this, false, false);
-        seriesCount = meta->getImageCount();
-        for (index_type series = 0; series < seriesCount; ++series)
+        try
           {
-            index_type planeCount = meta->getPlaneCount(series);
-            for (index_type plane = 0; plane < planeCount; ++plane)
-              {
-                // Make sure that TheZ, TheT and TheC are all set on
-                // any existing Planes.  Missing Planes are not added,
-                // and existing TheZ, TheC, and TheT values are not
-                // changed.
-                try
-                  {
-                    meta->getPlaneTheZ(series, plane);
-                  }
-                catch (const std::exception&)
-                  {
-                    metadataStore->setPlaneTheZ(0, series, plane);
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Setting unset Plane TheZ value to 0";
-                  }
-
-                try
-                  {
-                    meta->getPlaneTheT(series, plane);
-                  }
-                catch (const std::exception&)
-                  {
-                    metadataStore->setPlaneTheT(0, series, plane);
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Setting unset Plane TheT value to 0";
-                  }
-
-                try
-                  {
-                    meta->getPlaneTheC(series, plane);
-                  }
-                catch (const std::exception&)
-                  {
-                    metadataStore->setPlaneTheC(0, series, plane);
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
-                      << "Setting unset Plane TheC value to 0";
-                  }
-              }
+            coreMeta->moduloZ = getModuloAlongZ(meta, series);
           }
-
-        for (std::vector<boost::optional<Timestamp>>::const_iterator ts = acquiredDates.begin();
-             ts != acquiredDates.end();
-             ++ts)
+        catch (const std::exception&)
           {
-            index_type series = std::distance<std::vector<boost::optional<Timestamp>>::const_iterator>(acquiredDates.begin(), ts);
-            if (*ts)
-              {
-                try
-                  {
-                    metadataStore->setImageAcquisitionDate(**ts, series);
-                  }
-                catch (const std::exception& e)
-                  {
-                    boost::format fmt("Failed to set Image AcquisitionDate for series %1%: %2%");
-                    fmt % series % e.what();
+          }
+        try
+          {
+            coreMeta->moduloT = getModuloAlongT(meta, series);
+          }
+        catch (const std::exception&)
+          {
+          }
+        try
+          {
+            coreMeta->moduloC = getModuloAlongC(meta, series);
+          }
+        catch (const std::exception&)
+          {
+          }
 
-                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
-                  }
-              }
+        if (series == 0 && coreMeta->imageCount == 1U)
+          {
+            coreMeta->sizeZ = 1U;
+            // Only one channel, but may contain subchannels.
+            dimension_size_type subchannels = coreMeta->sizeC.at(0);
+            coreMeta->sizeC.clear();
+            coreMeta->sizeC.push_back(subchannels);
+            coreMeta->sizeT = 1U;
           }
 
-        // Set the metadata store Pixels.BigEndian attribute to match
-        // the values we set in the core metadata
+        // Update the metadata store Pixels to match the core metadata.
+        fillPixels(*metadataStore, *coreMeta, series);
         try
           {
-            std::shared_ptr<ome::xml::meta::MetadataRetrieve> metadataRetrieve
-              (std::dynamic_pointer_cast<ome::xml::meta::MetadataRetrieve>(getMetadataStore()));
-
-            for (index_type i = 0; i < metadataRetrieve->getImageCount(); ++i)
-              {
-#ifdef BOOST_BIG_ENDIAN
-                metadataStore->setPixelsBigEndian(1, i);
-#else // Little endian
-                metadataStore->setPixelsBigEndian(0, i);
-#endif
-              }
+            ::ome::xml::meta::OMEXMLMetadata& omexml(dynamic_cast<::ome::xml::meta::OMEXMLMetadata&>(*metadataStore));
+            if (omexml.getTiffDataCount(series) == 0 &&
+                omexml.getPixelsBinDataCount(series) == 0)
+              addMetadataOnly(omexml, series);
           }
-        catch(const std::exception&)
+        catch (const std::bad_cast&)
           {
-            // The metadata store doesn't support getImageCount so we
-            // can't meaningfully set anything.
           }
+
+        seriesInit->ready.at(series) = true;
       }
 
       void
@@ -1143,6 +1412,126 @@ namespace ome
         }
       }
 
+      void
+      OMETIFFReader::resolveTiffDataFiles(const ome::xml::meta::OMEXMLMetadata& meta,
+                                          OMETIFFFileTable&                     planeFiles)
+      {
+        path dir((*currentId).parent_path());
+
+        // Resolve each distinct filename and UUID once.
+        typedef std::pair<boost::optional<path>, boost::optional<std::string>> file_key;
+        std::map<file_key, SeriesInit::TiffDataFile> resolved;
+
+        seriesInit->currentFile = planeFiles.intern(*currentId);
+
+        index_type seriesCount = meta.getImageCount();
+        for (index_type series = 0; series < seriesCount; ++series)
+          {
+            std::vector<SeriesInit::TiffDataFile>& tdFiles(seriesInit->tiffData.at(series));
+            index_type tiffDataCount = meta.getTiffDataCount(series);
+            tdFiles.reserve(tiffDataCount);
+
+            for (index_type td = 0; td < tiffDataCount; ++td)
+              {
+                // get reader object for this filename.
+                boost::optional<path> filename;
+                boost::optional<std::string> uuid;
+                try
+                  {
+                    filename = path(meta.getUUIDFileName(series, td));
+                  }
+                catch (const std::exception&)
+                  {
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                      << "Ignoring null UUID object when retrieving filename";
+                  }
+                try
+                  {
+                    uuid = meta.getUUIDValue(series, td);
+                  }
+                catch (const std::exception&)
+                  {
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                      << "Ignoring null UUID object when retrieving value";
+                  }
+
+                const file_key key(filename, uuid);
+                std::map<file_key, SeriesInit::TiffDataFile>::const_iterator known = resolved.find(key);
+                if (known != resolved.end())
+                  {
+                    tdFiles.push_back(known->second);
+                    continue;
+                  }
+
+                if (!filename)
+                  {
+                    if (!uuid)
+                      {
+                        filename = *currentId;
+                      }
+                    else
+                      {
+                        std::map<std::string, path>::const_iterator i(files.find(*uuid));
+                        if (i != files.end())
+                          filename = i->second;
+                      }
+                  }
+                else
+                  {
+                    // All the other cases will already have a canonical path.
+                    if (fs::exists(dir / *filename))
+                      filename = canonical(dir / *filename, dir);
+                    else
+                      {
+                        invalid_file_map::const_iterator invalid = invalidFiles.find(*filename);
+                        if (invalid != invalidFiles.end())
+                          {
+                            filename = invalid->second;
+                          }
+                        else
+                          {
+                            boost::format fmt("UUID filename %1% not found; falling back to %2%");
+                            fmt % *filename % *currentId;
+                            BOOST_LOG_SEV(logger, ome::logging::trivial::warning) << fmt.str();
+
+                            invalidFiles.insert(invalid_file_map::value_type(*filename, *currentId));
+                            filename = *currentId;
+                          }
+                      }
+                  }
+
+                addTIFF(*filename);
+
+                bool exists = true;
+                if (!fs::exists(*filename))
+                  {
+                    // If an absolute filename, try using a relative
+                    // name.  Old versions of the Java OMETiffWriter
+                    // wrote an absolute path to UUID.FileName, which
+                    // causes problems if the file is moved to a
+                    // different directory.
+                    path relative(dir / (*filename).filename());
+                    if (fs::exists(relative))
+                      {
+                        filename = relative;
+                        addTIFF(*filename);
+                      }
+                    else
+                      {
+                        filename = *currentId;
+                        exists = usedFiles.size() == 1;
+                      }
+                  }
+
+                SeriesInit::TiffDataFile tdFile;
+                tdFile.file = planeFiles.intern(*filename);
+                tdFile.exists = exists;
+                resolved.insert(std::make_pair(key, tdFile));
+                tdFiles.push_back(tdFile);
+              }
+          }
+      }
+
       void
       OMETIFFReader::getAcquisitionDates(const ome::xml::meta::OMEXMLMetadata&                                 meta,
                                          std::vector<boost::optional<ome::xml::model::primitives::Timestamp>>& timestamps)
@@ -1163,7 +1552,7 @@ namespace ome
       }
 
       void
-      OMETIFFReader::cleanMetadata(ome::xml::meta::OMEXMLMetadata& meta)
+      OMETIFFReader::cleanMetadata(ome::xml::meta::OMEXMLMetadata& meta) const
       {
         index_type imageCount = meta.getImageCount();
         for (index_type i = 0; i < imageCount; ++i)
@@ -1178,7 +1567,7 @@ namespace ome
                                       ome::xml::meta::BaseMetadata::index_type                          series,
                                       boost::optional<ome::xml::model::primitives::NonNegativeInteger>& zIndexStart,
                                       boost::optional<ome::xml::model::primitives::NonNegativeInteger>& tIndexStart,
-                                      boost::optional<ome::xml::model::primitives::NonNegativeInteger>& cIndexStart)
+                                      boost::optional<ome::xml::model::primitives::NonNegativeInteger>& cIndexStart) const
       {
         // Pre-scan TiffData indices to see if any are indexed from 1.
         index_type tiffDataCount = meta.getTiffDataCount(series);
@@ -1233,7 +1622,7 @@ namespace ome
                                        ome::xml::model::primitives::NonNegativeInteger&                  numPlanes,
                                        ome::xml::model::primitives::NonNegativeInteger&                  firstZ,
                                        ome::xml::model::primitives::NonNegativeInteger&                  firstT,
-                                       ome::xml::model::primitives::NonNegativeInteger&                  firstC)
+                                       ome::xml::model::primitives::NonNegativeInteger&                  firstC) const
       {
         bool valid = true;
 
@@ -1256,10 +1645,7 @@ namespace ome
           }
 
         if (numPlanes == 0)
-          {
-            core.at(series) = std::shared_ptr<OMETIFFMetadata>();
-            valid = false;
-          }
+          valid = false;
 
         if (!tdIFD)
           tdIFD = 0; // Start at first IFD in file if unspecified.
@@ -1292,8 +1678,8 @@ namespace ome
       }
 
       void
-      OMETIFFReader::fixOMEROMetadata(ome::xml::meta::OMEXMLMetadata&          meta,
-                                      ome::xml::meta::BaseMetadata::index_type series)
+      OMETIFFReader::fixOMEROMetadata(const ome::xml::meta::OMEXMLMetadata&    meta,
+                                      ome::xml::meta::BaseMetadata::index_type series) const
       {
         // Hackish workaround for files exported by OMERO
         // having an incorrect dimension order.
@@ -1327,7 +1713,7 @@ namespace ome
       }
 
       void
-      OMETIFFReader::fixDimensions(ome::xml::meta::BaseMetadata::index_type series)
+      OMETIFFReader::fixDimensions(ome::xml::meta::BaseMetadata::index_type series) const
       {
         std::shared_ptr<CoreMetadata> coreMeta(core.at(series));
         if (coreMeta)
@@ -1402,7 +1788,24 @@ namespace ome
       }
 
       void
-      OMETIFFReader::addTIFF(const boost::filesystem::path& tiff)
+      OMETIFFReader::openBytesScheduledImpl(dimension_size_type      plane,
+                                            VariantPixelBuffer&      buf,
+                                            dimension_size_type      x,
+                                            dimension_size_type      y,
+                                            dimension_size_type      w,
+                                            dimension_size_type      h,
+                                            const TileSchedule&      schedule,
+                                            const CancellationToken& token) const
+      {
+        assertId(currentId, true);
+
+        const std::shared_ptr<const IFD>& ifd(ifdAtIndex(plane));
+
+        ifd->readImage(buf, x, y, w, h, schedule, token);
+      }
+
+      void
+      OMETIFFReader::addTIFF(const boost::filesystem::path& tiff) const
       {
         tiffs.insert(std::make_pair(tiff, std::shared_ptr<tiff::TIFF>()));
       }
@@ -1429,7 +1832,11 @@ namespace ome
           {
             try
               {
-                i->second = tiff::TIFF::open(i->first, "r");
+                tiff_offset_map::const_iterator known = tiffOffsets.find(i->first);
+                if (known != tiffOffsets.end())
+                  i->second = tiff::TIFF::open(i->first, known->second);
+                else
+                  i->second = tiff::TIFF::open(i->first, "r");
               }
             catch (const ome::files::tiff::Exception&)
               {
@@ -1458,12 +1865,12 @@ namespace ome
       void
       OMETIFFReader::closeTIFF(const boost::filesystem::path& tiff)
       {
+        // Drop shared reference to open TIFF; it may still be in use
+        // by a reader view, and will be closed with the last
+        // reference.
         tiff_map::iterator i = tiffs.find(tiff);
-        if (i->second)
-          {
-            i->second->close();
-            i->second = std::shared_ptr<ome::files::tiff::TIFF>();
-          }
+        if (i != tiffs.end() && i->second)
+          i->second = std::shared_ptr<ome::files::tiff::TIFF>();
       }
 
       std::shared_ptr<::ome::xml::meta::OMEXMLMetadata>
@@ -1492,22 +1899,23 @@ namespace ome
       {
         std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> meta;
         path dir(id.parent_path());
-        if(canonical(id, dir) == cachedMetadataFile && cachedMetadata)
+        path cid(canonical(id, dir));
+        OMEXMLMetadataCache& shared(OMEXMLMetadataCache::shared());
+        if(cid == cachedMetadataFile && cachedMetadata)
           {
             meta = cachedMetadata; // reuse cached metadata
           }
+        else if ((meta = shared.find(cid)))
+          {
+            // reuse metadata parsed by another reader
+            cachedMetadata = meta;
+            cachedMetadataFile = cid;
+          }
         else
           {
-            std::shared_ptr<tiff::TIFF> tiff = TIFF::open(id, "r");
-
-            if (!tiff)
-              {
-                boost::format fmt("Failed to open ‘%1%’");
-                fmt % id.string();
-                throw FormatException(fmt.str());
-              }
-
-            std::string omexml(getImageDescription(*tiff));
+            // Read the description directly; opening with libtiff
+            // would scan every IFD in the file.
+            std::string omexml(getImageDescription(id));
 
             // Basic sanity check before parsing.
             std::string::size_type lpos = omexml.find_last_not_of(" \r\n\t\f\v");
@@ -1523,9 +1931,15 @@ namespace ome
 
             meta = createOMEXMLMetadata(omexml);
 
+            // Clean up any invalid metadata before it is shared;
+            // once cached it must not be modified.
+            cleanMetadata(*meta);
+
+            shared.insert(cid, meta, omexml.size());
+
             // Don't overwrite state for open readers
             cachedMetadata = meta;
-            cachedMetadataFile = canonical(id, dir);
+            cachedMetadataFile = cid;
           }
 
         return meta;
@@ -58,6 +58,11 @@ namespace ome
 
   namespace files
   {
+    namespace detail
+    {
+      class OMETIFFFileTable;
+    }
+
     namespace in
     {
 
@@ -83,6 +88,9 @@ namespace ome
         /// Map filename to open TIFF handle.
         typedef std::map<boost::filesystem::path, std::shared_ptr<ome::files::tiff::TIFF>> tiff_map;
 
+        /// Map filename to TIFF directory offsets.
+        typedef std::map<boost::filesystem::path, std::vector<ome::files::tiff::offset_type>> tiff_offset_map;
+
         /// UUID to filename mapping.
         uuid_file_map files;
 
@@ -93,6 +101,12 @@ namespace ome
         /// Open TIFF files
         mutable tiff_map tiffs;
 
+        /**
+         * Known TIFF directory offsets (from saved state), to avoid
+         * scanning all IFDs when opening TIFF files.
+         */
+        tiff_offset_map tiffOffsets;
+
         /// Metadata file.
         boost::filesystem::path metadataFile;
 
@@ -111,6 +125,15 @@ namespace ome
          */
         mutable boost::filesystem::path cachedMetadataFile;
 
+        /// Deferred series initialisation state.
+        struct SeriesInit;
+
+        /**
+         * Deferred series initialisation state (shared with reader
+         * views).
+         */
+        std::shared_ptr<SeriesInit> seriesInit;
+
       public:
         /// Constructor.
         OMETIFFReader();
@@ -133,6 +156,22 @@ namespace ome
         bool
         isFilenameThisTypeImpl(const boost::filesystem::path& name) const;
 
+        // Documented in superclass.
+        std::shared_ptr<detail::FormatReader>
+        createReader() const;
+
+        // Documented in superclass.
+        void
+        shareView(detail::FormatReader& view) const;
+
+        // Documented in superclass.
+        void
+        saveReaderState(std::ostream& stream) const;
+
+        // Documented in superclass.
+        void
+        loadReaderState(std::istream& stream);
+
         // Documented in superclass.
         void
         getLookupTable(dimension_size_type plane,
@@ -147,6 +186,17 @@ namespace ome
                       dimension_size_type w,
                       dimension_size_type h) const;
 
+        // Documented in superclass.
+        void
+        openBytesScheduledImpl(dimension_size_type      plane,
+                               VariantPixelBuffer&      buf,
+                               dimension_size_type      x,
+                               dimension_size_type      y,
+                               dimension_size_type      w,
+                               dimension_size_type      h,
+                               const TileSchedule&      schedule,
+                               const CancellationToken& token) const;
+
         /**
          * Get the IFD index for a plane in the current series.
          *
@@ -163,7 +213,7 @@ namespace ome
          * @param tiff the TIFF file to add.
          */
         void
-        addTIFF(const boost::filesystem::path& tiff);
+        addTIFF(const boost::filesystem::path& tiff) const;
 
         /**
          * Get a an open TIFF file from the internal TIFF map.
@@ -226,6 +276,12 @@ namespace ome
          * initialised.  If the metadata was previously read and
          * cached, the cached copy will be returned.
          *
+         * If the shared OMEXMLMetadataCache is enabled, it will be
+         * searched before parsing, and newly parsed metadata will be
+         * added to it.  The returned metadata has already been
+         * cleaned with cleanMetadata(), and may be shared with other
+         * readers, so must not be modified.
+         *
          * @param id the file from which to read the metadata.
          * @returns the parsed metadata as a metadata store.
          */
@@ -256,11 +312,52 @@ namespace ome
         dimension_size_type
         getOptimalTileHeight(dimension_size_type channel) const;
 
+        // Documented in superclass.
+        void
+        setSeries(dimension_size_type series) const;
+
+        // Documented in superclass.
+        void
+        setCoreIndex(dimension_size_type index) const;
+
+        // Documented in superclass.
+        const std::vector<std::shared_ptr<::ome::files::CoreMetadata>>&
+        getCoreMetadataList() const;
+
+        // Documented in superclass.
+        //
+        // All series are initialised before the store is returned,
+        // so that its Pixels elements match the core metadata and it
+        // is not modified while in use.
+        const std::shared_ptr<::ome::xml::meta::MetadataStore>&
+        getMetadataStore() const;
+
+        // Documented in superclass.
+        std::shared_ptr<::ome::xml::meta::MetadataStore>&
+        getMetadataStore();
+
         // Documented in superclass.
         void
         initFile(const boost::filesystem::path& id);
 
       private:
+        /**
+         * Initialise the core metadata for a series.
+         *
+         * For datasets with many series, such as high-content
+         * screening plates, only the series count is determined by
+         * initFile().  The core metadata and plane to IFD mapping for
+         * each series, and the corresponding metadata store Pixels
+         * element, are filled when the series is first used, or
+         * when the metadata store is requested.  This is a no-op if
+         * the series has already been initialised.
+         *
+         * @param series the series to initialise.
+         * @throws FormatException if the series metadata is invalid.
+         */
+        void
+        initSeries(dimension_size_type series) const;
+
         /**
          * Get UUID to file associations and used files.
          *
@@ -277,6 +374,21 @@ namespace ome
                       const boost::filesystem::path&        currentDir,
                       const boost::optional<std::string>&   currentUUID);
 
+        /**
+         * Resolve the file referenced by each TiffData element.
+         *
+         * All files are resolved and interned in the file table by
+         * initFile(), so that initSeries() only looks up file
+         * indexes, and never modifies the file table shared by the
+         * series and reader views.
+         *
+         * @param meta the metadata store to use.
+         * @param planeFiles the file table for all series.
+         */
+        void
+        resolveTiffDataFiles(const ome::xml::meta::OMEXMLMetadata& meta,
+                             detail::OMETIFFFileTable&             planeFiles);
+
         /**
          * Get acquisition dates for each image.
          *
@@ -298,7 +410,7 @@ namespace ome
          * @param meta the metadata store to clean up.
          */
         void
-        cleanMetadata(ome::xml::meta::OMEXMLMetadata& meta);
+        cleanMetadata(ome::xml::meta::OMEXMLMetadata& meta) const;
 
         /**
          * Get the samples per pixel from the first IFD for a series.
@@ -328,7 +440,7 @@ namespace ome
                          ome::xml::meta::BaseMetadata::index_type                          series,
                          boost::optional<ome::xml::model::primitives::NonNegativeInteger>& zIndexStart,
                          boost::optional<ome::xml::model::primitives::NonNegativeInteger>& tIndexStart,
-                         boost::optional<ome::xml::model::primitives::NonNegativeInteger>& cIndexStart);
+                         boost::optional<ome::xml::model::primitives::NonNegativeInteger>& cIndexStart) const;
 
         /**
          * Get values from a TiffData element.
@@ -351,7 +463,7 @@ namespace ome
                           ome::xml::model::primitives::NonNegativeInteger&                  numPlanes,
                           ome::xml::model::primitives::NonNegativeInteger&                  firstZ,
                           ome::xml::model::primitives::NonNegativeInteger&                  firstT,
-                          ome::xml::model::primitives::NonNegativeInteger&                  firstC);
+                          ome::xml::model::primitives::NonNegativeInteger&                  firstC) const;
 
         /**
          * Fix invalid OMERO OME-TIFF metadata.
@@ -364,8 +476,8 @@ namespace ome
          * @param series the series to correct.
          */
         void
-        fixOMEROMetadata(ome::xml::meta::OMEXMLMetadata&          meta,
-                         ome::xml::meta::BaseMetadata::index_type series);
+        fixOMEROMetadata(const ome::xml::meta::OMEXMLMetadata&    meta,
+                         ome::xml::meta::BaseMetadata::index_type series) const;
 
         /**
          * Attempt to correct logically inconsistent dimensions.
@@ -379,7 +491,7 @@ namespace ome
          * @param series the series to correct.
          */
         void
-        fixDimensions(ome::xml::meta::BaseMetadata::index_type series);
+        fixDimensions(ome::xml::meta::BaseMetadata::index_type series) const;
 
       public:
         /**
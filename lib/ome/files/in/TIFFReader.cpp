@@ -35,9 +35,12 @@
  * #L%
  */
 
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
 #include <boost/range/size.hpp>
 
 #include <ome/files/FormatException.h>
+#include <ome/files/detail/ReaderState.h>
 #include <ome/files/in/TIFFReader.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/TIFF.h>
@@ -46,6 +49,8 @@
 #include <ome/files/tiff/Util.h>
 
 using ome::files::detail::ReaderProperties;
+using ome::files::detail::readState;
+using ome::files::detail::writeState;
 using ome::files::tiff::TIFF;
 using ome::files::tiff::IFD;
 
@@ -75,10 +80,64 @@ namespace ome
 
         const std::vector<boost::filesystem::path> companion_suffixes = {"txt", "xml"};
 
+        /*
+         * Get the offset of the first plane of a contiguous
+         * hyperstack.
+         *
+         * ImageJ writes large hyperstacks as a single IFD describing
+         * the first plane, with all the following planes stored
+         * uncompressed and contiguously after it.  The first plane's
+         * strips must be contiguous, and the file must be large
+         * enough to hold all of the planes.
+         */
+        boost::optional<tiff::offset_type>
+        contiguousOffset(const IFD&                     ifd,
+                         dimension_size_type            images,
+                         const boost::filesystem::path& filename,
+                         dimension_size_type&           planesize)
+        {
+          boost::optional<tiff::offset_type> ret;
+
+          uint16_t bits = ifd.getBitsPerSample();
+          if (ifd.getCompression() != tiff::COMPRESSION_NONE ||
+              ifd.getTileType() != tiff::STRIP ||
+              (bits != 8 && bits != 16 && bits != 32 && bits != 64))
+            return ret;
+
+          const std::vector<uint64_t>& offsets(ifd.getTileOffsets());
+          const std::vector<uint64_t>& bytecounts(ifd.getTileByteCounts());
+          if (offsets.empty() || offsets.size() != bytecounts.size())
+            return ret;
+
+          dimension_size_type size = 0;
+          for (std::vector<uint64_t>::size_type i = 0; i < offsets.size(); ++i)
+            {
+              if (offsets[i] != offsets[0] + size)
+                return ret;
+              size += bytecounts[i];
+            }
+
+          planesize = ifd.getImageWidth() * ifd.getImageHeight() *
+            ifd.getSamplesPerPixel() * (bits / 8U);
+          if (size != planesize)
+            return ret;
+
+          boost::system::error_code ec;
+          boost::uintmax_t filesize = boost::filesystem::file_size(filename, ec);
+          if (ec || filesize < offsets[0] + (planesize * images))
+            return ret;
+
+          ret = offsets[0];
+          return ret;
+        }
+
       }
 
       TIFFReader::TIFFReader():
-        MinimalTIFFReader(props)
+        MinimalTIFFReader(props),
+        ijmeta(),
+        ijcontiguous(),
+        ijplanesize(0U)
       {
       }
 
@@ -93,14 +152,69 @@ namespace ome
           }
       }
 
+      std::shared_ptr<::ome::files::detail::FormatReader>
+      TIFFReader::createReader() const
+      {
+        return std::make_shared<TIFFReader>();
+      }
+
+      void
+      TIFFReader::shareView(::ome::files::detail::FormatReader& view) const
+      {
+        MinimalTIFFReader::shareView(view);
+
+        TIFFReader& tiffview(dynamic_cast<TIFFReader&>(view));
+        tiffview.ijmeta = ijmeta;
+        tiffview.ijcontiguous = ijcontiguous;
+        tiffview.ijplanesize = ijplanesize;
+      }
+
+      void
+      TIFFReader::saveReaderState(std::ostream& stream) const
+      {
+        MinimalTIFFReader::saveReaderState(stream);
+
+        writeState(stream, ijcontiguous);
+        writeState(stream, ijplanesize);
+      }
+
+      void
+      TIFFReader::loadReaderState(std::istream& stream)
+      {
+        MinimalTIFFReader::loadReaderState(stream);
+
+        readState(stream, ijcontiguous);
+        readState(stream, ijplanesize);
+      }
+
       void
       TIFFReader::close(bool fileOnly)
       {
         ijmeta = boost::none;
+        ijcontiguous = boost::none;
+        ijplanesize = 0U;
 
         MinimalTIFFReader::close(fileOnly);
       }
 
+      const std::shared_ptr<const tiff::IFD>
+      TIFFReader::ifdAtIndex(dimension_size_type plane) const
+      {
+        if (!ijcontiguous)
+          return MinimalTIFFReader::ifdAtIndex(plane);
+
+        if (plane >= getImageCount())
+          {
+            boost::format fmt("Invalid plane number ‘%1%’ for series ‘%2%’");
+            fmt % plane % getSeries();
+            throw FormatException(fmt.str());
+          }
+
+        const std::shared_ptr<const IFD>& ifd(tiff->getDirectoryByIndex(0));
+
+        return ifd;
+      }
+
       void
       TIFFReader::readIFDs()
       {
@@ -112,61 +226,132 @@ namespace ome
 
             try
               {
-                tiff::ImageJMetadata ijmeta(*ifd0);
+                tiff::ImageJMetadata ij(*ifd0);
 
                 std::shared_ptr<CoreMetadata> ijm(tiff::makeCoreMetadata(*ifd0));
 
-                ijm->sizeZ = ijmeta.slices;
-                ijm->sizeT = ijmeta.frames;
+                dimension_size_type samples = ijm->sizeC.at(0);
+                ijm->sizeZ = ij.slices;
+                ijm->sizeT = ij.frames;
                 ijm->sizeC.clear();
-                for (dimension_size_type c = 0; c < ijmeta.channels; ++c)
-                  ijm->sizeC.push_back(1U);
+                for (dimension_size_type c = 0; c < ij.channels; ++c)
+                  ijm->sizeC.push_back(samples);
+                ijm->imageCount = ij.slices * ij.frames * ij.channels;
 
-                core.clear();
-                core.push_back(ijm);
+                if (ijm->imageCount != ij.images)
+                  {
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                      << "ImageJ TIFF image count is inconsistent with its dimensions; treating as a plain TIFF";
+                    imagej_metadata = false;
+                  }
 
                 dimension_size_type images = 0;
                 for (TIFF::const_iterator i = tiff->begin();
-                     i != tiff->end();
+                     imagej_metadata && i != tiff->end();
                      ++i, ++images)
                   {
-                    if (imagej_metadata)
+                    // Verify metadata is consistent
+
+                    std::string desc;
+                    (*i)->getField(ome::files::tiff::IMAGEDESCRIPTION).get(desc);
+                    std::map<std::string,std::string> imap(tiff::ImageJMetadata::parse_imagedescription(desc));
+
+                    if (imap != ij.map)
                       {
-                        // Verify metadata is consistent
-
-                        std::string desc;
-                        (*i)->getField(ome::files::tiff::IMAGEDESCRIPTION).get(desc);
-                        std::map<std::string,std::string> imap(tiff::ImageJMetadata::parse_imagedescription(desc));
-
-                        if (imap != ijmeta.map)
-                          {
-                            std::cerr << "ImageJ TIFF metadata is inconsistent; treating as a plain TIFF";
-                            imagej_metadata = false;
-                            break;
-                          }
+                        BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                          << "ImageJ TIFF metadata is inconsistent; treating as a plain TIFF";
+                        imagej_metadata = false;
                       }
                   }
 
-                if (images != ijmeta.images)
+                tiff::IFDRange range;
+                range.filename = *currentId;
+                range.begin = 0U;
+                range.end = images;
+
+                if (imagej_metadata && images == 1U && ij.images > 1U)
                   {
-                    std::cerr << "ImageJ TIFF metadata is inconsistent with TIFF image count; treating as a plain TIFF";
+                    // A single IFD may be followed by all the
+                    // remaining planes stored contiguously.
+                    ijcontiguous = contiguousOffset(*ifd0, ij.images, *currentId, ijplanesize);
+                    if (!ijcontiguous)
+                      {
+                        BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                          << "ImageJ TIFF planes are not stored contiguously; treating as a plain TIFF";
+                        imagej_metadata = false;
+                      }
+                  }
+                else if (imagej_metadata && images != ij.images)
+                  {
+                    BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+                      << "ImageJ TIFF metadata is inconsistent with TIFF image count; treating as a plain TIFF";
                     imagej_metadata = false;
                   }
+
+                if (imagej_metadata)
+                  {
+                    core.clear();
+                    core.push_back(ijm);
+                    seriesIFDRange.clear();
+                    seriesIFDRange.push_back(range);
+                    this->ijmeta = ij;
+                  }
               }
             catch (const std::exception& e)
               {
                 // Catch all TIFF exceptions and parse failures.
-                imagej_metadata = false;
-                core.clear();
+                ijcontiguous = boost::none;
               }
-
-            if (imagej_metadata)
-              this->ijmeta = ijmeta;
           }
 
         // If a plain TIFF, read metadata from IFDs.
         if (!ijmeta)
-          MinimalTIFFReader::readIFDs();
+          {
+            ijcontiguous = boost::none;
+            MinimalTIFFReader::readIFDs();
+          }
+      }
+
+      void
+      TIFFReader::openBytesImpl(dimension_size_type plane,
+                                VariantPixelBuffer& buf,
+                                dimension_size_type x,
+                                dimension_size_type y,
+                                dimension_size_type w,
+                                dimension_size_type h) const
+      {
+        if (!ijcontiguous)
+          {
+            MinimalTIFFReader::openBytesImpl(plane, buf, x, y, w, h);
+            return;
+          }
+
+        assertId(currentId, true);
+
+        const std::shared_ptr<const IFD>& ifd(tiff->getDirectoryByIndex(0));
+        ifd->readContiguousImage(buf, *ijcontiguous + (plane * ijplanesize),
+                                 x, y, w, h);
+      }
+
+      void
+      TIFFReader::openBytesScheduledImpl(dimension_size_type      plane,
+                                         VariantPixelBuffer&      buf,
+                                         dimension_size_type      x,
+                                         dimension_size_type      y,
+                                         dimension_size_type      w,
+                                         dimension_size_type      h,
+                                         const TileSchedule&      schedule,
+                                         const CancellationToken& token) const
+      {
+        if (!ijcontiguous)
+          {
+            MinimalTIFFReader::openBytesScheduledImpl(plane, buf, x, y, w, h, schedule, token);
+            return;
+          }
+
+        // Contiguous planes are read with a single read, so are not
+        // tiled and may only be cancelled before reading.
+        ::ome::files::detail::FormatReader::openBytesScheduledImpl(plane, buf, x, y, w, h, schedule, token);
       }
 
     }
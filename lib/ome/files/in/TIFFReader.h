@@ -40,6 +40,7 @@
 
 #include <ome/files/in/MinimalTIFFReader.h>
 #include <ome/files/tiff/ImageJMetadata.h>
+#include <ome/files/tiff/Types.h>
 
 namespace ome
 {
@@ -57,6 +58,20 @@ namespace ome
         /// ImageJ metadata.
         boost::optional<tiff::ImageJMetadata> ijmeta;
 
+        /**
+         * File offset of the first plane of a contiguous ImageJ
+         * hyperstack.
+         *
+         * Set if the file contains a single IFD with all planes
+         * stored contiguously after the first, rather than one IFD
+         * per plane.  Each plane is then read directly from its
+         * computed offset, without any need to walk the IFD chain.
+         */
+        boost::optional<tiff::offset_type> ijcontiguous;
+
+        /// Size of each plane of a contiguous ImageJ hyperstack (bytes).
+        dimension_size_type ijplanesize;
+
       public:
         /// Constructor.
         TIFFReader();
@@ -70,6 +85,63 @@ namespace ome
         void
         readIFDs();
 
+        // Documented in superclass.
+        std::shared_ptr<::ome::files::detail::FormatReader>
+        createReader() const;
+
+        /**
+         * Get the IFD for a plane in the current series.
+         *
+         * All planes of a contiguous ImageJ hyperstack share the
+         * first IFD.
+         *
+         * @param plane the plane index within the series.
+         * @returns the IFD.
+         * @throws FormatException if out of range.
+         */
+        const std::shared_ptr<const tiff::IFD>
+        ifdAtIndex(dimension_size_type plane) const;
+
+        // Documented in superclass.
+        void
+        openBytesImpl(dimension_size_type plane,
+                      VariantPixelBuffer& buf,
+                      dimension_size_type x,
+                      dimension_size_type y,
+                      dimension_size_type w,
+                      dimension_size_type h) const;
+
+        // Documented in superclass.
+        void
+        openBytesScheduledImpl(dimension_size_type      plane,
+                               VariantPixelBuffer&      buf,
+                               dimension_size_type      x,
+                               dimension_size_type      y,
+                               dimension_size_type      w,
+                               dimension_size_type      h,
+                               const TileSchedule&      schedule,
+                               const CancellationToken& token) const;
+
+        // Documented in superclass.
+        void
+        shareView(::ome::files::detail::FormatReader& view) const;
+
+        /**
+         * Save reader-specific state.
+         *
+         * @note The parsed ImageJ metadata is not saved, since it
+         * is only used by readIFDs(); only the contiguous pixel data
+         * offsets needed to read the pixel data are saved.
+         *
+         * @param stream the stream to write the state to.
+         */
+        void
+        saveReaderState(std::ostream& stream) const;
+
+        // Documented in superclass.
+        void
+        loadReaderState(std::istream& stream);
+
       public:
         // Documented in superclass.
         void
@@ -35,7 +35,17 @@
  * #L%
  */
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -47,9 +57,11 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 
+#include <ome/files/Executor.h>
 #include <ome/files/FormatException.h>
 #include <ome/files/FormatTools.h>
 #include <ome/files/MetadataTools.h>
+#include <ome/files/PixelProperties.h>
 #include <ome/files/out/OMETIFFWriter.h>
 #include <ome/files/tiff/Codec.h>
 #include <ome/files/tiff/Field.h>
@@ -62,6 +74,7 @@
 #include <ome/common/filesystem.h>
 
 #include <ome/xml/meta/Convert.h>
+#include <ome/xml/meta/MetadataException.h>
 
 #include <tiffio.h>
 
@@ -78,6 +91,7 @@ using ome::common::make_relative;
 using ome::xml::model::enums::DimensionOrder;
 using ome::xml::model::enums::PixelType;
 using ome::xml::meta::convert;
+using ome::xml::meta::MetadataException;
 using ome::xml::meta::MetadataRetrieve;
 using ome::xml::meta::OMEXMLMetadata;
 
@@ -121,6 +135,8 @@ namespace ome
 
         const std::string default_description("OME-TIFF");
 
+        const dimension_size_type default_write_buffer_size = 4U * 1024U * 1024U;
+
         /**
          * @todo Move these stream helpers to a proper location,
          * i.e. to replicate the equivalent Java helpers.
@@ -403,10 +419,154 @@ namespace ome
 
       }
 
+      struct OMETIFFWriter::IFDSetup
+      {
+        /// Image width.
+        dimension_size_type width;
+        /// Image height.
+        dimension_size_type height;
+        /// Strips or tiles.
+        tiff::TileType tileType;
+        /// Tile width.
+        dimension_size_type tileWidth;
+        /// Tile height (or rows per strip).
+        dimension_size_type tileHeight;
+        /// Pixel type.
+        PixelType pixelType;
+        /// Samples per pixel.
+        dimension_size_type samples;
+        /// Planar configuration.
+        tiff::PlanarConfiguration planarConfiguration;
+        /// Photometric interpretation.
+        tiff::PhotometricInterpretation photometricInterpretation;
+        /// Compression scheme, if set.
+        boost::optional<tiff::Compression> compression;
+        /// Predictor, if set.
+        boost::optional<tiff::Predictor> predictor;
+        /// Total storage to reserve for the file (0 if unchanged).
+        storage_size_type reserve;
+
+        IFDSetup(PixelType pixelType):
+          width(0U),
+          height(0U),
+          tileType(tiff::STRIP),
+          tileWidth(0U),
+          tileHeight(0U),
+          pixelType(pixelType),
+          samples(1U),
+          planarConfiguration(tiff::CONTIG),
+          photometricInterpretation(tiff::MIN_IS_BLACK),
+          compression(),
+          predictor(),
+          reserve(0U)
+        {}
+      };
+
+      struct OMETIFFWriter::WriteQueue
+      {
+        /// A plane or IFD change queued for writing.
+        struct Request
+        {
+          /// Parameters for a new IFD (if set, this request
+          /// finishes the current IFD rather than writing pixel data).
+          boost::optional<IFDSetup> setup;
+          /// Series index.
+          dimension_size_type series;
+          /// Plane index.
+          dimension_size_type plane;
+          /// X coordinate.
+          dimension_size_type x;
+          /// Y coordinate.
+          dimension_size_type y;
+          /// Width.
+          dimension_size_type w;
+          /// Height.
+          dimension_size_type h;
+          /// Pixel data (owned).
+          VariantPixelBuffer  buf;
+          /// Buffer owning the pixel data, if buf is a view.
+          std::shared_ptr<const VariantPixelBuffer> owner;
+
+          Request(const IFDSetup& setup):
+            setup(setup),
+            series(0U),
+            plane(0U),
+            x(0U),
+            y(0U),
+            w(0U),
+            h(0U),
+            buf(),
+            owner()
+          {}
+
+          Request(dimension_size_type  series,
+                  dimension_size_type  plane,
+                  VariantPixelBuffer&& buf,
+                  dimension_size_type  x,
+                  dimension_size_type  y,
+                  dimension_size_type  w,
+                  dimension_size_type  h,
+                  std::shared_ptr<const VariantPixelBuffer> owner):
+            setup(),
+            series(series),
+            plane(plane),
+            x(x),
+            y(y),
+            w(w),
+            h(h),
+            buf(std::move(buf)),
+            owner(owner)
+          {}
+        };
+
+        /// Lock for all queue state.
+        std::mutex                mutex;
+        /// Signalled when a request is dequeued or completed, or
+        /// the writer task finishes.
+        std::condition_variable   written;
+        /// Queued requests.
+        std::deque<Request>       requests;
+        /// A request is being written (by the writer task or by a
+        /// waiting thread).
+        bool                      busy;
+        /// A writer task is submitted or running.
+        bool                      scheduled;
+        /// First error writing a request.
+        std::exception_ptr        error;
+        /// Executor running the writer task.
+        std::shared_ptr<Executor> executor;
+
+        WriteQueue():
+          mutex(),
+          written(),
+          requests(),
+          busy(false),
+          scheduled(false),
+          error(),
+          executor(Executor::sharedIO())
+        {}
+
+        /// Rethrow and clear any pending error (lock must be held).
+        void
+        rethrow()
+        {
+          if (error)
+            {
+              std::exception_ptr e(error);
+              error = nullptr;
+              std::rethrow_exception(e);
+            }
+        }
+      };
+
       OMETIFFWriter::TIFFState::TIFFState(std::shared_ptr<ome::files::tiff::TIFF>& tiff):
         uuid(boost::uuids::to_string(boost::uuids::random_generator()())),
         tiff(tiff),
-        ifdCount(0U)
+        ifdCount(0U),
+        writeQueue(),
+        reserved(0U),
+        dirty(false),
+        mutex(std::make_shared<std::mutex>())
       {
       }
 
@@ -424,7 +584,16 @@ namespace ome
         seriesState(),
         originalMetadataRetrieve(),
         omeMeta(),
-        bigTIFF(boost::none)
+        stateMutex(),
+        bigTIFF(boost::none),
+        writeBehind(0U),
+        writeBufferSize(default_write_buffer_size),
+        preallocate(false),
+        directIO(false),
+        predictor(),
+        codecTuning(),
+        codecTuningPending(false),
+        codecMeasurements()
       {
       }
 
@@ -455,9 +624,13 @@ namespace ome
         if (currentId && *currentId == canonicalpath)
           return;
 
+        // Queued planes for the current file continue to be written
+        // while switching to another file.
+
         if (seriesState.empty()) // First call to setId.
           {
             baseDir = (canonicalpath.parent_path());
+            codecTuningPending = static_cast<bool>(codecTuning);
 
             // Create OME-XML metadata.
             originalMetadataRetrieve = metadataRetrieve;
@@ -520,11 +693,7 @@ namespace ome
         if (i == tiffs.end())
           {
             detail::FormatWriter::setId(canonicalpath);
-            std::shared_ptr<ome::files::tiff::TIFF> tiff(ome::files::tiff::TIFF::open(canonicalpath, flags));
-            std::pair<tiff_map::iterator,bool> result =
-              tiffs.insert(tiff_map::value_type(*currentId, TIFFState(tiff)));
-            if (result.second) // should always be true
-              currentTIFF = result.first;
+            currentTIFF = openTIFF(*currentId);
             detail::FormatWriter::setId(id);
             setupIFD();
           }
@@ -535,11 +704,26 @@ namespace ome
           }
       }
 
+      OMETIFFWriter::tiff_map::iterator
+      OMETIFFWriter::openTIFF(const boost::filesystem::path& id)
+      {
+        std::shared_ptr<ome::files::tiff::TIFF> tiff(ome::files::tiff::TIFF::open(id, flags));
+        tiff->setWriteBufferSize(writeBufferSize);
+        if (directIO)
+          tiff->setDirectIO(true);
+
+        return tiffs.insert(tiff_map::value_type(id, TIFFState(tiff))).first;
+      }
+
       void
       OMETIFFWriter::close(bool fileOnly)
       {
         try
           {
+            // Write any queued planes, and surface any errors.
+            flush();
+            stopWriteQueue();
+
             if (currentId)
               {
                 // Flush last IFD if unwritten.
@@ -548,6 +732,15 @@ namespace ome
                     nextIFD();
                     currentTIFF = tiffs.end();
                   }
+                for (auto& tiff : tiffs)
+                  {
+                    if (tiff.second.dirty)
+                      {
+                        tiff.second.tiff->writeCurrentDirectory();
+                        ++tiff.second.ifdCount;
+                        tiff.second.dirty = false;
+                      }
+                  }
 
                 // Remove any BinData and old TiffData elements.
                 removeBinData(*omeMeta);
@@ -579,11 +772,25 @@ namespace ome
             originalMetadataRetrieve.reset();
             omeMeta.reset();
             bigTIFF = boost::none;
+            writeBehind = 0U;
+            writeBufferSize = default_write_buffer_size;
+            preallocate = false;
+            directIO = false;
+            predictor = boost::none;
+            codecTuning = boost::none;
+            codecTuningPending = false;
 
             ome::files::detail::FormatWriter::close(fileOnly);
           }
         catch (const std::exception&)
           {
+            try
+              {
+                stopWriteQueue();
+              }
+            catch (...)
+              {
+              }
             currentTIFF = tiffs.end(); // Ensure we only flush the last IFD once.
             ome::files::detail::FormatWriter::close(fileOnly);
             throw;
@@ -597,10 +804,7 @@ namespace ome
         detail::FormatWriter::setSeries(series);
 
         if (currentSeries != series)
-          {
-            nextIFD();
-            setupIFD();
-          }
+          advanceIFD();
       }
 
       void
@@ -610,10 +814,7 @@ namespace ome
         detail::FormatWriter::setPlane(plane);
 
         if (currentPlane != plane)
-          {
-            nextIFD();
-            setupIFD();
-          }
+          advanceIFD();
       }
 
       dimension_size_type
@@ -624,6 +825,7 @@ namespace ome
         if (currentId && (!this->tile_size_x ||
                           (this->tile_size_x && *this->tile_size_x)))
           {
+            flush();
             std::shared_ptr<tiff::IFD> ifd (currentTIFF->second.tiff->getCurrentDirectory());
             return ifd->getTileWidth();
           }
@@ -639,6 +841,7 @@ namespace ome
         if (currentId && (!this->tile_size_y ||
                           (this->tile_size_y && *this->tile_size_y)))
           {
+            flush();
             std::shared_ptr<tiff::IFD> ifd (currentTIFF->second.tiff->getCurrentDirectory());
             return ifd->getTileWidth();
           }
@@ -651,22 +854,168 @@ namespace ome
       {
         currentTIFF->second.tiff->writeCurrentDirectory();
         ++currentTIFF->second.ifdCount;
+        currentTIFF->second.dirty = false;
       }
 
       void
       OMETIFFWriter::setupIFD() const
+      {
+        applyIFDSetup(currentTIFF->second, getIFDSetup());
+      }
+
+      void
+      OMETIFFWriter::advanceIFD() const
+      {
+        if (writeBehind)
+          {
+            WriteQueue& q(startWriteQueue());
+            IFDSetup setup(getIFDSetup());
+
+            std::unique_lock<std::mutex> lock(q.mutex);
+            waitWriteQueue(currentTIFF, lock, [this, &q]
+                           {
+                             return q.error || q.requests.size() < writeBehind;
+                           });
+            q.rethrow();
+
+            q.requests.emplace_back(setup);
+            scheduleWriteQueue(currentTIFF, lock);
+          }
+        else
+          {
+            nextIFD();
+            setupIFD();
+          }
+      }
+
+      OMETIFFWriter::IFDSetup
+      OMETIFFWriter::getIFDSetup() const
+      {
+        return getIFDSetup(currentTIFF->second, getSeries(), getPlane());
+      }
+
+      OMETIFFWriter::IFDSetup
+      OMETIFFWriter::getIFDSetup(TIFFState&          state,
+                                 dimension_size_type series,
+                                 dimension_size_type plane) const
+      {
+        IFDSetup setup(metadataRetrieve->getPixelsType(series));
+
+        setup.width = std::max(dimension_size_type(1U),
+                               static_cast<dimension_size_type>(metadataRetrieve->getPixelsSizeX(series)));
+        setup.height = std::max(dimension_size_type(1U),
+                                static_cast<dimension_size_type>(metadataRetrieve->getPixelsSizeY(series)));
+
+        const dimension_size_type sizeZ = metadataRetrieve->getPixelsSizeZ(series);
+        const dimension_size_type sizeT = metadataRetrieve->getPixelsSizeT(series);
+        const dimension_size_type effC = metadataRetrieve->getChannelCount(series);
+        std::array<dimension_size_type, 3> coords =
+          ome::files::getZCTCoords(metadataRetrieve->getPixelsDimensionOrder(series),
+                                   sizeZ, effC, sizeT, sizeZ * effC * sizeT, plane);
+
+        dimension_size_type channel = coords[1];
+
+        try
+          {
+            setup.samples = metadataRetrieve->getChannelSamplesPerPixel(series, channel);
+          }
+        catch (const MetadataException&)
+          {
+            // No SamplesPerPixel; default to 1.
+          }
+
+        const boost::optional<bool> interleaved(getInterleaved());
+        if (interleaved && *interleaved)
+          setup.planarConfiguration = tiff::CONTIG;
+        else
+          setup.planarConfiguration = tiff::SEPARATE;
+
+        getTileLayout(setup.width, setup.height, setup.pixelType,
+                      setup.planarConfiguration == tiff::CONTIG ? setup.samples : 1U,
+                      setup.tileType, setup.tileWidth, setup.tileHeight);
+
+        // This isn't necessarily always true; we might want to use a
+        // photometric interpretation other than RGB with three
+        // subchannels.
+        if (setup.samples == 3)
+          setup.photometricInterpretation = tiff::RGB;
+        else
+          setup.photometricInterpretation = tiff::MIN_IS_BLACK;
+
+        // The codec is set once tuning has selected it.
+        const boost::optional<std::string> compression(getCompression());
+        if(compression && !codecTuningPending)
+          {
+            setup.compression = tiff::getCodecScheme(*compression);
+            if (*setup.compression != static_cast<tiff::Compression>(COMPRESSION_NONE))
+              setup.predictor = predictor;
+          }
+
+        // Reserve space for uncompressed pixel data.  Each series is
+        // reserved in the file for which it is first set up, so that
+        // the reservation for each file only covers the series
+        // written to it.
+        SeriesState& seriesMeta(seriesState.at(series));
+        if (preallocate && !codecTuning && !seriesMeta.reserved &&
+            (!setup.compression || *setup.compression == static_cast<tiff::Compression>(COMPRESSION_NONE)))
+          {
+            if (!state.reserved)
+              state.reserved = 16U; // TIFF header.
+            state.reserved += expectedSeriesSize(series);
+            setup.reserve = state.reserved;
+            seriesMeta.reserved = true;
+          }
+
+        return setup;
+      }
+
+      void
+      OMETIFFWriter::applyIFDSetup(TIFFState&      state,
+                                   const IFDSetup& setup) const
       {
         // Get current IFD.
-        std::shared_ptr<tiff::IFD> ifd (currentTIFF->second.tiff->getCurrentDirectory());
+        std::shared_ptr<tiff::IFD> ifd (state.tiff->getCurrentDirectory());
+
+        ifd->setImageWidth(static_cast<uint32_t>(setup.width));
+        ifd->setImageHeight(static_cast<uint32_t>(setup.height));
 
-        ifd->setImageWidth(getSizeX());
-        ifd->setImageHeight(getSizeY());
+        ifd->setTileType(setup.tileType);
+        ifd->setTileWidth(static_cast<uint32_t>(setup.tileWidth));
+        ifd->setTileHeight(static_cast<uint32_t>(setup.tileHeight));
 
+        ifd->setPixelType(setup.pixelType);
+        ifd->setBitsPerSample(bitsPerPixel(setup.pixelType));
+        ifd->setSamplesPerPixel(static_cast<uint16_t>(setup.samples));
+        ifd->setPlanarConfiguration(setup.planarConfiguration);
+        ifd->setPhotometricInterpretation(setup.photometricInterpretation);
+
+        if(setup.compression)
+          ifd->setCompression(*setup.compression);
+        if(setup.predictor)
+          ifd->getField(ome::files::tiff::PREDICTOR).set(*setup.predictor);
+
+        if (state.ifdCount == 0)
+          ifd->getField(ome::files::tiff::IMAGEDESCRIPTION).set(default_description);
+
+        if (setup.reserve)
+          state.tiff->reserve(setup.reserve);
+      }
+
+      void
+      OMETIFFWriter::getTileLayout(dimension_size_type                 sizeX,
+                                   dimension_size_type                 sizeY,
+                                   ome::xml::model::enums::PixelType   pixeltype,
+                                   dimension_size_type                 samples,
+                                   tiff::TileType&                     type,
+                                   dimension_size_type&                width,
+                                   dimension_size_type&                height) const
+      {
         // Default strip or tile size.  We base this upon a default
         // chunk size of 64KiB for greyscale images, which will
         // increase to 192KiB for 3 sample RGB images.  We use strips
-        // up to a width of 2048 after which tiles are used.
-        if(getSizeX() == 0)
+        // up to a width of 2048 after which tiles are used.  The
+        // other layout profiles size each strip or tile in bytes.
+        if(sizeX == 0)
           {
             throw FormatException("Can't set strip or tile size: SizeX is 0");
           }
@@ -675,18 +1024,9 @@ namespace ome
             // Manually set strip size if the size is positive.  Or
             // else set strips of size 1 as a fallback for
             // compatibility with Bio-Formats.
-            if(*this->tile_size_y)
-              {
-                ifd->setTileType(tiff::STRIP);
-                ifd->setTileWidth(getSizeX());
-                ifd->setTileHeight(*this->tile_size_y);
-              }
-            else
-              {
-                ifd->setTileType(tiff::STRIP);
-                ifd->setTileWidth(getSizeX());
-                ifd->setTileHeight(1U);
-              }
+            type = tiff::STRIP;
+            width = sizeX;
+            height = *this->tile_size_y ? *this->tile_size_y : 1U;
           }
         else if(this->tile_size_x && this->tile_size_y)
           {
@@ -695,64 +1035,122 @@ namespace ome
             // compatibility with Bio-Formats.
             if(*this->tile_size_x && *this->tile_size_y)
               {
-                ifd->setTileType(tiff::TILE);
-                ifd->setTileWidth(*this->tile_size_x);
-                ifd->setTileHeight(*this->tile_size_y);
+                type = tiff::TILE;
+                width = *this->tile_size_x;
+                height = *this->tile_size_y;
+              }
+            else
+              {
+                type = tiff::STRIP;
+                width = sizeX;
+                height = 1U;
+              }
+          }
+        else if(layout == LAYOUT_SEQUENTIAL)
+          {
+            // Full width strips of about 1MiB, so that whole planes
+            // are read and written with few, large, chunks.
+            const dimension_size_type row = sizeX * samples * bytesPerPixel(pixeltype);
+            type = tiff::STRIP;
+            width = sizeX;
+            height = std::max(dimension_size_type(1U), (1024U * 1024U) / row);
+            if (sizeY)
+              height = std::min(height, sizeY);
+          }
+        else if(layout == LAYOUT_RANDOM_ACCESS || layout == LAYOUT_ARCHIVAL)
+          {
+            // Square tiles with a power of two size, sized to hold
+            // about 128KiB for random access (small enough that a
+            // region reads little unwanted data) or 1MiB for archival
+            // (large enough to give the codec plenty of context).
+            // Compressed tiles are stored smaller, so may hold four
+            // times as much.  When tuning, the codec is not known
+            // until the first plane is written, so the layout assumes
+            // compression to remain the same for every plane.
+            const bool archival = layout == LAYOUT_ARCHIVAL;
+            const dimension_size_type pixel = samples * bytesPerPixel(pixeltype);
+            dimension_size_type target = archival ? 1024U * 1024U : 128U * 1024U;
+            const boost::optional<std::string> compression(getCompression());
+            if (codecTuning ||
+                (compression &&
+                 tiff::getCodecScheme(*compression) != static_cast<tiff::Compression>(COMPRESSION_NONE)))
+              target *= 4U;
+
+            const dimension_size_type minsize = archival ? 256U : 64U;
+            dimension_size_type size = archival ? 1024U : 512U;
+            while (size > minsize && size * size * pixel > target)
+              size /= 2U;
+
+            if (sizeX <= size)
+              {
+                // Narrow images use strips of the same size, which
+                // avoids padding each row up to the tile width.
+                type = tiff::STRIP;
+                width = sizeX;
+                height = std::max(dimension_size_type(1U), target / (sizeX * pixel));
+                if (sizeY)
+                  height = std::min(height, sizeY);
               }
             else
               {
-                ifd->setTileType(tiff::STRIP);
-                ifd->setTileWidth(getSizeX());
-                ifd->setTileHeight(1U);
+                type = tiff::TILE;
+                width = size;
+                height = size;
               }
           }
-        else if(getSizeX() < 2048)
+        else if(sizeX < 2048)
           {
             // Default to strips, mainly for compatibility with
             // readers which don't support tiles.
-            ifd->setTileType(tiff::STRIP);
-            ifd->setTileWidth(getSizeX());
-            uint32_t height = 65536U / getSizeX();
+            type = tiff::STRIP;
+            width = sizeX;
+            height = 65536U / sizeX;
             if (height == 0)
               height = 1;
-            ifd->setTileHeight(height);
           }
         else
           {
             // Default to tiles.
-            ifd->setTileType(tiff::TILE);
-            ifd->setTileWidth(256U);
-            ifd->setTileHeight(256U);
+            type = tiff::TILE;
+            width = 256U;
+            height = 256U;
           }
+      }
 
-        std::array<dimension_size_type, 3> coords = getZCTCoords(getPlane());
-
-        dimension_size_type channel = coords[1];
-
-        ifd->setPixelType(getPixelType());
-        ifd->setBitsPerSample(bitsPerPixel(getPixelType()));
-        ifd->setSamplesPerPixel(getRGBChannelCount(channel));
+      storage_size_type
+      OMETIFFWriter::expectedSeriesSize(dimension_size_type series) const
+      {
+        // Allowance for each IFD and its tags, excluding the OME-XML
+        // ImageDescription which is written on close.
+        const storage_size_type ifd_size = 512U;
+        // Allowance for the offset and byte count of each strip or tile.
+        const storage_size_type offset_size = 16U;
+
+        const dimension_size_type sizeX = metadataRetrieve->getPixelsSizeX(series);
+        const dimension_size_type sizeY = metadataRetrieve->getPixelsSizeY(series);
+        const dimension_size_type sizeC = metadataRetrieve->getPixelsSizeC(series);
+        const dimension_size_type channels = metadataRetrieve->getChannelCount(series);
+        const dimension_size_type samples = channels && sizeC > channels ? sizeC / channels : 1U;
+        const storage_size_type bytes = bytesPerPixel(metadataRetrieve->getPixelsType(series));
 
         const boost::optional<bool> interleaved(getInterleaved());
-        if (interleaved && *interleaved)
-          ifd->setPlanarConfiguration(tiff::CONTIG);
-        else
-          ifd->setPlanarConfiguration(tiff::SEPARATE);
+        const bool contig = interleaved && *interleaved;
 
-        // This isn't necessarily always true; we might want to use a
-        // photometric interpretation other than RGB with three
-        // subchannels.
-        if (isRGB(channel) && getRGBChannelCount(channel) == 3)
-          ifd->setPhotometricInterpretation(tiff::RGB);
-        else
-          ifd->setPhotometricInterpretation(tiff::MIN_IS_BLACK);
+        tiff::TileType type;
+        dimension_size_type width, height;
+        getTileLayout(sizeX, sizeY, metadataRetrieve->getPixelsType(series),
+                      contig ? samples : 1U, type, width, height);
 
-        const boost::optional<std::string> compression(getCompression());
-        if(compression)
-          ifd->setCompression(tiff::getCodecScheme(*compression));
+        const dimension_size_type tilesX = (sizeX + width - 1U) / width;
+        const dimension_size_type tilesY = (sizeY + height - 1U) / height;
 
-        if (currentTIFF->second.ifdCount == 0)
-          ifd->getField(ome::files::tiff::IMAGEDESCRIPTION).set(default_description);
+        // Strips are padded to whole rows only; tiles in both dimensions.
+        storage_size_type planeSize = (type == tiff::TILE ? tilesX * width : sizeX);
+        planeSize *= tilesY * height;
+        planeSize *= samples * bytes;
+        planeSize += ifd_size + (tilesX * tilesY * samples * offset_size);
+
+        return planeSize * seriesState.at(series).planes.size();
       }
 
       void
@@ -765,21 +1163,506 @@ namespace ome
       {
         assertId(currentId, true);
 
+        if (writeBehind)
+          {
+            // The caller retains the buffer, so queue a copy.
+            std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions> shape;
+            std::copy(buf.shape(), buf.shape() + PixelBufferBase::dimensions, shape.begin());
+            VariantPixelBuffer copy;
+            copy.setBuffer(shape, buf.pixelType(), buf.storage_order());
+            copy = buf;
+            queuePlane(plane, std::move(copy), x, y, w, h);
+          }
+        else
+          writePlane(plane, buf, x, y, w, h);
+      }
+
+      void
+      OMETIFFWriter::saveBytes(dimension_size_type  plane,
+                               VariantPixelBuffer&& buf)
+      {
+        assertId(currentId, true);
+
+        dimension_size_type width = metadataRetrieve->getPixelsSizeX(getSeries());
+        dimension_size_type height = metadataRetrieve->getPixelsSizeY(getSeries());
+        saveBytes(plane, std::move(buf), 0, 0, width, height);
+      }
+
+      void
+      OMETIFFWriter::saveBytes(dimension_size_type  plane,
+                               VariantPixelBuffer&& buf,
+                               dimension_size_type  x,
+                               dimension_size_type  y,
+                               dimension_size_type  w,
+                               dimension_size_type  h)
+      {
+        assertId(currentId, true);
+
+        if (writeBehind)
+          queuePlane(plane, std::move(buf), x, y, w, h);
+        else
+          writePlane(plane, buf, x, y, w, h);
+      }
+
+      void
+      OMETIFFWriter::saveVolume(VariantPixelBuffer& buf)
+      {
+        assertId(currentId, true);
+
+        if (writeBehind)
+          {
+            const dimension_size_type width = getSizeX();
+            const dimension_size_type height = getSizeY();
+
+            // The caller retains the buffer, so the views must be
+            // written before returning, even on failure.
+            try
+              {
+                for (dimension_size_type p = 0U; p < getImageCount(); ++p)
+                  {
+                    VariantPixelBuffer view;
+                    getPlaneView(buf, p, view);
+                    queuePlane(p, std::move(view), 0, 0, width, height);
+                  }
+              }
+            catch (const std::exception&)
+              {
+                if (currentTIFF->second.writeQueue)
+                  {
+                    try
+                      {
+                        drainWriteQueue(currentTIFF);
+                      }
+                    catch (...)
+                      {
+                      }
+                  }
+                throw;
+              }
+
+            if (currentTIFF->second.writeQueue)
+              drainWriteQueue(currentTIFF);
+          }
+        else
+          detail::FormatWriter::saveVolume(buf);
+      }
+
+      void
+      OMETIFFWriter::saveVolume(VariantPixelBuffer&& buf)
+      {
+        assertId(currentId, true);
+
+        if (writeBehind)
+          {
+            // Shared by the queued plane views until written.
+            std::shared_ptr<const VariantPixelBuffer> owner(std::make_shared<VariantPixelBuffer>(std::move(buf)));
+            const dimension_size_type width = getSizeX();
+            const dimension_size_type height = getSizeY();
+
+            for (dimension_size_type p = 0U; p < getImageCount(); ++p)
+              {
+                VariantPixelBuffer view;
+                getPlaneView(*owner, p, view);
+                queuePlane(p, std::move(view), 0, 0, width, height, owner);
+              }
+          }
+        else
+          detail::FormatWriter::saveVolume(buf);
+      }
+
+      void
+      OMETIFFWriter::saveBytes(const boost::filesystem::path& file,
+                               dimension_size_type            series,
+                               dimension_size_type            plane,
+                               VariantPixelBuffer&            buf)
+      {
+        assertId(currentId, true);
+
+        // Check the plane now, rather than failing part way through.
+        if (series >= seriesState.size())
+          {
+            boost::format fmt("Invalid series: %1%");
+            fmt % series;
+            throw std::logic_error(fmt.str());
+          }
+        if (plane >= seriesState.at(series).planes.size())
+          {
+            boost::format fmt("Invalid plane: %1%");
+            fmt % plane;
+            throw std::logic_error(fmt.str());
+          }
+
+        // Attempt to canonicalize the path.
+        path canonicalpath = file;
+        try
+          {
+            canonicalpath = ome::common::canonical(file);
+          }
+        catch (const std::exception&)
+          {
+          }
+
+        // Shared state is only used while locked; the file itself is
+        // written while holding only its own lock, so that different
+        // files are written in parallel.
+        tiff_map::iterator i;
+        boost::optional<IFDSetup> setup;
+        std::shared_ptr<std::mutex> fileMutex;
+        {
+          std::lock_guard<std::mutex> lock(stateMutex);
+
+          tuneCodec(buf, series, plane);
+
+          i = tiffs.find(canonicalpath);
+          if (i == tiffs.end())
+            i = openTIFF(canonicalpath);
+
+          setup = getIFDSetup(i->second, series, plane);
+          fileMutex = i->second.mutex;
+        }
+
+        std::lock_guard<std::mutex> lock(*fileMutex);
+        TIFFState& state(i->second);
+
+        // Planes queued by write-behind are written first.
+        if (state.writeQueue)
+          drainWriteQueue(i);
+
+        if (state.dirty)
+          {
+            state.tiff->writeCurrentDirectory();
+            ++state.ifdCount;
+            state.dirty = false;
+          }
+        applyIFDSetup(state, *setup);
+        writePixels(i, series, plane, buf, 0, 0, setup->width, setup->height);
+      }
+
+      void
+      OMETIFFWriter::writePlane(dimension_size_type plane,
+                                VariantPixelBuffer& buf,
+                                dimension_size_type x,
+                                dimension_size_type y,
+                                dimension_size_type w,
+                                dimension_size_type h)
+      {
+        tuneCodec(buf, getSeries(), plane);
         setPlane(plane);
+        writePixels(currentTIFF, getSeries(), plane, buf, x, y, w, h);
+      }
 
+      void
+      OMETIFFWriter::writePixels(tiff_map::iterator  file,
+                                 dimension_size_type series,
+                                 dimension_size_type plane,
+                                 VariantPixelBuffer& buf,
+                                 dimension_size_type x,
+                                 dimension_size_type y,
+                                 dimension_size_type w,
+                                 dimension_size_type h) const
+      {
         // Get current IFD.
-        std::shared_ptr<tiff::IFD> ifd (currentTIFF->second.tiff->getCurrentDirectory());
+        std::shared_ptr<tiff::IFD> ifd (file->second.tiff->getCurrentDirectory());
 
         // Get plane metadata.
-        detail::OMETIFFPlane& planeMeta(seriesState.at(getSeries()).planes.at(plane));
+        detail::OMETIFFPlane& planeMeta(seriesState.at(series).planes.at(plane));
 
         ifd->writeImage(buf, x, y, w, h);
 
         // Set plane metadata.
-        planeMeta.id = currentTIFF->first;
-        planeMeta.ifd = currentTIFF->second.ifdCount;
+        planeMeta.id = file->first;
+        planeMeta.ifd = file->second.ifdCount;
         planeMeta.certain = true;
         planeMeta.status = detail::OMETIFFPlane::PRESENT; // Plane now written.
+        file->second.dirty = true;
+      }
+
+      void
+      OMETIFFWriter::queuePlane(dimension_size_type                       plane,
+                                VariantPixelBuffer&&                      buf,
+                                dimension_size_type                       x,
+                                dimension_size_type                       y,
+                                dimension_size_type                       w,
+                                dimension_size_type                       h,
+                                std::shared_ptr<const VariantPixelBuffer> owner)
+      {
+        // Check the plane now, rather than failing asynchronously.
+        if (plane >= getImageCount())
+          {
+            boost::format fmt("Invalid plane: %1%");
+            fmt % plane;
+            throw std::logic_error(fmt.str());
+          }
+
+        tuneCodec(buf, getSeries(), plane);
+
+        // Queues an IFD change if needed.
+        setPlane(plane);
+
+        WriteQueue& q(startWriteQueue());
+        std::unique_lock<std::mutex> lock(q.mutex);
+
+        // Backpressure: wait for space in the queue.
+        waitWriteQueue(currentTIFF, lock, [this, &q]
+                       {
+                         return q.error || q.requests.size() < writeBehind;
+                       });
+        q.rethrow();
+
+        q.requests.emplace_back(getSeries(), plane, std::move(buf), x, y, w, h, owner);
+        scheduleWriteQueue(currentTIFF, lock);
+      }
+
+      OMETIFFWriter::WriteQueue&
+      OMETIFFWriter::startWriteQueue() const
+      {
+        TIFFState& state(currentTIFF->second);
+
+        if (!state.writeQueue)
+          state.writeQueue = std::make_shared<WriteQueue>();
+
+        return *state.writeQueue;
+      }
+
+      void
+      OMETIFFWriter::scheduleWriteQueue(tiff_map::iterator            file,
+                                        std::unique_lock<std::mutex>& lock) const
+      {
+        WriteQueue& q(*file->second.writeQueue);
+
+        if (q.scheduled)
+          return;
+
+        // At most one task writes each file, so that requests are
+        // written in order; tasks for different files may run
+        // concurrently.
+        q.scheduled = true;
+        lock.unlock();
+        try
+          {
+            q.executor->submit(std::bind(&OMETIFFWriter::writeQueuedPlanes, this,
+                                         file->second.writeQueue, file));
+          }
+        catch (...)
+          {
+            lock.lock();
+            q.scheduled = false;
+            q.written.notify_all();
+            throw;
+          }
+        lock.lock();
+      }
+
+      void
+      OMETIFFWriter::writeQueuedPlanes(const OMETIFFWriter        *writer,
+                                       std::shared_ptr<WriteQueue> queue,
+                                       tiff_map::iterator          file)
+      {
+        // The queue is retained by the task, since the writer may be
+        // closed and destroyed before the task runs if a waiting
+        // thread wrote the queued planes.  The writer and file are
+        // only used while requests are queued.
+        WriteQueue& q(*queue);
+        std::unique_lock<std::mutex> lock(q.mutex);
+
+        // If a waiting thread is writing, leave the remaining
+        // requests to it; it will schedule a new task if needed.
+        while (!q.busy && !q.requests.empty())
+          writer->writeQueuedPlane(file, q, lock);
+
+        q.scheduled = false;
+        q.written.notify_all();
+      }
+
+      bool
+      OMETIFFWriter::writeQueuedPlane(tiff_map::iterator            file,
+                                      WriteQueue&                   q,
+                                      std::unique_lock<std::mutex>& lock) const
+      {
+        if (q.busy || q.requests.empty())
+          return false;
+
+        WriteQueue::Request r(std::move(q.requests.front()));
+        q.requests.pop_front();
+        q.busy = true;
+        q.written.notify_all();
+        lock.unlock();
+
+        std::exception_ptr error;
+        try
+          {
+            TIFFState& state(file->second);
+            if (r.setup)
+              {
+                // Flush current IFD and create new IFD.
+                state.tiff->writeCurrentDirectory();
+                ++state.ifdCount;
+                state.dirty = false;
+                applyIFDSetup(state, *r.setup);
+              }
+            else
+              writePixels(file, r.series, r.plane, r.buf, r.x, r.y, r.w, r.h);
+          }
+        catch (...)
+          {
+            error = std::current_exception();
+          }
+
+        lock.lock();
+        if (error)
+          {
+            // Discard queued planes following an error.
+            if (!q.error)
+              q.error = error;
+            q.requests.clear();
+          }
+        q.busy = false;
+        q.written.notify_all();
+
+        return true;
+      }
+
+      void
+      OMETIFFWriter::waitWriteQueue(tiff_map::iterator                 file,
+                                    std::unique_lock<std::mutex>&      lock,
+                                    const std::function<bool ()>&      done) const
+      {
+        WriteQueue& q(*file->second.writeQueue);
+
+        // Write queued requests on this thread rather than waiting
+        // for the writer task.  The task might never run if this
+        // thread is a worker of the executor, or if every worker is
+        // waiting in the same way.
+        while (!done())
+          {
+            if (!writeQueuedPlane(file, q, lock))
+              q.written.wait(lock); // Another thread is writing.
+          }
+
+        // The writer task may have left requests to this thread.
+        if (!q.requests.empty())
+          scheduleWriteQueue(file, lock);
+      }
+
+      void
+      OMETIFFWriter::drainWriteQueue(tiff_map::iterator file) const
+      {
+        WriteQueue& q(*file->second.writeQueue);
+        std::unique_lock<std::mutex> lock(q.mutex);
+
+        waitWriteQueue(file, lock, [&q]
+                       {
+                         return q.requests.empty() && !q.busy;
+                       });
+        q.rethrow();
+      }
+
+      void
+      OMETIFFWriter::tuneCodec(const VariantPixelBuffer& buf,
+                               dimension_size_type       series,
+                               dimension_size_type       plane)
+      {
+        if (!codecTuningPending)
+          return;
+        codecTuningPending = false;
+
+        // Sample tiles the size of the strips or tiles to be written.
+        const IFDSetup layout(getIFDSetup(currentTIFF->second, series, plane));
+        codecMeasurements = tiff::measureCodecs(buf, layout.tileWidth, layout.tileHeight, *codecTuning);
+        if (codecMeasurements.empty())
+          {
+            BOOST_LOG_SEV(logger, ome::logging::trivial::warning)
+              << "Codec tuning made no measurements; compression is unchanged";
+          }
+        else
+          {
+            const tiff::CodecMeasurement& selected(tiff::selectCodec(codecMeasurements, *codecTuning));
+
+            BOOST_LOG_SEV(logger, ome::logging::trivial::info)
+              << "Codec tuning selected " << selected.name
+              << (selected.predictor != tiff::NONE ? " with predictor" : "")
+              << " (ratio " << selected.ratio()
+              << ", " << selected.encodeThroughput() / (1024.0 * 1024.0) << " MiB/s)";
+
+            if (selected.scheme == static_cast<tiff::Compression>(COMPRESSION_NONE))
+              compression = boost::none;
+            else
+              compression = selected.name;
+            if (selected.predictor != tiff::NONE)
+              predictor = selected.predictor;
+            else
+              predictor = boost::none;
+          }
+
+        // No planes have been written, but IFD changes may be queued.
+        // IFDs set up while tuning was pending have neither a codec
+        // nor a predictor, so only those now in use need setting; a
+        // predictor set before tuning is never applied.
+        flush();
+        const IFDSetup setup(getIFDSetup(currentTIFF->second, series, plane));
+        if (!setup.compression)
+          return;
+        for (auto& file : tiffs)
+          {
+            std::shared_ptr<tiff::IFD> ifd(file.second.tiff->getCurrentDirectory());
+            ifd->setCompression(*setup.compression);
+            if (setup.predictor)
+              ifd->getField(ome::files::tiff::PREDICTOR).set(*setup.predictor);
+          }
+      }
+
+      void
+      OMETIFFWriter::flush() const
+      {
+        for (tiff_map::iterator i = tiffs.begin(); i != tiffs.end(); ++i)
+          {
+            if (i->second.writeQueue)
+              drainWriteQueue(i);
+          }
+      }
+
+      void
+      OMETIFFWriter::stopWriteQueue()
+      {
+        std::exception_ptr error;
+
+        for (tiff_map::iterator i = tiffs.begin(); i != tiffs.end(); ++i)
+          {
+            if (!i->second.writeQueue)
+              continue;
+
+            WriteQueue& q(*i->second.writeQueue);
+            {
+              // A writer task which has yet to run retains the
+              // queue, and will find nothing to write.
+              std::unique_lock<std::mutex> lock(q.mutex);
+              waitWriteQueue(i, lock, [&q]
+                             {
+                               return q.requests.empty() && !q.busy;
+                             });
+              if (q.error && !error)
+                error = q.error;
+            }
+            i->second.writeQueue.reset();
+          }
+
+        if (error)
+          std::rethrow_exception(error);
+      }
+
+      void
+      OMETIFFWriter::setWriteBehind(dimension_size_type depth)
+      {
+        flush();
+        if (!depth)
+          stopWriteQueue();
+        writeBehind = depth;
+      }
+
+      dimension_size_type
+      OMETIFFWriter::getWriteBehind() const
+      {
+        return writeBehind;
       }
 
       void
@@ -804,6 +1687,10 @@ namespace ome
 
         dimension_size_type seriesCount = getSeriesCount();
 
+        // Relative filename and UUID for each file, computed once.
+        typedef std::map<path, std::pair<std::string, std::string>> file_ref_map;
+        file_ref_map fileRefs;
+
         for (dimension_size_type series = 0U; series < seriesCount; ++series)
           {
             DimensionOrder dimOrder = metadataRetrieve->getPixelsDimensionOrder(series);
@@ -817,35 +1704,60 @@ namespace ome
                 omeMeta->setTiffDataPlaneCount(0, series, 0);
               }
 
-            for (dimension_size_type plane = 0U; plane < imageCount; ++plane)
+            const std::vector<detail::OMETIFFPlane>& planes(seriesState.at(series).planes);
+            dimension_size_type tiffData = 0U;
+
+            // Each TiffData element describes a run of planes stored in
+            // consecutive IFDs of the same file.
+            for (dimension_size_type plane = 0U; plane < imageCount;)
               {
-                std::array<dimension_size_type, 3> coords =
-                  ome::files::getZCTCoords(dimOrder, sizeZ, effC, sizeT, imageCount, plane);
-                const detail::OMETIFFPlane& planeState(seriesState.at(series).planes.at(plane));
+                const detail::OMETIFFPlane& planeState(planes.at(plane));
 
-                tiff_map::const_iterator t = tiffs.find(planeState.id);
-                if (t != tiffs.end())
+                dimension_size_type planeCount = 1U;
+                while (plane + planeCount < imageCount)
                   {
+                    const detail::OMETIFFPlane& next(planes.at(plane + planeCount));
+                    if (next.id != planeState.id ||
+                        next.ifd != planeState.ifd + planeCount)
+                      break;
+                    ++planeCount;
+                  }
+
+                file_ref_map::const_iterator ref = fileRefs.find(planeState.id);
+                if (ref == fileRefs.end())
+                  {
+                    tiff_map::const_iterator t = tiffs.find(planeState.id);
+                    if (t == tiffs.end())
+                      {
+                        boost::format fmt
+                          ("Inconsistent writer state: TIFF file %1% not registered with a UUID");
+                        fmt % planeState.id;
+                        throw FormatException(fmt.str());
+                      }
+
                     path relative(make_relative(baseDir, planeState.id));
                     std::string uuid("urn:uuid:");
                     uuid += t->second.uuid;
-                    omeMeta->setUUIDFileName(relative.generic_string(), series, plane);
-                    omeMeta->setUUIDValue(uuid, series, plane);
-
-                    // Fill in non-default TiffData attributes.
-                    omeMeta->setTiffDataFirstZ(coords[0], series, plane);
-                    omeMeta->setTiffDataFirstT(coords[2], series, plane);
-                    omeMeta->setTiffDataFirstC(coords[1], series, plane);
-                    omeMeta->setTiffDataIFD(planeState.ifd, series, plane);
-                    omeMeta->setTiffDataPlaneCount(1, series, plane);
-                  }
-                else
-                  {
-                    boost::format fmt
-                      ("Inconsistent writer state: TIFF file %1% not registered with a UUID");
-                    fmt % planeState.id;
-                    throw FormatException(fmt.str());
+                    ref = fileRefs.insert(file_ref_map::value_type
+                                          (planeState.id,
+                                           std::make_pair(relative.generic_string(), uuid))).first;
                   }
+
+                std::array<dimension_size_type, 3> coords =
+                  ome::files::getZCTCoords(dimOrder, sizeZ, effC, sizeT, imageCount, plane);
+
+                omeMeta->setUUIDFileName(ref->second.first, series, tiffData);
+                omeMeta->setUUIDValue(ref->second.second, series, tiffData);
+
+                // Fill in non-default TiffData attributes.
+                omeMeta->setTiffDataFirstZ(coords[0], series, tiffData);
+                omeMeta->setTiffDataFirstT(coords[2], series, tiffData);
+                omeMeta->setTiffDataFirstC(coords[1], series, tiffData);
+                omeMeta->setTiffDataIFD(planeState.ifd, series, tiffData);
+                omeMeta->setTiffDataPlaneCount(planeCount, series, tiffData);
+
+                plane += planeCount;
+                ++tiffData;
               }
           }
       }
@@ -991,6 +1903,72 @@ namespace ome
         return bigTIFF;
       }
 
+      void
+      OMETIFFWriter::setWriteBufferSize(dimension_size_type size)
+      {
+        writeBufferSize = size;
+      }
+
+      dimension_size_type
+      OMETIFFWriter::getWriteBufferSize() const
+      {
+        return writeBufferSize;
+      }
+
+      void
+      OMETIFFWriter::setPreallocate(bool preallocate)
+      {
+        this->preallocate = preallocate;
+      }
+
+      bool
+      OMETIFFWriter::getPreallocate() const
+      {
+        return preallocate;
+      }
+
+      void
+      OMETIFFWriter::setDirectIO(bool direct)
+      {
+        directIO = direct;
+      }
+
+      bool
+      OMETIFFWriter::getDirectIO() const
+      {
+        return directIO;
+      }
+
+      void
+      OMETIFFWriter::setPredictor(boost::optional<tiff::Predictor> predictor)
+      {
+        this->predictor = predictor;
+      }
+
+      boost::optional<tiff::Predictor>
+      OMETIFFWriter::getPredictor() const
+      {
+        return predictor;
+      }
+
+      void
+      OMETIFFWriter::setCodecTuning(const boost::optional<tiff::CodecTuning>& tuning)
+      {
+        codecTuning = tuning;
+      }
+
+      const boost::optional<tiff::CodecTuning>&
+      OMETIFFWriter::getCodecTuning() const
+      {
+        return codecTuning;
+      }
+
+      const std::vector<tiff::CodecMeasurement>&
+      OMETIFFWriter::getCodecMeasurements() const
+      {
+        return codecMeasurements;
+      }
+
     }
   }
 }
@@ -38,10 +38,16 @@
 #ifndef OME_FILES_OUT_OMETIFFWRITER_H
 #define OME_FILES_OUT_OMETIFFWRITER_H
 
+#include <functional>
+#include <memory>
+#include <mutex>
+
 #include <boost/filesystem/path.hpp>
 
 #include <ome/files/detail/FormatWriter.h>
 #include <ome/files/detail/OMETIFF.h>
+#include <ome/files/tiff/CodecTuning.h>
+#include <ome/files/tiff/Types.h>
 
 #include <ome/common/log.h>
 
@@ -74,6 +80,12 @@ namespace ome
         /// Map filename to UUID.
         typedef std::map<boost::filesystem::path, std::string> file_uuid_map;
 
+        /// Write-behind queue.
+        struct WriteQueue;
+
+        /// IFD parameters for a plane.
+        struct IFDSetup;
+
         // In the Java reader, this is uuids + ifdCounts
         /// State of TIFF file.
         struct TIFFState
@@ -84,6 +96,14 @@ namespace ome
           std::shared_ptr<ome::files::tiff::TIFF> tiff;
           /// Number of IFDs written.
           dimension_size_type ifdCount;
+          /// Write-behind state (null if write-behind is not in use).
+          std::shared_ptr<WriteQueue> writeQueue;
+          /// Storage reserved for the file (0 if not preallocated).
+          storage_size_type reserved;
+          /// Pixel data has been written to the current IFD.
+          bool dirty;
+          /// Lock for saving planes to this file from several threads.
+          std::shared_ptr<std::mutex> mutex;
 
           /**
            * Constructor.
@@ -105,6 +125,8 @@ namespace ome
         {
           /// Current state of each plane in an image series.
           std::vector<detail::OMETIFFPlane> planes;
+          /// Storage has been reserved for the series.
+          bool reserved;
         };
 
         /// Vector of SeriesState objects.
@@ -126,8 +148,10 @@ namespace ome
         /// TIFF flags.
         std::string flags;
         
+        // Mutable to allow write-behind tasks started when const
+        // to record plane state.
         /// State of each series.
-        series_list seriesState;
+        mutable series_list seriesState;
 
         /**
          * Original MetadataRetrieve.
@@ -143,10 +167,40 @@ namespace ome
         /// OME-XML metadata for embedding in the TIFF.
         std::shared_ptr<ome::xml::meta::OMEXMLMetadata> omeMeta;
 
+        /**
+         * Lock for the open TIFF files, series state and codec
+         * tuning when saving planes to several files concurrently.
+         */
+        std::mutex stateMutex;
+
       private:
         /// Write a Big TIFF
         boost::optional<bool> bigTIFF;
 
+        /// Maximum number of queued planes per file for write-behind (0 if synchronous).
+        dimension_size_type writeBehind;
+
+        /// Output buffer size for each TIFF (0 if unbuffered).
+        dimension_size_type writeBufferSize;
+
+        /// Preallocate storage for uncompressed TIFFs.
+        bool preallocate;
+
+        /// Write pixel data bypassing the page cache.
+        bool directIO;
+
+        /// Predictor to use with compression.
+        boost::optional<tiff::Predictor> predictor;
+
+        /// Codec tuning settings (none if tuning is disabled).
+        boost::optional<tiff::CodecTuning> codecTuning;
+
+        /// Codec tuning is pending until the first plane is written.
+        bool codecTuningPending;
+
+        /// Codec measurements from the last tuning.
+        std::vector<tiff::CodecMeasurement> codecMeasurements;
+
       public:
         /// Constructor.
         OMETIFFWriter();
@@ -190,8 +244,65 @@ namespace ome
         void
         setupIFD() const;
 
+        /**
+         * Flush current IFD and create new IFD for the current plane.
+         *
+         * If write-behind is enabled, this is queued for the current
+         * file's write-behind task; otherwise it is done immediately.
+         */
+        void
+        advanceIFD() const;
+
+        /**
+         * Get the IFD parameters for the current series and plane.
+         *
+         * If preallocation is enabled and the current series has not
+         * been selected before, storage for the series is added to
+         * the reservation for the current file.
+         *
+         * @returns the IFD parameters.
+         */
+        IFDSetup
+        getIFDSetup() const;
+
+        /**
+         * Get the IFD parameters for a plane of a TIFF file.
+         *
+         * This does not use the current series or plane.  If
+         * preallocation is enabled and storage for the series has
+         * not been reserved, storage for the series is added to the
+         * reservation for the file.
+         *
+         * @param state the TIFF file state.
+         * @param series the image series.
+         * @param plane the plane index within the series.
+         * @returns the IFD parameters.
+         */
+        IFDSetup
+        getIFDSetup(TIFFState&          state,
+                    dimension_size_type series,
+                    dimension_size_type plane) const;
+
+        /**
+         * Set IFD parameters for the current IFD of a TIFF file.
+         *
+         * @param state the TIFF file state.
+         * @param setup the IFD parameters to set.
+         */
+        void
+        applyIFDSetup(TIFFState&      state,
+                      const IFDSetup& setup) const;
+
       public:
-        // Documented in superclass.
+        /**
+         * @copydoc FormatWriter::saveBytes(dimension_size_type,VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type)
+         *
+         * If write-behind is enabled, a copy of the pixel data is
+         * queued for writing by the current file's write-behind task
+         * and this method returns without waiting for it to be written.
+         * Use the overload taking an rvalue reference to avoid the
+         * copy.
+         */
         void
         saveBytes(dimension_size_type plane,
                   VariantPixelBuffer& buf,
@@ -200,7 +311,387 @@ namespace ome
                   dimension_size_type w,
                   dimension_size_type h);
 
+        /**
+         * Save a whole image plane, transferring ownership of the
+         * pixel data.
+         *
+         * If write-behind is enabled, the pixel data is queued for
+         * writing by a background task without copying; the buffer
+         * is left empty.  Otherwise, the plane is written
+         * immediately.
+         *
+         * @param plane the plane index within the series.
+         * @param buf the pixel data to save.
+         */
+        void
+        saveBytes(dimension_size_type   plane,
+                  VariantPixelBuffer&&  buf);
+
+        /**
+         * Save a region of an image plane, transferring ownership of
+         * the pixel data.
+         *
+         * @copydetails saveBytes(dimension_size_type,VariantPixelBuffer&&)
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         */
+        void
+        saveBytes(dimension_size_type   plane,
+                  VariantPixelBuffer&&  buf,
+                  dimension_size_type   x,
+                  dimension_size_type   y,
+                  dimension_size_type   w,
+                  dimension_size_type   h);
+
+        /**
+         * @copydoc FormatWriter::saveVolume(VariantPixelBuffer&)
+         *
+         * If write-behind is enabled, the planes are queued for
+         * writing by the current file's write-behind task without
+         * copying, and this method waits for them to be written
+         * before returning.  Use the overload taking an rvalue
+         * reference to avoid waiting.
+         *
+         * With Deflate compression, the strips or tiles of each
+         * plane are encoded concurrently using the shared executor
+         * (see Executor::shared()), and the planes are written in
+         * order.
+         */
+        void
+        saveVolume(VariantPixelBuffer& buf);
+
+        /**
+         * Save all image planes of the current series, transferring
+         * ownership of the pixel data.
+         *
+         * If write-behind is enabled, the planes are queued for
+         * writing by the current file's write-behind task without
+         * copying, and this method returns without waiting for them
+         * to be written, so that the next volume may be prepared
+         * while this volume is encoded; the buffer is left empty.
+         * Otherwise, the planes are written immediately.
+         *
+         * @param buf the source pixel buffer.
+         * @throws std::logic_error if the buffer dimensions or storage
+         * order are unsuitable.
+         */
+        void
+        saveVolume(VariantPixelBuffer&& buf);
+
+        /**
+         * Save a whole image plane to a file.
+         *
+         * Unlike the other saveBytes() methods, this neither uses nor
+         * changes the current file, series and plane.  It may be
+         * called concurrently from several threads, each writing to
+         * a different file, so that the planes of a dataset split
+         * between many files (for example, one file per timepoint or
+         * well) are encoded and written in parallel.  Calls for the
+         * same file are serialised, and each call writes the plane
+         * to a new IFD.  The file is added to the dataset if it is
+         * not already open; the OME-XML for all files is merged by
+         * close() as for files added with changeOutputFile().
+         *
+         * The plane is written on the calling thread, after any
+         * planes queued for the file by write-behind.  Uncompressed
+         * and Deflate tiles are encoded without the global libtiff
+         * lock, so only the writes of encoded tiles are serialised
+         * between files; other codecs are encoded by libtiff, which
+         * serialises encoding as well.  setId() must
+         * have been called first, and the methods which change the
+         * current file, series or plane, and close(), must not be
+         * called concurrently with this method.
+         *
+         * @param file the file to write to.
+         * @param series the image series.
+         * @param plane the plane index within the series.
+         * @param buf the pixel data to save.
+         * @throws std::logic_error if the series or plane is invalid.
+         */
+        void
+        saveBytes(const boost::filesystem::path& file,
+                  dimension_size_type            series,
+                  dimension_size_type            plane,
+                  VariantPixelBuffer&            buf);
+
+        /**
+         * Set the write-behind queue depth.
+         *
+         * When nonzero, saveBytes() queues planes for encoding and
+         * writing by a background task run on the shared I/O
+         * Executor, so that the caller is not blocked by compression
+         * or disk writes.  Each output file has its own queue, written by at
+         * most one task at a time, so when a dataset is split
+         * between several files with changeOutputFile(), planes may
+         * be queued for the next file while earlier files are still
+         * being written.  At most @p depth planes may be queued for
+         * each file; when the queue is full, further calls to
+         * saveBytes() write queued planes on the calling thread until
+         * there is space, rather than waiting for the task.  When
+         * zero (the default), planes are written synchronously.
+         *
+         * Errors from a background task are rethrown by the next
+         * call to saveBytes(), setSeries() or setPlane() for the same
+         * file, or by flush() or close().  Once an error has occurred,
+         * any remaining planes queued for the file are discarded.
+         *
+         * Any planes already queued are written before the depth is
+         * changed.  The depth is reset to zero by close().
+         *
+         * @param depth the maximum number of queued planes per file.
+         */
+        void
+        setWriteBehind(dimension_size_type depth);
+
+        /**
+         * Get the write-behind queue depth.
+         *
+         * @returns the maximum number of queued planes, or zero if
+         * planes are written synchronously.
+         */
+        dimension_size_type
+        getWriteBehind() const;
+
+        /**
+         * Wait for all queued planes to be written.
+         *
+         * This is a barrier for write-behind; when it returns, every
+         * plane passed to saveBytes() has been written to its IFD in
+         * every file.
+         * It has no effect if write-behind is not enabled.
+         *
+         * @throws the first error which occurred when writing a
+         * queued plane.
+         */
+        void
+        flush() const;
+
       private:
+        /**
+         * Open a TIFF file and add it to the open files.
+         *
+         * No IFD parameters are set.
+         *
+         * @param id the file to open.
+         * @returns the TIFF file state.
+         */
+        tiff_map::iterator
+        openTIFF(const boost::filesystem::path& id);
+
+        /**
+         * Write a plane immediately.
+         *
+         * The plane is made current, and then written to the current
+         * file.
+         *
+         * @param plane the plane index within the series.
+         * @param buf the pixel data to save.
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         */
+        void
+        writePlane(dimension_size_type plane,
+                   VariantPixelBuffer& buf,
+                   dimension_size_type x,
+                   dimension_size_type y,
+                   dimension_size_type w,
+                   dimension_size_type h);
+
+        /**
+         * Write a plane to the current IFD of a TIFF file.
+         *
+         * @param file the TIFF file to write to.
+         * @param series the image series.
+         * @param plane the plane index within the series.
+         * @param buf the pixel data to save.
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         */
+        void
+        writePixels(tiff_map::iterator  file,
+                    dimension_size_type series,
+                    dimension_size_type plane,
+                    VariantPixelBuffer& buf,
+                    dimension_size_type x,
+                    dimension_size_type y,
+                    dimension_size_type w,
+                    dimension_size_type h) const;
+
+        /**
+         * Queue a plane for writing by the write-behind task of the
+         * current file.
+         *
+         * The plane is made current before queuing.  Blocks while
+         * the queue is full.
+         *
+         * @param plane the plane index within the series.
+         * @param buf the pixel data to save; ownership is transferred.
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         * @param owner the buffer owning the pixel data, if @c buf
+         * is a view of another buffer.
+         */
+        void
+        queuePlane(dimension_size_type                       plane,
+                   VariantPixelBuffer&&                      buf,
+                   dimension_size_type                       x,
+                   dimension_size_type                       y,
+                   dimension_size_type                       w,
+                   dimension_size_type                       h,
+                   std::shared_ptr<const VariantPixelBuffer> owner = std::shared_ptr<const VariantPixelBuffer>());
+
+        /**
+         * Get the write-behind queue for the current file.
+         *
+         * The queue is created if it does not already exist.
+         *
+         * @returns the queue.
+         */
+        WriteQueue&
+        startWriteQueue() const;
+
+        /**
+         * Submit a task to write the queued planes of a file.
+         *
+         * If a task is already submitted or running for the file, it
+         * will write any newly queued planes, and no task is
+         * submitted.
+         *
+         * @param file the TIFF file to write to.
+         * @param lock the lock on the file's queue (held).
+         */
+        void
+        scheduleWriteQueue(tiff_map::iterator            file,
+                           std::unique_lock<std::mutex>& lock) const;
+
+        /**
+         * Write queued planes until the queue is empty (write-behind
+         * task).
+         *
+         * The task stops early if a waiting thread is writing a
+         * queued plane.
+         *
+         * @param writer the writer which queued the planes.
+         * @param queue the queue to write.
+         * @param file the TIFF file to write to.
+         */
+        static void
+        writeQueuedPlanes(const OMETIFFWriter        *writer,
+                          std::shared_ptr<WriteQueue> queue,
+                          tiff_map::iterator          file);
+
+        /**
+         * Write the next queued plane or IFD change of a file.
+         *
+         * @param file the TIFF file to write to.
+         * @param q the file's queue.
+         * @param lock the lock on the file's queue (held, but
+         * released while writing).
+         * @returns @c true if a request was written, or @c false if
+         * the queue is empty or another thread is writing.
+         */
+        bool
+        writeQueuedPlane(tiff_map::iterator            file,
+                         WriteQueue&                   q,
+                         std::unique_lock<std::mutex>& lock) const;
+
+        /**
+         * Wait for a condition on the write-behind queue of a file.
+         *
+         * Rather than blocking until the write-behind task writes
+         * the queued planes, the calling thread writes them itself.
+         * The task might otherwise never run, for example if the
+         * caller is itself a task of the same executor.
+         *
+         * @param file the TIFF file.
+         * @param lock the lock on the file's queue (held).
+         * @param done the condition to wait for.
+         */
+        void
+        waitWriteQueue(tiff_map::iterator            file,
+                       std::unique_lock<std::mutex>& lock,
+                       const std::function<bool ()>& done) const;
+
+        /**
+         * Wait for all queued planes of a file to be written.
+         *
+         * @param file the TIFF file.
+         * @throws the first error writing a queued plane.
+         */
+        void
+        drainWriteQueue(tiff_map::iterator file) const;
+
+        /// Wait for all write-behind tasks after writing any queued planes.
+        void
+        stopWriteQueue();
+
+        /**
+         * Select the codec and predictor by measurement, if pending.
+         *
+         * The sample tiles are taken from the pixel data to be
+         * written.  The selected codec and predictor are used for
+         * all IFDs, including the current IFDs which have not yet
+         * been written.
+         *
+         * @param buf the pixel data to sample.
+         * @param series the image series of the pixel data.
+         * @param plane the plane index of the pixel data.
+         */
+        void
+        tuneCodec(const VariantPixelBuffer& buf,
+                  dimension_size_type       series,
+                  dimension_size_type       plane);
+
+        /**
+         * Get the strip or tile layout for an image.
+         *
+         * The layout is determined by the tile size options, if set,
+         * falling back to the layout profile.  The default profile
+         * uses strips for narrow images and tiles for wide images.
+         * The other profiles size strips or tiles by the number of
+         * bytes in each, using the pixel type, samples and
+         * compression type.
+         *
+         * @param sizeX the image width.
+         * @param sizeY the image height.
+         * @param pixeltype the pixel type.
+         * @param samples the number of samples in each strip or tile.
+         * @param type the tile type to set.
+         * @param width the tile width to set.
+         * @param height the tile height (or rows per strip) to set.
+         * @throws FormatException if @c sizeX is zero.
+         */
+        void
+        getTileLayout(dimension_size_type                 sizeX,
+                      dimension_size_type                 sizeY,
+                      ome::xml::model::enums::PixelType   pixeltype,
+                      dimension_size_type                 samples,
+                      tiff::TileType&                     type,
+                      dimension_size_type&                width,
+                      dimension_size_type&                height) const;
+
+        /**
+         * Get the expected size of the planes of a series.
+         *
+         * This is the size of the pixel data for all planes in the
+         * series, padded to whole strips or tiles, plus an allowance
+         * for the IFD and strip or tile offsets for each plane.  It is
+         * exact only for uncompressed data.
+         *
+         * @param series the series to size.
+         * @returns the expected size in bytes.
+         */
+        storage_size_type
+        expectedSeriesSize(dimension_size_type series) const;
+
         /**
          * Fill MetadataStore with cached metadata.
          *
@@ -247,6 +738,156 @@ namespace ome
          */
         boost::optional<bool>
         getBigTIFF() const;
+
+        /**
+         * Set the output buffer size.
+         *
+         * Small sequential writes to each TIFF file are gathered
+         * into a buffer of this size and written to the file as a
+         * single large write, which is considerably faster on network
+         * and parallel filesystems.  The default is 4 MiB.
+         *
+         * This must be set before calling setId() to take effect, and
+         * is reset to the default by close().
+         *
+         * @param size the buffer size in bytes, or 0 to disable
+         * buffering.
+         */
+        void
+        setWriteBufferSize(dimension_size_type size);
+
+        /**
+         * Get the output buffer size.
+         *
+         * @returns the buffer size in bytes, or 0 if unbuffered.
+         */
+        dimension_size_type
+        getWriteBufferSize() const;
+
+        /**
+         * Set whether to preallocate storage.
+         *
+         * If enabled, the expected size of the pixel data of each
+         * series is reserved in the file which is current when the
+         * series is first selected, to reduce fragmentation.  This is
+         * only done for uncompressed data, where the size is known in
+         * advance.  Any unused space is released when the file is
+         * closed.
+         *
+         * This is disabled by default, since filesystems without
+         * native preallocation (including many parallel filesystems)
+         * emulate it by writing every reserved block in advance.
+         *
+         * This must be set before calling setId() to take effect, and
+         * is reset to @c false by close().
+         *
+         * @param preallocate @c true to preallocate, @c false otherwise.
+         */
+        void
+        setPreallocate(bool preallocate);
+
+        /**
+         * Get whether to preallocate storage.
+         *
+         * @returns @c true if preallocating, @c false otherwise.
+         */
+        bool
+        getPreallocate() const;
+
+        /**
+         * Set whether to write data bypassing the page cache.
+         *
+         * If enabled, buffered output is written to the file using
+         * direct (uncached) I/O where supported by the platform and
+         * filesystem.  This avoids evicting other data from the page
+         * cache when writing very large datasets, but is only useful
+         * with a large output buffer.  The default is disabled.
+         *
+         * This must be set before calling setId() to take effect, and
+         * is reset to the default by close().
+         *
+         * @param direct @c true to enable, @c false to disable.
+         */
+        void
+        setDirectIO(bool direct);
+
+        /**
+         * Get whether to write data bypassing the page cache.
+         *
+         * @returns @c true if enabled, @c false otherwise.
+         */
+        bool
+        getDirectIO() const;
+
+        /**
+         * Set the predictor to use with compression.
+         *
+         * The predictor is applied before compression, and can
+         * improve the compression ratio.  It is only supported by
+         * some codecs, including LZW and Deflate.  The default is
+         * none (no predictor).
+         *
+         * This is reset to the default by close().
+         *
+         * @param predictor the predictor, or none to disable.
+         */
+        void
+        setPredictor(boost::optional<tiff::Predictor> predictor);
+
+        /**
+         * Get the predictor to use with compression.
+         *
+         * @returns the predictor, or none if disabled.
+         */
+        boost::optional<tiff::Predictor>
+        getPredictor() const;
+
+        /**
+         * Set codec tuning.
+         *
+         * If enabled, the codec and predictor are chosen when the
+         * first plane is written, by compressing sample tiles from
+         * the plane with each candidate codec and picking the best
+         * for the tuning target.
+         *
+         * Tuning overrides any codec set with setCompression() and
+         * any predictor set with setPredictor(); these are replaced
+         * by the selection, which may be no compression, and may be
+         * queried with getCompression() and getPredictor() once the
+         * first plane has been written.  The strip or tile layout of
+         * the LAYOUT_RANDOM_ACCESS and LAYOUT_ARCHIVAL profiles is
+         * chosen as for compressed data, whichever codec is selected,
+         * so that every plane has the layout used for the
+         * measurements.  Storage is not preallocated when tuning is
+         * enabled.  The default is disabled.
+         *
+         * This must be set before calling setId() to take effect, and
+         * is reset to the default by close().
+         *
+         * @param tuning the tuning settings, or none to disable.
+         */
+        void
+        setCodecTuning(const boost::optional<tiff::CodecTuning>& tuning);
+
+        /**
+         * Get codec tuning.
+         *
+         * @returns the tuning settings, or none if disabled.
+         */
+        const boost::optional<tiff::CodecTuning>&
+        getCodecTuning() const;
+
+        /**
+         * Get the codec measurements made by codec tuning.
+         *
+         * The measurements remain available after close(), until
+         * the next tuning.
+         *
+         * @returns the measurements for each codec and predictor, or
+         * an empty list if tuning has not been done.
+         */
+        const std::vector<tiff::CodecMeasurement>&
+        getCodecMeasurements() const;
       };
 
     }
@@ -0,0 +1,383 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/format.hpp>
+
+#include <ome/files/PixelProperties.h>
+#include <ome/files/PlaneRegion.h>
+#include <ome/files/tiff/Codec.h>
+#include <ome/files/tiff/CodecTuning.h>
+#include <ome/files/tiff/Exception.h>
+#include <ome/files/tiff/Field.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/tiff/Tags.h>
+#include <ome/files/tiff/TIFF.h>
+
+using ome::xml::model::enums::PixelType;
+
+namespace ome
+{
+  namespace files
+  {
+    namespace tiff
+    {
+
+      namespace
+      {
+
+        /// Clock used for codec timings.
+        typedef std::chrono::steady_clock tuning_clock;
+
+        double
+        elapsed(tuning_clock::time_point start)
+        {
+          return std::chrono::duration<double>(tuning_clock::now() - start).count();
+        }
+
+        /// Temporary file, removed on destruction.
+        struct TemporaryFile
+        {
+          /// File path.
+          boost::filesystem::path path;
+
+          TemporaryFile():
+            path(boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("ome-files-codec-%%%%-%%%%-%%%%-%%%%.tiff"))
+          {}
+
+          ~TemporaryFile()
+          {
+            boost::system::error_code ec;
+            boost::filesystem::remove(path, ec);
+          }
+        };
+
+        /**
+         * Copy sample tiles from a plane into a buffer, with the
+         * tiles stacked vertically.
+         */
+        struct SampleVisitor : public boost::static_visitor<>
+        {
+          /// Destination buffer.
+          VariantPixelBuffer& dest;
+          /// Tiles to copy.
+          const std::vector<PlaneRegion>& tiles;
+
+          SampleVisitor(VariantPixelBuffer&             dest,
+                        const std::vector<PlaneRegion>& tiles):
+            dest(dest),
+            tiles(tiles)
+          {}
+
+          template<typename T>
+          void
+          operator()(const std::shared_ptr<T>& src)
+          {
+            T& d = *boost::get<std::shared_ptr<T>>(dest.vbuffer());
+
+            typedef boost::multi_array_types::index index;
+            typedef boost::multi_array_types::index_range range;
+            for (std::vector<PlaneRegion>::size_type i = 0; i < tiles.size(); ++i)
+              {
+                const PlaneRegion& r(tiles[i]);
+                const index dy = static_cast<index>(i * r.h);
+                d.array()[boost::indices[range(0, static_cast<index>(r.w))][range(dy, dy + static_cast<index>(r.h))][range()][range()][range()][range()][range()][range()][range()]] =
+                  src->array()[boost::indices[range(static_cast<index>(r.x), static_cast<index>(r.x + r.w))][range(static_cast<index>(r.y), static_cast<index>(r.y + r.h))][range()][range()][range()][range()][range()][range()][range()]];
+              }
+          }
+        };
+
+        /**
+         * Get the predictor suited to a pixel type.
+         *
+         * @param pixeltype the pixel type.
+         * @returns the predictor, or NONE if there is none.
+         */
+        Predictor
+        typePredictor(PixelType pixeltype)
+        {
+          switch(pixeltype)
+            {
+            case PixelType::FLOAT:
+            case PixelType::DOUBLE:
+              return FLOATING_POINT;
+            case PixelType::BIT:
+            case PixelType::COMPLEXFLOAT:
+            case PixelType::COMPLEXDOUBLE:
+              return NONE;
+            default:
+              return HORIZONTAL;
+            }
+        }
+
+        /**
+         * Write and read back sample data with a codec.
+         *
+         * @param sample the sample data (tiles stacked vertically).
+         * @param tileHeight the height of each tile.
+         * @param measurement the codec and predictor to use, and the
+         * measurements to set.
+         */
+        void
+        measure(const VariantPixelBuffer& sample,
+                dimension_size_type       tileHeight,
+                CodecMeasurement&         measurement)
+        {
+          const VariantPixelBuffer::size_type *shape(sample.shape());
+          const PixelType pixeltype(sample.pixelType());
+          const bool contig = sample.storage_order().ordering(0) == DIM_SUBCHANNEL;
+
+          TemporaryFile file;
+
+          tuning_clock::time_point start(tuning_clock::now());
+          {
+            std::shared_ptr<TIFF> tiff(TIFF::open(file.path, "w"));
+            std::shared_ptr<IFD> ifd(tiff->getCurrentDirectory());
+
+            // One strip per sample tile.
+            ifd->setImageWidth(static_cast<uint32_t>(shape[DIM_SPATIAL_X]));
+            ifd->setImageHeight(static_cast<uint32_t>(shape[DIM_SPATIAL_Y]));
+            ifd->setTileType(STRIP);
+            ifd->setTileWidth(static_cast<uint32_t>(shape[DIM_SPATIAL_X]));
+            ifd->setTileHeight(static_cast<uint32_t>(tileHeight));
+            ifd->setPixelType(pixeltype);
+            ifd->setBitsPerSample(bitsPerPixel(pixeltype));
+            ifd->setSamplesPerPixel(static_cast<uint16_t>(shape[DIM_SUBCHANNEL]));
+            ifd->setPlanarConfiguration(contig ? CONTIG : SEPARATE);
+            ifd->setPhotometricInterpretation(MIN_IS_BLACK);
+            ifd->setCompression(measurement.scheme);
+            if (measurement.predictor != NONE)
+              ifd->getField(PREDICTOR).set(measurement.predictor);
+
+            ifd->writeImage(sample);
+            tiff->writeCurrentDirectory();
+            tiff->close();
+          }
+          measurement.encodeSeconds = elapsed(start);
+
+          std::shared_ptr<TIFF> tiff(TIFF::open(file.path, "r"));
+          std::shared_ptr<IFD> ifd(tiff->getDirectoryByIndex(0));
+
+          const std::vector<uint64_t>& bytecounts(ifd->getTileByteCounts());
+          measurement.encodedBytes = 0U;
+          for (const auto& count : bytecounts)
+            measurement.encodedBytes += count;
+
+          start = tuning_clock::now();
+          VariantPixelBuffer check;
+          ifd->readImage(check);
+          measurement.decodeSeconds = elapsed(start);
+
+          if (!(check == sample))
+            {
+              boost::format fmt("Codec %1% did not preserve pixel data");
+              fmt % measurement.name;
+              throw Exception(fmt.str());
+            }
+        }
+
+      }
+
+      CodecTuning::CodecTuning():
+        target(MIN_SIZE),
+        minThroughput(0.0),
+        sampleTiles(8U),
+        codecs()
+      {
+      }
+
+      CodecMeasurement::CodecMeasurement():
+        name(),
+        scheme(COMPRESSION_NONE),
+        predictor(NONE),
+        rawBytes(0U),
+        encodedBytes(0U),
+        encodeSeconds(0.0),
+        decodeSeconds(0.0)
+      {
+      }
+
+      double
+      CodecMeasurement::ratio() const
+      {
+        return encodedBytes ? static_cast<double>(rawBytes) / static_cast<double>(encodedBytes) : 0.0;
+      }
+
+      double
+      CodecMeasurement::encodeThroughput() const
+      {
+        return encodeSeconds > 0.0 ? static_cast<double>(rawBytes) / encodeSeconds : 0.0;
+      }
+
+      double
+      CodecMeasurement::decodeThroughput() const
+      {
+        return decodeSeconds > 0.0 ? static_cast<double>(rawBytes) / decodeSeconds : 0.0;
+      }
+
+      std::vector<CodecMeasurement>
+      measureCodecs(const VariantPixelBuffer& plane,
+                    dimension_size_type       tileWidth,
+                    dimension_size_type       tileHeight,
+                    const CodecTuning&        tuning)
+      {
+        std::vector<CodecMeasurement> measurements;
+
+        std::array<VariantPixelBuffer::size_type, PixelBufferBase::dimensions> shape;
+        std::copy(plane.shape(), plane.shape() + PixelBufferBase::dimensions, shape.begin());
+        const dimension_size_type sizeX = shape[DIM_SPATIAL_X];
+        const dimension_size_type sizeY = shape[DIM_SPATIAL_Y];
+        if (!sizeX || !sizeY || !tileWidth || !tileHeight || !tuning.sampleTiles)
+          return measurements;
+
+        // Pick tiles spread evenly over the tile grid; edge tiles are
+        // moved inside the plane so that all tiles are whole.
+        const dimension_size_type w = std::min(tileWidth, sizeX);
+        const dimension_size_type h = std::min(tileHeight, sizeY);
+        const dimension_size_type tilesX = (sizeX + w - 1U) / w;
+        const dimension_size_type tilesY = (sizeY + h - 1U) / h;
+        const dimension_size_type ntiles = tilesX * tilesY;
+        const dimension_size_type nsample = std::min(tuning.sampleTiles, ntiles);
+
+        std::vector<PlaneRegion> tiles;
+        for (dimension_size_type i = 0U; i < nsample; ++i)
+          {
+            const dimension_size_type tile = (i * ntiles) / nsample;
+            const dimension_size_type x = std::min((tile % tilesX) * w, sizeX - w);
+            const dimension_size_type y = std::min((tile / tilesX) * h, sizeY - h);
+            tiles.push_back(PlaneRegion(x, y, w, h));
+          }
+
+        shape[DIM_SPATIAL_X] = w;
+        shape[DIM_SPATIAL_Y] = h * nsample;
+        VariantPixelBuffer sample;
+        sample.setBuffer(shape, plane.pixelType(), plane.storage_order());
+        SampleVisitor v(sample, tiles);
+        boost::apply_visitor(v, plane.vbuffer());
+
+        const storage_size_type rawBytes = sample.num_elements() * bytesPerPixel(plane.pixelType());
+
+        // Candidate codecs, with no compression as a baseline.  JPEG
+        // is lossy, so is only used if requested explicitly.
+        std::vector<std::string> codecs(tuning.codecs);
+        if (codecs.empty())
+          {
+            for (const auto& name : getCodecNames(plane.pixelType()))
+              if (getCodecScheme(name) != COMPRESSION_JPEG)
+                codecs.push_back(name);
+          }
+        codecs.insert(codecs.begin(), "None");
+
+        const Predictor predictor(typePredictor(plane.pixelType()));
+
+        for (const auto& name : codecs)
+          {
+            const Compression scheme(getCodecScheme(name));
+            if (scheme == COMPRESSION_NONE && name != "None")
+              continue; // Unknown codec.
+            if (scheme == COMPRESSION_NONE && !measurements.empty())
+              continue; // Baseline already measured.
+
+            std::vector<Predictor> predictors{NONE};
+            if (scheme != COMPRESSION_NONE && predictor != NONE)
+              predictors.push_back(predictor);
+
+            for (const auto pred : predictors)
+              {
+                CodecMeasurement m;
+                m.name = name;
+                m.scheme = scheme;
+                m.predictor = pred;
+                m.rawBytes = rawBytes;
+                try
+                  {
+                    measure(sample, h, m);
+                    measurements.push_back(m);
+                  }
+                catch (const std::exception&)
+                  {
+                    // Codec or predictor unusable with this data.
+                  }
+              }
+          }
+
+        return measurements;
+      }
+
+      const CodecMeasurement&
+      selectCodec(const std::vector<CodecMeasurement>& measurements,
+                  const CodecTuning&                   tuning)
+      {
+        if (measurements.empty())
+          throw Exception("No codec measurements available for selection");
+
+        const CodecMeasurement *fastest = &measurements.front();
+        const CodecMeasurement *best = nullptr;
+        for (const auto& m : measurements)
+          {
+            if (m.encodeThroughput() > fastest->encodeThroughput())
+              fastest = &m;
+
+            if (tuning.target == CodecTuning::MAX_THROUGHPUT)
+              {
+                if (m.ratio() > 1.0 &&
+                    (!best || m.encodeThroughput() > best->encodeThroughput()))
+                  best = &m;
+              }
+            else
+              {
+                if (m.encodeThroughput() >= tuning.minThroughput &&
+                    (!best || m.encodedBytes < best->encodedBytes ||
+                     (m.encodedBytes == best->encodedBytes &&
+                      m.encodeThroughput() > best->encodeThroughput())))
+                  best = &m;
+              }
+          }
+
+        return best ? *best : *fastest;
+      }
+
+    }
+  }
+}
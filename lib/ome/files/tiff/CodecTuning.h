@@ -0,0 +1,191 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2006 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef OME_FILES_TIFF_CODECTUNING_H
+#define OME_FILES_TIFF_CODECTUNING_H
+
+#include <string>
+#include <vector>
+
+#include <ome/files/Types.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/tiff/Types.h>
+
+namespace ome
+{
+  namespace files
+  {
+    namespace tiff
+    {
+
+      /**
+       * Settings for empirical codec selection.
+       *
+       * Sample tiles are compressed with each candidate codec, with
+       * and without a predictor, and the best is chosen for the
+       * target.
+       */
+      struct CodecTuning
+      {
+        /// Selection target.
+        enum Target
+          {
+            /**
+             * Fastest encoding codec which reduces the size of the
+             * data, or the fastest codec if none do.
+             */
+            MAX_THROUGHPUT,
+            /**
+             * Smallest encoded size with an encoding throughput of at
+             * least @c minThroughput, or the fastest codec if none
+             * are fast enough.
+             */
+            MIN_SIZE
+          };
+
+        /// Selection target.
+        Target target;
+        /// Minimum encoding throughput for MIN_SIZE (bytes per second).
+        double minThroughput;
+        /// Maximum number of sample tiles to compress.
+        dimension_size_type sampleTiles;
+        /**
+         * Candidate codec names.  If empty, all lossless codecs
+         * available for the pixel type are used.
+         */
+        std::vector<std::string> codecs;
+
+        /// Constructor.
+        CodecTuning();
+      };
+
+      /// Measured performance of a codec and predictor.
+      struct CodecMeasurement
+      {
+        /// Codec name.
+        std::string name;
+        /// Codec number.
+        Compression scheme;
+        /// Predictor.
+        Predictor predictor;
+        /// Size of the uncompressed sample tiles (bytes).
+        storage_size_type rawBytes;
+        /// Size of the compressed sample tiles (bytes).
+        storage_size_type encodedBytes;
+        /// Time to compress and write the sample tiles (seconds).
+        double encodeSeconds;
+        /// Time to read and decompress the sample tiles (seconds).
+        double decodeSeconds;
+
+        /// Constructor.
+        CodecMeasurement();
+
+        /**
+         * Get the compression ratio.
+         *
+         * @returns the uncompressed size divided by the compressed
+         * size.
+         */
+        double
+        ratio() const;
+
+        /**
+         * Get the encoding throughput.
+         *
+         * @returns uncompressed bytes encoded per second.
+         */
+        double
+        encodeThroughput() const;
+
+        /**
+         * Get the decoding throughput.
+         *
+         * @returns uncompressed bytes decoded per second.
+         */
+        double
+        decodeThroughput() const;
+      };
+
+      /**
+       * Measure codec performance with sample tiles from a plane.
+       *
+       * Up to @c tuning.sampleTiles tiles, spread evenly over the
+       * plane, are written to a temporary TIFF file and read back
+       * with each candidate codec.  Each codec is measured without
+       * a predictor, and also with the predictor for the pixel type
+       * (horizontal differencing for integer types, or floating
+       * point) if the codec supports it.  No compression is always
+       * measured, as a baseline.  Candidates which can't be used
+       * with the pixel data are skipped.
+       *
+       * @param plane the plane to sample; the planar configuration
+       * follows the storage order of the buffer.
+       * @param tileWidth the width of each sample tile.
+       * @param tileHeight the height of each sample tile.
+       * @param tuning the tuning settings.
+       * @returns the measurements for each usable codec and
+       * predictor.
+       */
+      std::vector<CodecMeasurement>
+      measureCodecs(const VariantPixelBuffer& plane,
+                    dimension_size_type       tileWidth,
+                    dimension_size_type       tileHeight,
+                    const CodecTuning&        tuning);
+
+      /**
+       * Select the best codec measurement for a tuning target.
+       *
+       * @param measurements the measurements to select from.
+       * @param tuning the tuning settings.
+       * @returns the selected measurement.
+       * @throws Exception if @c measurements is empty.
+       */
+      const CodecMeasurement&
+      selectCodec(const std::vector<CodecMeasurement>& measurements,
+                  const CodecTuning&                   tuning);
+
+    }
+  }
+}
+
+#endif // OME_FILES_TIFF_CODECTUNING_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
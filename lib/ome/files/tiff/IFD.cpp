@@ -36,12 +36,24 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <complex>
+#include <condition_variable>
 #include <cstdarg>
 #include <cassert>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include <fcntl.h> // For O_RDONLY on Unix and Windows
 
 #include <boost/format.hpp>
+#include <boost/optional.hpp>
 
+#include <ome/files/Executor.h>
 #include <ome/files/PlaneRegion.h>
 #include <ome/files/TileBuffer.h>
 #include <ome/files/TileCache.h>
@@ -51,17 +63,21 @@
 #include <ome/files/tiff/TIFF.h>
 #include <ome/files/tiff/Sentry.h>
 #include <ome/files/tiff/Exception.h>
+#include <ome/files/detail/tiff/TagTable.h>
 
 #include <ome/common/string.h>
 
 #include <tiffio.h>
 
+#include <zlib.h>
+
 using ome::xml::model::enums::PixelType;
 
 namespace
 {
 
   using namespace ::ome::files::tiff;
+  using ::ome::files::CancellationToken;
   using ::ome::files::dimension_size_type;
   using ::ome::files::PixelBuffer;
   using ::ome::files::PixelProperties;
@@ -69,6 +85,8 @@ namespace
   using ::ome::files::TileBuffer;
   using ::ome::files::TileCache;
   using ::ome::files::TileCoverage;
+  using ::ome::files::TileSchedule;
+  using ::ome::files::VariantPixelBuffer;
 
   // VariantPixelBuffer tile transfer
   // ────────────────────────────────
@@ -118,6 +136,81 @@ namespace
   // chunks where the tile widths are compatible, or individual
   // scanlines where they are not compatible.
 
+  // Unpack samples from an MSB-first packed bitstream.
+  template<typename T>
+  inline
+  void
+  unpack_bits(const uint8_t       *src,
+              T                   *dest,
+              dimension_size_type  count,
+              uint16_t             bits)
+  {
+    const uint32_t mask = (1U << bits) - 1U;
+    for (dimension_size_type i = 0; i < count; ++i)
+      {
+        const dimension_size_type bit = i * bits;
+        const uint8_t *p = src + (bit / 8U);
+        const dimension_size_type shift = bit % 8U;
+        // At most 3 bytes for sample sizes up to 16 bits.
+        const dimension_size_type nbytes = (shift + bits + 7U) / 8U;
+        uint32_t word = 0U;
+        for (dimension_size_type b = 0; b < nbytes; ++b)
+          word = (word << 8) | p[b];
+        word >>= (nbytes * 8U) - shift - bits;
+        dest[i] = static_cast<T>(word & mask);
+      }
+  }
+
+  /*
+   * Unpack a row of packed samples.
+   *
+   * The common camera bit depths use fixed-size groups of whole
+   * bytes, which are unpacked with straight-line shifts and masks
+   * that the compiler can vectorise; any remaining samples, and all
+   * other bit depths, use the generic bitstream unpacker.
+   */
+  template<typename T>
+  inline
+  void
+  unpack_row(const uint8_t       *src,
+             T                   *dest,
+             dimension_size_type  count,
+             uint16_t             bits)
+  {
+    dimension_size_type i = 0;
+    switch (bits)
+      {
+      case 10: // 4 samples in 5 bytes.
+        for (; i + 4U <= count; i += 4U, src += 5U)
+          {
+            dest[i]      = static_cast<T>((src[0] << 2) | (src[1] >> 6));
+            dest[i + 1U] = static_cast<T>(((src[1] & 0x3FU) << 4) | (src[2] >> 4));
+            dest[i + 2U] = static_cast<T>(((src[2] & 0x0FU) << 6) | (src[3] >> 2));
+            dest[i + 3U] = static_cast<T>(((src[3] & 0x03U) << 8) | src[4]);
+          }
+        break;
+      case 12: // 2 samples in 3 bytes.
+        for (; i + 2U <= count; i += 2U, src += 3U)
+          {
+            dest[i]      = static_cast<T>((src[0] << 4) | (src[1] >> 4));
+            dest[i + 1U] = static_cast<T>(((src[1] & 0x0FU) << 8) | src[2]);
+          }
+        break;
+      case 14: // 4 samples in 7 bytes.
+        for (; i + 4U <= count; i += 4U, src += 7U)
+          {
+            dest[i]      = static_cast<T>((src[0] << 6) | (src[1] >> 2));
+            dest[i + 1U] = static_cast<T>(((src[1] & 0x03U) << 12) | (src[2] << 4) | (src[3] >> 4));
+            dest[i + 2U] = static_cast<T>(((src[3] & 0x0FU) << 10) | (src[4] << 2) | (src[5] >> 6));
+            dest[i + 3U] = static_cast<T>(((src[5] & 0x3FU) << 8) | src[6]);
+          }
+        break;
+      default:
+        break;
+      }
+    unpack_bits(src, dest + i, count - i, bits);
+  }
+
   struct ReadVisitor : public boost::static_visitor<>
   {
     const IFD&                              ifd;
@@ -125,16 +218,26 @@ namespace
     const PlaneRegion&                      region;
     const std::vector<dimension_size_type>& tiles;
     TileBuffer                              tilebuf;
+    uint16_t                                bits;
+    std::unique_ptr<TileBuffer>             unpackbuf;
+    const CancellationToken                *token;
+    const TileSchedule::callback_type      *callback;
 
     ReadVisitor(const IFD&                              ifd,
                 const TileInfo&                         tileinfo,
                 const PlaneRegion&                      region,
-                const std::vector<dimension_size_type>& tiles):
+                const std::vector<dimension_size_type>& tiles,
+                const CancellationToken                *token = nullptr,
+                const TileSchedule::callback_type      *callback = nullptr):
       ifd(ifd),
       tileinfo(tileinfo),
       region(region),
       tiles(tiles),
-      tilebuf(tileinfo.bufferSize())
+      tilebuf(tileinfo.bufferSize()),
+      bits(ifd.getBitsPerSample()),
+      unpackbuf(),
+      token(token),
+      callback(callback)
     {}
 
     ~ReadVisitor()
@@ -233,12 +336,30 @@ namespace
         }
     }
 
+    // Check if samples are packed into fewer bits than the pixel type.
+    template<typename T>
+    bool
+    packed(const std::shared_ptr<T>& /* buffer */) const
+    {
+      return bits < sizeof(typename T::value_type) * 8U;
+    }
+
+    // Special case for BIT
+    bool
+    packed(const std::shared_ptr<PixelBuffer<PixelProperties<PixelType::BIT>::std_type>>& /* buffer */) const
+    {
+      return false;
+    }
+
     template<typename T>
     dimension_size_type
-    expected_read(const std::shared_ptr<T>& /* buffer */,
+    expected_read(const std::shared_ptr<T>& buffer,
                   const PlaneRegion&        rclip,
                   uint16_t                  copysamples) const
     {
+      // Packed rows are padded to a whole number of bytes.
+      if (packed(buffer))
+        return rclip.h * (((rclip.w * copysamples * bits) + 7U) / 8U);
       return rclip.w * rclip.h * copysamples * sizeof(typename T::value_type);
     }
 
@@ -258,19 +379,76 @@ namespace
       return expectedread;
     }
 
+    // Unpack packed samples from the tile buffer.
+    template<typename T>
+    const TileBuffer&
+    unpack(const std::shared_ptr<T>& /* buffer */,
+           const PlaneRegion&        rfull,
+           uint16_t                  copysamples,
+           dimension_size_type       bytesread)
+    {
+      typedef typename T::value_type value_type;
+
+      const dimension_size_type rowsamples = rfull.w * copysamples;
+      const dimension_size_type rowbytes = ((rowsamples * bits) + 7U) / 8U;
+      const dimension_size_type rows = std::min(rfull.h, bytesread / rowbytes);
+      const dimension_size_type size = rowsamples * rfull.h * sizeof(value_type);
+
+      if (!unpackbuf || unpackbuf->size() < size)
+        unpackbuf = std::unique_ptr<TileBuffer>(new TileBuffer(size));
+
+      const uint8_t *src = reinterpret_cast<const uint8_t *>(tilebuf.data());
+      value_type *dest = reinterpret_cast<value_type *>(unpackbuf->data());
+      for (dimension_size_type row = 0; row < rows; ++row)
+        unpack_row(src + (row * rowbytes), dest + (row * rowsamples), rowsamples, bits);
+
+      return *unpackbuf;
+    }
+
+    /*
+     * Read a tile into the tile buffer, and check it was read fully.
+     *
+     * Returns the buffer containing the tile samples in the native
+     * pixel type: the tile buffer, or the unpack buffer for packed
+     * samples.
+     */
+    template<typename T>
+    const TileBuffer&
+    read_tile(const std::shared_ptr<T>& buffer,
+              tstrile_t                 tile,
+              const PlaneRegion&        rfull,
+              const PlaneRegion&        rclip,
+              uint16_t                  copysamples)
+    {
+      // Stop between tiles if the read was cancelled.
+      if (token)
+        token->check();
+
+      dimension_size_type bytesread = ifd.readTile(tile, tilebuf);
+      if (tileinfo.tileType() == TILE)
+        {
+          if (bytesread != tilebuf.size())
+            throw Exception("Failed to read encoded tile fully");
+        }
+      else
+        {
+          dimension_size_type expectedread = expected_read(buffer, rclip, copysamples);
+          if (bytesread < expectedread)
+            throw Exception("Failed to read encoded strip fully");
+        }
+
+      if (packed(buffer))
+        return unpack(buffer, rfull, copysamples, bytesread);
+      return tilebuf;
+    }
+
     template<typename T>
     void
     operator()(std::shared_ptr<T>& buffer)
     {
-      std::shared_ptr<::ome::files::tiff::TIFF>& tiff(ifd.getTIFF());
-      ::TIFF *tiffraw = reinterpret_cast<::TIFF *>(tiff->getWrapped());
-      TileType type = tileinfo.tileType();
-
       uint16_t samples = ifd.getSamplesPerPixel();
       PlanarConfiguration planarconfig = ifd.getPlanarConfiguration();
 
-      Sentry sentry;
-
       for(const auto i : tiles)
         {
           tstrile_t tile = static_cast<tstrile_t>(i);
@@ -286,23 +464,7 @@ namespace
               dest_subchannel = sample;
             }
 
-          if (type == TILE)
-            {
-              tmsize_t bytesread = TIFFReadEncodedTile(tiffraw, tile, tilebuf.data(), static_cast<tsize_t>(tilebuf.size()));
-              if (bytesread < 0)
-                sentry.error("Failed to read encoded tile");
-              else if (static_cast<dimension_size_type>(bytesread) != tilebuf.size())
-                sentry.error("Failed to read encoded tile fully");
-            }
-          else
-            {
-              tmsize_t bytesread = TIFFReadEncodedStrip(tiffraw, tile, tilebuf.data(), static_cast<tsize_t>(tilebuf.size()));
-              dimension_size_type expectedread = expected_read(buffer, rclip, copysamples);
-              if (bytesread < 0)
-                sentry.error("Failed to read encoded strip");
-              else if (static_cast<dimension_size_type>(bytesread) < expectedread)
-                sentry.error("Failed to read encoded strip fully");
-            }
+          const TileBuffer& tiledata(read_tile(buffer, tile, rfull, rclip, copysamples));
 
           typename T::indices_type destidx;
           destidx[ome::files::DIM_SPATIAL_X] = 0;
@@ -312,11 +474,617 @@ namespace
             destidx[ome::files::DIM_CHANNEL] = destidx[ome::files::DIM_MODULO_Z] =
             destidx[ome::files::DIM_MODULO_T] = destidx[ome::files::DIM_MODULO_C] = 0;
 
-          transfer(buffer, destidx, tilebuf, rfull, rclip, copysamples);
+          transfer(buffer, destidx, tiledata, rfull, rclip, copysamples);
+
+          if (callback && *callback)
+            (*callback)(rclip);
         }
     }
   };
 
+  /*
+   * Run work for each of a number of items concurrently.
+   *
+   * Items are claimed one at a time by the calling thread and by
+   * executor tasks.  Each thread calls make_work() once, on claiming
+   * its first item, to get the function called with the index of
+   * each item it claims, so that per-thread state may be reused.
+   * The calling thread works until no items remain, and then only
+   * waits for items claimed by tasks, so it never waits for a task
+   * which has not started.  Tasks starting after all items are
+   * claimed do nothing, and do not call make_work().  The first
+   * exception thrown stops further items being claimed, and is
+   * rethrown once the claimed items are finished.
+   */
+  template<typename MakeWork>
+  void
+  run_concurrently(::ome::files::Executor& executor,
+                   dimension_size_type     count,
+                   MakeWork                make_work)
+  {
+    struct State
+    {
+      std::mutex              mutex;
+      std::condition_variable idle;
+      dimension_size_type     next;
+      dimension_size_type     running;
+      std::exception_ptr      error;
+    };
+
+    std::shared_ptr<State> state(std::make_shared<State>());
+    state->next = state->running = 0U;
+
+    auto work = [state, count, make_work]()
+      {
+        std::unique_ptr<decltype(make_work())> worker;
+
+        while (true)
+          {
+            dimension_size_type item;
+            {
+              std::lock_guard<std::mutex> lock(state->mutex);
+              if (state->error || state->next == count)
+                break;
+              item = state->next++;
+              ++state->running;
+            }
+
+            try
+              {
+                if (!worker)
+                  worker = std::unique_ptr<decltype(make_work())>(new decltype(make_work())(make_work()));
+                (*worker)(item);
+              }
+            catch (...)
+              {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error)
+                  state->error = std::current_exception();
+              }
+
+            {
+              std::lock_guard<std::mutex> lock(state->mutex);
+              --state->running;
+            }
+            state->idle.notify_all();
+          }
+      };
+
+    if (!count)
+      return;
+
+    const dimension_size_type tasks = std::min(count, executor.concurrency()) - 1U;
+    for (dimension_size_type i = 0; i < tasks; ++i)
+      executor.submit(work);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->idle.wait(lock, [&state]{ return state->running == 0U; });
+    if (state->error)
+      std::rethrow_exception(state->error);
+  }
+
+  /*
+   * Read a set of tiles concurrently using the shared I/O executor.
+   *
+   * This is only useful for tiles read directly from the file,
+   * which do not take the libtiff lock.  Each thread reads its
+   * tiles with its own ReadVisitor.
+   */
+  void
+  read_tiles_concurrently(const IFD&                              ifd,
+                          const TileInfo&                         tileinfo,
+                          const PlaneRegion&                      region,
+                          const std::vector<dimension_size_type>& tiles,
+                          VariantPixelBuffer&                     dest)
+  {
+    run_concurrently(*::ome::files::Executor::sharedIO(), tiles.size(),
+                     [&ifd, &tileinfo, &region, &tiles, &dest]()
+                     {
+                       std::shared_ptr<std::vector<dimension_size_type>> tile(std::make_shared<std::vector<dimension_size_type>>(1U));
+                       std::shared_ptr<ReadVisitor> v(std::make_shared<ReadVisitor>(ifd, tileinfo, region, *tile));
+                       return [tile, v, &tiles, &dest](dimension_size_type item)
+                         {
+                           (*tile)[0] = tiles[item];
+                           boost::apply_visitor(*v, dest.vbuffer());
+                         };
+                     });
+  }
+
+  // Accumulator type for decimation by averaging.
+  template<typename T>
+  struct DecimateAccumulator
+  {
+    typedef double type;
+  };
+
+  // Complex types average real and imaginary parts together.
+  template<typename T>
+  struct DecimateAccumulator<std::complex<T>>
+  {
+    typedef std::complex<double> type;
+  };
+
+  // Convert an average to an integer pixel value (round to nearest).
+  template<typename T>
+  inline
+  typename std::enable_if<std::is_integral<T>::value &&
+                          !std::is_same<T, bool>::value, T>::type
+  decimated_value(double v)
+  {
+    return static_cast<T>(std::floor(v + 0.5));
+  }
+
+  // Convert an average to a floating point pixel value.
+  template<typename T>
+  inline
+  typename std::enable_if<std::is_floating_point<T>::value, T>::type
+  decimated_value(double v)
+  {
+    return static_cast<T>(v);
+  }
+
+  // Convert an average to a bit pixel value (set if half or more are set).
+  template<typename T>
+  inline
+  typename std::enable_if<std::is_same<T, bool>::value, T>::type
+  decimated_value(double v)
+  {
+    return v >= 0.5;
+  }
+
+  // Convert an average to a complex pixel value.
+  template<typename T>
+  inline
+  typename std::enable_if<!std::is_arithmetic<T>::value, T>::type
+  decimated_value(const std::complex<double>& v)
+  {
+    typedef typename T::value_type component_type;
+    return T(static_cast<component_type>(v.real()),
+             static_cast<component_type>(v.imag()));
+  }
+
+  // Get a sample from a tile buffer.
+  template<typename T>
+  inline
+  T
+  tile_value(const TileBuffer&   tilebuf,
+             dimension_size_type index)
+  {
+    return reinterpret_cast<const T *>(tilebuf.data())[index];
+  }
+
+  // Special case for BIT
+  template<>
+  inline
+  PixelProperties<PixelType::BIT>::std_type
+  tile_value<PixelProperties<PixelType::BIT>::std_type>(const TileBuffer&   tilebuf,
+                                                        dimension_size_type index)
+  {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(tilebuf.data());
+    const uint8_t mask = static_cast<uint8_t>(1U << (7U - (index % 8U)));
+    return (src[index / 8U] & mask) != 0;
+  }
+
+  // Check if a range contains any position origin + (n × step).
+  inline
+  bool
+  contains_sample(dimension_size_type start,
+                  dimension_size_type size,
+                  dimension_size_type origin,
+                  dimension_size_type step)
+  {
+    dimension_size_type first = origin + (((start - origin) + step - 1) / step) * step;
+    return first < start + size;
+  }
+
+  // Read a region, decimating each step×step block to a single pixel.
+  struct DecimateVisitor : public ReadVisitor
+  {
+    dimension_size_type stepX;
+    dimension_size_type stepY;
+    Decimation          method;
+
+    DecimateVisitor(const IFD&                              ifd,
+                    const TileInfo&                         tileinfo,
+                    const PlaneRegion&                      region,
+                    const std::vector<dimension_size_type>& tiles,
+                    dimension_size_type                     stepX,
+                    dimension_size_type                     stepY,
+                    Decimation                              method):
+      ReadVisitor(ifd, tileinfo, region, tiles),
+      stepX(stepX),
+      stepY(stepY),
+      method(method)
+    {}
+
+    template<typename T>
+    void
+    operator()(std::shared_ptr<T>& buffer)
+    {
+      typedef typename T::value_type value_type;
+      typedef typename DecimateAccumulator<value_type>::type accum_type;
+
+      const uint16_t samples = ifd.getSamplesPerPixel();
+      const PlanarConfiguration planarconfig = ifd.getPlanarConfiguration();
+      const bool average = (method == DECIMATE_AVERAGE);
+
+      const dimension_size_type destw = buffer->shape()[ome::files::DIM_SPATIAL_X];
+      const dimension_size_type desth = buffer->shape()[ome::files::DIM_SPATIAL_Y];
+      const boost::multi_array_types::index *strides = buffer->strides();
+      value_type *dest = buffer->data();
+
+      // Per-sample sums for each destination pixel (averaging only).
+      std::vector<accum_type> sums;
+      if (average)
+        sums.assign(destw * desth * samples, accum_type(0));
+
+      for(const auto i : tiles)
+        {
+          tstrile_t tile = static_cast<tstrile_t>(i);
+          PlaneRegion rfull = tileinfo.tileRegion(tile);
+          PlaneRegion rclip = tileinfo.tileRegion(tile, region);
+          dimension_size_type sample = tileinfo.tileSample(tile);
+
+          uint16_t copysamples = samples;
+          dimension_size_type dest_subchannel = 0;
+          if (planarconfig == SEPARATE)
+            {
+              copysamples = 1;
+              dest_subchannel = sample;
+            }
+
+          // With nearest sampling, skip tiles containing no sampled
+          // pixels without decoding them.
+          if (!average &&
+              !(contains_sample(rclip.x, rclip.w, region.x, stepX) &&
+                contains_sample(rclip.y, rclip.h, region.y, stepY)))
+            continue;
+
+          const TileBuffer& tiledata(read_tile(buffer, tile, rfull, rclip, copysamples));
+
+          // Every pixel is used when averaging; otherwise only the
+          // first of each block.
+          const dimension_size_type xstep = average ? 1U : stepX;
+          const dimension_size_type ystep = average ? 1U : stepY;
+          const dimension_size_type xstart = average ? rclip.x :
+            region.x + (((rclip.x - region.x) + stepX - 1) / stepX) * stepX;
+          const dimension_size_type ystart = average ? rclip.y :
+            region.y + (((rclip.y - region.y) + stepY - 1) / stepY) * stepY;
+          const dimension_size_type row_width = rfull.w * copysamples;
+
+          for (dimension_size_type row = ystart;
+               row < rclip.y + rclip.h;
+               row += ystep)
+            {
+              const dimension_size_type dy = (row - region.y) / stepY;
+              const dimension_size_type yoffset = (row - rfull.y) * row_width;
+
+              for (dimension_size_type col = xstart;
+                   col < rclip.x + rclip.w;
+                   col += xstep)
+                {
+                  const dimension_size_type dx = (col - region.x) / stepX;
+                  const dimension_size_type srcoffset = yoffset + ((col - rfull.x) * copysamples);
+
+                  for (uint16_t s = 0; s < copysamples; ++s)
+                    {
+                      const dimension_size_type subc = dest_subchannel + s;
+                      const value_type value(tile_value<value_type>(tiledata, srcoffset + s));
+                      if (average)
+                        sums[((dy * destw) + dx) * samples + subc] += static_cast<accum_type>(value);
+                      else
+                        dest[dx * strides[ome::files::DIM_SPATIAL_X] +
+                             dy * strides[ome::files::DIM_SPATIAL_Y] +
+                             subc * strides[ome::files::DIM_SUBCHANNEL]] = value;
+                    }
+                }
+            }
+        }
+
+      if (average)
+        {
+          // Divide by the block area; edge blocks may be partial.
+          for (dimension_size_type dy = 0; dy < desth; ++dy)
+            {
+              const dimension_size_type bh = std::min(stepY, region.h - (dy * stepY));
+              for (dimension_size_type dx = 0; dx < destw; ++dx)
+                {
+                  const dimension_size_type bw = std::min(stepX, region.w - (dx * stepX));
+                  const double area = static_cast<double>(bw * bh);
+                  for (dimension_size_type s = 0; s < samples; ++s)
+                    dest[dx * strides[ome::files::DIM_SPATIAL_X] +
+                         dy * strides[ome::files::DIM_SPATIAL_Y] +
+                         s * strides[ome::files::DIM_SUBCHANNEL]] =
+                      decimated_value<value_type>(sums[((dy * destw) + dx) * samples + s] / area);
+                }
+            }
+        }
+    }
+  };
+
+  // Read a single subchannel, decoding only the tiles containing it.
+  struct SubchannelReadVisitor : public ReadVisitor
+  {
+    dimension_size_type subC;
+
+    SubchannelReadVisitor(const IFD&                              ifd,
+                          const TileInfo&                         tileinfo,
+                          const PlaneRegion&                      region,
+                          const std::vector<dimension_size_type>& tiles,
+                          dimension_size_type                     subC):
+      ReadVisitor(ifd, tileinfo, region, tiles),
+      subC(subC)
+    {}
+
+    template<typename T>
+    void
+    operator()(std::shared_ptr<T>& buffer)
+    {
+      typedef typename T::value_type value_type;
+
+      const uint16_t samples = ifd.getSamplesPerPixel();
+      const PlanarConfiguration planarconfig = ifd.getPlanarConfiguration();
+
+      typename T::indices_type destidx;
+      destidx[ome::files::DIM_SPATIAL_X] = 0;
+      destidx[ome::files::DIM_SPATIAL_Y] = 0;
+      destidx[ome::files::DIM_SUBCHANNEL] = 0;
+      destidx[ome::files::DIM_SPATIAL_Z] = destidx[ome::files::DIM_TEMPORAL_T] =
+        destidx[ome::files::DIM_CHANNEL] = destidx[ome::files::DIM_MODULO_Z] =
+        destidx[ome::files::DIM_MODULO_T] = destidx[ome::files::DIM_MODULO_C] = 0;
+
+      for(const auto i : tiles)
+        {
+          tstrile_t tile = static_cast<tstrile_t>(i);
+          PlaneRegion rfull = tileinfo.tileRegion(tile);
+          PlaneRegion rclip = tileinfo.tileRegion(tile, region);
+
+          if (planarconfig == SEPARATE)
+            {
+              // Tiles for other samples are not decoded; the tiles
+              // for this sample are copied as for a whole read.
+              if (tileinfo.tileSample(tile) != subC)
+                continue;
+
+              const TileBuffer& tiledata(read_tile(buffer, tile, rfull, rclip, 1U));
+              transfer(buffer, destidx, tiledata, rfull, rclip, 1U);
+            }
+          else
+            {
+              // De-interleave the requested sample.
+              const TileBuffer& tiledata(read_tile(buffer, tile, rfull, rclip, samples));
+
+              const dimension_size_type row_width = rfull.w * samples;
+              const dimension_size_type xoffset = ((rclip.x - rfull.x) * samples) + subC;
+
+              for (dimension_size_type row = rclip.y;
+                   row != rclip.y + rclip.h;
+                   ++row)
+                {
+                  const dimension_size_type srcoffset = ((row - rfull.y) * row_width) + xoffset;
+
+                  destidx[ome::files::DIM_SPATIAL_X] = rclip.x - region.x;
+                  destidx[ome::files::DIM_SPATIAL_Y] = row - region.y;
+
+                  value_type *dest = &buffer->at(destidx);
+                  for (dimension_size_type col = 0; col < rclip.w; ++col)
+                    dest[col] = tile_value<value_type>(tiledata, srcoffset + (col * samples));
+                }
+            }
+        }
+    }
+  };
+
+  struct ContiguousReadVisitor : public boost::static_visitor<>
+  {
+    typedef std::function<void (offset_type, void *, dimension_size_type)> read_function;
+
+    const PlaneRegion&  region;
+    offset_type         offset;
+    dimension_size_type width;
+    dimension_size_type height;
+    uint16_t            samples;
+    bool                interleaved;
+    read_function       read;
+
+    ContiguousReadVisitor(const PlaneRegion&  region,
+                          offset_type         offset,
+                          dimension_size_type width,
+                          dimension_size_type height,
+                          uint16_t            samples,
+                          bool                interleaved,
+                          read_function       read):
+      region(region),
+      offset(offset),
+      width(width),
+      height(height),
+      samples(samples),
+      interleaved(interleaved),
+      read(read)
+    {}
+
+    template<typename T>
+    void
+    operator()(std::shared_ptr<T>& buffer)
+    {
+      typedef typename T::value_type value_type;
+
+      const dimension_size_type planes = interleaved ? 1U : samples;
+      const dimension_size_type rowsamples = interleaved ? samples : 1U;
+      const dimension_size_type rowbytes = width * rowsamples * sizeof(value_type);
+
+      typename T::indices_type destidx;
+      std::fill(destidx.begin(), destidx.end(), 0);
+
+      // Each destination row is contiguous, so read it in place.
+      for (dimension_size_type p = 0; p < planes; ++p)
+        {
+          destidx[ome::files::DIM_SUBCHANNEL] = p;
+          for (dimension_size_type row = 0; row < region.h; ++row)
+            {
+              destidx[ome::files::DIM_SPATIAL_X] = 0;
+              destidx[ome::files::DIM_SPATIAL_Y] = row;
+
+              offset_type rowoffset = offset +
+                (((p * height) + region.y + row) * rowbytes) +
+                (region.x * rowsamples * sizeof(value_type));
+
+              read(rowoffset, &buffer->at(destidx),
+                   region.w * rowsamples * sizeof(value_type));
+            }
+        }
+    }
+
+    // Special case for BIT
+    void
+    operator()(std::shared_ptr<PixelBuffer<PixelProperties<PixelType::BIT>::std_type>>& /* buffer */)
+    {
+      throw Exception("Contiguous reading of bit data is not supported");
+    }
+  };
+
+  // Difference each sample from the previous pixel's, per row, as
+  // for the TIFF horizontal predictor.
+  template<typename T>
+  void
+  horizontal_difference(uint8_t             *data,
+                        dimension_size_type  size,
+                        dimension_size_type  rowsamples,
+                        dimension_size_type  stride)
+  {
+    T *samples = reinterpret_cast<T *>(data);
+    const dimension_size_type rows = size / (rowsamples * sizeof(T));
+
+    for (dimension_size_type row = 0; row < rows; ++row)
+      {
+        T *r = samples + (row * rowsamples);
+        for (dimension_size_type i = rowsamples - 1; i >= stride; --i)
+          r[i] = static_cast<T>(r[i] - r[i - stride]);
+      }
+  }
+
+  /*
+   * Encode tiles without libtiff.
+   *
+   * Encoding with libtiff requires holding the libtiff lock, which
+   * serialises encoding for all files.  Uncompressed and Deflate
+   * tiles, with or without horizontal prediction, are instead
+   * encoded here without the lock, and written with
+   * TIFFWriteRawTile() or TIFFWriteRawStrip().  The output is the
+   * same as libtiff would write.
+   */
+  struct TileEncoder
+  {
+    Compression         compression;
+    Predictor           predictor;
+    uint16_t            bits;
+    dimension_size_type rowsamples;
+    dimension_size_type stride;
+
+    // Get an encoder for an IFD, if its codec is supported.
+    static boost::optional<TileEncoder>
+    create(const IFD&      ifd,
+           const TileInfo& tileinfo)
+    {
+      TileEncoder encoder;
+
+      encoder.compression = ifd.getCompression();
+      if (encoder.compression != static_cast<Compression>(COMPRESSION_NONE) &&
+          encoder.compression != static_cast<Compression>(COMPRESSION_ADOBE_DEFLATE) &&
+          encoder.compression != static_cast<Compression>(COMPRESSION_DEFLATE))
+        return boost::none;
+
+      encoder.predictor = NONE;
+      if (encoder.compression != static_cast<Compression>(COMPRESSION_NONE))
+        {
+          try
+            {
+              ifd.getField(PREDICTOR).get(encoder.predictor);
+            }
+          catch (const Exception&)
+            {
+            }
+        }
+
+      FillOrder fillorder = MSB_TO_LSB;
+      try
+        {
+          ifd.getField(FILLORDER).get(fillorder);
+        }
+      catch (const Exception&)
+        {
+        }
+      if (fillorder != MSB_TO_LSB)
+        return boost::none;
+
+      encoder.bits = ifd.getBitsPerSample();
+      // libtiff swaps samples when writing.
+      if (ifd.getTIFF()->isByteSwapped() && encoder.bits > 8)
+        return boost::none;
+
+      encoder.stride = ifd.getPlanarConfiguration() == CONTIG ? ifd.getSamplesPerPixel() : 1U;
+      encoder.rowsamples = tileinfo.tileWidth() * encoder.stride;
+
+      if (encoder.predictor == HORIZONTAL &&
+          encoder.bits != 8 && encoder.bits != 16 && encoder.bits != 32)
+        return boost::none;
+      if (encoder.predictor != NONE && encoder.predictor != HORIZONTAL)
+        return boost::none;
+
+      return encoder;
+    }
+
+    // Check if tiles are written unchanged.
+    bool
+    raw() const
+    {
+      return compression == static_cast<Compression>(COMPRESSION_NONE);
+    }
+
+    // Encode a tile.
+    void
+    encode(const TileBuffer&     tilebuf,
+           std::vector<uint8_t>& dest) const
+    {
+      const uint8_t *src = tilebuf.data();
+      std::vector<uint8_t> predicted;
+
+      if (predictor == HORIZONTAL)
+        {
+          predicted.assign(tilebuf.data(), tilebuf.data() + tilebuf.size());
+          switch (bits)
+            {
+            case 8:
+              horizontal_difference<uint8_t>(predicted.data(), predicted.size(), rowsamples, stride);
+              break;
+            case 16:
+              horizontal_difference<uint16_t>(predicted.data(), predicted.size(), rowsamples, stride);
+              break;
+            case 32:
+              horizontal_difference<uint32_t>(predicted.data(), predicted.size(), rowsamples, stride);
+              break;
+            default:
+              break;
+            }
+          src = predicted.data();
+        }
+
+      uLongf size = compressBound(static_cast<uLong>(tilebuf.size()));
+      dest.resize(size);
+      int status = compress2(dest.data(), &size, src,
+                             static_cast<uLong>(tilebuf.size()), Z_DEFAULT_COMPRESSION);
+      if (status != Z_OK)
+        {
+          boost::format fmt("Failed to deflate tile: %1%");
+          fmt % zError(status);
+          throw Exception(fmt.str());
+        }
+      dest.resize(size);
+    }
+  };
+
   struct WriteVisitor : public boost::static_visitor<>
   {
     IFD&                                    ifd;
@@ -350,6 +1118,13 @@ namespace
       PlaneRegion rimage(0, 0, ifd.getImageWidth(), ifd.getImageHeight());
       tstrile_t tile = static_cast<tstrile_t>(ifd.getCurrentTile());
 
+      boost::optional<TileEncoder> encoder(TileEncoder::create(ifd, tileinfo));
+      if (encoder)
+        {
+          flush(*encoder);
+          return;
+        }
+
       Sentry sentry;
       while(tile < tileinfo.tileCount())
         {
@@ -381,7 +1156,81 @@ namespace
                 sentry.error("Failed to write encoded strip fully");
             }
           tilecache.erase(tile);
-          ifd.setCurrentTile(++tile);
+          ifd.setCurrentTile(++tile);
+        }
+    }
+
+    // Flush covered tiles, encoding without the libtiff lock.
+    void
+    flush(const TileEncoder& encoder)
+    {
+      std::shared_ptr<::ome::files::tiff::TIFF>& tiff(ifd.getTIFF());
+      ::TIFF *tiffraw = reinterpret_cast<::TIFF *>(tiff->getWrapped());
+      TileType type = tileinfo.tileType();
+      PlaneRegion rimage(0, 0, ifd.getImageWidth(), ifd.getImageHeight());
+      const tstrile_t first = static_cast<tstrile_t>(ifd.getCurrentTile());
+
+      tstrile_t last = first;
+      while(last < tileinfo.tileCount())
+        {
+          dimension_size_type tile_subchannel = tileinfo.tileSample(last);
+
+          PlaneRegion validarea = tileinfo.tileRegion(last) & rimage;
+          if (!validarea.area())
+            break;
+
+          if (!tilecoverage.at(tile_subchannel).covered(validarea))
+            break;
+
+          assert(tilecache.find(last));
+          ++last;
+        }
+
+      // Tiles are encoded concurrently on the shared executor, and
+      // then written in order.
+      std::vector<std::vector<uint8_t>> encoded;
+      if (!encoder.raw())
+        {
+          std::vector<const TileBuffer *> tiles;
+          for (tstrile_t tile = first; tile < last; ++tile)
+            tiles.push_back(tilecache.find(tile).get());
+          encoded.resize(tiles.size());
+
+          run_concurrently(*::ome::files::Executor::shared(), tiles.size(),
+                           [&encoder, &tiles, &encoded]()
+                           {
+                             return [&encoder, &tiles, &encoded](dimension_size_type item)
+                               {
+                                 encoder.encode(*tiles[item], encoded[item]);
+                               };
+                           });
+        }
+
+      Sentry sentry;
+      for (tstrile_t tile = first; tile < last; ++tile)
+        {
+          TileBuffer& tilebuf = *tilecache.find(tile);
+          uint8_t *data = tilebuf.data();
+          tsize_t size = static_cast<tsize_t>(tilebuf.size());
+          if (!encoder.raw())
+            {
+              std::vector<uint8_t>& e(encoded.at(tile - first));
+              data = e.data();
+              size = static_cast<tsize_t>(e.size());
+            }
+
+          tsize_t byteswritten;
+          if (type == TILE)
+            byteswritten = TIFFWriteRawTile(tiffraw, tile, data, size);
+          else
+            byteswritten = TIFFWriteRawStrip(tiffraw, tile, data, size);
+          if (byteswritten < 0)
+            sentry.error(type == TILE ? "Failed to write encoded tile" : "Failed to write encoded strip");
+          else if (byteswritten != size)
+            sentry.error(type == TILE ? "Failed to write encoded tile fully" : "Failed to write encoded strip fully");
+
+          tilecache.erase(tile);
+          ifd.setCurrentTile(tile + 1);
         }
     }
 
@@ -564,6 +1413,94 @@ namespace ome
           }
         };
 
+        using ::ome::files::detail::tiff::TagTable;
+
+        /// Shared tag table being filled by IFD::loadTags() on this thread.
+        thread_local const TagTable *loading_tags = nullptr;
+
+        /**
+         * Check if a tag table may be written by the current thread.
+         *
+         * Private tables may always be written.  Shared tables may
+         * only be written by IFD::loadTags(), which holds the libtiff
+         * lock while filling the table and before publishing it.
+         *
+         * @param tags the tag table to check.
+         * @returns @c true if writable, @c false otherwise.
+         */
+        bool
+        writable(const TagTable& tags)
+        {
+          return !tags.shared || &tags == loading_tags;
+        }
+
+        /**
+         * Get a tag value, caching it in the tag table where permitted.
+         *
+         * A shared table which is not being filled by this thread is
+         * loaded first and then only read; should the tag be missing
+         * from the loaded table, @p fetch is called again to report
+         * the error.
+         *
+         * @param ifd the IFD to query.
+         * @param tags the tag table of @p ifd.
+         * @param field the table field caching the tag value.
+         * @param cache @c true to use an existing cached value, or
+         * @c false to always fetch a new value.
+         * @param fetch function to get the tag value from libtiff.
+         * @returns the tag value.
+         */
+        template<typename T, typename Fetch>
+        const T&
+        cachedTag(const IFD&                   ifd,
+                  TagTable&                    tags,
+                  boost::optional<T> TagTable::*field,
+                  bool                         cache,
+                  Fetch                        fetch)
+        {
+          if (!writable(tags))
+            {
+              ifd.loadTags();
+              if (!(tags.*field))
+                {
+                  fetch();
+                  throw Exception("TIFF tag not available from loaded directory");
+                }
+            }
+          else if (!(tags.*field) || !cache)
+            {
+              tags.*field = fetch();
+            }
+          return (tags.*field).get();
+        }
+
+        /// Set the current shared table being loaded for the lifetime of this object.
+        class LoadingTags
+        {
+        public:
+          /**
+           * Constructor.
+           *
+           * @param tags the table being loaded.
+           */
+          explicit
+          LoadingTags(const TagTable& tags):
+            previous(loading_tags)
+          {
+            loading_tags = &tags;
+          }
+
+          /// Destructor.
+          ~LoadingTags()
+          {
+            loading_tags = previous;
+          }
+
+        private:
+          /// The previous table being loaded.
+          const TagTable *previous;
+        };
+
       }
 
       /**
@@ -580,28 +1517,8 @@ namespace ome
         std::vector<TileCoverage> coverage;
         /// Tile cache (used when writing).
         TileCache tilecache;
-        /// Tile type.
-        boost::optional<TileType> tiletype;
-        /// Image width.
-        boost::optional<uint32_t> imagewidth;
-        /// Image height.
-        boost::optional<uint32_t> imageheight;
-        /// Tile width.
-        boost::optional<uint32_t> tilewidth;
-        /// Tile height.
-        boost::optional<uint32_t> tileheight;
-        /// Pixel type.
-        boost::optional<PixelType> pixeltype;
-        /// Bits per sample.
-        boost::optional<uint16_t> bits;
-        /// Samples per pixel.
-        boost::optional<uint16_t> samples;
-        /// Planar configuration.
-        boost::optional<PlanarConfiguration> planarconfig;
-        /// Photometric interpretation.
-        boost::optional<PhotometricInterpretation> photometric;
-        /// Compression scheme.
-        boost::optional<Compression> compression;
+        /// Tag table.
+        std::shared_ptr<::ome::files::detail::tiff::TagTable> tags;
         /// Current tile (for writing).
         tstrile_t ctile;
 
@@ -617,13 +1534,7 @@ namespace ome
           offset(offset),
           coverage(),
           tilecache(),
-          imagewidth(),
-          imageheight(),
-          tilewidth(),
-          tileheight(),
-          pixeltype(),
-          samples(),
-          planarconfig(),
+          tags(std::make_shared<::ome::files::detail::tiff::TagTable>()),
           ctile(0)
         {
         }
@@ -647,6 +1558,10 @@ namespace ome
         // here.
         impl(std::shared_ptr<Impl>(new Impl(tiff, offset)))
       {
+        // Offset zero is the current (unwritten) directory, so its
+        // tags are never shared.
+        if (offset)
+          impl->tags = tiff->getTagTable(offset);
       }
 
       IFD::IFD(std::shared_ptr<TIFF>& tiff):
@@ -720,6 +1635,88 @@ namespace ome
         return impl->offset;
       }
 
+      void
+      IFD::loadTags() const
+      {
+        if (impl->tags->loaded.load(std::memory_order_acquire))
+          return;
+
+        Sentry sentry;
+
+        // Another thread may have loaded the table while waiting for
+        // the lock; a published table must not be written again.
+        if (impl->tags->loaded.load(std::memory_order_acquire))
+          return;
+
+        LoadingTags loading(*impl->tags);
+
+        makeCurrent();
+
+        // Not all tags are required to be present; any missing will
+        // be reported by the getter when used.
+        const std::array<std::function<void ()>, 14> loaders
+          {{
+              [this]{ getTileType(); },
+              [this]{ getImageWidth(); },
+              [this]{ getImageHeight(); },
+              [this]{ getTileWidth(); },
+              [this]{ getTileHeight(); },
+              [this]{ getBitsPerSample(); },
+              [this]{ getPixelType(); },
+              [this]{ getSamplesPerPixel(); },
+              [this]{ getPlanarConfiguration(); },
+              [this]{ getPhotometricInterpretation(); },
+              [this]{ getCompression(); },
+              [this]{ getTileCount(); getTileBufferSize(); },
+              [this]{ getTileOffsets(); },
+              [this]{ getTileByteCounts(); }
+          }};
+
+        for (const auto& load : loaders)
+          {
+            try
+              {
+                load();
+              }
+            catch (const Exception&)
+              {
+              }
+          }
+
+        // Uncompressed data may be read directly from the file
+        // without involving libtiff, provided that no bit or byte
+        // reordering is required other than simple byte swapping of
+        // whole samples.
+        try
+          {
+            FillOrder fillorder = MSB_TO_LSB;
+            try
+              {
+                getField(FILLORDER).get(fillorder);
+              }
+            catch (const Exception&)
+              {
+              }
+
+            uint16_t bits = getBitsPerSample();
+            bool swabbable = (!getTIFF()->isByteSwapped() ||
+                              bits == 8 || bits == 16 || bits == 32 || bits == 64);
+
+            impl->tags->directread = (getTIFF()->directReadable() &&
+                                      getCompression() == COMPRESSION_NONE &&
+                                      fillorder == MSB_TO_LSB &&
+                                      swabbable &&
+                                      getTileOffsets().size() == getTileCount() &&
+                                      getTileByteCounts().size() == getTileCount());
+          }
+        catch (const Exception&)
+          {
+            impl->tags->directread = false;
+          }
+
+        impl->tags->loaded.store(true, std::memory_order_release);
+      }
+
       void
       IFD::getRawField(tag_type tag,
                        ...) const
@@ -806,29 +1803,28 @@ namespace ome
       TileType
       IFD::getTileType() const
       {
-        if (!impl->tiletype)
-          {
-            uint32_t w, h;
-            try
-              {
-                getField(TILEWIDTH).get(w);
-                getField(TILELENGTH).get(h);
-                impl->tiletype = TILE;
-              }
-            catch (const Exception&)
-              {
-                getField(ROWSPERSTRIP).get(h);
-                impl->tiletype = STRIP;
-              }
-          }
-
-        return impl->tiletype.get();
+        return cachedTag(*this, *impl->tags, &TagTable::tiletype, true,
+                         [this]{
+                           uint32_t w, h;
+                           try
+                             {
+                               getField(TILEWIDTH).get(w);
+                               getField(TILELENGTH).get(h);
+                               return TILE;
+                             }
+                           catch (const Exception&)
+                             {
+                               getField(ROWSPERSTRIP).get(h);
+                               return STRIP;
+                             }
+                         });
       }
 
       void
       IFD::setTileType(TileType type)
       {
-        impl->tiletype = type;
+        if (writable(*impl->tags))
+          impl->tags->tiletype = type;
       }
 
       dimension_size_type
@@ -855,6 +1851,80 @@ namespace ome
         return TileInfo(const_cast<IFD *>(this)->shared_from_this());
       }
 
+      dimension_size_type
+      IFD::getTileCount() const
+      {
+        // Only cache for existing directories; when writing, the
+        // count depends upon tags which may still be changed.
+        return cachedTag(*this, *impl->tags, &TagTable::tilecount, impl->offset != 0,
+                         [this]{
+                           std::shared_ptr<TIFF>& tiff = getTIFF();
+                           ::TIFF *tiffraw = reinterpret_cast<::TIFF *>(tiff->getWrapped());
+                           TileType type = getTileType();
+
+                           Sentry sentry;
+
+                           makeCurrent();
+
+                           return static_cast<dimension_size_type>
+                             (type == TILE ?
+                              TIFFNumberOfTiles(tiffraw) :
+                              TIFFNumberOfStrips(tiffraw));
+                         });
+      }
+
+      dimension_size_type
+      IFD::getTileBufferSize() const
+      {
+        return cachedTag(*this, *impl->tags, &TagTable::buffersize, impl->offset != 0,
+                         [this]{
+                           std::shared_ptr<TIFF>& tiff = getTIFF();
+                           ::TIFF *tiffraw = reinterpret_cast<::TIFF *>(tiff->getWrapped());
+                           TileType type = getTileType();
+
+                           Sentry sentry;
+
+                           makeCurrent();
+
+                           tmsize_t size;
+                           if (type == TILE)
+                             size = TIFFTileSize(tiffraw);
+                           else
+                             size = TIFFStripSize(tiffraw);
+                           if (size <= 0)
+                             sentry.error("Invalid tile or strip size");
+                           return static_cast<dimension_size_type>(size);
+                         });
+      }
+
+      const std::vector<uint64_t>&
+      IFD::getTileOffsets() const
+      {
+        return cachedTag(*this, *impl->tags, &TagTable::tileoffsets, impl->offset != 0,
+                         [this]{
+                           std::vector<uint64_t> offsets;
+                           if (getTileType() == TILE)
+                             getField(TILEOFFSETS).get(offsets);
+                           else
+                             getField(STRIPOFFSETS).get(offsets);
+                           return offsets;
+                         });
+      }
+
+      const std::vector<uint64_t>&
+      IFD::getTileByteCounts() const
+      {
+        return cachedTag(*this, *impl->tags, &TagTable::tilebytecounts, impl->offset != 0,
+                         [this]{
+                           std::vector<uint64_t> bytecounts;
+                           if (getTileType() == TILE)
+                             getField(TILEBYTECOUNTS).get(bytecounts);
+                           else
+                             getField(STRIPBYTECOUNTS).get(bytecounts);
+                           return bytecounts;
+                         });
+      }
+
       std::vector<TileCoverage>&
       IFD::getTileCoverage()
       {
@@ -870,58 +1940,53 @@ namespace ome
       uint32_t
       IFD::getImageWidth() const
       {
-        if (!impl->imagewidth)
-          {
-            uint32_t width;
-            getField(IMAGEWIDTH).get(width);
-            impl->imagewidth = width;
-          }
-        return impl->imagewidth.get();
+        return cachedTag(*this, *impl->tags, &TagTable::imagewidth, true,
+                         [this]{
+                           uint32_t width;
+                           getField(IMAGEWIDTH).get(width);
+                           return width;
+                         });
       }
 
       void
       IFD::setImageWidth(uint32_t width)
       {
         getField(IMAGEWIDTH).set(width);
-        impl->imagewidth = width;
+        if (writable(*impl->tags))
+          impl->tags->imagewidth = width;
       }
 
       uint32_t
       IFD::getImageHeight() const
       {
-        if (!impl->imageheight)
-          {
-            uint32_t height;
-            getField(IMAGELENGTH).get(height);
-            impl->imageheight = height;
-          }
-        return impl->imageheight.get();
+        return cachedTag(*this, *impl->tags, &TagTable::imageheight, true,
+                         [this]{
+                           uint32_t height;
+                           getField(IMAGELENGTH).get(height);
+                           return height;
+                         });
       }
 
       void
       IFD::setImageHeight(uint32_t height)
       {
         getField(IMAGELENGTH).set(height);
-        impl->imageheight = height;
+        if (writable(*impl->tags))
+          impl->tags->imageheight = height;
       }
 
       uint32_t
       IFD::getTileWidth() const
       {
-        if (!impl->tilewidth)
-          {
-            if (getTileType() == TILE)
-              {
-                uint32_t width;
-                getField(TILEWIDTH).get(width);
-                impl->tilewidth = width;
-              }
-            else // strip
-              {
-                impl->tilewidth = getImageWidth();
-              }
-          }
-        return impl->tilewidth.get();
+        return cachedTag(*this, *impl->tags, &TagTable::tilewidth, true,
+                         [this]{
+                           uint32_t width;
+                           if (getTileType() == TILE)
+                             getField(TILEWIDTH).get(width);
+                           else // strip
+                             width = getImageWidth();
+                           return width;
+                         });
       }
 
       void
@@ -930,7 +1995,8 @@ namespace ome
         if (getTileType() == TILE)
           {
             getField(TILEWIDTH).set(width);
-            impl->tilewidth = width;
+            if (writable(*impl->tags))
+              impl->tags->tilewidth = width;
           }
         else
           {
@@ -941,22 +2007,15 @@ namespace ome
       uint32_t
       IFD::getTileHeight() const
       {
-        if (!impl->tileheight)
-          {
-            if (getTileType() == TILE)
-              {
-                uint32_t height;
-                getField(TILELENGTH).get(height);
-                impl->tileheight = height;
-              }
-            else
-              {
-                uint32_t rows;
-                getField(ROWSPERSTRIP).get(rows);
-                impl->tileheight = rows;
-              }
-          }
-        return impl->tileheight.get();
+        return cachedTag(*this, *impl->tags, &TagTable::tileheight, true,
+                         [this]{
+                           uint32_t height;
+                           if (getTileType() == TILE)
+                             getField(TILELENGTH).get(height);
+                           else // strip
+                             getField(ROWSPERSTRIP).get(height);
+                           return height;
+                         });
       }
 
       void
@@ -970,7 +2029,8 @@ namespace ome
           {
             getField(ROWSPERSTRIP).set(height);
           }
-        impl->tileheight = height;
+        if (writable(*impl->tags))
+          impl->tags->tileheight = height;
       }
 
       ::ome::xml::model::enums::PixelType
@@ -978,9 +2038,12 @@ namespace ome
       {
         PixelType pt = PixelType::UINT8;
 
-        if (impl->pixeltype)
+        if (!writable(*impl->tags))
+          loadTags();
+
+        if (impl->tags->pixeltype)
           {
-            pt = impl->pixeltype.get();
+            pt = impl->tags->pixeltype.get();
           }
         else
           {
@@ -1001,11 +2064,13 @@ namespace ome
               {
               case UNSIGNED_INT:
                 {
+                  // Packed samples of less than 8 or 16 bits are
+                  // unpacked to the next largest type when read.
                   if (bits == 1)
                     pt = PixelType::BIT;
-                  else if (bits == 8)
+                  else if (bits > 1 && bits <= 8)
                     pt = PixelType::UINT8;
-                  else if (bits == 16)
+                  else if (bits > 8 && bits <= 16)
                     pt = PixelType::UINT16;
                   else if (bits == 32)
                     pt = PixelType::UINT32;
@@ -1069,6 +2134,8 @@ namespace ome
                 }
                 break;
               }
+            if (impl->offset && writable(*impl->tags))
+              impl->tags->pixeltype = pt;
           }
         return pt;
       }
@@ -1113,19 +2180,19 @@ namespace ome
           }
 
         getField(SAMPLEFORMAT).set(fmt);
-        impl->pixeltype = type;
+        if (writable(*impl->tags))
+          impl->tags->pixeltype = type;
       }
 
       uint16_t
       IFD::getBitsPerSample() const
       {
-        if (!impl->bits)
-          {
-            uint16_t bits;
-            getField(BITSPERSAMPLE).get(bits);
-            impl->bits = bits;
-          }
-        return impl->bits.get();
+        return cachedTag(*this, *impl->tags, &TagTable::bits, true,
+                         [this]{
+                           uint16_t bits;
+                           getField(BITSPERSAMPLE).get(bits);
+                           return bits;
+                         });
       }
 
       void
@@ -1136,83 +2203,84 @@ namespace ome
           bits = max_bits;
 
         getField(BITSPERSAMPLE).set(bits);
-        impl->bits = bits;
+        if (writable(*impl->tags))
+          impl->tags->bits = bits;
       }
 
       uint16_t
       IFD::getSamplesPerPixel() const
       {
-        if (!impl->samples)
-          {
-            uint16_t samples;
-            getField(SAMPLESPERPIXEL).get(samples);
-            impl->samples = samples;
-          }
-        return impl->samples.get();
+        return cachedTag(*this, *impl->tags, &TagTable::samples, true,
+                         [this]{
+                           uint16_t samples;
+                           getField(SAMPLESPERPIXEL).get(samples);
+                           return samples;
+                         });
       }
 
       void
       IFD::setSamplesPerPixel(uint16_t samples)
       {
         getField(SAMPLESPERPIXEL).set(samples);
-        impl->samples = samples;
+        if (writable(*impl->tags))
+          impl->tags->samples = samples;
       }
 
       PlanarConfiguration
       IFD::getPlanarConfiguration() const
       {
-        if (!impl->planarconfig)
-          {
-            PlanarConfiguration config;
-            getField(PLANARCONFIG).get(config);
-            impl->planarconfig = config;
-          }
-        return impl->planarconfig.get();
+        return cachedTag(*this, *impl->tags, &TagTable::planarconfig, true,
+                         [this]{
+                           PlanarConfiguration config;
+                           getField(PLANARCONFIG).get(config);
+                           return config;
+                         });
       }
 
       void
       IFD::setPlanarConfiguration(PlanarConfiguration planarconfig)
       {
         getField(PLANARCONFIG).set(planarconfig);
-        impl->planarconfig = planarconfig;
+        if (writable(*impl->tags))
+          impl->tags->planarconfig = planarconfig;
       }
 
       PhotometricInterpretation
       IFD::getPhotometricInterpretation() const
       {
-        if (!impl->photometric)
-          {
-            PhotometricInterpretation photometric;
-            getField(PHOTOMETRIC).get(photometric);
-            impl->photometric = photometric;
-          }
-        return impl->photometric.get();
+        return cachedTag(*this, *impl->tags, &TagTable::photometric, true,
+                         [this]{
+                           PhotometricInterpretation photometric;
+                           getField(PHOTOMETRIC).get(photometric);
+                           return photometric;
+                         });
       }
 
       void
       IFD::setPhotometricInterpretation(PhotometricInterpretation photometric)
       {
         getField(PHOTOMETRIC).set(photometric);
-        impl->photometric = photometric;
+        if (writable(*impl->tags))
+          impl->tags->photometric = photometric;
       }
 
       Compression
       IFD::getCompression() const
       {
-        if (!impl->compression)
-          {
-            Compression compression;
-            getField(COMPRESSION).get(compression);
-            impl->compression = compression;
-          }
-        return impl->compression.get();
+        return cachedTag(*this, *impl->tags, &TagTable::compression, true,
+                         [this]{
+                           Compression compression;
+                           getField(COMPRESSION).get(compression);
+                           return compression;
+                         });
       }
 
       void
       IFD::setCompression(Compression compression)
       {
         getField(COMPRESSION).set(compression);
-        impl->compression = compression;
+        if (writable(*impl->tags))
+          impl->tags->compression = compression;
       }
 
       void
@@ -1234,15 +2302,135 @@ namespace ome
                      dimension_size_type y,
                      dimension_size_type w,
                      dimension_size_type h) const
+      {
+        prepareBuffer(dest, w, h, getSamplesPerPixel(),
+                      getPlanarConfiguration() == CONTIG);
+
+        TileInfo info = getTileInfo();
+
+        PlaneRegion region(x, y, w, h);
+        std::vector<dimension_size_type> tiles(info.tileCoverage(region));
+
+        // Tiles read directly from the file do not need the libtiff
+        // lock, so reads of several tiles may overlap.
+        if (tiles.size() > 1U &&
+            impl->tags->loaded.load(std::memory_order_acquire) &&
+            impl->tags->directread)
+          {
+            read_tiles_concurrently(*this, info, region, tiles, dest);
+            return;
+          }
+
+        ReadVisitor v(*this, info, region, tiles);
+        boost::apply_visitor(v, dest.vbuffer());
+      }
+
+      void
+      IFD::readImage(VariantPixelBuffer&      dest,
+                     dimension_size_type      x,
+                     dimension_size_type      y,
+                     dimension_size_type      w,
+                     dimension_size_type      h,
+                     const CancellationToken& token) const
+      {
+        readImage(dest, x, y, w, h, TileSchedule(), token);
+      }
+
+      void
+      IFD::readImage(VariantPixelBuffer&      dest,
+                     dimension_size_type      x,
+                     dimension_size_type      y,
+                     dimension_size_type      w,
+                     dimension_size_type      h,
+                     const TileSchedule&      schedule,
+                     const CancellationToken& token) const
+      {
+        token.check();
+
+        prepareBuffer(dest, w, h, getSamplesPerPixel(),
+                      getPlanarConfiguration() == CONTIG);
+
+        TileInfo info = getTileInfo();
+
+        PlaneRegion region(x, y, w, h);
+        std::vector<dimension_size_type> tiles;
+
+        switch (schedule.order)
+          {
+          case TileSchedule::CENTER:
+            tiles = info.tileCoverage(region, schedule.centerX, schedule.centerY);
+            break;
+          case TileSchedule::OFFSET:
+            {
+              tiles = info.tileCoverage(region);
+              const std::vector<uint64_t>& offsets(getTileOffsets());
+              if (offsets.size() == info.tileCount())
+                std::stable_sort(tiles.begin(), tiles.end(),
+                                 [&offsets](dimension_size_type lhs,
+                                            dimension_size_type rhs)
+                                 {
+                                   return offsets[lhs] < offsets[rhs];
+                                 });
+            }
+            break;
+          case TileSchedule::STORAGE:
+          default:
+            tiles = info.tileCoverage(region);
+            break;
+          }
+
+        ReadVisitor v(*this, info, region, tiles, &token, &schedule.callback);
+        boost::apply_visitor(v, dest.vbuffer());
+      }
+
+      void
+      IFD::readImage(VariantPixelBuffer& dest,
+                     dimension_size_type x,
+                     dimension_size_type y,
+                     dimension_size_type w,
+                     dimension_size_type h,
+                     dimension_size_type stepX,
+                     dimension_size_type stepY,
+                     Decimation          method) const
+      {
+        if (!stepX || !stepY)
+          {
+            boost::format fmt("Invalid decimation step %1%×%2%");
+            fmt % stepX % stepY;
+            throw Exception(fmt.str());
+          }
+
+        if (stepX == 1U && stepY == 1U)
+          {
+            readImage(dest, x, y, w, h);
+            return;
+          }
+
+        prepareBuffer(dest, (w + stepX - 1) / stepX, (h + stepY - 1) / stepY,
+                      getSamplesPerPixel(), getPlanarConfiguration() == CONTIG);
+
+        TileInfo info = getTileInfo();
+
+        PlaneRegion region(x, y, w, h);
+        std::vector<dimension_size_type> tiles(info.tileCoverage(region));
+
+        DecimateVisitor v(*this, info, region, tiles, stepX, stepY, method);
+        boost::apply_visitor(v, dest.vbuffer());
+      }
+
+      void
+      IFD::prepareBuffer(VariantPixelBuffer& dest,
+                         dimension_size_type w,
+                         dimension_size_type h,
+                         dimension_size_type samples,
+                         bool                interleaved) const
       {
         PixelType type = getPixelType();
-        PlanarConfiguration planarconfig = getPlanarConfiguration();
-        uint16_t subC = getSamplesPerPixel();
 
         std::array<VariantPixelBuffer::size_type, 9> shape, dest_shape;
         shape[DIM_SPATIAL_X] = w;
         shape[DIM_SPATIAL_Y] = h;
-        shape[DIM_SUBCHANNEL] = subC;
+        shape[DIM_SUBCHANNEL] = samples;
         shape[DIM_SPATIAL_Z] = shape[DIM_TEMPORAL_T] = shape[DIM_CHANNEL] =
           shape[DIM_MODULO_Z] = shape[DIM_MODULO_T] = shape[DIM_MODULO_C] = 1;
 
@@ -1250,36 +2438,186 @@ namespace ome
         std::copy(dest_shape_ptr, dest_shape_ptr + PixelBufferBase::dimensions,
                   dest_shape.begin());
 
-        PixelBufferBase::storage_order_type order(PixelBufferBase::make_storage_order(ome::xml::model::enums::DimensionOrder::XYZTC, planarconfig == SEPARATE ? false : true));
+        PixelBufferBase::storage_order_type order(PixelBufferBase::make_storage_order(ome::xml::model::enums::DimensionOrder::XYZTC, interleaved));
 
         if (type != dest.pixelType() ||
             shape != dest_shape ||
             !(order == dest.storage_order()))
           dest.setBuffer(shape, type, order);
+      }
+
+      void
+      IFD::readImage(VariantPixelBuffer& dest,
+                     dimension_size_type x,
+                     dimension_size_type y,
+                     dimension_size_type w,
+                     dimension_size_type h,
+                     dimension_size_type subC) const
+      {
+        if (subC >= getSamplesPerPixel())
+          {
+            boost::format fmt("Invalid subchannel %1% for image with %2% samples");
+            fmt % subC % getSamplesPerPixel();
+            throw Exception(fmt.str());
+          }
+
+        // Planar ordering, as for a whole read of a single sample.
+        prepareBuffer(dest, w, h, 1U, false);
 
         TileInfo info = getTileInfo();
 
         PlaneRegion region(x, y, w, h);
         std::vector<dimension_size_type> tiles(info.tileCoverage(region));
 
-        ReadVisitor v(*this, info, region, tiles);
+        SubchannelReadVisitor v(*this, info, region, tiles, subC);
         boost::apply_visitor(v, dest.vbuffer());
       }
 
       void
-      IFD::readImage(VariantPixelBuffer& dest,
-                     dimension_size_type x,
-                     dimension_size_type y,
-                     dimension_size_type w,
-                     dimension_size_type h,
-                     dimension_size_type subC) const
+      IFD::readContiguousImage(VariantPixelBuffer& dest,
+                               offset_type         offset,
+                               dimension_size_type x,
+                               dimension_size_type y,
+                               dimension_size_type w,
+                               dimension_size_type h) const
+      {
+        std::shared_ptr<TIFF>& tiff = getTIFF();
+        uint16_t bits = getBitsPerSample();
+
+        if (getCompression() != COMPRESSION_NONE)
+          throw Exception("Contiguous image data must be uncompressed");
+        if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+          {
+            boost::format fmt("Contiguous reading of %1%-bit samples is not supported");
+            fmt % bits;
+            throw Exception(fmt.str());
+          }
+        if (!tiff->directReadable())
+          throw Exception("Contiguous image data is not directly readable");
+
+        const dimension_size_type width = getImageWidth();
+        const dimension_size_type height = getImageHeight();
+        if (x + w > width || y + h > height)
+          {
+            boost::format fmt("Region %1%×%2%+%3%+%4% exceeds image size %5%×%6%");
+            fmt % w % h % x % y % width % height;
+            throw Exception(fmt.str());
+          }
+
+        const bool interleaved = getPlanarConfiguration() == CONTIG;
+        prepareBuffer(dest, w, h, getSamplesPerPixel(), interleaved);
+
+        const bool swapped = tiff->isByteSwapped();
+        auto read = [&tiff, bits, swapped](offset_type         rowoffset,
+                                           void               *buf,
+                                           dimension_size_type size)
+          {
+            if (tiff->readRaw(rowoffset, buf, size) != size)
+              {
+                boost::format fmt("Failed to read %1% bytes of contiguous image data at offset %2%");
+                fmt % size % rowoffset;
+                throw Exception(fmt.str());
+              }
+
+            if (swapped)
+              {
+                switch (bits)
+                  {
+                  case 16:
+                    TIFFSwabArrayOfShort(static_cast<uint16_t *>(buf),
+                                         static_cast<tmsize_t>(size / 2));
+                    break;
+                  case 32:
+                    TIFFSwabArrayOfLong(static_cast<uint32_t *>(buf),
+                                        static_cast<tmsize_t>(size / 4));
+                    break;
+                  case 64:
+                    TIFFSwabArrayOfLong8(static_cast<uint64_t *>(buf),
+                                         static_cast<tmsize_t>(size / 8));
+                    break;
+                  default:
+                    break;
+                  }
+              }
+          };
+
+        PlaneRegion region(x, y, w, h);
+        ContiguousReadVisitor v(region, offset, width, height,
+                                getSamplesPerPixel(), interleaved, read);
+        boost::apply_visitor(v, dest.vbuffer());
+      }
+
+      dimension_size_type
+      IFD::readTile(dimension_size_type tile,
+                    TileBuffer&         buf) const
       {
-        // Copy the desired subchannel into the destination buffer.
-        VariantPixelBuffer tmp;
-        readImage(tmp, x, y, w, h);
+        if (impl->tags->loaded.load(std::memory_order_acquire) && impl->tags->directread)
+          {
+            const std::vector<uint64_t>& offsets(getTileOffsets());
+            const std::vector<uint64_t>& bytecounts(getTileByteCounts());
+
+            if (tile >= offsets.size())
+              {
+                boost::format fmt("Tile %1% out of range (%2% tiles)");
+                fmt % tile % offsets.size();
+                throw Exception(fmt.str());
+              }
+
+            std::shared_ptr<TIFF>& tiff = getTIFF();
+            dimension_size_type size = std::min(static_cast<dimension_size_type>(bytecounts[tile]),
+                                                buf.size());
+            dimension_size_type bytesread = tiff->readRaw(offsets[tile], buf.data(), size);
+
+            if (tiff->isByteSwapped())
+              {
+                switch (getBitsPerSample())
+                  {
+                  case 16:
+                    TIFFSwabArrayOfShort(reinterpret_cast<uint16_t *>(buf.data()),
+                                         static_cast<tmsize_t>(bytesread / 2));
+                    break;
+                  case 32:
+                    TIFFSwabArrayOfLong(reinterpret_cast<uint32_t *>(buf.data()),
+                                        static_cast<tmsize_t>(bytesread / 4));
+                    break;
+                  case 64:
+                    TIFFSwabArrayOfLong8(reinterpret_cast<uint64_t *>(buf.data()),
+                                         static_cast<tmsize_t>(bytesread / 8));
+                    break;
+                  default:
+                    break;
+                  }
+              }
+
+            return bytesread;
+          }
+
+        std::shared_ptr<TIFF>& tiff = getTIFF();
+        ::TIFF *tiffraw = reinterpret_cast<::TIFF *>(tiff->getWrapped());
+        TileType type = getTileType();
+
+        Sentry sentry;
+
+        // Decoding requires libtiff to have this directory loaded.
+        makeCurrent();
+
+        tmsize_t bytesread;
+        if (type == TILE)
+          {
+            bytesread = TIFFReadEncodedTile(tiffraw, static_cast<tstrile_t>(tile),
+                                            buf.data(), static_cast<tsize_t>(buf.size()));
+            if (bytesread < 0)
+              sentry.error("Failed to read encoded tile");
+          }
+        else
+          {
+            bytesread = TIFFReadEncodedStrip(tiffraw, static_cast<tstrile_t>(tile),
+                                             buf.data(), static_cast<tsize_t>(buf.size()));
+            if (bytesread < 0)
+              sentry.error("Failed to read encoded strip");
+          }
 
-        detail::CopySubchannelVisitor v(dest, subC);
-        boost::apply_visitor(v, tmp.vbuffer());
+        return static_cast<dimension_size_type>(bytesread);
       }
 
       void
@@ -1437,6 +2775,9 @@ namespace ome
           {
             uint64_t offset = static_cast<uint64_t>(TIFFCurrentDirOffset(tiffraw));
             ret = openOffset(tiff, offset);
+            // The new directory is current, so load its tags now.
+            if (TIFFGetMode(tiffraw) == O_RDONLY)
+              ret->loadTags();
           }
 
         return ret;
@@ -40,9 +40,12 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
+#include <ome/files/CancellationToken.h>
 #include <ome/files/CoreMetadata.h>
 #include <ome/files/TileCoverage.h>
+#include <ome/files/TileSchedule.h>
 #include <ome/files/tiff/TileInfo.h>
 #include <ome/files/tiff/Types.h>
 #include <ome/files/VariantPixelBuffer.h>
@@ -53,6 +56,9 @@ namespace ome
 {
   namespace files
   {
+
+    class TileBuffer;
+
     namespace tiff
     {
 
@@ -161,6 +167,21 @@ namespace ome
         offset_type
         getOffset() const;
 
+        /**
+         * Load the tags used for image access into memory.
+         *
+         * The tags are read from libtiff with a single directory
+         * switch, and subsequently all tag getters and tile offset
+         * queries are answered from memory without needing to make
+         * this directory current.  When reading, the loaded tags are
+         * shared with all other IFD instances for the same directory
+         * offset.  This is done automatically for IFDs obtained with
+         * TIFF::getDirectoryByIndex() and
+         * TIFF::getDirectoryByOffset().
+         */
+        void
+        loadTags() const;
+
         /**
          * Get a field by its tag number.
          *
@@ -288,6 +309,38 @@ namespace ome
         const TileInfo
         getTileInfo() const;
 
+        /**
+         * Get the number of tiles or strips.
+         *
+         * @returns the tile or strip count.
+         */
+        dimension_size_type
+        getTileCount() const;
+
+        /**
+         * Get the decoded size of a tile or strip.
+         *
+         * @returns the tile or strip size in bytes.
+         */
+        dimension_size_type
+        getTileBufferSize() const;
+
+        /**
+         * Get the file offsets of all tiles or strips.
+         *
+         * @returns the tile or strip offsets.
+         */
+        const std::vector<uint64_t>&
+        getTileOffsets() const;
+
+        /**
+         * Get the encoded sizes of all tiles or strips.
+         *
+         * @returns the tile or strip byte counts.
+         */
+        const std::vector<uint64_t>&
+        getTileByteCounts() const;
+
         /**
          * Get tile coverage cache.
          *
@@ -372,7 +425,10 @@ namespace ome
          * Get the OME data model PixelType.
          *
          * This is computed based upon the SampleFormat and
-         * BitsPerSample tags for this IFD.
+         * BitsPerSample tags for this IFD.  Unsigned integer samples
+         * packed into fewer than 8 or 16 bits (e.g. 10, 12 or 14-bit
+         * camera data) are unpacked to @c UINT8 or @c UINT16 when
+         * read; getBitsPerSample() returns the packed sample size.
          *
          * @returns the PixelType.
          * @throws an Exception if there is no corresponding PixelType
@@ -510,6 +566,48 @@ namespace ome
                   dimension_size_type w,
                   dimension_size_type h) const;
 
+        /**
+         * Read a region of an image plane into a pixel buffer,
+         * allowing cancellation.
+         *
+         * @copydetails readImage(VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type) const
+         *
+         * The token is checked before reading each tile or strip.
+         *
+         * @param token the cancellation token.
+         * @throws CancelledException if the token is cancelled or its
+         * deadline passes before the read is complete.
+         */
+        void
+        readImage(VariantPixelBuffer&      dest,
+                  dimension_size_type      x,
+                  dimension_size_type      y,
+                  dimension_size_type      w,
+                  dimension_size_type      h,
+                  const CancellationToken& token) const;
+
+        /**
+         * Read a region of an image plane into a pixel buffer, in a
+         * specified tile order, allowing cancellation.
+         *
+         * @copydetails readImage(VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type,const CancellationToken&) const
+         *
+         * The tiles or strips covering the region are read in the
+         * order specified by @p schedule, and its callback (if set)
+         * is invoked after each tile or strip has been read into the
+         * destination buffer.
+         *
+         * @param schedule the tile schedule.
+         */
+        void
+        readImage(VariantPixelBuffer&      dest,
+                  dimension_size_type      x,
+                  dimension_size_type      y,
+                  dimension_size_type      w,
+                  dimension_size_type      h,
+                  const TileSchedule&      schedule,
+                  const CancellationToken& token) const;
+
         /**
          * @copydoc IFD::readImage(VariantPixelBuffer&,dimension_size_type,dimension_size_type,dimension_size_type,dimension_size_type) const
          * @param subC the subchannel to read.
@@ -522,6 +620,76 @@ namespace ome
                   dimension_size_type h,
                   dimension_size_type subC) const;
 
+        /**
+         * Read a subsampled region of an image plane into a pixel buffer.
+         *
+         * The region is divided into blocks of @c stepX × @c stepY
+         * pixels, and each block is reduced to a single destination
+         * pixel, so the destination buffer is ⌈w/stepX⌉ × ⌈h/stepY⌉
+         * pixels in size.  Blocks at the right and bottom edges may
+         * be partial.  When using nearest sampling, only the tiles or
+         * strips containing sampled pixels are read.
+         *
+         * If the destination pixel buffer is of a different size to
+         * the decimated region, or is of the incorrect pixel type, or
+         * has a different storage order, it will be resized using
+         * the correct pixel type and storage order.
+         *
+         * @param dest the destination pixel buffer.
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         * @param stepX the sampling step in @c X.
+         * @param stepY the sampling step in @c Y.
+         * @param method the decimation method.
+         * @throws an Exception if either step is zero.
+         */
+        void
+        readImage(VariantPixelBuffer& dest,
+                  dimension_size_type x,
+                  dimension_size_type y,
+                  dimension_size_type w,
+                  dimension_size_type h,
+                  dimension_size_type stepX,
+                  dimension_size_type stepY,
+                  Decimation          method = DECIMATE_NEAREST) const;
+
+        /**
+         * Read an image plane stored outside the IFD's strips.
+         *
+         * Some writers, notably ImageJ for large hyperstacks, store a
+         * single IFD followed by every plane as contiguous raw data.
+         * This reads a region of the plane starting at the specified
+         * file offset, using the dimensions, pixel type, sample count
+         * and planar configuration of this IFD to compute the
+         * layout.  The data is read directly from the file, without
+         * using libtiff, and may be called concurrently from
+         * multiple threads.
+         *
+         * If the destination pixel buffer is of a different size to
+         * the region being read, or is of the incorrect pixel type,
+         * or has a different storage order, it will be resized using
+         * the correct pixel type and storage order.
+         *
+         * @param dest the destination pixel buffer.
+         * @param offset the file offset of the start of the plane.
+         * @param x the @c X coordinate of the upper-left corner of the sub-image.
+         * @param y the @c Y coordinate of the upper-left corner of the sub-image.
+         * @param w the width of the sub-image.
+         * @param h the height of the sub-image.
+         * @throws an Exception if the data is compressed, the samples
+         * are not a whole number of bytes, direct reading is not
+         * supported, or the data could not be read fully.
+         */
+        void
+        readContiguousImage(VariantPixelBuffer& dest,
+                            offset_type         offset,
+                            dimension_size_type x,
+                            dimension_size_type y,
+                            dimension_size_type w,
+                            dimension_size_type h) const;
+
         /**
          * Read a lookup table into a pixel buffer.
          *
@@ -530,6 +698,24 @@ namespace ome
         void
         readLookupTable(VariantPixelBuffer& buf) const;
 
+        /**
+         * Read a single tile or strip into a tile buffer.
+         *
+         * Uncompressed data is read directly from the file without
+         * using libtiff; this does not require switching directory,
+         * and may be called concurrently from multiple threads.  All
+         * other data is decoded by libtiff, which serialises access.
+         *
+         * @param tile the tile or strip index.
+         * @param buf the destination buffer, which must be at least
+         * getTileBufferSize() bytes.
+         * @returns the number of bytes read.
+         * @throws an Exception on failure.
+         */
+        dimension_size_type
+        readTile(dimension_size_type tile,
+                 TileBuffer&         buf) const;
+
         /**
          * Write a whole image plane from a pixel buffer.
          *
@@ -593,6 +779,27 @@ namespace ome
          */
         bool
         last() const;
+
+      private:
+        /**
+         * Set up a pixel buffer for reading image data.
+         *
+         * The buffer is only reallocated if its size, pixel type or
+         * storage order do not match.
+         *
+         * @param dest the destination pixel buffer.
+         * @param w the width of the buffer.
+         * @param h the height of the buffer.
+         * @param samples the number of samples (subchannels).
+         * @param interleaved @c true for interleaved (chunky)
+         * storage order, or @c false for planar.
+         */
+        void
+        prepareBuffer(VariantPixelBuffer& dest,
+                      dimension_size_type w,
+                      dimension_size_type h,
+                      dimension_size_type samples,
+                      bool                interleaved) const;
       };
 
     }
@@ -45,6 +45,7 @@
 #include <ome/files/tiff/Exception.h>
 
 #include <sstream>
+#include <stdexcept>
 
 namespace ome
 {
@@ -62,14 +63,41 @@ namespace ome
 	const int LUTS =         0x6c757473;  // "luts" (channel LUTs)
       }
 
-      ImageJMetadata::ImageJMetadata(const IFD& ifd)
+      ImageJMetadata::ImageJMetadata(const IFD& ifd):
+        map(),
+        counts(),
+        data(),
+        images(1U),
+        slices(1U),
+        frames(1U),
+        channels(1U),
+        unit(),
+        spacing(1.0),
+        finterval(0.0),
+        xorigin(0U),
+        yorigin(0U),
+        mode(),
+        loop(false)
       {
-        ifd.getField(IMAGEJ_META_DATA_BYTE_COUNTS).get(counts);
-        ifd.getField(IMAGEJ_META_DATA).get(data);
         std::string desc;
         ifd.getField(IMAGEDESCRIPTION).get(desc);
         map = parse_imagedescription(desc);
 
+        if (map.find("ImageJ") == map.end())
+          throw std::runtime_error("ImageDescription does not contain ImageJ metadata");
+
+        // Overlays, LUTs and labels are optional.
+        try
+          {
+            ifd.getField(IMAGEJ_META_DATA_BYTE_COUNTS).get(counts);
+            ifd.getField(IMAGEJ_META_DATA).get(data);
+          }
+        catch (const Exception&)
+          {
+            counts.clear();
+            data.clear();
+          }
+
         parse_value("images", images);
         parse_value("channels", channels);
         parse_value("slices", slices);
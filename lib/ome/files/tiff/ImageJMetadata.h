@@ -91,8 +91,12 @@ namespace ome
         /**
          * Construct from an IFD.
          *
+         * Keys not present in the ImageDescription are set to
+         * ImageJ's defaults (a single image).
+         *
          * @param ifd the IFD to parse the metadata from.
-         * @throws an exception on parse errors.
+         * @throws an exception on parse errors, or if the
+         * ImageDescription does not contain ImageJ metadata.
          */
         ImageJMetadata(const IFD& ifd);
 
@@ -36,8 +36,13 @@
  */
 
 #include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <cstdarg>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <fcntl.h> // For O_RDONLY on Unix and Windows
@@ -45,6 +50,17 @@
 // Include before boost headers to ensure the MPL limits get defined.
 #include <ome/common/config.h>
 
+#include <ome/files/config-internal.h>
+
+#if defined(OME_HAVE_PREAD) || defined(OME_HAVE_PWRITE)
+#include <unistd.h>
+#endif
+
+#ifdef OME_HAVE_PWRITE
+#include <sys/stat.h>
+#endif
+
+#include <boost/format.hpp>
 #include <boost/range/size.hpp>
 
 #include <ome/files/Version.h>
@@ -54,6 +70,7 @@
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/Sentry.h>
 #include <ome/files/tiff/Exception.h>
+#include <ome/files/detail/tiff/TagTable.h>
 #include <ome/files/detail/tiff/Tags.h>
 
 #include <ome/common/string.h>
@@ -86,6 +103,387 @@ namespace ome
       namespace
       {
 
+#ifdef OME_HAVE_PWRITE
+
+        /// Alignment of direct writes (file offset, size and memory).
+        const dimension_size_type DIRECT_ALIGNMENT = 4096U;
+
+        /// Default size of the output buffer.
+        const dimension_size_type DEFAULT_WRITE_BUFFER_SIZE = 4U * 1024U * 1024U;
+
+        /**
+         * Output file with write coalescing.
+         *
+         * libtiff writes image data, directories and offset arrays
+         * with many small writes, interspersed with seeks to update
+         * earlier directory entries.  Sequential writes are gathered
+         * in a large buffer and written with a single positioned
+         * write, which avoids fragmentation on parallel and network
+         * filesystems.  Optionally, aligned portions of the buffer
+         * are written using a second, uncached (O_DIRECT) descriptor.
+         *
+         * The file size reported to libtiff is the logical size (the
+         * end of the data written), so that any space preallocated
+         * beyond it is not mistaken for file content; the file is
+         * truncated to the logical size when closed.
+         */
+        class OutputFile
+        {
+        public:
+          /// File descriptor.
+          int fd;
+          /// Uncached file descriptor, or -1 if not in use.
+          int directfd;
+          /// File name (for opening the uncached descriptor).
+          std::string filename;
+          /// Current position.
+          offset_type pos;
+          /// Logical file size.
+          offset_type eof;
+          /// Physical file size, if larger than the logical size.
+          offset_type allocated;
+          /// Buffer storage (over-allocated to allow alignment).
+          std::vector<uint8_t> storage;
+          /// Aligned start of the buffer within storage.
+          uint8_t *buffer;
+          /// Buffer capacity.
+          dimension_size_type capacity;
+          /// File offset of the start of the buffered data.
+          offset_type bufoffset;
+          /// Size of the buffered data.
+          dimension_size_type buflen;
+          /// First error, if any.
+          std::string error;
+
+          OutputFile(const std::string& filename,
+                     int                flags):
+            fd(-1),
+            directfd(-1),
+            filename(filename),
+            pos(0U),
+            eof(0U),
+            allocated(0U),
+            storage(),
+            buffer(0),
+            capacity(0U),
+            bufoffset(0U),
+            buflen(0U),
+            error()
+          {
+            fd = ::open(filename.c_str(), flags, 0666);
+            if (fd < 0)
+              {
+                boost::format fmt("Failed to open ‘%1%’: %2%");
+                fmt % filename % std::strerror(errno);
+                throw Exception(fmt.str());
+              }
+
+            struct stat sb;
+            if (::fstat(fd, &sb) == 0)
+              eof = static_cast<offset_type>(sb.st_size);
+          }
+
+          ~OutputFile()
+          {
+            close();
+          }
+
+          /// Record an error from errno.
+          void
+          fail(const std::string& operation)
+          {
+            if (error.empty())
+              {
+                boost::format fmt("Failed to %1% ‘%2%’: %3%");
+                fmt % operation % filename % std::strerror(errno);
+                error = fmt.str();
+              }
+          }
+
+          /// Write data at an offset.
+          bool
+          writeAt(int             writefd,
+                  const uint8_t  *data,
+                  dimension_size_type size,
+                  offset_type     offset)
+          {
+            while (size)
+              {
+                ssize_t count = ::pwrite(writefd, data, size, static_cast<off_t>(offset));
+                if (count < 0)
+                  {
+                    if (errno == EINTR)
+                      continue;
+                    fail("write");
+                    return false;
+                  }
+                data += count;
+                size -= static_cast<dimension_size_type>(count);
+                offset += static_cast<offset_type>(count);
+              }
+            return true;
+          }
+
+          /// Write out the buffered data.
+          bool
+          flush()
+          {
+            if (!buflen)
+              return true;
+
+            const uint8_t *data = buffer;
+            dimension_size_type size = buflen;
+            offset_type offset = bufoffset;
+            buflen = 0U;
+
+            // The aligned part may bypass the page cache.
+            if (directfd >= 0 && offset % DIRECT_ALIGNMENT == 0)
+              {
+                dimension_size_type aligned = size - (size % DIRECT_ALIGNMENT);
+                if (aligned && !writeAt(directfd, data, aligned, offset))
+                  return false;
+                data += aligned;
+                offset += aligned;
+                size -= aligned;
+              }
+
+            return writeAt(fd, data, size, offset);
+          }
+
+          /// Set the buffer size (0 to disable buffering).
+          bool
+          setBufferSize(dimension_size_type size)
+          {
+            if (!flush())
+              return false;
+
+            // Round up to allow the full buffer to be written directly.
+            size = ((size + DIRECT_ALIGNMENT - 1U) / DIRECT_ALIGNMENT) * DIRECT_ALIGNMENT;
+            storage.resize(size ? size + DIRECT_ALIGNMENT : 0U);
+            storage.shrink_to_fit();
+            capacity = size;
+            buffer = 0;
+            if (size)
+              {
+                void *ptr = storage.data();
+                std::size_t space = storage.size();
+                buffer = static_cast<uint8_t *>(std::align(DIRECT_ALIGNMENT, size, ptr, space));
+              }
+            return true;
+          }
+
+          /// Enable or disable uncached writes.
+          bool
+          setDirect(bool direct)
+          {
+            if (!flush())
+              return false;
+
+            if (directfd >= 0)
+              {
+                ::close(directfd);
+                directfd = -1;
+              }
+#ifdef OME_HAVE_O_DIRECT
+            if (direct)
+              {
+                directfd = ::open(filename.c_str(), O_WRONLY | O_DIRECT);
+                // Not all filesystems support O_DIRECT; fall back to
+                // cached writes.
+              }
+#else
+            static_cast<void>(direct);
+#endif
+            return true;
+          }
+
+          /// Preallocate storage.
+          bool
+          reserve(offset_type size)
+          {
+#ifdef OME_HAVE_POSIX_FALLOCATE
+            if (size <= std::max(eof, allocated))
+              return true;
+            int err = ::posix_fallocate(fd, 0, static_cast<off_t>(size));
+            if (err)
+              return false; // Unsupported or insufficient space; not fatal.
+            allocated = size;
+            return true;
+#else
+            static_cast<void>(size);
+            return false;
+#endif
+          }
+
+          tmsize_t
+          read(void     *buf,
+               tmsize_t  size)
+          {
+            if (!flush())
+              return -1;
+
+            // Preallocated space past the logical end is not content.
+            if (pos >= eof)
+              return 0;
+            size = std::min(size, static_cast<tmsize_t>(eof - pos));
+
+            uint8_t *dest = static_cast<uint8_t *>(buf);
+            tmsize_t total = 0;
+            while (total < size)
+              {
+                ssize_t count = ::pread(fd, dest + total, static_cast<size_t>(size - total),
+                                        static_cast<off_t>(pos + total));
+                if (count < 0)
+                  {
+                    if (errno == EINTR)
+                      continue;
+                    fail("read");
+                    return -1;
+                  }
+                if (count == 0)
+                  break;
+                total += count;
+              }
+            pos += static_cast<offset_type>(total);
+            return total;
+          }
+
+          tmsize_t
+          write(const void *buf,
+                tmsize_t    size)
+          {
+            const uint8_t *src = static_cast<const uint8_t *>(buf);
+            dimension_size_type remaining = static_cast<dimension_size_type>(size);
+
+            // Writes which do not follow on from the buffered data
+            // require the buffer to be written out first.
+            if (buflen && pos != bufoffset + buflen)
+              {
+                if (!flush())
+                  return -1;
+              }
+
+            if (!capacity || (!buflen && remaining >= capacity))
+              {
+                // Unbuffered, or too large to benefit from buffering.
+                if (!writeAt(fd, src, remaining, pos))
+                  return -1;
+              }
+            else
+              {
+                while (remaining)
+                  {
+                    if (!buflen)
+                      bufoffset = pos + (static_cast<dimension_size_type>(size) - remaining);
+                    dimension_size_type count = std::min(remaining, capacity - buflen);
+                    std::copy(src, src + count, buffer + buflen);
+                    buflen += count;
+                    src += count;
+                    remaining -= count;
+                    if (buflen == capacity && !flush())
+                      return -1;
+                  }
+              }
+
+            pos += static_cast<offset_type>(size);
+            eof = std::max(eof, pos);
+            return size;
+          }
+
+          toff_t
+          seek(toff_t offset,
+               int    whence)
+          {
+            switch (whence)
+              {
+              case SEEK_SET:
+                pos = offset;
+                break;
+              case SEEK_CUR:
+                pos += offset;
+                break;
+              case SEEK_END:
+                pos = eof + offset;
+                break;
+              default:
+                return static_cast<toff_t>(-1);
+              }
+            return pos;
+          }
+
+          /// Flush, trim preallocated space, and close.
+          void
+          close()
+          {
+            if (fd < 0)
+              return;
+
+            flush();
+            if (allocated > eof && ::ftruncate(fd, static_cast<off_t>(eof)) != 0)
+              fail("truncate");
+            if (directfd >= 0)
+              ::close(directfd);
+            if (::close(fd) != 0)
+              fail("close");
+            fd = directfd = -1;
+          }
+        };
+
+        tmsize_t
+        output_read(thandle_t  handle,
+                    void      *buf,
+                    tmsize_t   size)
+        {
+          return static_cast<OutputFile *>(handle)->read(buf, size);
+        }
+
+        tmsize_t
+        output_write(thandle_t  handle,
+                     void      *buf,
+                     tmsize_t   size)
+        {
+          return static_cast<OutputFile *>(handle)->write(buf, size);
+        }
+
+        toff_t
+        output_seek(thandle_t handle,
+                    toff_t    offset,
+                    int       whence)
+        {
+          return static_cast<OutputFile *>(handle)->seek(offset, whence);
+        }
+
+        int
+        output_close(thandle_t handle)
+        {
+          OutputFile *file = static_cast<OutputFile *>(handle);
+          file->close();
+          return file->error.empty() ? 0 : -1;
+        }
+
+        toff_t
+        output_size(thandle_t handle)
+        {
+          return static_cast<OutputFile *>(handle)->eof;
+        }
+
+        int
+        output_map(thandle_t /* handle */,
+                   void **   /* base */,
+                   toff_t *  /* size */)
+        {
+          return 0;
+        }
+
+        void
+        output_unmap(thandle_t /* handle */,
+                     void *    /* base */,
+                     toff_t    /* size */)
+        {
+        }
+
+#endif // OME_HAVE_PWRITE
+
         class TIFFConcrete : public TIFF
         {
         public:
@@ -95,6 +493,12 @@ namespace ome
           {
           }
 
+          TIFFConcrete(const boost::filesystem::path&  filename,
+                       const std::vector<offset_type>& offsets):
+            TIFF(filename, offsets)
+          {
+          }
+
           virtual
           ~TIFFConcrete()
           {
@@ -111,13 +515,27 @@ namespace ome
       public:
         /// The libtiff file handle.
         ::TIFF *tiff;
+        /// The underlying file descriptor (for direct reading).
+        int fd;
+        /// File byte order differs from the native byte order.
+        bool byteswapped;
         /// Directory offsets
         std::vector<offset_type> offsets;
+        /// Tag tables for each directory offset (when reading).
+        std::map<offset_type, std::shared_ptr<::ome::files::detail::tiff::TagTable>> tagtables;
+        /// Mutex to serialise tag table access.
+        std::mutex tagtables_mutex;
+#ifdef OME_HAVE_PWRITE
+        /// Coalescing output file (when writing).
+        std::unique_ptr<OutputFile> output;
+#endif
 
         /**
          * The constructor.
          *
-         * Opens the TIFF using TIFFOpen().
+         * Opens the TIFF using TIFFOpen() when reading, or
+         * TIFFClientOpen() with coalesced output when writing, if
+         * supported by the platform.
          *
          * @param filename the filename to open.
          * @param mode the file open mode.
@@ -125,10 +543,44 @@ namespace ome
         Impl(const boost::filesystem::path& filename,
              const std::string&             mode):
           tiff(),
-          offsets()
+          fd(-1),
+          byteswapped(false),
+          offsets(),
+          tagtables(),
+          tagtables_mutex()
+#ifdef OME_HAVE_PWRITE
+          , output()
+#endif
         {
           Sentry sentry;
 
+#ifdef OME_HAVE_PWRITE
+          // Files opened for writing use coalesced output.
+          if (!mode.empty() && (mode[0] == 'w' || mode[0] == 'a'))
+            {
+              int flags = O_RDWR | O_CREAT;
+              if (mode[0] == 'w')
+                flags |= O_TRUNC;
+              output = std::unique_ptr<OutputFile>(new OutputFile(filename.string(), flags));
+              output->setBufferSize(DEFAULT_WRITE_BUFFER_SIZE);
+
+              tiff = TIFFClientOpen(filename.string().c_str(), mode.c_str(),
+                                    static_cast<thandle_t>(output.get()),
+                                    output_read, output_write, output_seek,
+                                    output_close, output_size,
+                                    output_map, output_unmap);
+              if (!tiff)
+                {
+                  output.reset();
+                  sentry.error();
+                }
+
+              fd = output->fd;
+              byteswapped = TIFFIsByteSwapped(tiff) != 0;
+              return;
+            }
+#endif
+
 #ifdef _MSC_VER
           tiff = TIFFOpenW(filename.wstring().c_str(), mode.c_str());
 #else
@@ -136,6 +588,9 @@ namespace ome
 #endif
           if (!tiff)
             sentry.error();
+
+          fd = TIFFFileno(tiff);
+          byteswapped = TIFFIsByteSwapped(tiff) != 0;
         }
 
         /**
@@ -179,9 +634,15 @@ namespace ome
               Sentry sentry;
 
               TIFFClose(tiff);
+              tiff = 0;
+              fd = -1;
+#ifdef OME_HAVE_PWRITE
+              std::unique_ptr<OutputFile> file(std::move(output));
+              if (file && !file->error.empty())
+                throw Exception(file->error);
+#endif
               if (!sentry.getMessage().empty())
                 sentry.error();
-              tiff = 0;
             }
         }
       };
@@ -207,6 +668,16 @@ namespace ome
           }
       }
 
+      // Note boost::make_shared can't be used here.
+      TIFF::TIFF(const boost::filesystem::path&  filename,
+                 const std::vector<offset_type>& offsets):
+        impl(std::shared_ptr<Impl>(new Impl(filename, "r")))
+      {
+        registerImageJTags();
+
+        impl->offsets = offsets;
+      }
+
       TIFF::~TIFF()
       {
       }
@@ -235,6 +706,24 @@ namespace ome
         return ret;
       }
 
+      std::shared_ptr<TIFF>
+      TIFF::open(const boost::filesystem::path&  filename,
+                 const std::vector<offset_type>& offsets)
+      {
+        std::shared_ptr<TIFF> ret;
+        try
+          {
+            // Note boost::make_shared can't be used here.
+            ret = std::shared_ptr<TIFF>(new TIFFConcrete(filename, offsets));
+          }
+        catch (const std::exception& e)
+          {
+            // All exception types are propagated as an Exception.
+            throw Exception(e.what());
+          }
+        return ret;
+      }
+
       void
       TIFF::close()
       {
@@ -252,6 +741,12 @@ namespace ome
         return impl->offsets.size();
       }
 
+      const std::vector<offset_type>&
+      TIFF::directoryOffsets() const
+      {
+        return impl->offsets;
+      }
+
       std::shared_ptr<IFD>
       TIFF::getDirectoryByIndex(directory_index_type index) const
       {
@@ -275,7 +770,15 @@ namespace ome
 
         std::shared_ptr<TIFF> t(std::const_pointer_cast<TIFF>(shared_from_this()));
         std::shared_ptr<IFD> ifd = IFD::openOffset(t, offset);
-        ifd->makeCurrent(); // Validate offset.
+        // If the tags for this directory were previously loaded, the
+        // offset is known to be valid and no directory switch is
+        // needed.
+        if (!getTagTable(offset)->loaded.load(std::memory_order_acquire))
+          {
+            ifd->makeCurrent(); // Validate offset.
+            if (TIFFGetMode(impl->tiff) == O_RDONLY)
+              ifd->loadTags();
+          }
         return ifd;
       }
 
@@ -324,6 +827,115 @@ namespace ome
         return const_iterator();
       }
 
+      std::shared_ptr<::ome::files::detail::tiff::TagTable>
+      TIFF::getTagTable(offset_type offset) const
+      {
+        typedef ::ome::files::detail::tiff::TagTable TagTable;
+
+        if (!impl->tiff || TIFFGetMode(impl->tiff) != O_RDONLY)
+          return std::make_shared<TagTable>();
+
+        std::lock_guard<std::mutex> lock(impl->tagtables_mutex);
+        std::shared_ptr<TagTable>& table(impl->tagtables[offset]);
+        if (!table)
+          {
+            table = std::make_shared<TagTable>();
+            table->shared = true;
+          }
+        return table;
+      }
+
+      bool
+      TIFF::directReadable() const
+      {
+#ifdef OME_HAVE_PREAD
+        return impl->tiff && impl->fd >= 0 &&
+          TIFFGetMode(impl->tiff) == O_RDONLY;
+#else
+        return false;
+#endif
+      }
+
+      bool
+      TIFF::isByteSwapped() const
+      {
+        return impl->byteswapped;
+      }
+
+      dimension_size_type
+      TIFF::readRaw(offset_type         offset,
+                    void               *buf,
+                    dimension_size_type size) const
+      {
+#ifdef OME_HAVE_PREAD
+        if (!impl->tiff || impl->fd < 0)
+          throw Exception("Failed to read raw data: TIFF is closed");
+
+        char *dest = static_cast<char *>(buf);
+        dimension_size_type total = 0;
+        while (total < size)
+          {
+            ssize_t count = ::pread(impl->fd, dest + total, size - total,
+                                    static_cast<off_t>(offset + total));
+            if (count < 0)
+              {
+                if (errno == EINTR)
+                  continue;
+                boost::format fmt("Failed to read %1% bytes at offset %2%: %3%");
+                fmt % size % offset % std::strerror(errno);
+                throw Exception(fmt.str());
+              }
+            if (count == 0) // End of file.
+              break;
+            total += static_cast<dimension_size_type>(count);
+          }
+        return total;
+#else
+        boost::format fmt("Failed to read %1% bytes at offset %2%: direct reading not supported on this platform");
+        fmt % size % offset;
+        throw Exception(fmt.str());
+#endif
+      }
+
+      void
+      TIFF::setWriteBufferSize(dimension_size_type size)
+      {
+#ifdef OME_HAVE_PWRITE
+        Sentry sentry;
+
+        if (impl->output && !impl->output->setBufferSize(size))
+          throw Exception(impl->output->error);
+#else
+        static_cast<void>(size);
+#endif
+      }
+
+      void
+      TIFF::setDirectIO(bool direct)
+      {
+#ifdef OME_HAVE_PWRITE
+        Sentry sentry;
+
+        if (impl->output && !impl->output->setDirect(direct))
+          throw Exception(impl->output->error);
+#else
+        static_cast<void>(direct);
+#endif
+      }
+
+      bool
+      TIFF::reserve(offset_type size)
+      {
+#ifdef OME_HAVE_PWRITE
+        Sentry sentry;
+
+        return impl->output && impl->output->reserve(size);
+#else
+        static_cast<void>(size);
+        return false;
+#endif
+      }
+
       void
       TIFF::registerImageJTags()
       {
@@ -41,6 +41,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/iterator/iterator_facade.hpp>
@@ -51,6 +52,14 @@ namespace ome
 {
   namespace files
   {
+    namespace detail
+    {
+      namespace tiff
+      {
+        struct TagTable;
+      }
+    }
+
     /**
      * TIFF file format (libtiff wrapper).
      */
@@ -173,6 +182,16 @@ namespace ome
         TIFF(const boost::filesystem::path& filename,
              const std::string&             mode);
 
+        /**
+         * Constructor with known directory offsets (non-public).
+         *
+         * @param filename the file to open for reading.
+         * @param offsets the directory offsets.
+         * @throws an Exception on failure.
+         */
+        TIFF(const boost::filesystem::path&  filename,
+             const std::vector<offset_type>& offsets);
+
         /// @cond SKIP
         TIFF (const TIFF&) = delete;
 
@@ -200,6 +219,24 @@ namespace ome
         open(const boost::filesystem::path& filename,
              const std::string&             mode);
 
+        /**
+         * Open a TIFF file for reading with known directory offsets.
+         *
+         * When opened for reading, all directories are normally
+         * scanned to find their offsets.  If the offsets are already
+         * known, for example from directoryOffsets() of a previous
+         * instance, the scan is skipped.  The offsets are not
+         * validated; they must match the file.
+         *
+         * @param filename the file to open.
+         * @param offsets the directory offsets.
+         * @returns the the open TIFF.
+         * @throws an Exception on failure.
+         */
+        static std::shared_ptr<TIFF>
+        open(const boost::filesystem::path&  filename,
+             const std::vector<offset_type>& offsets);
+
         /**
          * Close the TIFF file.
          *
@@ -226,6 +263,14 @@ namespace ome
         directory_index_type
         directoryCount() const;
 
+        /**
+         * Get the offsets of all IFDs.
+         *
+         * @returns the directory offsets, in directory index order.
+         */
+        const std::vector<offset_type>&
+        directoryOffsets() const;
+
         /**
          * Get an IFD by its index.
          *
@@ -290,6 +335,50 @@ namespace ome
         wrapped_type *
         getWrapped() const;
 
+        /**
+         * Set the output buffer size.
+         *
+         * When writing, sequential writes made by libtiff are
+         * gathered into a buffer of this size and written to the file
+         * as a single large write.  The default is 4 MiB.  This has
+         * no effect when reading, or if not supported by the platform.
+         *
+         * @param size the buffer size in bytes, or 0 to disable
+         * buffering.
+         * @throws an Exception if buffered data could not be written.
+         */
+        void
+        setWriteBufferSize(dimension_size_type size);
+
+        /**
+         * Enable or disable direct (uncached) output.
+         *
+         * When enabled, aligned portions of the output buffer are
+         * written bypassing the operating system page cache, if
+         * supported by the platform and filesystem.  This has no
+         * effect when reading or if output buffering is disabled.
+         *
+         * @param direct @c true to enable, @c false to disable.
+         * @throws an Exception if buffered data could not be written.
+         */
+        void
+        setDirectIO(bool direct);
+
+        /**
+         * Preallocate storage for the file.
+         *
+         * Reserving the expected size of the file in advance reduces
+         * fragmentation when writing large files.  Any space not used
+         * will be released when the file is closed.
+         *
+         * @param size the expected file size in bytes.
+         * @returns @c true if the space was reserved, or @c false if
+         * preallocation is not supported, or the file is not open for
+         * writing.
+         */
+        bool
+        reserve(offset_type size);
+
         /// IFD uses internal TIFF state.
         friend class IFD;
 
@@ -334,6 +423,59 @@ namespace ome
         /// Register ImageJ tags with libtiff for this image.
         void
         registerImageJTags();
+
+        /**
+         * Get the tag table for a directory.
+         *
+         * When reading, tag tables are shared between all IFDs
+         * referring to the same directory offset, so that tags need
+         * only be read from libtiff once.  When writing, a new table
+         * is returned for each call.
+         *
+         * @param offset the directory offset.
+         * @returns the tag table.
+         */
+        std::shared_ptr<::ome::files::detail::tiff::TagTable>
+        getTagTable(offset_type offset) const;
+
+        /**
+         * Check if raw image data may be read directly from the file.
+         *
+         * Direct reads use positioned reads on the underlying file
+         * descriptor, bypassing the libtiff handle entirely, and so
+         * do not require any directory switching or serialisation.
+         *
+         * @returns @c true if the file is open read-only and the
+         * platform supports positioned reads, @c false otherwise.
+         */
+        bool
+        directReadable() const;
+
+        /**
+         * Check if the file byte order differs from the native byte order.
+         *
+         * @returns @c true if the data requires byte swapping, @c
+         * false otherwise.
+         */
+        bool
+        isByteSwapped() const;
+
+        /**
+         * Read raw data directly from the file.
+         *
+         * This is safe to call concurrently from multiple threads.
+         *
+         * @param offset the file offset to read from.
+         * @param buf the destination buffer.
+         * @param size the number of bytes to read.
+         * @returns the number of bytes read, which will be less than
+         * @c size only at end of file.
+         * @throws an Exception on failure.
+         */
+        dimension_size_type
+        readRaw(offset_type         offset,
+                void               *buf,
+                dimension_size_type size) const;
       };
 
     }
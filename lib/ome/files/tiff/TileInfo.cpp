@@ -35,6 +35,9 @@
  * #L%
  */
 
+#include <algorithm>
+#include <utility>
+
 #include <ome/files/tiff/Field.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/Tags.h>
@@ -101,9 +104,6 @@ namespace ome
           ntiles(),
           buffersize()
         {
-          Sentry sentry;
-          ::TIFF *tiff = getTIFF();
-
           // Get basic image metadata.
           uint32_t imagewidth = ifd->getImageWidth();
           uint32_t imageheight = ifd->getImageHeight();
@@ -113,18 +113,9 @@ namespace ome
           tileheight = ifd->getTileHeight();
           type = ifd->getTileType();
 
-          // Get tile-specific metadata, falling back to
-          // strip-specific metadata if not present.
-          if (type == TILE)
-            {
-              tilecount = TIFFNumberOfTiles(tiff);
-              buffersize = TIFFTileSize(tiff);
-            }
-          else
-            {
-              tilecount = TIFFNumberOfStrips(tiff);
-              buffersize = TIFFStripSize(tiff);
-            }
+          // Get tile or strip count and size.
+          tilecount = ifd->getTileCount();
+          buffersize = static_cast<tsize_t>(ifd->getTileBufferSize());
 
           // Compute row and column counts.
           nrows = imageheight / tileheight;
@@ -155,21 +146,6 @@ namespace ome
 
           return sifd;
         }
-
-        /**
-         * Get the TIFF this tile belongs to.
-         *
-         * @note Needs wrapping in a sentry by the caller.
-         *
-         * @returns a pointer to the underlying TIFF.
-         */
-        ::TIFF *
-        getTIFF()
-        {
-          getIFD()->makeCurrent();
-          ::TIFF *tiff = reinterpret_cast<::TIFF *>(getIFD()->getTIFF()->getWrapped());
-          return tiff;
-        }
       };
 
       TileInfo::TileInfo(std::shared_ptr<IFD> ifd):
@@ -228,10 +204,14 @@ namespace ome
                           dimension_size_type y,
                           dimension_size_type s) const
       {
-        Sentry sentry;
-        ::TIFF *tiff = impl->getTIFF();
+        // Equivalent to TIFFComputeTile, but without requiring the
+        // directory to be current.
+        dimension_size_type index = ((y / impl->tileheight) * impl->ncols) +
+          (x / impl->tilewidth);
+        if (impl->planarconfig == SEPARATE)
+          index += s * impl->ntiles;
 
-        return TIFFComputeTile(tiff, x, y, 0, s);
+        return index;
       }
 
       dimension_size_type
@@ -316,6 +296,36 @@ namespace ome
         return ret;
       }
 
+      std::vector<dimension_size_type>
+      TileInfo::tileCoverage(PlaneRegion         region,
+                             dimension_size_type centerX,
+                             dimension_size_type centerY) const
+      {
+        std::vector<dimension_size_type> tiles(tileCoverage(region));
+
+        // Squared distance of each tile centre from the centre point,
+        // followed by the spatial tile index so that planar samples
+        // of the same area are adjacent.
+        typedef std::pair<dimension_size_type, dimension_size_type> index_type;
+        std::vector<std::pair<double, index_type>> order;
+        order.reserve(tiles.size());
+        for (const auto& tile : tiles)
+          {
+            PlaneRegion r(tileRegion(tile));
+            const double dx = (static_cast<double>(r.x) + (static_cast<double>(r.w) / 2.0)) - static_cast<double>(centerX);
+            const double dy = (static_cast<double>(r.y) + (static_cast<double>(r.h) / 2.0)) - static_cast<double>(centerY);
+            order.push_back(std::make_pair((dx * dx) + (dy * dy),
+                                           index_type(tile % impl->ntiles, tile)));
+          }
+
+        std::sort(order.begin(), order.end());
+
+        for (dimension_size_type i = 0; i < order.size(); ++i)
+          tiles[i] = order[i].second.second;
+
+        return tiles;
+      }
+
     }
   }
 }
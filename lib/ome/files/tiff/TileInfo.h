@@ -225,6 +225,24 @@ namespace ome
         std::vector<dimension_size_type>
         tileCoverage(PlaneRegion region) const;
 
+        /**
+         * Get a list of the tiles covering an image region, closest
+         * to a centre point first.
+         *
+         * Tiles are ordered by the distance of their centre from the
+         * centre point, and then by position.  If the samples are
+         * planar, the tiles for each sample of the same area are
+         * adjacent, in sample order.
+         *
+         * @copydetails tileCoverage(PlaneRegion) const
+         * @param centerX the @c X coordinate of the centre point.
+         * @param centerY the @c Y coordinate of the centre point.
+         */
+        std::vector<dimension_size_type>
+        tileCoverage(PlaneRegion         region,
+                     dimension_size_type centerX,
+                     dimension_size_type centerY) const;
+
       protected:
         class Impl;
         /// Private implementation details.
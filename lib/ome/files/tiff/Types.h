@@ -220,6 +220,13 @@ namespace ome
           TILE   ///< Tiles.
         };
 
+      /// Method used to decimate image data when subsampling.
+      enum Decimation
+        {
+          DECIMATE_NEAREST, ///< Use the first pixel of each block.
+          DECIMATE_AVERAGE  ///< Use the average of all pixels in each block.
+        };
+
     }
   }
 }
@@ -35,8 +35,14 @@
  * #L%
  */
 
+#include <cstring>
+#include <set>
+
+#include <boost/filesystem/fstream.hpp>
+
 #include <ome/files/CoreMetadata.h>
 #include <ome/files/FormatException.h>
+#include <ome/files/tiff/Exception.h>
 #include <ome/files/tiff/Field.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/Tags.h>
@@ -54,6 +60,203 @@ namespace ome
       namespace
       {
 
+        // Image structure tag numbers.
+        const uint64_t TAG_IMAGEWIDTH = 256U;
+        const uint64_t TAG_IMAGELENGTH = 257U;
+        const uint64_t TAG_BITSPERSAMPLE = 258U;
+        const uint64_t TAG_PHOTOMETRIC = 262U;
+        const uint64_t TAG_SAMPLESPERPIXEL = 277U;
+        const uint64_t TAG_PLANARCONFIG = 284U;
+        const uint64_t TAG_SAMPLEFORMAT = 339U;
+
+        // ImageDescription tag number.
+        const uint64_t TAG_IMAGEDESCRIPTION = 270U;
+
+        /*
+         * Direct reader for the TIFF header and IFD chain.
+         *
+         * This reads the file structure using plain stream I/O, to
+         * avoid libtiff reading every IFD when the file is opened.
+         */
+        class RawTIFF
+        {
+        private:
+          /// The file being read.
+          boost::filesystem::path filename;
+          /// Input stream.
+          boost::filesystem::ifstream in;
+          /// Little-endian byte order.
+          bool little;
+          /// BigTIFF.
+          bool big;
+          /// Offset of first IFD.
+          offset_type first;
+
+        public:
+          explicit
+          RawTIFF(const boost::filesystem::path& filename):
+            filename(filename),
+            in(filename, std::ios::in | std::ios::binary),
+            little(true),
+            big(false),
+            first(0U)
+          {
+            if (!in)
+              fail("Failed to open file");
+
+            uint8_t header[16];
+            in.read(reinterpret_cast<char *>(header), sizeof(header));
+            std::streamsize size = in.gcount();
+            in.clear();
+
+            if (size < 8)
+              fail("Not a TIFF file");
+            if (header[0] == 'I' && header[1] == 'I')
+              little = true;
+            else if (header[0] == 'M' && header[1] == 'M')
+              little = false;
+            else
+              fail("Not a TIFF file");
+
+            switch (decode(header + 2, 2U))
+              {
+              case 42U:
+                big = false;
+                first = decode(header + 4, 4U);
+                break;
+              case 43U:
+                if (size < 16 || decode(header + 4, 2U) != 8U)
+                  fail("Invalid BigTIFF header");
+                big = true;
+                first = decode(header + 8, 8U);
+                break;
+              default:
+                fail("Not a TIFF file");
+                break;
+              }
+          }
+
+          offset_type
+          firstDirectory() const
+          {
+            return first;
+          }
+
+          // Size of the IFD entry count.
+          std::size_t
+          countSize() const
+          {
+            return big ? 8U : 2U;
+          }
+
+          // Size of an IFD entry.
+          std::size_t
+          entrySize() const
+          {
+            return big ? 20U : 12U;
+          }
+
+          // Size of an offset or inline value.
+          std::size_t
+          offsetSize() const
+          {
+            return big ? 8U : 4U;
+          }
+
+          // Number of entries in the IFD at the specified offset.
+          uint64_t
+          entryCount(offset_type offset)
+          {
+            uint8_t buf[8];
+            read(offset, buf, countSize());
+            uint64_t count = decode(buf, countSize());
+            // The maximum possible for classic TIFF; BigTIFF files
+            // with more tags than this are not plausible.
+            if (count > 65535U)
+              fail("Invalid IFD entry count");
+            return count;
+          }
+
+          // Offset of the IFD following the IFD at the specified offset.
+          offset_type
+          nextDirectory(offset_type offset,
+                        uint64_t    count)
+          {
+            uint8_t buf[8];
+            read(offset + countSize() + (count * entrySize()), buf, offsetSize());
+            return decode(buf, offsetSize());
+          }
+
+          void
+          read(offset_type offset,
+               void        *buf,
+               std::size_t  size)
+          {
+            in.seekg(static_cast<std::streamoff>(offset));
+            in.read(static_cast<char *>(buf), static_cast<std::streamsize>(size));
+            if (!in || in.gcount() != static_cast<std::streamsize>(size))
+              {
+                in.clear();
+                fail("Unexpected end of file");
+              }
+          }
+
+          // Decode an unsigned integer in file byte order.
+          uint64_t
+          decode(const uint8_t *data,
+                 std::size_t    size) const
+          {
+            uint64_t value = 0U;
+            for (std::size_t i = 0; i < size; ++i)
+              value = (value << 8) | data[little ? size - 1 - i : i];
+            return value;
+          }
+
+          // Decode the first value of an IFD entry.  Values of
+          // integer types are supported; others decode as zero.
+          uint64_t
+          decodeEntry(const uint8_t *entry)
+          {
+            std::size_t size = 0U;
+            switch (decode(entry + 2, 2U))
+              {
+              case 1U: // BYTE
+                size = 1U;
+                break;
+              case 3U: // SHORT
+                size = 2U;
+                break;
+              case 4U: // LONG
+                size = 4U;
+                break;
+              case 16U: // LONG8
+                size = 8U;
+                break;
+              default:
+                return 0U;
+              }
+
+            const uint64_t count = decode(entry + 4, offsetSize());
+            const uint8_t *value = entry + 4 + offsetSize();
+            if (count == 0U)
+              return 0U;
+            if (count * size <= offsetSize())
+              return decode(value, size);
+
+            uint8_t buf[8];
+            read(decode(value, offsetSize()), buf, size);
+            return decode(buf, size);
+          }
+
+          void
+          fail(const std::string& reason) const
+          {
+            boost::format fmt("Failed to read TIFF ‘%1%’: %2%");
+            fmt % filename.string() % reason;
+            throw Exception(fmt.str());
+          }
+        };
+
         // Scalar
         template<typename T>
         void
@@ -439,6 +642,179 @@ namespace ome
         return enable;
       }
 
+      std::string
+      readImageDescription(const boost::filesystem::path& filename,
+                           dimension_size_type            limit)
+      {
+        RawTIFF raw(filename);
+
+        const offset_type ifd = raw.firstDirectory();
+        if (!ifd)
+          raw.fail("No TIFF IFDs found");
+
+        const uint64_t count = raw.entryCount(ifd);
+        const std::size_t esize = raw.entrySize();
+        const std::size_t osize = raw.offsetSize();
+        std::vector<uint8_t> entries(count * esize);
+        if (!entries.empty())
+          raw.read(ifd + raw.countSize(), &entries[0], entries.size());
+
+        for (uint64_t i = 0U; i < count; ++i)
+          {
+            const uint8_t *entry = &entries[i * esize];
+            if (raw.decode(entry, 2U) != TAG_IMAGEDESCRIPTION)
+              continue;
+
+            // ASCII, or BYTE or UNDEFINED as written by some software.
+            const uint64_t type = raw.decode(entry + 2, 2U);
+            if (type != 1U && type != 2U && type != 7U)
+              raw.fail("Invalid ImageDescription type");
+
+            const uint64_t length = raw.decode(entry + 4, osize);
+            const uint8_t *value = entry + 4 + osize;
+            dimension_size_type size = length;
+            if (limit && size > limit)
+              size = limit;
+
+            std::string description(size, '\0');
+            if (size)
+              {
+                if (length <= osize)
+                  std::memcpy(&description[0], value, size);
+                else
+                  raw.read(raw.decode(value, osize), &description[0], size);
+              }
+
+            std::string::size_type end = description.find('\0');
+            if (end != std::string::npos)
+              description.resize(end);
+
+            return description;
+          }
+
+        raw.fail("No TIFF ImageDescription found");
+        return std::string();
+      }
+
+      bool
+      sameStructure(const IFDSummary& lhs,
+                    const IFDSummary& rhs)
+      {
+        return (lhs.width == rhs.width &&
+                lhs.height == rhs.height &&
+                lhs.bits == rhs.bits &&
+                lhs.sampleFormat == rhs.sampleFormat &&
+                lhs.samples == rhs.samples &&
+                lhs.planarConfig == rhs.planarConfig &&
+                lhs.photometric == rhs.photometric);
+      }
+
+      std::vector<IFDSummary>
+      readIFDSummaries(const boost::filesystem::path& filename)
+      {
+        RawTIFF raw(filename);
+
+        std::vector<IFDSummary> summaries;
+        std::set<offset_type> seen;
+        std::vector<uint8_t> entries;
+        offset_type offset = raw.firstDirectory();
+
+        while (offset)
+          {
+            if (!seen.insert(offset).second)
+              break;
+            try
+              {
+                // Read all entries and the next IFD offset at once.
+                const uint64_t count = raw.entryCount(offset);
+                const std::size_t esize = raw.entrySize();
+                entries.resize((count * esize) + raw.offsetSize());
+                raw.read(offset + raw.countSize(), &entries[0], entries.size());
+
+                IFDSummary summary;
+                summary.offset = offset;
+                summary.width = 0U;
+                summary.height = 0U;
+                summary.bits = 1U;
+                summary.sampleFormat = 1U;
+                summary.samples = 1U;
+                summary.planarConfig = 1U;
+                summary.photometric = 0U;
+
+                for (uint64_t i = 0U; i < count; ++i)
+                  {
+                    const uint8_t *entry = &entries[i * esize];
+                    switch (raw.decode(entry, 2U))
+                      {
+                      case TAG_IMAGEWIDTH:
+                        summary.width = raw.decodeEntry(entry);
+                        break;
+                      case TAG_IMAGELENGTH:
+                        summary.height = raw.decodeEntry(entry);
+                        break;
+                      case TAG_BITSPERSAMPLE:
+                        summary.bits = static_cast<uint16_t>(raw.decodeEntry(entry));
+                        break;
+                      case TAG_PHOTOMETRIC:
+                        summary.photometric = static_cast<uint16_t>(raw.decodeEntry(entry));
+                        break;
+                      case TAG_SAMPLESPERPIXEL:
+                        summary.samples = static_cast<uint16_t>(raw.decodeEntry(entry));
+                        break;
+                      case TAG_PLANARCONFIG:
+                        summary.planarConfig = static_cast<uint16_t>(raw.decodeEntry(entry));
+                        break;
+                      case TAG_SAMPLEFORMAT:
+                        summary.sampleFormat = static_cast<uint16_t>(raw.decodeEntry(entry));
+                        break;
+                      default:
+                        break;
+                      }
+                  }
+
+                summaries.push_back(summary);
+                offset = raw.decode(&entries[count * esize], raw.offsetSize());
+              }
+            catch (const Exception&)
+              {
+                break;
+              }
+          }
+
+        return summaries;
+      }
+
+      dimension_size_type
+      countDirectories(const boost::filesystem::path& filename,
+                       dimension_size_type            limit)
+      {
+        RawTIFF raw(filename);
+
+        std::set<offset_type> seen;
+        dimension_size_type count = 0U;
+        offset_type offset = raw.firstDirectory();
+
+        while (offset && (!limit || count < limit))
+          {
+            // As for libtiff, a looping, truncated or otherwise
+            // invalid IFD ends the chain.
+            if (!seen.insert(offset).second)
+              break;
+            try
+              {
+                const uint64_t entries = raw.entryCount(offset);
+                ++count;
+                offset = raw.nextDirectory(offset, entries);
+              }
+            catch (const Exception&)
+              {
+                break;
+              }
+          }
+
+        return count;
+      }
+
     }
   }
 }
@@ -102,6 +102,69 @@ namespace ome
       /// Mapping between series index and IFD range.
       typedef std::vector<IFDRange> SeriesIFDRange;
 
+      /**
+       * Summary of the image structure of an IFD.
+       *
+       * The raw values of the tags determining the image size and
+       * pixel format, as stored in the file.  Tags which are not
+       * present have their default value as defined by the TIFF
+       * specification, or zero if there is no default.
+       */
+      struct IFDSummary
+      {
+        /// IFD offset.
+        offset_type offset;
+        /// Image width.
+        uint64_t    width;
+        /// Image height.
+        uint64_t    height;
+        /// Bits per sample (of the first sample).
+        uint16_t    bits;
+        /// Sample format (of the first sample).
+        uint16_t    sampleFormat;
+        /// Samples per pixel.
+        uint16_t    samples;
+        /// Planar configuration.
+        uint16_t    planarConfig;
+        /// Photometric interpretation.
+        uint16_t    photometric;
+      };
+
+      /**
+       * Check if two IFD summaries have the same image structure.
+       *
+       * All fields other than the offset are compared.  If @c true,
+       * the IFDs have the same size and pixel format.  If @c false,
+       * the pixel format may still be the same, since different raw
+       * tag values may result in the same pixel type.
+       *
+       * @param lhs the first IFD summary.
+       * @param rhs the second IFD summary.
+       * @returns @c true if the structure is the same, @c false
+       * otherwise.
+       */
+      bool
+      sameStructure(const IFDSummary& lhs,
+                    const IFDSummary& rhs);
+
+      /**
+       * Summarise all IFDs in a TIFF file.
+       *
+       * This follows the chain of IFDs directly from the file, as
+       * for countDirectories(), and decodes the image structure tags
+       * from the raw entries of each IFD.  This requires a single
+       * read for most IFDs, rather than loading every tag with
+       * libtiff.  As for libtiff, a looping, truncated or otherwise
+       * invalid IFD ends the chain.
+       *
+       * @param filename the TIFF file to read.
+       * @returns a summary of each IFD, in file order.
+       * @throws an Exception if the file could not be read or is not
+       * a TIFF file.
+       */
+      std::vector<IFDSummary>
+      readIFDSummaries(const boost::filesystem::path& filename);
+
       /**
        * Compute IFD index from IFD map and plane index.
        *
@@ -143,6 +206,45 @@ namespace ome
                     const boost::filesystem::path& filename,
                     ome::common::Logger&           logger);
 
+      /**
+       * Read the ImageDescription of the first IFD.
+       *
+       * This reads only the TIFF header, the first IFD and the
+       * description itself directly from the file, without opening
+       * it with libtiff (which scans every IFD on open).  This makes
+       * it suitable for cheaply checking the type of a file.
+       *
+       * @param filename the TIFF file to read.
+       * @param limit the maximum number of bytes of the description
+       * to read, or zero to read all of it.
+       * @returns the description (up to the first null byte).
+       * @throws an Exception if the file could not be read, is not a
+       * TIFF file, or has no ImageDescription.
+       */
+      std::string
+      readImageDescription(const boost::filesystem::path& filename,
+                           dimension_size_type            limit = 0U);
+
+      /**
+       * Count the IFDs in a TIFF file.
+       *
+       * This follows the chain of IFD offsets directly from the file,
+       * reading only the entry count and next offset of each IFD
+       * rather than loading its tags.  Counting stops early once @c
+       * limit IFDs have been found, so callers which only need a
+       * lower bound need not walk the whole file.
+       *
+       * @param filename the TIFF file to read.
+       * @param limit the maximum number of IFDs to count, or zero to
+       * count all of them.
+       * @returns the number of IFDs (at most @c limit, if set).
+       * @throws an Exception if the file could not be read or is not
+       * a TIFF file, or if the IFD chain is invalid.
+       */
+      dimension_size_type
+      countDirectories(const boost::filesystem::path& filename,
+                       dimension_size_type            limit = 0U);
+
     }
   }
 }
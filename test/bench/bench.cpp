@@ -0,0 +1,1141 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+// Performance benchmarks for OME-Files.
+//
+// Synthetic OME-TIFF and TIFF datasets are generated in a working
+// directory, covering a range of layouts (strips and tiles), codecs,
+// pixel types, planar configurations and IFD and file counts.  For
+// each dataset, the time to write, open (setId) and read (whole
+// planes, random regions and thumbnails) is measured, and the results
+// are written as JSON for tracking across releases.  OME-TIFF writes
+// are also timed without output buffering and preallocation, to
+// compare with the unbuffered small writes made by libtiff.  The
+// writer layout profiles are compared to show their read and write
+// tradeoffs.  Multi-file OME-TIFF datasets are also written with one
+// thread per file, to show how far the per-file writes overlap.
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Include before boost headers to ensure the MPL limits get defined.
+#include <ome/common/config.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/format.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+
+#include <ome/files/CoreMetadata.h>
+#include <ome/files/FormatReader.h>
+#include <ome/files/FormatWriter.h>
+#include <ome/files/MetadataTools.h>
+#include <ome/files/PixelProperties.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/Version.h>
+#include <ome/files/in/OMETIFFReader.h>
+#include <ome/files/in/TIFFReader.h>
+#include <ome/files/module.h>
+#include <ome/files/out/MinimalTIFFWriter.h>
+#include <ome/files/out/OMETIFFWriter.h>
+
+#include <ome/common/log.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+#ifndef _MSC_VER
+#  include <sys/resource.h>
+#endif
+
+using boost::filesystem::path;
+using ome::files::dimension_size_type;
+using ome::files::CoreMetadata;
+using ome::files::FormatReader;
+using ome::files::FormatWriter;
+using ome::files::VariantPixelBuffer;
+using ome::xml::model::enums::DimensionOrder;
+using ome::xml::model::enums::PixelType;
+
+namespace opt = boost::program_options;
+
+namespace
+{
+
+  /// Clock used for all timings.
+  typedef std::chrono::steady_clock bench_clock;
+
+  /// Dataset file format.
+  enum BenchFormat
+    {
+      FORMAT_OMETIFF, ///< OME-TIFF (OMETIFFWriter and OMETIFFReader).
+      FORMAT_TIFF     ///< Plain TIFF (MinimalTIFFWriter and TIFFReader).
+    };
+
+  /// Benchmark settings.
+  struct Settings
+  {
+    /// Directory for generated datasets.
+    path workdir;
+    /// File for results (or "-" for standard output).
+    std::string output;
+    /// Plane width and height.
+    dimension_size_type size;
+    /// Planes per series.
+    dimension_size_type planes;
+    /// Number of repetitions (the fastest is reported).
+    dimension_size_type repeat;
+    /// Number of random regions to read.
+    dimension_size_type regions;
+    /// Random region width and height.
+    dimension_size_type regionsize;
+    /// Tile width and height.
+    dimension_size_type tilesize;
+    /// Rows per strip.
+    dimension_size_type striprows;
+    /// Only run cases containing this string.
+    std::string filter;
+    /// Keep generated datasets.
+    bool keep;
+    /// List cases only.
+    bool list;
+  };
+
+  /// A single benchmark case (dataset and access pattern).
+  struct BenchCase
+  {
+    /// Case name.
+    std::string name;
+    /// File format.
+    BenchFormat format;
+    /// Pixel type.
+    PixelType pixeltype;
+    /// Samples per pixel.
+    dimension_size_type samples;
+    /// Interleaved (contiguous) or planar (separate) samples.
+    bool interleaved;
+    /// Tile width (tiles), or none (strips).
+    boost::optional<dimension_size_type> tilewidth;
+    /// Tile height (tiles) or rows per strip (strips).
+    dimension_size_type tileheight;
+    /// Writer layout profile (tile sizes are not set if present).
+    boost::optional<ome::files::LayoutProfile> profile;
+    /// Compression scheme, or empty for none.
+    std::string compression;
+    /// Plane width.
+    dimension_size_type sizeX;
+    /// Plane height.
+    dimension_size_type sizeY;
+    /// Planes per series.
+    dimension_size_type planes;
+    /// Number of series.
+    dimension_size_type series;
+    /// Write each series to a separate file.
+    bool multifile;
+  };
+
+  /// Measurements for a single benchmark case.
+  struct BenchResult
+  {
+    /// Status ("ok", "skipped" or "error").
+    std::string status;
+    /// Reason for skip or error.
+    std::string message;
+    /// Fastest write time (seconds).
+    double write_seconds;
+    /// Fastest write time without output buffering or preallocation (seconds).
+    boost::optional<double> unbuffered_write_seconds;
+    /// Fastest write time with one thread per file (seconds).
+    boost::optional<double> concurrent_write_seconds;
+    /// Fastest open time (seconds).
+    double open_seconds;
+    /// Fastest time to read all planes (seconds).
+    double plane_seconds;
+    /// Fastest time to read all random regions (seconds).
+    double region_seconds;
+    /// Fastest time to read thumbnails of all planes (seconds).
+    double thumb_seconds;
+    /// Fastest time to read all planes and resize to thumbnails (seconds).
+    double naive_thumb_seconds;
+    /// Pixel data size of all planes (bytes).
+    dimension_size_type plane_bytes;
+    /// Pixel data size of all random regions (bytes).
+    dimension_size_type region_bytes;
+    /// Total size of all files (bytes).
+    dimension_size_type file_bytes;
+    /// Number of files.
+    dimension_size_type files;
+    /// Tile width (or image width for strips) used by the writer.
+    dimension_size_type tile_width;
+    /// Tile height (or rows per strip) used by the writer.
+    dimension_size_type tile_height;
+    /// Peak resident set size of the process after the case (KiB).
+    boost::optional<dimension_size_type> peak_rss_kib;
+
+    BenchResult():
+      status("ok"),
+      message(),
+      write_seconds(0.0),
+      unbuffered_write_seconds(),
+      concurrent_write_seconds(),
+      open_seconds(0.0),
+      plane_seconds(0.0),
+      region_seconds(0.0),
+      thumb_seconds(0.0),
+      naive_thumb_seconds(0.0),
+      plane_bytes(0U),
+      region_bytes(0U),
+      file_bytes(0U),
+      files(0U),
+      tile_width(0U),
+      tile_height(0U),
+      peak_rss_kib()
+    {}
+  };
+
+  double
+  elapsed(bench_clock::time_point start)
+  {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+  }
+
+  std::string
+  pixel_type_name(PixelType pixeltype)
+  {
+    std::ostringstream os;
+    os << pixeltype;
+    return os.str();
+  }
+
+  std::string
+  profile_name(ome::files::LayoutProfile profile)
+  {
+    if (profile == ome::files::LAYOUT_SEQUENTIAL)
+      return "sequential";
+    else if (profile == ome::files::LAYOUT_RANDOM_ACCESS)
+      return "random-access";
+    else if (profile == ome::files::LAYOUT_ARCHIVAL)
+      return "archival";
+    return "default";
+  }
+
+  boost::optional<dimension_size_type>
+  peak_rss_kib()
+  {
+#ifndef _MSC_VER
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      {
+#  ifdef __APPLE__
+        // Bytes on MacOS.
+        return static_cast<dimension_size_type>(usage.ru_maxrss) / 1024U;
+#  else
+        // KiB on Linux and BSD.
+        return static_cast<dimension_size_type>(usage.ru_maxrss);
+#  endif
+      }
+#endif
+    return boost::none;
+  }
+
+  std::vector<BenchCase>
+  make_cases(const Settings& settings)
+  {
+    std::vector<BenchCase> cases;
+
+    const dimension_size_type size = settings.size;
+    const dimension_size_type planes = settings.planes;
+
+    BenchCase base;
+    base.format = FORMAT_OMETIFF;
+    base.pixeltype = PixelType::UINT8;
+    base.samples = 1U;
+    base.interleaved = true;
+    base.tilewidth = boost::none;
+    base.tileheight = settings.striprows;
+    base.profile = boost::none;
+    base.sizeX = size;
+    base.sizeY = size;
+    base.planes = planes;
+    base.series = 1U;
+    base.multifile = false;
+
+    const std::vector<PixelType> pixeltypes{PixelType::UINT8, PixelType::UINT16, PixelType::FLOAT};
+
+    // Layout and pixel type, uncompressed.
+    for (const auto format : {FORMAT_OMETIFF, FORMAT_TIFF})
+      for (const bool tiled : {false, true})
+        for (const auto& pixeltype : pixeltypes)
+          {
+            BenchCase c(base);
+            c.format = format;
+            c.pixeltype = pixeltype;
+            if (tiled)
+              {
+                c.tilewidth = settings.tilesize;
+                c.tileheight = settings.tilesize;
+              }
+            c.name = (boost::format("%1%-%2%-%3%")
+                      % (format == FORMAT_OMETIFF ? "ometiff" : "tiff")
+                      % (tiled ? "tile" : "strip")
+                      % pixel_type_name(pixeltype)).str();
+            cases.push_back(c);
+          }
+
+    // Codecs.
+    for (const std::string codec : {"LZW", "Deflate"})
+      for (const bool tiled : {false, true})
+        {
+          BenchCase c(base);
+          c.pixeltype = PixelType::UINT16;
+          c.compression = codec;
+          if (tiled)
+            {
+              c.tilewidth = settings.tilesize;
+              c.tileheight = settings.tilesize;
+            }
+          std::string lcodec(codec);
+          std::transform(lcodec.begin(), lcodec.end(), lcodec.begin(),
+                         [](unsigned char ch){ return static_cast<char>(std::tolower(ch)); });
+          c.name = (boost::format("ometiff-%1%-uint16-%2%")
+                    % (tiled ? "tile" : "strip")
+                    % lcodec).str();
+          cases.push_back(c);
+        }
+
+    // Planar configuration.
+    for (const bool interleaved : {true, false})
+      {
+        BenchCase c(base);
+        c.samples = 3U;
+        c.interleaved = interleaved;
+        c.tilewidth = settings.tilesize;
+        c.tileheight = settings.tilesize;
+        c.name = (boost::format("ometiff-tile-uint8-rgb-%1%")
+                  % (interleaved ? "contig" : "separate")).str();
+        cases.push_back(c);
+      }
+
+    // Writer layout profiles, uncompressed and compressed.  The
+    // layout is chosen by the writer from the profile, pixel type
+    // and codec.
+    for (const auto profile : {ome::files::LAYOUT_DEFAULT,
+                               ome::files::LAYOUT_SEQUENTIAL,
+                               ome::files::LAYOUT_RANDOM_ACCESS,
+                               ome::files::LAYOUT_ARCHIVAL})
+      for (const std::string codec : {"", "Deflate"})
+        {
+          BenchCase c(base);
+          c.pixeltype = PixelType::UINT16;
+          c.samples = 3U;
+          c.interleaved = profile != ome::files::LAYOUT_ARCHIVAL;
+          c.compression = codec;
+          c.profile = profile;
+          c.name = (boost::format("ometiff-profile-%1%-uint16-rgb%2%")
+                    % profile_name(profile)
+                    % (codec.empty() ? "" : "-deflate")).str();
+          cases.push_back(c);
+        }
+
+    // Many small IFDs in a single file.
+    {
+      BenchCase c(base);
+      c.sizeX = c.sizeY = std::max(size / 8U, dimension_size_type(16U));
+      c.tileheight = std::min(c.tileheight, c.sizeY);
+      c.planes = planes * 32U;
+      c.name = "ometiff-many-ifd";
+      cases.push_back(c);
+    }
+
+    // Many files, one per series.
+    {
+      BenchCase c(base);
+      c.sizeX = c.sizeY = std::max(size / 4U, dimension_size_type(16U));
+      c.tileheight = std::min(c.tileheight, c.sizeY);
+      c.series = 8U;
+      c.multifile = true;
+      c.name = "ometiff-many-file";
+      cases.push_back(c);
+    }
+
+    // Many compressed files, one per series, where encoding dominates
+    // and the per-file writes may overlap when written concurrently.
+    {
+      BenchCase c(base);
+      c.sizeX = c.sizeY = std::max(size / 2U, dimension_size_type(16U));
+      c.tileheight = std::min(c.tileheight, c.sizeY);
+      c.compression = "Deflate";
+      c.series = 4U;
+      c.multifile = true;
+      c.name = "ometiff-many-file-deflate";
+      cases.push_back(c);
+    }
+
+    // Many tiny planes over several files, dominated by the cost of
+    // building and looking up the plane to IFD table.
+    {
+      BenchCase c(base);
+      c.sizeX = c.sizeY = 16U;
+      c.tileheight = std::min(c.tileheight, c.sizeY);
+      c.planes = planes * 128U;
+      c.series = 4U;
+      c.multifile = true;
+      c.name = "ometiff-many-plane";
+      cases.push_back(c);
+    }
+
+    if (!settings.filter.empty())
+      {
+        cases.erase(std::remove_if(cases.begin(), cases.end(),
+                                   [&settings](const BenchCase& c)
+                                   { return c.name.find(settings.filter) == std::string::npos; }),
+                    cases.end());
+      }
+
+    return cases;
+  }
+
+  /// Fill a pixel buffer with a deterministic, partly compressible, pattern.
+  struct FillVisitor : public boost::static_visitor<>
+  {
+    dimension_size_type seed;
+
+    FillVisitor(dimension_size_type seed):
+      seed(seed)
+    {}
+
+    template<typename T>
+    void
+    operator()(std::shared_ptr<T>& buffer) const
+    {
+      typedef typename T::value_type value_type;
+
+      value_type *data = buffer->data();
+      const dimension_size_type count = buffer->num_elements();
+      for (dimension_size_type i = 0U; i < count; ++i)
+        {
+          // Smooth gradient with a small amount of noise.
+          dimension_size_type noise = ((i + seed) * 2654435761U) >> 28;
+          data[i] = static_cast<value_type>(((i / 7U) + seed * 13U + noise) % 251U);
+        }
+    }
+  };
+
+  /**
+   * Resize a full plane to a thumbnail by nearest-neighbour sampling.
+   *
+   * This is the cheapest possible resize, so that the naive
+   * thumbnail timing is dominated by reading the full plane.
+   */
+  struct NaiveThumbVisitor : public boost::static_visitor<>
+  {
+    VariantPixelBuffer& dest;
+    dimension_size_type thumbX;
+    dimension_size_type thumbY;
+
+    NaiveThumbVisitor(VariantPixelBuffer& dest,
+                      dimension_size_type thumbX,
+                      dimension_size_type thumbY):
+      dest(dest),
+      thumbX(thumbX),
+      thumbY(thumbY)
+    {}
+
+    template<typename T>
+    void
+    operator()(const std::shared_ptr<T>& src)
+    {
+      std::array<VariantPixelBuffer::size_type, 9> shape;
+      std::copy(src->shape(), src->shape() + ome::files::PixelBufferBase::dimensions,
+                shape.begin());
+      const dimension_size_type sizeX = shape[ome::files::DIM_SPATIAL_X];
+      const dimension_size_type sizeY = shape[ome::files::DIM_SPATIAL_Y];
+      const dimension_size_type samples = shape[ome::files::DIM_SUBCHANNEL];
+      shape[ome::files::DIM_SPATIAL_X] = thumbX;
+      shape[ome::files::DIM_SPATIAL_Y] = thumbY;
+      dest.setBuffer(shape, src->pixelType(), src->storage_order());
+
+      T& d = *boost::get<std::shared_ptr<T>>(dest.vbuffer());
+      typename T::indices_type si;
+      si.fill(0);
+      typename T::indices_type di(si);
+      for (dimension_size_type y = 0U; y < thumbY; ++y)
+        for (dimension_size_type x = 0U; x < thumbX; ++x)
+          for (dimension_size_type s = 0U; s < samples; ++s)
+            {
+              di[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(x);
+              di[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(y);
+              di[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+              si[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>((x * sizeX) / thumbX);
+              si[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>((y * sizeY) / thumbY);
+              si[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+              d.at(di) = src->at(si);
+            }
+    }
+  };
+
+  std::vector<std::shared_ptr<CoreMetadata>>
+  make_series(const BenchCase& c)
+  {
+    std::vector<std::shared_ptr<CoreMetadata>> seriesList;
+    for (dimension_size_type s = 0U; s < c.series; ++s)
+      {
+        std::shared_ptr<CoreMetadata> core(std::make_shared<CoreMetadata>());
+        core->sizeX = c.sizeX;
+        core->sizeY = c.sizeY;
+        core->sizeZ = 1U;
+        core->sizeT = c.planes;
+        core->sizeC.clear();
+        core->sizeC.push_back(c.samples);
+        core->pixelType = c.pixeltype;
+        core->bitsPerPixel = ome::files::significantBitsPerPixel(c.pixeltype);
+        core->imageCount = c.planes;
+        core->dimensionOrder = DimensionOrder::XYZTC;
+        core->orderCertain = true;
+        core->interleaved = c.interleaved;
+        seriesList.push_back(core);
+      }
+    return seriesList;
+  }
+
+  std::vector<path>
+  case_files(const Settings&  settings,
+             const BenchCase& c)
+  {
+    const std::string ext(c.format == FORMAT_OMETIFF ? ".ome.tiff" : ".tiff");
+    std::vector<path> files;
+    if (c.multifile)
+      {
+        for (dimension_size_type s = 0U; s < c.series; ++s)
+          files.push_back(settings.workdir / (boost::format("%1%-%2%%3%") % c.name % s % ext).str());
+      }
+    else
+      files.push_back(settings.workdir / (c.name + ext));
+    return files;
+  }
+
+  dimension_size_type
+  plane_bytes(const BenchCase& c)
+  {
+    return c.sizeX * c.sizeY * c.samples * ome::files::bytesPerPixel(c.pixeltype);
+  }
+
+  std::shared_ptr<FormatWriter>
+  make_writer(const BenchCase& c)
+  {
+    std::shared_ptr<FormatWriter> writer;
+    if (c.format == FORMAT_OMETIFF)
+      writer = std::make_shared<ome::files::out::OMETIFFWriter>();
+    else
+      writer = std::make_shared<ome::files::out::MinimalTIFFWriter>();
+    return writer;
+  }
+
+  std::shared_ptr<FormatReader>
+  make_reader(const BenchCase& c)
+  {
+    std::shared_ptr<FormatReader> reader;
+    if (c.format == FORMAT_OMETIFF)
+      reader = std::make_shared<ome::files::in::OMETIFFReader>();
+    else
+      reader = std::make_shared<ome::files::in::TIFFReader>();
+    return reader;
+  }
+
+  double
+  write_dataset(const BenchCase&                        c,
+                const std::vector<path>&                files,
+                std::vector<VariantPixelBuffer>&        planes,
+                bool                                    unbuffered = false)
+  {
+    for (const auto& file : files)
+      {
+        if (boost::filesystem::exists(file))
+          boost::filesystem::remove(file);
+      }
+
+    std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> meta(std::make_shared<::ome::xml::meta::OMEXMLMetadata>());
+    ome::files::fillMetadata(*meta, make_series(c));
+    std::shared_ptr<::ome::xml::meta::MetadataRetrieve> retrieve(std::static_pointer_cast<::ome::xml::meta::MetadataRetrieve>(meta));
+
+    std::shared_ptr<FormatWriter> writer(make_writer(c));
+
+    bench_clock::time_point start(bench_clock::now());
+
+    writer->setMetadataRetrieve(retrieve);
+    writer->setInterleaved(c.interleaved);
+    if (!c.compression.empty())
+      writer->setCompression(c.compression);
+    if (c.profile)
+      writer->setLayoutProfile(*c.profile);
+    else
+      {
+        writer->setTileSizeX(c.tilewidth);
+        writer->setTileSizeY(c.tileheight);
+      }
+    std::shared_ptr<ome::files::out::OMETIFFWriter> omewriter(std::dynamic_pointer_cast<ome::files::out::OMETIFFWriter>(writer));
+    if (omewriter)
+      {
+        if (unbuffered)
+          omewriter->setWriteBufferSize(0U);
+        omewriter->setPreallocate(!unbuffered);
+      }
+    writer->setId(files.front());
+
+    for (dimension_size_type s = 0U; s < c.series; ++s)
+      {
+        if (c.multifile && s)
+          writer->changeOutputFile(files.at(s));
+        writer->setSeries(s);
+        for (dimension_size_type p = 0U; p < c.planes; ++p)
+          writer->saveBytes(p, planes.at((s + p) % planes.size()));
+      }
+    writer->close();
+
+    return elapsed(start);
+  }
+
+  double
+  write_dataset_concurrently(const BenchCase&                        c,
+                             const std::vector<path>&                files,
+                             const std::vector<VariantPixelBuffer>&  planes)
+  {
+    for (const auto& file : files)
+      {
+        if (boost::filesystem::exists(file))
+          boost::filesystem::remove(file);
+      }
+
+    std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> meta(std::make_shared<::ome::xml::meta::OMEXMLMetadata>());
+    ome::files::fillMetadata(*meta, make_series(c));
+    std::shared_ptr<::ome::xml::meta::MetadataRetrieve> retrieve(std::static_pointer_cast<::ome::xml::meta::MetadataRetrieve>(meta));
+
+    // Each thread has its own copies of the source planes (not timed)
+    // since saveBytes() takes a non-const buffer.
+    std::vector<std::vector<VariantPixelBuffer>> local(c.series, planes);
+
+    ome::files::out::OMETIFFWriter writer;
+
+    bench_clock::time_point start(bench_clock::now());
+
+    writer.setMetadataRetrieve(retrieve);
+    writer.setInterleaved(c.interleaved);
+    if (!c.compression.empty())
+      writer.setCompression(c.compression);
+    if (c.profile)
+      writer.setLayoutProfile(*c.profile);
+    else
+      {
+        writer.setTileSizeX(c.tilewidth);
+        writer.setTileSizeY(c.tileheight);
+      }
+    writer.setId(files.front());
+
+    // One thread per file.
+    std::vector<std::string> errors(files.size());
+    std::vector<std::thread> threads;
+    for (dimension_size_type s = 0U; s < c.series; ++s)
+      {
+        threads.emplace_back([&, s]{
+            try
+              {
+                for (dimension_size_type p = 0U; p < c.planes; ++p)
+                  writer.saveBytes(files.at(s), s, p, local.at(s).at((s + p) % planes.size()));
+              }
+            catch (const std::exception& e)
+              {
+                errors.at(s) = e.what();
+              }
+          });
+      }
+    for (auto& thread : threads)
+      thread.join();
+
+    for (const auto& error : errors)
+      {
+        if (!error.empty())
+          throw std::runtime_error(error);
+      }
+
+    writer.close();
+
+    return elapsed(start);
+  }
+
+  BenchResult
+  run_case(const Settings&  settings,
+           const BenchCase& c)
+  {
+    BenchResult result;
+    const std::vector<path> files(case_files(settings, c));
+    result.files = files.size();
+
+    {
+      std::shared_ptr<FormatWriter> writer(make_writer(c));
+      if (!c.compression.empty())
+        {
+          const std::set<std::string>& codecs(writer->getCompressionTypes(c.pixeltype));
+          if (codecs.find(c.compression) == codecs.end())
+            {
+              result.status = "skipped";
+              result.message = (boost::format("Compression type %1% unavailable") % c.compression).str();
+              return result;
+            }
+        }
+    }
+
+    // Source planes (generation is not timed).
+    std::vector<VariantPixelBuffer> planes;
+    {
+      std::array<VariantPixelBuffer::size_type, 9> shape;
+      shape[ome::files::DIM_SPATIAL_X] = c.sizeX;
+      shape[ome::files::DIM_SPATIAL_Y] = c.sizeY;
+      shape[ome::files::DIM_SUBCHANNEL] = c.samples;
+      shape[ome::files::DIM_SPATIAL_Z] = shape[ome::files::DIM_TEMPORAL_T] = shape[ome::files::DIM_CHANNEL] =
+        shape[ome::files::DIM_MODULO_Z] = shape[ome::files::DIM_MODULO_T] = shape[ome::files::DIM_MODULO_C] = 1;
+
+      ome::files::PixelBufferBase::storage_order_type order(ome::files::PixelBufferBase::make_storage_order(DimensionOrder::XYZTC, c.interleaved));
+
+      const dimension_size_type nplanes = std::min(c.planes * c.series, dimension_size_type(4U));
+      for (dimension_size_type i = 0U; i < nplanes; ++i)
+        {
+          planes.emplace_back(shape, c.pixeltype, order);
+          FillVisitor v(i);
+          boost::apply_visitor(v, planes.back().vbuffer());
+        }
+    }
+
+    result.plane_bytes = plane_bytes(c) * c.planes * c.series;
+
+    for (dimension_size_type r = 0U; r < settings.repeat; ++r)
+      {
+        if (c.format == FORMAT_OMETIFF)
+          {
+            double unbuffered_write_seconds = write_dataset(c, files, planes, true);
+            if (r == 0U || unbuffered_write_seconds < *result.unbuffered_write_seconds)
+              result.unbuffered_write_seconds = unbuffered_write_seconds;
+          }
+
+        if (c.format == FORMAT_OMETIFF && c.multifile)
+          {
+            double concurrent_write_seconds = write_dataset_concurrently(c, files, planes);
+            if (r == 0U || concurrent_write_seconds < *result.concurrent_write_seconds)
+              result.concurrent_write_seconds = concurrent_write_seconds;
+          }
+
+        double write_seconds = write_dataset(c, files, planes);
+
+        std::shared_ptr<FormatReader> reader(make_reader(c));
+
+        bench_clock::time_point start(bench_clock::now());
+        reader->setId(files.front());
+        double open_seconds = elapsed(start);
+
+        result.tile_width = reader->getOptimalTileWidth();
+        result.tile_height = reader->getOptimalTileHeight();
+
+        VariantPixelBuffer buf;
+
+        start = bench_clock::now();
+        for (dimension_size_type s = 0U; s < reader->getSeriesCount(); ++s)
+          {
+            reader->setSeries(s);
+            for (dimension_size_type p = 0U; p < reader->getImageCount(); ++p)
+              reader->openBytes(p, buf);
+          }
+        double plane_seconds = elapsed(start);
+
+        // Same sequence of regions for every repetition and case.
+        std::mt19937 gen(42U);
+        dimension_size_type region_bytes = 0U;
+        start = bench_clock::now();
+        for (dimension_size_type i = 0U; i < settings.regions; ++i)
+          {
+            const dimension_size_type w = std::min(settings.regionsize, c.sizeX);
+            const dimension_size_type h = std::min(settings.regionsize, c.sizeY);
+            std::uniform_int_distribution<dimension_size_type> sdist(0U, c.series - 1U);
+            std::uniform_int_distribution<dimension_size_type> pdist(0U, c.planes - 1U);
+            std::uniform_int_distribution<dimension_size_type> xdist(0U, c.sizeX - w);
+            std::uniform_int_distribution<dimension_size_type> ydist(0U, c.sizeY - h);
+            const dimension_size_type s = sdist(gen);
+            const dimension_size_type p = pdist(gen);
+            const dimension_size_type x = xdist(gen);
+            const dimension_size_type y = ydist(gen);
+
+            if (reader->getSeries() != s)
+              reader->setSeries(s);
+            reader->openBytes(p, buf, x, y, w, h);
+            region_bytes += w * h * c.samples * ome::files::bytesPerPixel(c.pixeltype);
+          }
+        double region_seconds = elapsed(start);
+
+        // Thumbnails of every plane, compared with reading each full
+        // plane and resizing it.
+        VariantPixelBuffer thumb;
+        start = bench_clock::now();
+        for (dimension_size_type s = 0U; s < reader->getSeriesCount(); ++s)
+          {
+            reader->setSeries(s);
+            for (dimension_size_type p = 0U; p < reader->getImageCount(); ++p)
+              reader->openThumbBytes(p, thumb);
+          }
+        double thumb_seconds = elapsed(start);
+
+        start = bench_clock::now();
+        for (dimension_size_type s = 0U; s < reader->getSeriesCount(); ++s)
+          {
+            reader->setSeries(s);
+            for (dimension_size_type p = 0U; p < reader->getImageCount(); ++p)
+              {
+                reader->openBytes(p, buf);
+                NaiveThumbVisitor v(thumb, reader->getThumbSizeX(), reader->getThumbSizeY());
+                boost::apply_visitor(v, buf.vbuffer());
+              }
+          }
+        double naive_thumb_seconds = elapsed(start);
+
+        reader->close();
+
+        if (r == 0U || write_seconds < result.write_seconds)
+          result.write_seconds = write_seconds;
+        if (r == 0U || open_seconds < result.open_seconds)
+          result.open_seconds = open_seconds;
+        if (r == 0U || plane_seconds < result.plane_seconds)
+          result.plane_seconds = plane_seconds;
+        if (r == 0U || region_seconds < result.region_seconds)
+          result.region_seconds = region_seconds;
+        if (r == 0U || thumb_seconds < result.thumb_seconds)
+          result.thumb_seconds = thumb_seconds;
+        if (r == 0U || naive_thumb_seconds < result.naive_thumb_seconds)
+          result.naive_thumb_seconds = naive_thumb_seconds;
+        result.region_bytes = region_bytes;
+      }
+
+    result.file_bytes = 0U;
+    for (const auto& file : files)
+      {
+        result.file_bytes += boost::filesystem::file_size(file);
+        if (!settings.keep)
+          boost::filesystem::remove(file);
+      }
+
+    result.peak_rss_kib = peak_rss_kib();
+
+    return result;
+  }
+
+  std::string
+  json_string(const std::string& str)
+  {
+    std::string ret("\"");
+    for (const char ch : str)
+      {
+        switch (ch)
+          {
+          case '"':
+            ret += "\\\"";
+            break;
+          case '\\':
+            ret += "\\\\";
+            break;
+          case '\n':
+            ret += "\\n";
+            break;
+          case '\t':
+            ret += "\\t";
+            break;
+          default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+              ret += (boost::format("\\u%04x") % static_cast<unsigned int>(ch)).str();
+            else
+              ret += ch;
+            break;
+          }
+      }
+    ret += '"';
+    return ret;
+  }
+
+  std::string
+  json_rate(dimension_size_type bytes,
+            double              seconds)
+  {
+    if (seconds <= 0.0)
+      return "null";
+    std::ostringstream os;
+    os << (static_cast<double>(bytes) / (1024.0 * 1024.0)) / seconds;
+    return os.str();
+  }
+
+  void
+  write_results(std::ostream&                   os,
+                const Settings&                 settings,
+                const std::vector<BenchCase>&   cases,
+                const std::vector<BenchResult>& results)
+  {
+    os.precision(6);
+
+    os << "{\n"
+       << "  \"benchmark\": \"ome-files-bench\",\n"
+       << "  \"version\": "
+       << json_string(OME_FILES_VERSION_MAJOR_S "." OME_FILES_VERSION_MINOR_S "." OME_FILES_VERSION_PATCH_S OME_FILES_VERSION_EXTRA_S)
+       << ",\n"
+       << "  \"settings\": {\n"
+       << "    \"size\": " << settings.size << ",\n"
+       << "    \"planes\": " << settings.planes << ",\n"
+       << "    \"repeat\": " << settings.repeat << ",\n"
+       << "    \"regions\": " << settings.regions << ",\n"
+       << "    \"region_size\": " << settings.regionsize << ",\n"
+       << "    \"tile_size\": " << settings.tilesize << ",\n"
+       << "    \"strip_rows\": " << settings.striprows << "\n"
+       << "  },\n"
+       << "  \"results\": [";
+
+    for (std::vector<BenchCase>::size_type i = 0U; i < cases.size(); ++i)
+      {
+        const BenchCase& c(cases.at(i));
+        const BenchResult& r(results.at(i));
+
+        os << (i ? ",\n" : "\n")
+           << "    {\n"
+           << "      \"name\": " << json_string(c.name) << ",\n"
+           << "      \"format\": " << json_string(c.format == FORMAT_OMETIFF ? "OME-TIFF" : "TIFF") << ",\n"
+           << "      \"pixel_type\": " << json_string(pixel_type_name(c.pixeltype)) << ",\n"
+           << "      \"samples\": " << c.samples << ",\n"
+           << "      \"interleaved\": " << (c.interleaved ? "true" : "false") << ",\n"
+           << "      \"profile\": " << (c.profile ? json_string(profile_name(*c.profile)) : "null") << ",\n";
+        if (c.profile)
+          os << "      \"layout\": " << json_string("profile") << ",\n";
+        else
+          os << "      \"layout\": " << json_string(c.tilewidth ? "tile" : "strip") << ",\n"
+             << "      \"tile_width\": " << (c.tilewidth ? *c.tilewidth : c.sizeX) << ",\n"
+             << "      \"tile_height\": " << c.tileheight << ",\n";
+        os << "      \"compression\": " << json_string(c.compression.empty() ? "none" : c.compression) << ",\n"
+           << "      \"size_x\": " << c.sizeX << ",\n"
+           << "      \"size_y\": " << c.sizeY << ",\n"
+           << "      \"planes\": " << c.planes << ",\n"
+           << "      \"series\": " << c.series << ",\n"
+           << "      \"files\": " << r.files << ",\n"
+           << "      \"status\": " << json_string(r.status);
+
+        if (!r.message.empty())
+          os << ",\n      \"message\": " << json_string(r.message);
+
+        if (r.status == "ok")
+          {
+            os << ",\n"
+               << "      \"written_tile_width\": " << r.tile_width << ",\n"
+               << "      \"written_tile_height\": " << r.tile_height << ",\n"
+               << "      \"file_bytes\": " << r.file_bytes << ",\n"
+               << "      \"write_seconds\": " << r.write_seconds << ",\n"
+               << "      \"write_mib_per_second\": " << json_rate(r.plane_bytes, r.write_seconds) << ",\n"
+               << "      \"unbuffered_write_seconds\": ";
+            if (r.unbuffered_write_seconds)
+              os << *r.unbuffered_write_seconds << ",\n"
+                 << "      \"unbuffered_write_mib_per_second\": " << json_rate(r.plane_bytes, *r.unbuffered_write_seconds) << ",\n";
+            else
+              os << "null,\n"
+                 << "      \"unbuffered_write_mib_per_second\": null,\n";
+            os << "      \"concurrent_write_seconds\": ";
+            if (r.concurrent_write_seconds)
+              os << *r.concurrent_write_seconds << ",\n"
+                 << "      \"concurrent_write_mib_per_second\": " << json_rate(r.plane_bytes, *r.concurrent_write_seconds) << ",\n";
+            else
+              os << "null,\n"
+                 << "      \"concurrent_write_mib_per_second\": null,\n";
+            os << "      \"open_seconds\": " << r.open_seconds << ",\n"
+               << "      \"plane_read_seconds\": " << r.plane_seconds << ",\n"
+               << "      \"plane_read_mib_per_second\": " << json_rate(r.plane_bytes, r.plane_seconds) << ",\n"
+               << "      \"region_read_seconds\": " << r.region_seconds << ",\n"
+               << "      \"region_read_mib_per_second\": " << json_rate(r.region_bytes, r.region_seconds) << ",\n"
+               << "      \"thumb_read_seconds\": " << r.thumb_seconds << ",\n"
+               << "      \"naive_thumb_read_seconds\": " << r.naive_thumb_seconds << ",\n"
+               << "      \"peak_rss_kib\": ";
+            if (r.peak_rss_kib)
+              os << *r.peak_rss_kib;
+            else
+              os << "null";
+          }
+
+        os << "\n    }";
+      }
+
+    os << "\n  ]\n"
+       << "}\n";
+  }
+
+}
+
+int
+main(int argc, char *argv[])
+{
+  int status = 0;
+
+  ome::files::register_module_paths();
+  ome::common::setLogLevel(ome::logging::trivial::warning);
+
+  try
+    {
+      Settings settings;
+
+      opt::options_description general("Benchmark options");
+      general.add_options()
+        ("help,h", "Show command usage")
+        ("output,o", opt::value<std::string>(&settings.output)->default_value("-"),
+         "Write JSON results to file (- for standard output)")
+        ("workdir", opt::value<std::string>()->default_value("ome-files-bench-data"),
+         "Directory for generated datasets")
+        ("size", opt::value<dimension_size_type>(&settings.size)->default_value(2048U),
+         "Plane width and height")
+        ("planes", opt::value<dimension_size_type>(&settings.planes)->default_value(8U),
+         "Planes per series")
+        ("repeat", opt::value<dimension_size_type>(&settings.repeat)->default_value(3U),
+         "Repetitions per case (fastest is reported)")
+        ("regions", opt::value<dimension_size_type>(&settings.regions)->default_value(64U),
+         "Random regions read per case")
+        ("region-size", opt::value<dimension_size_type>(&settings.regionsize)->default_value(256U),
+         "Random region width and height")
+        ("tile-size", opt::value<dimension_size_type>(&settings.tilesize)->default_value(256U),
+         "Tile width and height")
+        ("strip-rows", opt::value<dimension_size_type>(&settings.striprows)->default_value(64U),
+         "Rows per strip")
+        ("filter", opt::value<std::string>(&settings.filter),
+         "Only run cases with names containing this string")
+        ("keep", "Keep generated datasets")
+        ("list", "List benchmark cases and exit")
+        ("quick", "Use small datasets (for testing the benchmark itself)");
+
+      opt::variables_map vm;
+      opt::store(opt::parse_command_line(argc, argv, general), vm);
+      opt::notify(vm);
+
+      if (vm.count("help"))
+        {
+          std::cout << "Usage:\n  ome-files-bench [OPTION…] — benchmark reading and writing\n"
+                    << general
+                    << std::flush;
+          return 0;
+        }
+
+      settings.workdir = vm["workdir"].as<std::string>();
+      settings.keep = vm.count("keep") != 0;
+      settings.list = vm.count("list") != 0;
+
+      if (vm.count("quick"))
+        {
+          settings.size = 128U;
+          settings.planes = 2U;
+          settings.repeat = 1U;
+          settings.regions = 8U;
+          settings.regionsize = 32U;
+          settings.tilesize = 32U;
+          settings.striprows = 16U;
+        }
+
+      if (!settings.size || !settings.planes || !settings.repeat ||
+          !settings.regionsize || !settings.tilesize || !settings.striprows)
+        throw std::runtime_error("Sizes and counts must be greater than zero");
+      if (settings.tilesize % 16U)
+        throw std::runtime_error("Tile size must be a multiple of 16");
+
+      const std::vector<BenchCase> cases(make_cases(settings));
+
+      if (settings.list)
+        {
+          for (const auto& c : cases)
+            std::cout << c.name << '\n';
+          return 0;
+        }
+
+      if (!boost::filesystem::exists(settings.workdir))
+        boost::filesystem::create_directories(settings.workdir);
+
+      std::vector<BenchResult> results;
+      for (const auto& c : cases)
+        {
+          std::cerr << "Running " << c.name << "…" << std::flush;
+          BenchResult result;
+          try
+            {
+              result = run_case(settings, c);
+            }
+          catch (const std::exception& e)
+            {
+              result = BenchResult();
+              result.status = "error";
+              result.message = e.what();
+              status = 1;
+            }
+          std::cerr << ' ' << result.status << std::endl;
+          results.push_back(result);
+        }
+
+      if (settings.output == "-")
+        write_results(std::cout, settings, cases, results);
+      else
+        {
+          std::ofstream out(settings.output.c_str());
+          if (!out)
+            {
+              boost::format fmt("Failed to open ‘%1%’ for writing");
+              fmt % settings.output;
+              throw std::runtime_error(fmt.str());
+            }
+          write_results(out, settings, cases, results);
+        }
+    }
+  catch (const std::exception& e)
+    {
+      status = 1;
+      std::cerr << "E: " << e.what() << std::endl;
+    }
+
+  return status;
+}
@@ -0,0 +1,247 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * %%
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <ome/files/Executor.h>
+
+#include <ome/test/test.h>
+
+using ome::files::dimension_size_type;
+using ome::files::Executor;
+using ome::files::ThreadPoolExecutor;
+
+namespace
+{
+
+  // Executor running tasks on the calling thread when run() is
+  // called, for testing custom executors.
+  class ManualExecutor : public Executor
+  {
+  public:
+    std::vector<task_type> tasks;
+
+    void
+    submit(task_type task)
+    {
+      tasks.push_back(task);
+    }
+
+    dimension_size_type
+    concurrency() const
+    {
+      return 1U;
+    }
+
+    void
+    run()
+    {
+      std::vector<task_type> pending;
+      pending.swap(tasks);
+      for (auto& task : pending)
+        task();
+    }
+  };
+
+}
+
+TEST(ThreadPoolExecutor, Construct)
+{
+  ThreadPoolExecutor::Options options;
+  options.threads = 3U;
+  ThreadPoolExecutor e(options);
+  ASSERT_EQ(3U, e.concurrency());
+}
+
+TEST(ThreadPoolExecutor, ConstructDefault)
+{
+  ThreadPoolExecutor e;
+  ASSERT_LE(1U, e.concurrency());
+}
+
+TEST(ThreadPoolExecutor, RunAll)
+{
+  std::atomic<dimension_size_type> count(0U);
+
+  {
+    ThreadPoolExecutor::Options options;
+    options.threads = 4U;
+    ThreadPoolExecutor e(options);
+
+    for (dimension_size_type i = 0U; i < 1000U; ++i)
+      e.submit([&count]
+               {
+                 ++count;
+               });
+    // Destruction runs all queued tasks.
+  }
+
+  ASSERT_EQ(1000U, count);
+}
+
+TEST(ThreadPoolExecutor, NestedSubmit)
+{
+  std::atomic<dimension_size_type> count(0U);
+
+  {
+    ThreadPoolExecutor::Options options;
+    options.threads = 2U;
+    ThreadPoolExecutor e(options);
+
+    for (dimension_size_type i = 0U; i < 10U; ++i)
+      e.submit([&e, &count]
+               {
+                 for (dimension_size_type j = 0U; j < 10U; ++j)
+                   e.submit([&count]
+                            {
+                              ++count;
+                            });
+               });
+  }
+
+  ASSERT_EQ(100U, count);
+}
+
+TEST(ThreadPoolExecutor, Concurrent)
+{
+  // Both tasks must run at the same time to complete.
+  ThreadPoolExecutor::Options options;
+  options.threads = 2U;
+  ThreadPoolExecutor e(options);
+
+  std::mutex m;
+  std::condition_variable cv;
+  dimension_size_type started = 0U;
+
+  for (dimension_size_type i = 0U; i < 2U; ++i)
+    e.submit([&]
+             {
+               std::unique_lock<std::mutex> lock(m);
+               ++started;
+               cv.notify_all();
+               cv.wait(lock, [&started] { return started == 2U; });
+             });
+
+  std::unique_lock<std::mutex> lock(m);
+  ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(30),
+                          [&started] { return started == 2U; }));
+}
+
+TEST(ThreadPoolExecutor, TaskException)
+{
+  std::atomic<bool> ran(false);
+
+  {
+    ThreadPoolExecutor::Options options;
+    options.threads = 1U;
+    ThreadPoolExecutor e(options);
+
+    e.submit([]
+             {
+               throw std::runtime_error("Task failed");
+             });
+    e.submit([&ran]
+             {
+               ran = true;
+             });
+  }
+
+  ASSERT_TRUE(ran);
+}
+
+TEST(ThreadPoolExecutor, Affinity)
+{
+  ThreadPoolExecutor::Options options;
+  options.cpus.push_back(0U);
+  ThreadPoolExecutor e(options);
+  ASSERT_EQ(1U, e.concurrency());
+}
+
+TEST(ThreadPoolExecutor, InvalidNUMANode)
+{
+  ThreadPoolExecutor::Options options;
+  options.numaNode = 65535U;
+  ASSERT_THROW(ThreadPoolExecutor e(options), std::runtime_error);
+}
+
+TEST(Executor, Shared)
+{
+  std::shared_ptr<Executor> e(Executor::shared());
+  ASSERT_TRUE(static_cast<bool>(e));
+  ASSERT_EQ(e, Executor::shared());
+
+  std::shared_ptr<ManualExecutor> manual(std::make_shared<ManualExecutor>());
+  Executor::setShared(manual);
+  ASSERT_EQ(manual, Executor::shared());
+
+  bool ran = false;
+  Executor::shared()->submit([&ran]
+                             {
+                               ran = true;
+                             });
+  ASSERT_FALSE(ran);
+  manual->run();
+  ASSERT_TRUE(ran);
+
+  Executor::setShared(std::shared_ptr<Executor>());
+  ASSERT_TRUE(static_cast<bool>(Executor::shared()));
+  ASSERT_NE(std::static_pointer_cast<Executor>(manual), Executor::shared());
+}
+
+TEST(Executor, SharedIO)
+{
+  std::shared_ptr<Executor> e(Executor::sharedIO());
+  ASSERT_TRUE(static_cast<bool>(e));
+  ASSERT_EQ(e, Executor::sharedIO());
+  ASSERT_NE(e, Executor::shared());
+
+  std::shared_ptr<ManualExecutor> manual(std::make_shared<ManualExecutor>());
+  Executor::setSharedIO(manual);
+  ASSERT_EQ(manual, Executor::sharedIO());
+  ASSERT_NE(std::static_pointer_cast<Executor>(manual), Executor::shared());
+
+  Executor::setSharedIO(std::shared_ptr<Executor>());
+  ASSERT_TRUE(static_cast<bool>(Executor::sharedIO()));
+  ASSERT_NE(std::static_pointer_cast<Executor>(manual), Executor::sharedIO());
+}
@@ -36,15 +36,23 @@
  * #L%
  */
 
+#include <chrono>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
+#include <ome/files/CancellationToken.h>
+#include <ome/files/CancelledException.h>
 #include <ome/files/VariantPixelBuffer.h>
 #include <ome/files/in/MinimalTIFFReader.h>
 
 #include <ome/test/test.h>
 
+using ome::files::CancellationToken;
+using ome::files::CancelledException;
 using ome::files::dimension_size_type;
+using ome::files::FormatReader;
 using ome::files::VariantPixelBuffer;
 using ome::files::in::MinimalTIFFReader;
 
@@ -147,6 +155,135 @@ TEST_P(TIFFTest, openBytes)
     }
 }
 
+TEST_P(TIFFTest, openThumbBytes)
+{
+  const TIFFTestParameters& params = GetParam();
+
+  ASSERT_NO_THROW(tiff.setId(params.file));
+
+  // Thumbnail size matches image size; no resampling is needed.
+  for (dimension_size_type p = 0; p < tiff.getImageCount(); ++p)
+    {
+      VariantPixelBuffer buf;
+      VariantPixelBuffer thumb;
+      ASSERT_NO_THROW(tiff.openBytes(p, buf));
+      ASSERT_NO_THROW(tiff.openThumbBytes(p, thumb));
+      EXPECT_TRUE(buf == thumb);
+    }
+}
+
+TEST_P(TIFFTest, createView)
+{
+  const TIFFTestParameters& params = GetParam();
+
+  EXPECT_THROW(tiff.createView(), std::logic_error);
+
+  ASSERT_NO_THROW(tiff.setId(params.file));
+
+  std::shared_ptr<FormatReader> view;
+  ASSERT_NO_THROW(view = tiff.createView());
+  ASSERT_TRUE(static_cast<bool>(view));
+
+  EXPECT_EQ(tiff.getFormat(), view->getFormat());
+  EXPECT_EQ(tiff.getSeriesCount(), view->getSeriesCount());
+  EXPECT_EQ(tiff.getImageCount(), view->getImageCount());
+  EXPECT_EQ(tiff.getSizeX(), view->getSizeX());
+  EXPECT_EQ(tiff.getSizeY(), view->getSizeY());
+
+  // Plane selection is independent.
+  view->setPlane(1U);
+  EXPECT_EQ(1U, view->getPlane());
+  EXPECT_EQ(0U, tiff.getPlane());
+
+  // Closing a view does not close the reader.
+  ASSERT_NO_THROW(view->close());
+  EXPECT_EQ(params.sizeT, tiff.getSizeT());
+}
+
+TEST_P(TIFFTest, concurrentViews)
+{
+  const TIFFTestParameters& params = GetParam();
+
+  ASSERT_NO_THROW(tiff.setId(params.file));
+
+  std::vector<VariantPixelBuffer> expected(tiff.getImageCount());
+  for (dimension_size_type p = 0; p < tiff.getImageCount(); ++p)
+    ASSERT_NO_THROW(tiff.openBytes(p, expected[p]));
+
+  const unsigned int nthreads = 4U;
+  std::vector<std::shared_ptr<FormatReader>> views;
+  for (unsigned int t = 0; t < nthreads; ++t)
+    views.push_back(tiff.createView());
+
+  std::vector<dimension_size_type> failures(nthreads, 0U);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < nthreads; ++t)
+    {
+      threads.emplace_back([&, t]{
+          const FormatReader& view(*views[t]);
+          for (dimension_size_type p = 0; p < view.getImageCount(); ++p)
+            {
+              try
+                {
+                  VariantPixelBuffer buf;
+                  view.openBytes(p, buf);
+                  if (!(buf == expected[p]))
+                    ++failures[t];
+                }
+              catch (const std::exception&)
+                {
+                  ++failures[t];
+                }
+            }
+        });
+    }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (unsigned int t = 0; t < nthreads; ++t)
+    EXPECT_EQ(0U, failures[t]);
+}
+
+TEST_P(TIFFTest, cancelRead)
+{
+  const TIFFTestParameters& params = GetParam();
+
+  ASSERT_NO_THROW(tiff.setId(params.file));
+
+  VariantPixelBuffer expected;
+  ASSERT_NO_THROW(tiff.openBytes(0, expected));
+
+  // An uncancelled token reads normally.
+  CancellationToken token;
+  VariantPixelBuffer buf;
+  ASSERT_NO_THROW(tiff.openBytes(0, buf, token));
+  EXPECT_TRUE(expected == buf);
+
+  // A cancelled token stops the read.
+  CancellationToken cancelled;
+  CancellationToken copy(cancelled);
+  copy.cancel();
+  EXPECT_TRUE(cancelled.isCancelled());
+  EXPECT_THROW(tiff.openBytes(0, buf, cancelled), CancelledException);
+  EXPECT_THROW(tiff.openBytes(0, buf, 0, 0, 2, 2, cancelled), CancelledException);
+
+  // An expired deadline stops the read.
+  CancellationToken expired(CancellationToken::clock_type::now() - std::chrono::seconds(1));
+  EXPECT_TRUE(expired.isExpired());
+  EXPECT_FALSE(expired.isCancelled());
+  EXPECT_THROW(tiff.openBytes(0, buf, expired), CancelledException);
+
+  // A future deadline does not.
+  CancellationToken future(CancellationToken::clock_type::now() + std::chrono::hours(1));
+  EXPECT_FALSE(future.isExpired());
+  ASSERT_NO_THROW(tiff.openBytes(0, buf, future));
+  EXPECT_TRUE(expected == buf);
+
+  // The reader remains usable after a cancelled read.
+  ASSERT_NO_THROW(tiff.openBytes(0, buf));
+  EXPECT_TRUE(expected == buf);
+}
+
 namespace
 {
 
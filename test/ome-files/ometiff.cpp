@@ -0,0 +1,360 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * %%
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <ome/files/CoreMetadata.h>
+#include <ome/files/FormatException.h>
+#include <ome/files/Types.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/detail/OMETIFF.h>
+#include <ome/files/in/MinimalTIFFReader.h>
+#include <ome/files/in/OMETIFFReader.h>
+#include <ome/files/out/OMETIFFWriter.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+#include <ome/test/test.h>
+
+#include "ometiffsamples.h"
+
+using boost::filesystem::path;
+using ome::files::dimension_size_type;
+using ome::files::CoreMetadata;
+using ome::files::VariantPixelBuffer;
+using ome::files::detail::OMETIFFFileTable;
+using ome::files::detail::OMETIFFPlane;
+using ome::files::detail::OMETIFFPlaneTable;
+using ome::files::in::MinimalTIFFReader;
+using ome::files::in::OMETIFFReader;
+using ome::files::out::OMETIFFWriter;
+
+TEST(OMETIFFFileTable, Intern)
+{
+  OMETIFFFileTable files;
+  ASSERT_EQ(0U, files.size());
+
+  OMETIFFFileTable::index_type a = files.intern("a.ome.tiff");
+  OMETIFFFileTable::index_type b = files.intern("b.ome.tiff");
+  ASSERT_NE(a, b);
+  ASSERT_EQ(a, files.intern("a.ome.tiff"));
+  ASSERT_EQ(2U, files.size());
+  ASSERT_EQ(boost::filesystem::path("b.ome.tiff"), files.at(b));
+  ASSERT_THROW(files.at(2U), std::out_of_range);
+}
+
+TEST(OMETIFFPlaneTable, Defaults)
+{
+  OMETIFFPlaneTable planes;
+  planes.resize(4U);
+  ASSERT_EQ(4U, planes.size());
+
+  for (dimension_size_type p = 0; p < planes.size(); ++p)
+    {
+      ASSERT_FALSE(planes.hasFile(p));
+      ASSERT_TRUE(planes.file(p).empty());
+      ASSERT_EQ(0U, planes.ifd(p));
+      ASSERT_FALSE(planes.certain(p));
+      ASSERT_EQ(OMETIFFPlane::UNKNOWN, planes.status(p));
+    }
+
+  ASSERT_THROW(planes.ifd(4U), std::out_of_range);
+}
+
+TEST(OMETIFFPlaneTable, SetAndReset)
+{
+  OMETIFFPlaneTable planes;
+  planes.resize(2U);
+
+  planes.set(1U, "a.ome.tiff", 12U);
+  planes.setCertain(1U, true);
+  planes.setStatus(1U, OMETIFFPlane::ABSENT);
+  ASSERT_TRUE(planes.hasFile(1U));
+  ASSERT_EQ(boost::filesystem::path("a.ome.tiff"), planes.file(1U));
+  ASSERT_EQ(12U, planes.ifd(1U));
+  ASSERT_TRUE(planes.certain(1U));
+  ASSERT_EQ(OMETIFFPlane::ABSENT, planes.status(1U));
+
+  // Status and certainty are independent.
+  planes.setStatus(1U, OMETIFFPlane::PRESENT);
+  ASSERT_TRUE(planes.certain(1U));
+  planes.setCertain(1U, false);
+  ASSERT_EQ(OMETIFFPlane::PRESENT, planes.status(1U));
+
+  planes.reset(1U);
+  ASSERT_FALSE(planes.hasFile(1U));
+  ASSERT_EQ(0U, planes.ifd(1U));
+  ASSERT_EQ(OMETIFFPlane::PRESENT, planes.status(1U));
+
+  ASSERT_THROW(planes.set(0U, "a.ome.tiff", dimension_size_type(1U) << 40U), std::out_of_range);
+}
+
+TEST(OMETIFFPlaneTable, SharedFiles)
+{
+  std::shared_ptr<OMETIFFFileTable> files(std::make_shared<OMETIFFFileTable>());
+  OMETIFFPlaneTable s0(files);
+  OMETIFFPlaneTable s1(files);
+  s0.resize(8U);
+  s1.resize(8U);
+
+  for (dimension_size_type p = 0; p < 8U; ++p)
+    {
+      s0.set(p, "a.ome.tiff", p);
+      s1.set(p, p < 4U ? "a.ome.tiff" : "b.ome.tiff", p + 8U);
+    }
+
+  // Each file is stored once, however many planes refer to it.
+  ASSERT_EQ(2U, files->size());
+  ASSERT_EQ(s0.fileId(0U), s1.fileId(0U));
+  ASSERT_NE(s1.fileId(0U), s1.fileId(7U));
+  ASSERT_EQ(boost::filesystem::path("b.ome.tiff"), s1.file(7U));
+  ASSERT_EQ(15U, s1.ifd(7U));
+}
+
+TEST(OMETIFFReaderThumbnail, AreaAverage)
+{
+  const dimension_size_type sizeX = 300U;
+  const dimension_size_type sizeY = 200U;
+
+  path testfile(sample_file("ometiffreader-thumbnail.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(sizeX, sizeY));
+
+  {
+    OMETIFFWriter writer;
+    writer.setTileSizeX(dimension_size_type(64U));
+    writer.setTileSizeY(dimension_size_type(64U));
+    ASSERT_NO_FATAL_FAILURE(write_dataset(writer, testfile, seriesList));
+  }
+
+  OMETIFFReader reader;
+  ASSERT_NO_THROW(reader.setId(testfile));
+
+  const dimension_size_type thumbX = reader.getThumbSizeX();
+  const dimension_size_type thumbY = reader.getThumbSizeY();
+  ASSERT_EQ(128U, thumbX);
+  ASSERT_EQ(85U, thumbY);
+
+  VariantPixelBuffer thumb;
+  ASSERT_NO_THROW(reader.openThumbBytes(0, thumb));
+  EXPECT_EQ(ome::xml::model::enums::PixelType::UINT16, thumb.pixelType());
+  ASSERT_EQ(thumbX, thumb.shape()[ome::files::DIM_SPATIAL_X]);
+  ASSERT_EQ(thumbY, thumb.shape()[ome::files::DIM_SPATIAL_Y]);
+  ASSERT_EQ(1U, thumb.shape()[ome::files::DIM_SUBCHANNEL]);
+
+  // Reference area average of the source pixels mapping to each
+  // thumbnail pixel.
+  std::vector<double> sums(thumbX * thumbY, 0.0);
+  std::vector<dimension_size_type> counts(thumbX * thumbY, 0U);
+  for (dimension_size_type y = 0; y < sizeY; ++y)
+    for (dimension_size_type x = 0; x < sizeX; ++x)
+      {
+        dimension_size_type i = ((y * thumbY) / sizeY) * thumbX + ((x * thumbX) / sizeX);
+        sums[i] += static_cast<uint16_t>(sample_value(0U, 0U, x, y));
+        ++counts[i];
+      }
+
+  VariantPixelBuffer::indices_type idx;
+  idx.fill(0);
+  for (dimension_size_type y = 0; y < thumbY; ++y)
+    for (dimension_size_type x = 0; x < thumbX; ++x)
+      {
+        dimension_size_type i = y * thumbX + x;
+        ASSERT_LT(0U, counts[i]);
+        idx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(x);
+        idx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(y);
+        EXPECT_EQ(static_cast<uint16_t>(std::floor(sums[i] / static_cast<double>(counts[i]) + 0.5)),
+                  thumb.array<uint16_t>()(idx));
+      }
+}
+
+TEST(OMETIFFReaderSeries, InitOnFirstUse)
+{
+  const dimension_size_type seriesCount = 3U;
+
+  // Each series has a different size and plane count.
+  path file(sample_file("ometiffreader-series-init.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList;
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    seriesList.push_back(sample_series(16U + (s * 8U), 12U + (s * 4U), s + 1U, 1U, 1U,
+                                       ome::xml::model::enums::PixelType::UINT8));
+
+  {
+    OMETIFFWriter writer;
+    ASSERT_NO_FATAL_FAILURE(write_dataset(writer, file, seriesList));
+  }
+
+  OMETIFFReader reader;
+  ASSERT_NO_THROW(reader.setId(file));
+  ASSERT_EQ(seriesCount, reader.getSeriesCount());
+
+  // Visit series out of order; each is initialised on first use.
+  for (const dimension_size_type s : {2U, 0U, 1U, 2U})
+    {
+      ASSERT_NO_THROW(reader.setSeries(s));
+      EXPECT_EQ(seriesList.at(s)->sizeX, reader.getSizeX());
+      EXPECT_EQ(seriesList.at(s)->sizeY, reader.getSizeY());
+      EXPECT_EQ(seriesList.at(s)->sizeZ, reader.getSizeZ());
+      ASSERT_EQ(seriesList.at(s)->imageCount, reader.getImageCount());
+
+      for (dimension_size_type p = 0; p < reader.getImageCount(); ++p)
+        {
+          VariantPixelBuffer buf;
+          ASSERT_NO_THROW(reader.openBytes(p, buf));
+          verify_plane(buf, s, p);
+        }
+    }
+
+  // The full list initialises all series.
+  OMETIFFReader listReader;
+  ASSERT_NO_THROW(listReader.setId(file));
+  const std::vector<std::shared_ptr<CoreMetadata>>& coreList(listReader.getCoreMetadataList());
+  ASSERT_EQ(seriesCount, coreList.size());
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    {
+      EXPECT_EQ(seriesList.at(s)->sizeX, coreList.at(s)->sizeX);
+      EXPECT_EQ(seriesList.at(s)->imageCount, coreList.at(s)->imageCount);
+    }
+
+  // The metadata store also initialises all series, so that its
+  // Pixels match the core metadata for series not yet visited.
+  OMETIFFReader storeReader;
+  ASSERT_NO_THROW(storeReader.setId(file));
+  std::shared_ptr<::ome::xml::meta::MetadataRetrieve> retrieve
+    (std::dynamic_pointer_cast<::ome::xml::meta::MetadataRetrieve>(storeReader.getMetadataStore()));
+  ASSERT_TRUE(static_cast<bool>(retrieve));
+  ASSERT_EQ(seriesCount, retrieve->getImageCount());
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    {
+      storeReader.setSeries(s);
+      EXPECT_EQ(storeReader.getSizeX(), static_cast<dimension_size_type>(retrieve->getPixelsSizeX(s)));
+      EXPECT_EQ(storeReader.getSizeZ(), static_cast<dimension_size_type>(retrieve->getPixelsSizeZ(s)));
+    }
+
+  // Original metadata is collected when the metadata store is first
+  // used, not by setId, and leaves the current series unchanged.
+  OMETIFFReader originalReader;
+  originalReader.setOriginalMetadataPopulated(true);
+  ASSERT_NO_THROW(originalReader.setId(file));
+  ASSERT_NO_THROW(originalReader.setSeries(1U));
+  {
+    VariantPixelBuffer buf;
+    ASSERT_NO_THROW(originalReader.openBytes(0U, buf));
+  }
+  retrieve = std::dynamic_pointer_cast<::ome::xml::meta::MetadataRetrieve>(originalReader.getMetadataStore());
+  ASSERT_TRUE(static_cast<bool>(retrieve));
+  EXPECT_EQ(seriesCount, retrieve->getImageCount());
+  EXPECT_EQ(1U, originalReader.getSeries());
+}
+
+TEST(OMETIFFReaderState, SaveLoad)
+{
+  const dimension_size_type seriesCount = 2U;
+
+  path file(sample_file("ometiffreader-state.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList;
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    seriesList.push_back(sample_series(24U + (s * 8U), 16U, s + 2U, 1U, 1U,
+                                       ome::xml::model::enums::PixelType::UINT8));
+
+  {
+    OMETIFFWriter writer;
+    ASSERT_NO_FATAL_FAILURE(write_dataset(writer, file, seriesList));
+  }
+
+  std::ostringstream saved;
+  {
+    OMETIFFReader reader;
+    std::shared_ptr<::ome::xml::meta::MetadataStore> store(std::make_shared<::ome::xml::meta::OMEXMLMetadata>());
+    reader.setMetadataStore(store);
+    ASSERT_NO_THROW(reader.setId(file));
+    ASSERT_NO_THROW(reader.saveState(saved));
+  }
+
+  // Restore state, including metadata store content.
+  OMETIFFReader reader;
+  std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> omexml(std::make_shared<::ome::xml::meta::OMEXMLMetadata>());
+  std::shared_ptr<::ome::xml::meta::MetadataStore> store(omexml);
+  reader.setMetadataStore(store);
+  std::istringstream in(saved.str());
+  bool loaded = false;
+  ASSERT_NO_THROW(loaded = reader.loadState(in));
+  ASSERT_TRUE(loaded);
+  ASSERT_TRUE(static_cast<bool>(reader.getCurrentFile()));
+  EXPECT_EQ(canonical(file), *reader.getCurrentFile());
+  ASSERT_EQ(seriesCount, reader.getSeriesCount());
+  EXPECT_EQ(seriesCount, omexml->getImageCount());
+  EXPECT_EQ(std::vector<path>(1U, canonical(file)), reader.getUsedFiles());
+
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    {
+      ASSERT_NO_THROW(reader.setSeries(s));
+      EXPECT_EQ(seriesList.at(s)->sizeX, reader.getSizeX());
+      EXPECT_EQ(seriesList.at(s)->sizeY, reader.getSizeY());
+      EXPECT_EQ(seriesList.at(s)->sizeZ, reader.getSizeZ());
+      EXPECT_EQ(ome::xml::model::enums::PixelType::UINT8, reader.getPixelType());
+      ASSERT_EQ(seriesList.at(s)->imageCount, reader.getImageCount());
+
+      for (dimension_size_type p = 0; p < reader.getImageCount(); ++p)
+        {
+          VariantPixelBuffer buf;
+          ASSERT_NO_THROW(reader.openBytes(p, buf));
+          verify_plane(buf, s, p);
+        }
+    }
+
+  // State for a different reader type is rejected.
+  {
+    MinimalTIFFReader minimal;
+    std::istringstream in(saved.str());
+    EXPECT_THROW(minimal.loadState(in), ome::files::FormatException);
+  }
+
+  // State is stale once the file is modified.
+  last_write_time(file, last_write_time(file) + 10);
+  {
+    OMETIFFReader stale;
+    std::istringstream in(saved.str());
+    ASSERT_NO_THROW(loaded = stale.loadState(in));
+    EXPECT_FALSE(loaded);
+    EXPECT_THROW(stale.getSeriesCount(), std::logic_error);
+  }
+}
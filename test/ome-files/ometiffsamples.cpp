@@ -0,0 +1,233 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * %%
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <algorithm>
+#include <array>
+
+#include <boost/optional.hpp>
+
+#include <ome/files/MetadataTools.h>
+#include <ome/files/PixelProperties.h>
+#include <ome/files/in/OMETIFFReader.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+#include "ometiffsamples.h"
+
+using ome::files::dimension_size_type;
+using ome::files::CoreMetadata;
+using ome::files::VariantPixelBuffer;
+
+namespace
+{
+
+  struct FillVisitor : public boost::static_visitor<>
+  {
+    dimension_size_type series;
+    dimension_size_type plane;
+
+    FillVisitor(dimension_size_type series,
+                dimension_size_type plane):
+      series(series),
+      plane(plane)
+    {}
+
+    template<typename T>
+    void
+    operator()(std::shared_ptr<T>& buffer) const
+    {
+      typedef typename T::value_type value_type;
+
+      const VariantPixelBuffer::size_type *shape = buffer->shape();
+      VariantPixelBuffer::indices_type idx;
+      idx.fill(0);
+      for (dimension_size_type y = 0; y < shape[ome::files::DIM_SPATIAL_Y]; ++y)
+        for (dimension_size_type x = 0; x < shape[ome::files::DIM_SPATIAL_X]; ++x)
+          for (dimension_size_type s = 0; s < shape[ome::files::DIM_SUBCHANNEL]; ++s)
+            {
+              idx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(x);
+              idx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(y);
+              idx[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+              buffer->array()(idx) = static_cast<value_type>(sample_value(series, plane, x, y));
+            }
+    }
+  };
+
+}
+
+boost::filesystem::path
+sample_file(const std::string& name)
+{
+  boost::filesystem::path file(boost::filesystem::path(PROJECT_BINARY_DIR "/test/ome-files/data") / name);
+  if (boost::filesystem::exists(file))
+    boost::filesystem::remove(file);
+  return file;
+}
+
+std::shared_ptr<CoreMetadata>
+sample_series(dimension_size_type               sizeX,
+              dimension_size_type               sizeY,
+              dimension_size_type               sizeZ,
+              dimension_size_type               sizeT,
+              dimension_size_type               sizeC,
+              ome::xml::model::enums::PixelType pixeltype)
+{
+  std::shared_ptr<CoreMetadata> core(std::make_shared<CoreMetadata>());
+  core->sizeX = sizeX;
+  core->sizeY = sizeY;
+  core->sizeZ = sizeZ;
+  core->sizeT = sizeT;
+  core->sizeC.assign(sizeC, 1U);
+  core->imageCount = sizeZ * sizeT * sizeC;
+  core->pixelType = pixeltype;
+  core->bitsPerPixel = ome::files::bitsPerPixel(pixeltype);
+  core->dimensionOrder = ome::xml::model::enums::DimensionOrder::XYZTC;
+  return core;
+}
+
+std::shared_ptr<ome::xml::meta::MetadataRetrieve>
+sample_metadata(const std::vector<std::shared_ptr<CoreMetadata>>& seriesList)
+{
+  std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta(std::make_shared<ome::xml::meta::OMEXMLMetadata>());
+  ome::files::fillMetadata(*meta, seriesList);
+  return std::static_pointer_cast<ome::xml::meta::MetadataRetrieve>(meta);
+}
+
+dimension_size_type
+sample_value(dimension_size_type series,
+             dimension_size_type plane,
+             dimension_size_type x,
+             dimension_size_type y)
+{
+  return (series * 10007U) + (plane * 1009U) + (y * 67U) + x;
+}
+
+void
+fill_plane(VariantPixelBuffer& buf,
+           dimension_size_type series,
+           dimension_size_type plane)
+{
+  FillVisitor v(series, plane);
+  boost::apply_visitor(v, buf.vbuffer());
+}
+
+VariantPixelBuffer
+sample_plane(const CoreMetadata& core,
+             dimension_size_type series,
+             dimension_size_type plane,
+             bool                interleaved)
+{
+  std::array<VariantPixelBuffer::size_type, 9> shape;
+  shape.fill(1U);
+  shape[ome::files::DIM_SPATIAL_X] = core.sizeX;
+  shape[ome::files::DIM_SPATIAL_Y] = core.sizeY;
+  shape[ome::files::DIM_SUBCHANNEL] = core.sizeC.front();
+
+  VariantPixelBuffer buf(shape, core.pixelType,
+                         ome::files::PixelBufferBase::make_storage_order(ome::xml::model::enums::DimensionOrder::XYZTC, interleaved));
+  fill_plane(buf, series, plane);
+  return buf;
+}
+
+void
+write_dataset(ome::files::out::OMETIFFWriter&                   writer,
+              const boost::filesystem::path&                    file,
+              const std::vector<std::shared_ptr<CoreMetadata>>& seriesList)
+{
+  writer.setMetadataRetrieve(sample_metadata(seriesList));
+  ASSERT_NO_THROW(writer.setId(file));
+
+  // The profile may have set the interleaving.
+  const boost::optional<bool> interleaved(writer.getInterleaved());
+
+  for (dimension_size_type s = 0; s < seriesList.size(); ++s)
+    {
+      ASSERT_NO_THROW(writer.setSeries(s));
+      for (dimension_size_type p = 0; p < seriesList.at(s)->imageCount; ++p)
+        {
+          VariantPixelBuffer buf(sample_plane(*seriesList.at(s), s, p, interleaved && *interleaved));
+          ASSERT_NO_THROW(writer.saveBytes(p, buf));
+        }
+    }
+
+  ASSERT_NO_THROW(writer.close());
+}
+
+void
+verify_plane(const VariantPixelBuffer& buf,
+             dimension_size_type       series,
+             dimension_size_type       plane)
+{
+  std::array<VariantPixelBuffer::size_type, 9> shape;
+  std::copy(buf.shape(), buf.shape() + shape.size(), shape.begin());
+
+  VariantPixelBuffer expected;
+  expected.setBuffer(shape, buf.pixelType(), buf.storage_order());
+  fill_plane(expected, series, plane);
+
+  EXPECT_TRUE(buf == expected) << "series " << series << " plane " << plane;
+}
+
+void
+verify_dataset(const boost::filesystem::path&                    file,
+               const std::vector<std::shared_ptr<CoreMetadata>>& seriesList)
+{
+  ome::files::in::OMETIFFReader reader;
+  ASSERT_NO_THROW(reader.setId(file));
+  ASSERT_EQ(seriesList.size(), reader.getSeriesCount());
+
+  for (dimension_size_type s = 0; s < seriesList.size(); ++s)
+    {
+      const CoreMetadata& core(*seriesList.at(s));
+
+      reader.setSeries(s);
+      EXPECT_EQ(core.sizeX, reader.getSizeX());
+      EXPECT_EQ(core.sizeY, reader.getSizeY());
+      EXPECT_EQ(core.sizeZ, reader.getSizeZ());
+      EXPECT_EQ(core.sizeT, reader.getSizeT());
+      EXPECT_EQ(core.pixelType, reader.getPixelType());
+      ASSERT_EQ(core.imageCount, reader.getImageCount());
+
+      for (dimension_size_type p = 0; p < core.imageCount; ++p)
+        {
+          VariantPixelBuffer buf;
+          ASSERT_NO_THROW(reader.openBytes(p, buf));
+          verify_plane(buf, s, p);
+        }
+    }
+}
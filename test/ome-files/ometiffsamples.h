@@ -0,0 +1,122 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * %%
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#ifndef TEST_OMETIFFSAMPLES_H
+#define TEST_OMETIFFSAMPLES_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/files/CoreMetadata.h>
+#include <ome/files/Types.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/out/OMETIFFWriter.h>
+
+#include <ome/xml/meta/MetadataRetrieve.h>
+
+#include <ome/test/config.h>
+#include <ome/test/test.h>
+
+// Synthetic OME-TIFF datasets.  Every pixel has a known value,
+// computed from its series, plane and position by sample_value(), so
+// that a dataset may be written in any way and then checked with
+// verify_dataset().
+
+// Test output file in the test data directory; any existing file is
+// removed.
+extern boost::filesystem::path
+sample_file(const std::string& name);
+
+// Single-sample series with XYZTC dimension order.
+extern std::shared_ptr<ome::files::CoreMetadata>
+sample_series(ome::files::dimension_size_type   sizeX,
+              ome::files::dimension_size_type   sizeY,
+              ome::files::dimension_size_type   sizeZ = 1U,
+              ome::files::dimension_size_type   sizeT = 1U,
+              ome::files::dimension_size_type   sizeC = 1U,
+              ome::xml::model::enums::PixelType pixeltype = ome::xml::model::enums::PixelType::UINT16);
+
+extern std::shared_ptr<ome::xml::meta::MetadataRetrieve>
+sample_metadata(const std::vector<std::shared_ptr<ome::files::CoreMetadata>>& seriesList);
+
+// Pixel value, truncated to the pixel type when stored.
+extern ome::files::dimension_size_type
+sample_value(ome::files::dimension_size_type series,
+             ome::files::dimension_size_type plane,
+             ome::files::dimension_size_type x,
+             ome::files::dimension_size_type y);
+
+// Fill all samples of each pixel of a plane with its value.
+extern void
+fill_plane(ome::files::VariantPixelBuffer& buf,
+           ome::files::dimension_size_type series,
+           ome::files::dimension_size_type plane);
+
+extern ome::files::VariantPixelBuffer
+sample_plane(const ome::files::CoreMetadata& core,
+             ome::files::dimension_size_type series,
+             ome::files::dimension_size_type plane,
+             bool                            interleaved = false);
+
+// Write every plane of every series in order.  Writer options must
+// be set first; the metadata is set from seriesList.
+extern void
+write_dataset(ome::files::out::OMETIFFWriter&                               writer,
+              const boost::filesystem::path&                                file,
+              const std::vector<std::shared_ptr<ome::files::CoreMetadata>>& seriesList);
+
+extern void
+verify_plane(const ome::files::VariantPixelBuffer& buf,
+             ome::files::dimension_size_type       series,
+             ome::files::dimension_size_type       plane);
+
+// Check the series sizes and every plane of a dataset.
+extern void
+verify_dataset(const boost::filesystem::path&                                file,
+               const std::vector<std::shared_ptr<ome::files::CoreMetadata>>& seriesList);
+
+#endif // TEST_OMETIFFSAMPLES_H
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -36,10 +36,16 @@
  * #L%
  */
 
+#include <array>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <ome/files/CoreMetadata.h>
+#include <ome/files/Executor.h>
+#include <ome/files/FormatTools.h>
 #include <ome/files/MetadataTools.h>
 #include <ome/files/VariantPixelBuffer.h>
 #include <ome/files/in/OMETIFFReader.h>
@@ -54,6 +60,7 @@
 
 #include <ome/test/test.h>
 
+#include "ometiffsamples.h"
 #include "tiffsamples.h"
 
 using ome::files::dimension_size_type;
@@ -203,6 +210,443 @@ TEST_P(TIFFWriterTest, setId)
 
 std::vector<TIFFTestParameters> params(find_tiff_tests());
 
+TEST(OMETIFFWriterAsync, WriteBehind)
+{
+  path testfile(sample_file("ometiffwriter-writebehind.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(64U, 48U, 1U, 6U));
+  const CoreMetadata& core(*seriesList.front());
+
+  {
+    OMETIFFWriter writer;
+    writer.setMetadataRetrieve(sample_metadata(seriesList));
+    writer.setCompression("LZW");
+    writer.setWriteBehind(2U);
+    EXPECT_EQ(2U, writer.getWriteBehind());
+    ASSERT_NO_THROW(writer.setId(testfile));
+
+    // Reused buffer; the writer must take a copy.
+    VariantPixelBuffer reused(sample_plane(core, 0U, 0U));
+    for (dimension_size_type t = 0; t < core.imageCount; ++t)
+      {
+        if (t % 2)
+          {
+            // Ownership transferred without copying.
+            VariantPixelBuffer moved(sample_plane(core, 0U, t));
+            ASSERT_NO_THROW(writer.saveBytes(t, std::move(moved)));
+          }
+        else
+          {
+            fill_plane(reused, 0U, t);
+            ASSERT_NO_THROW(writer.saveBytes(t, reused));
+          }
+      }
+
+    EXPECT_THROW(writer.saveBytes(core.imageCount, reused), std::logic_error);
+    ASSERT_NO_THROW(writer.flush());
+    ASSERT_NO_THROW(writer.close());
+    EXPECT_EQ(0U, writer.getWriteBehind());
+  }
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+}
+
+namespace
+{
+
+  // Executor which never runs its tasks.
+  class StalledExecutor : public ome::files::Executor
+  {
+  public:
+    std::vector<task_type> tasks;
+
+    void
+    submit(task_type task)
+    {
+      tasks.push_back(task);
+    }
+
+    dimension_size_type
+    concurrency() const
+    {
+      return 1U;
+    }
+  };
+
+}
+
+TEST(OMETIFFWriterAsync, WriteBehindStalled)
+{
+  path testfile(sample_file("ometiffwriter-writebehind-stalled.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(32U, 24U, 1U, 5U, 1U, ome::xml::model::enums::PixelType::UINT8));
+  const CoreMetadata& core(*seriesList.front());
+
+  // The write-behind tasks never run, as if every worker were
+  // blocked, so the writer must write the queued planes itself
+  // when the queue is full, and on flush and close.
+  std::shared_ptr<StalledExecutor> stalled(std::make_shared<StalledExecutor>());
+  ome::files::Executor::setSharedIO(stalled);
+
+  {
+    OMETIFFWriter writer;
+    writer.setMetadataRetrieve(sample_metadata(seriesList));
+    writer.setWriteBehind(2U);
+    ASSERT_NO_THROW(writer.setId(testfile));
+
+    for (dimension_size_type t = 0; t < core.imageCount; ++t)
+      {
+        VariantPixelBuffer buf(sample_plane(core, 0U, t));
+        ASSERT_NO_THROW(writer.saveBytes(t, std::move(buf)));
+      }
+
+    ASSERT_NO_THROW(writer.close());
+  }
+
+  ome::files::Executor::setSharedIO(std::shared_ptr<ome::files::Executor>());
+  EXPECT_FALSE(stalled->tasks.empty());
+  // The tasks retain their queues, which retain the executor.
+  stalled->tasks.clear();
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+}
+
+TEST(OMETIFFWriterAsync, WriteBehindMultiFile)
+{
+  const dimension_size_type seriesCount = 3U;
+
+  std::vector<path> files;
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    files.push_back(sample_file("ometiffwriter-writebehind-multi-" + std::to_string(s) + ".ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(seriesCount, sample_series(48U, 40U, 1U, 3U));
+
+  {
+    OMETIFFWriter writer;
+    writer.setMetadataRetrieve(sample_metadata(seriesList));
+    writer.setCompression("LZW");
+    writer.setWriteBehind(2U);
+    ASSERT_NO_THROW(writer.setId(files.front()));
+
+    // Each series is queued for its own file while the previous
+    // files are still being written.
+    for (dimension_size_type s = 0; s < seriesCount; ++s)
+      {
+        if (s)
+          ASSERT_NO_THROW(writer.changeOutputFile(files.at(s)));
+        ASSERT_NO_THROW(writer.setSeries(s));
+        for (dimension_size_type t = 0; t < seriesList.at(s)->imageCount; ++t)
+          {
+            VariantPixelBuffer buf(sample_plane(*seriesList.at(s), s, t));
+            ASSERT_NO_THROW(writer.saveBytes(t, std::move(buf)));
+          }
+      }
+
+    ASSERT_NO_THROW(writer.close());
+  }
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(files.front(), seriesList));
+}
+
+TEST(OMETIFFWriterAsync, ConcurrentFiles)
+{
+  const dimension_size_type seriesCount = 4U;
+
+  std::vector<path> files;
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    files.push_back(sample_file("ometiffwriter-concurrent-" + std::to_string(s) + ".ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(seriesCount, sample_series(48U, 40U, 1U, 3U));
+
+  {
+    OMETIFFWriter writer;
+    writer.setMetadataRetrieve(sample_metadata(seriesList));
+    writer.setCompression("Deflate");
+    ASSERT_NO_THROW(writer.setId(files.front()));
+
+    // Each series is written to its own file by its own thread.
+    std::vector<dimension_size_type> failures(seriesCount, 0U);
+    std::vector<std::thread> threads;
+    for (dimension_size_type s = 0; s < seriesCount; ++s)
+      {
+        threads.emplace_back([&, s]{
+            for (dimension_size_type t = 0; t < seriesList.at(s)->imageCount; ++t)
+              {
+                try
+                  {
+                    VariantPixelBuffer buf(sample_plane(*seriesList.at(s), s, t));
+                    writer.saveBytes(files.at(s), s, t, buf);
+                  }
+                catch (const std::exception&)
+                  {
+                    ++failures[s];
+                  }
+              }
+          });
+      }
+    for (auto& thread : threads)
+      thread.join();
+
+    for (dimension_size_type s = 0; s < seriesCount; ++s)
+      EXPECT_EQ(0U, failures[s]);
+
+    ASSERT_NO_THROW(writer.close());
+  }
+
+  // The OME-XML of every file describes the whole dataset.
+  for (const auto& file : files)
+    ASSERT_NO_FATAL_FAILURE(verify_dataset(file, seriesList));
+}
+
+TEST(OMETIFFWriterMetadata, CompactTiffData)
+{
+  const dimension_size_type seriesCount = 2U;
+
+  path file(sample_file("ometiffwriter-compact-tiffdata.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(seriesCount, sample_series(32U, 24U, 2U, 3U, 1U, ome::xml::model::enums::PixelType::UINT8));
+  const dimension_size_type imageCount = seriesList.front()->imageCount;
+
+  {
+    OMETIFFWriter writer;
+    ASSERT_NO_FATAL_FAILURE(write_dataset(writer, file, seriesList));
+  }
+
+  // Each series is stored in consecutive IFDs, so is described by
+  // a single TiffData element.
+  std::shared_ptr<ome::files::tiff::TIFF> tiff(ome::files::tiff::TIFF::open(file, "r"));
+  std::string text;
+  ASSERT_NO_THROW(tiff->getDirectoryByIndex(0)->getField(ome::files::tiff::IMAGEDESCRIPTION).get(text));
+  tiff->close();
+
+  std::shared_ptr<::ome::xml::meta::OMEXMLMetadata> written(ome::files::createOMEXMLMetadata(text));
+  ASSERT_EQ(seriesCount, written->getImageCount());
+  for (dimension_size_type s = 0; s < seriesCount; ++s)
+    {
+      ASSERT_EQ(1U, written->getTiffDataCount(s));
+      EXPECT_EQ(s * imageCount, static_cast<dimension_size_type>(written->getTiffDataIFD(s, 0)));
+      EXPECT_EQ(imageCount, static_cast<dimension_size_type>(written->getTiffDataPlaneCount(s, 0)));
+      EXPECT_EQ(0U, static_cast<dimension_size_type>(written->getTiffDataFirstZ(s, 0)));
+      EXPECT_EQ(0U, static_cast<dimension_size_type>(written->getTiffDataFirstT(s, 0)));
+      EXPECT_EQ(0U, static_cast<dimension_size_type>(written->getTiffDataFirstC(s, 0)));
+    }
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(file, seriesList));
+}
+
+TEST(OMETIFFWriterVolume, SaveVolume)
+{
+  std::shared_ptr<CoreMetadata> core(sample_series(40U, 30U, 2U, 3U, 2U));
+  // Output order differs from the volume storage order.
+  core->dimensionOrder = ome::xml::model::enums::DimensionOrder::XYCZT;
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, core);
+
+  std::array<VariantPixelBuffer::size_type, 9> shape;
+  shape.fill(1U);
+  shape[ome::files::DIM_SPATIAL_X] = core->sizeX;
+  shape[ome::files::DIM_SPATIAL_Y] = core->sizeY;
+  shape[ome::files::DIM_SPATIAL_Z] = core->sizeZ;
+  shape[ome::files::DIM_TEMPORAL_T] = core->sizeT;
+  shape[ome::files::DIM_CHANNEL] = core->sizeC.size();
+  ome::files::PixelBufferBase::storage_order_type order(ome::files::PixelBufferBase::make_storage_order(ome::xml::model::enums::DimensionOrder::XYZTC, false));
+
+  // Synchronous, write-behind, and write-behind with ownership transfer.
+  for (int mode = 0; mode < 3; ++mode)
+    {
+      path testfile(sample_file("ometiffwriter-volume-" + std::to_string(mode) + ".ome.tiff"));
+
+      // Each plane of the volume has the values of the plane it is
+      // written to.
+      VariantPixelBuffer volume(shape, core->pixelType, order);
+      VariantPixelBuffer::indices_type idx;
+      idx.fill(0);
+      for (dimension_size_type p = 0; p < core->imageCount; ++p)
+        {
+          std::array<dimension_size_type, 3> coords(ome::files::getZCTCoords("XYCZT", core->sizeZ, core->sizeC.size(),
+                                                                            core->sizeT, core->imageCount, p));
+          idx[ome::files::DIM_SPATIAL_Z] = static_cast<boost::multi_array_types::index>(coords[0]);
+          idx[ome::files::DIM_CHANNEL] = static_cast<boost::multi_array_types::index>(coords[1]);
+          idx[ome::files::DIM_TEMPORAL_T] = static_cast<boost::multi_array_types::index>(coords[2]);
+          for (dimension_size_type y = 0; y < core->sizeY; ++y)
+            for (dimension_size_type x = 0; x < core->sizeX; ++x)
+              {
+                idx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(x);
+                idx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(y);
+                volume.array<uint16_t>()(idx) = static_cast<uint16_t>(sample_value(0U, p, x, y));
+              }
+        }
+
+      {
+        OMETIFFWriter writer;
+        writer.setMetadataRetrieve(sample_metadata(seriesList));
+        writer.setInterleaved(false);
+        // Several strips per plane, encoded concurrently.
+        writer.setCompression("Deflate");
+        writer.setTileSizeY(8U);
+        if (mode)
+          writer.setWriteBehind(2U);
+        ASSERT_NO_THROW(writer.setId(testfile));
+
+        // Mismatched dimensions.
+        VariantPixelBuffer plane(sample_plane(*core, 0U, 0U));
+        EXPECT_THROW(writer.saveVolume(plane), std::logic_error);
+
+        if (mode == 2)
+          ASSERT_NO_THROW(writer.saveVolume(std::move(volume)));
+        else
+          ASSERT_NO_THROW(writer.saveVolume(volume));
+        ASSERT_NO_THROW(writer.close());
+      }
+
+      ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+    }
+}
+
+TEST(OMETIFFWriterOutput, BufferedPreallocated)
+{
+  path testfile(sample_file("ometiffwriter-buffered.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(300U, 70U, 1U, 4U, 1U, ome::xml::model::enums::PixelType::UINT8));
+
+  {
+    OMETIFFWriter writer;
+    // Smaller than a plane, so that buffer flushes split strips.
+    writer.setWriteBufferSize(5000U);
+    EXPECT_FALSE(writer.getPreallocate());
+    writer.setPreallocate(true);
+    writer.setDirectIO(true);
+    EXPECT_EQ(5000U, writer.getWriteBufferSize());
+    EXPECT_TRUE(writer.getPreallocate());
+    EXPECT_TRUE(writer.getDirectIO());
+
+    ASSERT_NO_FATAL_FAILURE(write_dataset(writer, testfile, seriesList));
+    EXPECT_FALSE(writer.getPreallocate());
+    EXPECT_FALSE(writer.getDirectIO());
+  }
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+}
+
+TEST(OMETIFFWriterLayout, Profiles)
+{
+  struct LayoutCase
+  {
+    ome::files::LayoutProfile profile;
+    boost::optional<dimension_size_type> tilesize;
+    dimension_size_type tilewidth;
+    dimension_size_type tileheight;
+  };
+
+  // 16-bit greyscale: 2400 bytes per row.
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(1200U, 600U));
+  const std::vector<LayoutCase> cases
+    {
+      {ome::files::LAYOUT_DEFAULT, boost::none, 1200U, 54U},
+      {ome::files::LAYOUT_SEQUENTIAL, boost::none, 1200U, 436U},
+      {ome::files::LAYOUT_RANDOM_ACCESS, boost::none, 256U, 256U},
+      {ome::files::LAYOUT_ARCHIVAL, boost::none, 512U, 512U},
+      {ome::files::LAYOUT_ARCHIVAL, dimension_size_type(64U), 64U, 64U}
+    };
+
+  for (const auto& c : cases)
+    {
+      path testfile(sample_file("ometiffwriter-layout.ome.tiff"));
+
+      {
+        OMETIFFWriter writer;
+        writer.setLayoutProfile(c.profile);
+        EXPECT_EQ(c.profile, writer.getLayoutProfile());
+        if (c.tilesize)
+          {
+            writer.setTileSizeX(c.tilesize);
+            writer.setTileSizeY(c.tilesize);
+          }
+        ASSERT_NO_FATAL_FAILURE(write_dataset(writer, testfile, seriesList));
+      }
+
+      OMETIFFReader reader;
+      ASSERT_NO_THROW(reader.setId(testfile));
+      EXPECT_EQ(c.tilewidth, reader.getOptimalTileWidth());
+      EXPECT_EQ(c.tileheight, reader.getOptimalTileHeight());
+
+      ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+    }
+
+  // Profiles set the interleaving only if not already set.
+  OMETIFFWriter writer;
+  EXPECT_FALSE(writer.getInterleaved());
+  writer.setLayoutProfile(ome::files::LAYOUT_RANDOM_ACCESS);
+  ASSERT_TRUE(writer.getInterleaved());
+  EXPECT_TRUE(*writer.getInterleaved());
+
+  OMETIFFWriter planarwriter;
+  planarwriter.setInterleaved(false);
+  planarwriter.setLayoutProfile(ome::files::LAYOUT_SEQUENTIAL);
+  ASSERT_TRUE(planarwriter.getInterleaved());
+  EXPECT_FALSE(*planarwriter.getInterleaved());
+}
+
+TEST(OMETIFFWriterCompression, CodecTuning)
+{
+  path testfile(sample_file("ometiffwriter-tuning.ome.tiff"));
+  std::vector<std::shared_ptr<CoreMetadata>> seriesList(1U, sample_series(512U, 256U, 1U, 3U));
+  const CoreMetadata& core(*seriesList.front());
+
+  ome::files::tiff::CodecTuning tuning;
+  tuning.target = ome::files::tiff::CodecTuning::MIN_SIZE;
+  tuning.sampleTiles = 4U;
+
+  std::vector<ome::files::tiff::CodecMeasurement> measurements;
+  boost::optional<std::string> compression;
+
+  {
+    OMETIFFWriter writer;
+    writer.setMetadataRetrieve(sample_metadata(seriesList));
+    // Tuning overrides the codec and predictor.
+    writer.setCompression("LZW");
+    writer.setPredictor(ome::files::tiff::HORIZONTAL);
+    writer.setLayoutProfile(ome::files::LAYOUT_RANDOM_ACCESS);
+    writer.setCodecTuning(tuning);
+    ASSERT_TRUE(static_cast<bool>(writer.getCodecTuning()));
+    ASSERT_NO_THROW(writer.setId(testfile));
+    EXPECT_TRUE(writer.getCodecMeasurements().empty());
+
+    for (dimension_size_type t = 0; t < core.imageCount; ++t)
+      {
+        VariantPixelBuffer buf(sample_plane(core, 0U, t));
+        ASSERT_NO_THROW(writer.saveBytes(t, buf));
+      }
+
+    measurements = writer.getCodecMeasurements();
+    compression = writer.getCompression();
+
+    ASSERT_NO_THROW(writer.close());
+    EXPECT_FALSE(static_cast<bool>(writer.getCodecTuning()));
+    EXPECT_EQ(measurements.size(), writer.getCodecMeasurements().size());
+  }
+
+  ASSERT_FALSE(measurements.empty());
+  const ome::files::tiff::CodecMeasurement& selected(ome::files::tiff::selectCodec(measurements, tuning));
+  if (selected.scheme == ome::files::tiff::COMPRESSION_NONE)
+    EXPECT_FALSE(static_cast<bool>(compression));
+  else
+    {
+      ASSERT_TRUE(static_cast<bool>(compression));
+      EXPECT_EQ(selected.name, *compression);
+    }
+
+  // The first IFD is written with the same codec and tile layout
+  // as the others.
+  {
+    std::shared_ptr<ome::files::tiff::TIFF> tiff(ome::files::tiff::TIFF::open(testfile, "r"));
+    std::shared_ptr<ome::files::tiff::IFD> first(tiff->getDirectoryByIndex(0));
+    for (dimension_size_type t = 1; t < core.imageCount; ++t)
+      {
+        std::shared_ptr<ome::files::tiff::IFD> ifd(tiff->getDirectoryByIndex(t));
+        EXPECT_EQ(first->getCompression(), ifd->getCompression());
+        EXPECT_EQ(first->getTileWidth(), ifd->getTileWidth());
+        EXPECT_EQ(first->getTileHeight(), ifd->getTileHeight());
+      }
+    EXPECT_EQ(selected.scheme, first->getCompression());
+  }
+
+  ASSERT_NO_FATAL_FAILURE(verify_dataset(testfile, seriesList));
+}
+
 // Disable missing-prototypes warning for INSTANTIATE_TEST_CASE_P;
 // this is solely to work around a missing prototype in gtest.
 #ifdef __GNUC__
@@ -0,0 +1,202 @@
+/*
+ * #%L
+ * OME-FILES C++ library for image IO.
+ * %%
+ * Copyright © 2014 - 2015 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include <ctime>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <ome/files/OMEXMLMetadataCache.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+#include <ome/test/test.h>
+
+using boost::filesystem::path;
+using ome::files::dimension_size_type;
+using ome::files::OMEXMLMetadataCache;
+using ome::xml::meta::OMEXMLMetadata;
+
+namespace
+{
+
+  // Files are backdated unless recent is set, since files modified
+  // within the timestamp resolution are not cached.
+  path
+  testfile(dimension_size_type index,
+           const std::string&  content = "<OME/>",
+           bool                recent = false)
+  {
+    path dir(PROJECT_BINARY_DIR "/test/ome-files/data");
+    boost::filesystem::create_directories(dir);
+    path file(dir / (std::string("omexmlmetadatacache-") + std::to_string(index) + ".xml"));
+    {
+      boost::filesystem::ofstream out(file);
+      out << content;
+    }
+    if (!recent)
+      boost::filesystem::last_write_time(file, std::time(nullptr) - 60);
+    return file;
+  }
+
+}
+
+TEST(OMEXMLMetadataCache, Construct)
+{
+  OMEXMLMetadataCache c;
+  ASSERT_EQ(0U, c.getLimit());
+  ASSERT_EQ(0U, c.size());
+}
+
+TEST(OMEXMLMetadataCache, Disabled)
+{
+  OMEXMLMetadataCache c;
+  path f(testfile(0));
+
+  ASSERT_FALSE(c.insert(f, std::make_shared<OMEXMLMetadata>(), 6U));
+  ASSERT_FALSE(static_cast<bool>(c.find(f)));
+  ASSERT_EQ(0U, c.size());
+}
+
+TEST(OMEXMLMetadataCache, Insert)
+{
+  OMEXMLMetadataCache c(1024U);
+
+  for (dimension_size_type i = 0; i < 16; ++i)
+    {
+      path f(testfile(i));
+      std::shared_ptr<OMEXMLMetadata> meta(std::make_shared<OMEXMLMetadata>());
+      ASSERT_TRUE(c.insert(f, meta, 6U));
+      ASSERT_EQ(meta, c.find(f));
+    }
+
+  ASSERT_EQ(16U, c.size());
+  ASSERT_EQ(16U * 6U, c.weight());
+}
+
+TEST(OMEXMLMetadataCache, Remove)
+{
+  OMEXMLMetadataCache c(1024U);
+
+  for (dimension_size_type i = 0; i < 16; ++i)
+    ASSERT_TRUE(c.insert(testfile(i), std::make_shared<OMEXMLMetadata>(), 6U));
+  for (dimension_size_type i = 0; i < 16; ++i)
+    {
+      path f(testfile(i));
+      c.erase(f);
+      ASSERT_FALSE(static_cast<bool>(c.find(f)));
+    }
+  ASSERT_EQ(0U, c.size());
+  ASSERT_EQ(0U, c.weight());
+}
+
+TEST(OMEXMLMetadataCache, Evict)
+{
+  OMEXMLMetadataCache c(40U);
+
+  for (dimension_size_type i = 0; i < 4; ++i)
+    ASSERT_TRUE(c.insert(testfile(i), std::make_shared<OMEXMLMetadata>(), 10U));
+
+  // Use the first entry so the second is least recently used.
+  ASSERT_TRUE(static_cast<bool>(c.find(testfile(0))));
+  ASSERT_TRUE(c.insert(testfile(4), std::make_shared<OMEXMLMetadata>(), 10U));
+
+  ASSERT_EQ(4U, c.size());
+  ASSERT_TRUE(static_cast<bool>(c.find(testfile(0))));
+  ASSERT_FALSE(static_cast<bool>(c.find(testfile(1))));
+
+  // Too large to cache.
+  ASSERT_FALSE(c.insert(testfile(5), std::make_shared<OMEXMLMetadata>(), 41U));
+
+  c.setLimit(20U);
+  ASSERT_EQ(2U, c.size());
+  ASSERT_EQ(20U, c.weight());
+
+  c.setLimit(0U);
+  ASSERT_EQ(0U, c.size());
+}
+
+TEST(OMEXMLMetadataCache, Stale)
+{
+  OMEXMLMetadataCache c(1024U);
+  path f(testfile(0));
+
+  ASSERT_TRUE(c.insert(f, std::make_shared<OMEXMLMetadata>(), 6U));
+  ASSERT_TRUE(static_cast<bool>(c.find(f)));
+
+  // Changing the file size invalidates the entry.
+  testfile(0, "<OME></OME>");
+  ASSERT_FALSE(static_cast<bool>(c.find(f)));
+  ASSERT_EQ(0U, c.size());
+
+  // A missing file can not be cached.
+  boost::filesystem::remove(f);
+  ASSERT_FALSE(c.insert(f, std::make_shared<OMEXMLMetadata>(), 6U));
+}
+
+TEST(OMEXMLMetadataCache, SameSize)
+{
+  OMEXMLMetadataCache c(1024U);
+  path f(testfile(0));
+
+  ASSERT_TRUE(c.insert(f, std::make_shared<OMEXMLMetadata>(), 6U));
+  ASSERT_TRUE(static_cast<bool>(c.find(f)));
+
+  // Rewriting the file with the same size invalidates the entry.
+  testfile(0, "<XML/>", true);
+  ASSERT_FALSE(static_cast<bool>(c.find(f)));
+  ASSERT_EQ(0U, c.size());
+}
+
+TEST(OMEXMLMetadataCache, Recent)
+{
+  OMEXMLMetadataCache c(1024U);
+
+  // A rewrite could reuse the timestamp of a just-written file.
+  path f(testfile(0, "<OME/>", true));
+  ASSERT_FALSE(c.insert(f, std::make_shared<OMEXMLMetadata>(), 6U));
+  ASSERT_FALSE(static_cast<bool>(c.find(f)));
+}
+
+TEST(OMEXMLMetadataCache, Shared)
+{
+  OMEXMLMetadataCache& c(OMEXMLMetadataCache::shared());
+  ASSERT_EQ(&c, &OMEXMLMetadataCache::shared());
+  ASSERT_EQ(0U, c.getLimit());
+}
@@ -36,9 +36,13 @@
  * #L%
  */
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdio>
+#include <fstream>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <vector>
@@ -46,13 +50,19 @@
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
 
+#include <ome/files/CancellationToken.h>
+#include <ome/files/CancelledException.h>
 #include <ome/files/PixelProperties.h>
+#include <ome/files/TileBuffer.h>
+#include <ome/files/TileSchedule.h>
 #include <ome/files/tiff/Codec.h>
+#include <ome/files/tiff/CodecTuning.h>
 #include <ome/files/tiff/TileInfo.h>
 #include <ome/files/tiff/TIFF.h>
 #include <ome/files/tiff/IFD.h>
 #include <ome/files/tiff/Field.h>
 #include <ome/files/tiff/Exception.h>
+#include <ome/files/tiff/Util.h>
 
 #include <ome/compat/regex.h>
 
@@ -69,12 +79,16 @@ using ome::files::tiff::TileInfo;
 using ome::files::tiff::TIFF;
 using ome::files::tiff::IFD;
 using ome::files::tiff::Codec;
+using ome::files::tiff::CodecMeasurement;
+using ome::files::tiff::CodecTuning;
 using ome::files::dimension_size_type;
 using ome::files::significantBitsPerPixel;
 using ome::files::VariantPixelBuffer;
 using ome::files::PixelBuffer;
 using ome::files::PixelProperties;
 using ome::files::PlaneRegion;
+using ome::files::TileSchedule;
+using ome::files::CancellationToken;
 typedef ome::xml::model::enums::PixelType PT;
 
 using namespace boost::filesystem;
@@ -316,6 +330,102 @@ TEST_F(TIFFTest, TIFFConstIter2)
     }
 }
 
+TEST_F(TIFFTest, IFDTagTable)
+{
+  std::shared_ptr<TIFF> t;
+  ASSERT_NO_THROW(t = TIFF::open(tiff_path, "r"));
+  ASSERT_TRUE(static_cast<bool>(t));
+
+  // Alternate between directories; the tags must be served from the
+  // tag table for each directory, not the current libtiff directory.
+  for (directory_index_type i = 0; i < 10; ++i)
+    {
+      std::shared_ptr<IFD> ifd1(t->getDirectoryByIndex(i));
+      std::shared_ptr<IFD> ifd2(t->getDirectoryByIndex(static_cast<directory_index_type>(9 - i)));
+
+      for (const auto& ifd : {ifd1, ifd2, ifd1})
+        {
+          uint32_t width, height;
+          uint16_t samples;
+          std::vector<uint64_t> offsets, bytecounts;
+          ifd->makeCurrent();
+          ifd->getField(ome::files::tiff::IMAGEWIDTH).get(width);
+          ifd->getField(ome::files::tiff::IMAGELENGTH).get(height);
+          ifd->getField(ome::files::tiff::SAMPLESPERPIXEL).get(samples);
+          ifd->getField(ome::files::tiff::STRIPOFFSETS).get(offsets);
+          ifd->getField(ome::files::tiff::STRIPBYTECOUNTS).get(bytecounts);
+
+          // Switch to another directory.
+          (ifd == ifd1 ? ifd2 : ifd1)->makeCurrent();
+
+          EXPECT_EQ(width, ifd->getImageWidth());
+          EXPECT_EQ(height, ifd->getImageHeight());
+          EXPECT_EQ(samples, ifd->getSamplesPerPixel());
+          EXPECT_EQ(offsets, ifd->getTileOffsets());
+          EXPECT_EQ(bytecounts, ifd->getTileByteCounts());
+          EXPECT_EQ(offsets.size(), ifd->getTileCount());
+        }
+    }
+}
+
+TEST_F(TIFFTest, ReadImageDescription)
+{
+  std::shared_ptr<TIFF> t;
+  ASSERT_NO_THROW(t = TIFF::open(tiff_path, "r"));
+  std::string expected;
+  t->getDirectoryByIndex(0)->getField(ome::files::tiff::IMAGEDESCRIPTION).get(expected);
+
+  std::string description;
+  ASSERT_NO_THROW(description = ome::files::tiff::readImageDescription(tiff_path));
+  EXPECT_EQ(expected, description);
+
+  ASSERT_NO_THROW(description = ome::files::tiff::readImageDescription(tiff_path, 16U));
+  EXPECT_EQ(expected.substr(0, 16U), description);
+
+  ASSERT_THROW(ome::files::tiff::readImageDescription(PROJECT_SOURCE_DIR "/CMakeLists.txt"),
+               ome::files::tiff::Exception);
+}
+
+TEST_F(TIFFTest, CountDirectories)
+{
+  std::shared_ptr<TIFF> t;
+  ASSERT_NO_THROW(t = TIFF::open(tiff_path, "r"));
+
+  EXPECT_EQ(t->directoryCount(), ome::files::tiff::countDirectories(tiff_path));
+  EXPECT_EQ(4U, ome::files::tiff::countDirectories(tiff_path, 4U));
+  EXPECT_EQ(t->directoryCount(), ome::files::tiff::countDirectories(tiff_path, 1000U));
+
+  ASSERT_THROW(ome::files::tiff::countDirectories(PROJECT_SOURCE_DIR "/CMakeLists.txt"),
+               ome::files::tiff::Exception);
+}
+
+TEST_F(TIFFTest, ReadIFDSummaries)
+{
+  std::shared_ptr<TIFF> t;
+  ASSERT_NO_THROW(t = TIFF::open(tiff_path, "r"));
+
+  std::vector<ome::files::tiff::IFDSummary> summaries;
+  ASSERT_NO_THROW(summaries = ome::files::tiff::readIFDSummaries(tiff_path));
+  ASSERT_EQ(t->directoryCount(), summaries.size());
+
+  for (ome::files::tiff::directory_index_type i = 0; i < t->directoryCount(); ++i)
+    {
+      std::shared_ptr<IFD> ifd(t->getDirectoryByIndex(i));
+      const ome::files::tiff::IFDSummary& summary(summaries.at(i));
+
+      EXPECT_EQ(t->directoryOffsets().at(i), summary.offset);
+      EXPECT_EQ(ifd->getImageWidth(), summary.width);
+      EXPECT_EQ(ifd->getImageHeight(), summary.height);
+      EXPECT_EQ(ifd->getSamplesPerPixel(), summary.samples);
+      EXPECT_EQ(static_cast<uint16_t>(ifd->getPlanarConfiguration()), summary.planarConfig);
+      EXPECT_EQ(static_cast<uint16_t>(ifd->getPhotometricInterpretation()), summary.photometric);
+      EXPECT_TRUE(ome::files::tiff::sameStructure(summary, summary));
+    }
+
+  ASSERT_THROW(ome::files::tiff::readIFDSummaries(PROJECT_SOURCE_DIR "/CMakeLists.txt"),
+               ome::files::tiff::Exception);
+}
+
 TEST_F(TIFFTest, RawField)
 {
   std::shared_ptr<TIFF> t;
@@ -819,6 +929,145 @@ TEST_F(TIFFTest, PixelType)
   ASSERT_EQ(8U, ifd->getBitsPerSample());
 }
 
+namespace
+{
+
+  // Write a minimal little-endian TIFF with a single strip of packed
+  // MSB-first samples; each row is padded to a whole byte.
+  void
+  writePackedTIFF(const path&                  filename,
+                  uint16_t                     width,
+                  uint16_t                     height,
+                  uint16_t                     bits,
+                  const std::vector<uint16_t>& values)
+  {
+    const uint32_t rowbytes = ((width * bits) + 7U) / 8U;
+    std::vector<uint8_t> pixels(rowbytes * height, 0U);
+    for (uint16_t y = 0; y < height; ++y)
+      for (uint16_t x = 0; x < width; ++x)
+        {
+          uint16_t v = values[(y * width) + x];
+          for (uint16_t b = 0; b < bits; ++b)
+            {
+              if (v & (1U << (bits - b - 1U)))
+                {
+                  uint32_t bit = (x * bits) + b;
+                  pixels[(y * rowbytes) + (bit / 8U)] |= static_cast<uint8_t>(0x80U >> (bit % 8U));
+                }
+            }
+        }
+
+    const uint16_t nentries = 9U;
+    const uint32_t dataoffset = 8U + 2U + (nentries * 12U) + 4U;
+    std::vector<uint8_t> data;
+    auto put16 = [&data](uint16_t v)
+      {
+        data.push_back(static_cast<uint8_t>(v & 0xFFU));
+        data.push_back(static_cast<uint8_t>(v >> 8));
+      };
+    auto put32 = [&put16](uint32_t v)
+      {
+        put16(static_cast<uint16_t>(v & 0xFFFFU));
+        put16(static_cast<uint16_t>(v >> 16));
+      };
+    auto entry = [&put16, &put32](uint16_t tag, uint16_t type, uint32_t value)
+      {
+        put16(tag);
+        put16(type);
+        put32(1U);
+        if (type == 3U) // SHORT
+          {
+            put16(static_cast<uint16_t>(value));
+            put16(0U);
+          }
+        else // LONG
+          put32(value);
+      };
+
+    data.push_back('I');
+    data.push_back('I');
+    put16(42U);
+    put32(8U);
+    put16(nentries);
+    entry(256U, 3U, width);                                   // ImageWidth
+    entry(257U, 3U, height);                                  // ImageLength
+    entry(258U, 3U, bits);                                    // BitsPerSample
+    entry(259U, 3U, 1U);                                      // Compression
+    entry(262U, 3U, 1U);                                      // PhotometricInterpretation
+    entry(273U, 4U, dataoffset);                              // StripOffsets
+    entry(277U, 3U, 1U);                                      // SamplesPerPixel
+    entry(278U, 3U, height);                                  // RowsPerStrip
+    entry(279U, 4U, static_cast<uint32_t>(pixels.size()));   // StripByteCounts
+    put32(0U);
+    data.insert(data.end(), pixels.begin(), pixels.end());
+
+    std::ofstream out(filename.string().c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char *>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+  }
+
+}
+
+TEST(TIFFPacked, ReadPackedSamples)
+{
+  path dir(PROJECT_BINARY_DIR "/test/ome-files/data");
+  if (!exists(dir))
+    create_directories(dir);
+
+  const uint16_t width = 5U;
+  const uint16_t height = 3U;
+  const uint16_t depths[] = {10U, 12U, 14U};
+  for (uint16_t bits : depths)
+    {
+      std::vector<uint16_t> values;
+      const uint16_t mask = static_cast<uint16_t>((1U << bits) - 1U);
+      for (uint16_t y = 0; y < height; ++y)
+        for (uint16_t x = 0; x < width; ++x)
+          values.push_back(static_cast<uint16_t>(((x * 937U) + (y * 1511U) + bits) & mask));
+
+      std::ostringstream f;
+      f << "packed-" << bits << ".tiff";
+      path file(dir / f.str());
+      writePackedTIFF(file, width, height, bits, values);
+
+      std::shared_ptr<TIFF> t;
+      ASSERT_NO_THROW(t = TIFF::open(file, "r"));
+      std::shared_ptr<IFD> ifd;
+      ASSERT_NO_THROW(ifd = t->getDirectoryByIndex(0));
+
+      ASSERT_EQ(bits, ifd->getBitsPerSample());
+      ASSERT_EQ(PT::UINT16, ifd->getPixelType());
+
+      VariantPixelBuffer buf;
+      ASSERT_NO_THROW(ifd->readImage(buf));
+      for (uint16_t y = 0; y < height; ++y)
+        for (uint16_t x = 0; x < width; ++x)
+          {
+            VariantPixelBuffer::indices_type idx;
+            std::fill(idx.begin(), idx.end(), 0);
+            idx[ome::files::DIM_SPATIAL_X] = x;
+            idx[ome::files::DIM_SPATIAL_Y] = y;
+            EXPECT_EQ(values[(y * width) + x],
+                      buf.array<PixelProperties<PT::UINT16>::std_type>()(idx))
+              << bits << "-bit sample at " << x << "," << y;
+          }
+
+      // Subregion crossing packing group boundaries.
+      VariantPixelBuffer sub;
+      ASSERT_NO_THROW(ifd->readImage(sub, 1, 1, 3, 2));
+      for (uint16_t y = 0; y < 2U; ++y)
+        for (uint16_t x = 0; x < 3U; ++x)
+          {
+            VariantPixelBuffer::indices_type idx;
+            std::fill(idx.begin(), idx.end(), 0);
+            idx[ome::files::DIM_SPATIAL_X] = x;
+            idx[ome::files::DIM_SPATIAL_Y] = y;
+            EXPECT_EQ(values[((y + 1U) * width) + x + 1U],
+                      sub.array<PixelProperties<PT::UINT16>::std_type>()(idx));
+          }
+    }
+}
+
 TEST(TIFFCodec, ListCodecs)
 {
   // Note this list depends upon the codecs provided by libtiff, which
@@ -832,6 +1081,85 @@ TEST(TIFFCodec, ListCodecs)
     }
 }
 
+TEST(TIFFCodec, MeasureCodecs)
+{
+  std::array<VariantPixelBuffer::size_type, 9> shape;
+  shape.fill(1U);
+  shape[ome::files::DIM_SPATIAL_X] = 256U;
+  shape[ome::files::DIM_SPATIAL_Y] = 128U;
+
+  // Smooth gradient, which compresses well with a predictor.
+  VariantPixelBuffer buf(shape, PT::UINT16);
+  uint16_t *data = buf.data<uint16_t>();
+  for (dimension_size_type i = 0; i < buf.num_elements(); ++i)
+    data[i] = static_cast<uint16_t>((i % 256U) * 97U + (i / 256U) * 13U);
+
+  CodecTuning tuning;
+  tuning.sampleTiles = 4U;
+
+  std::vector<CodecMeasurement> measurements;
+  ASSERT_NO_THROW(measurements = ome::files::tiff::measureCodecs(buf, 64U, 64U, tuning));
+  ASSERT_FALSE(measurements.empty());
+
+  // Uncompressed baseline.
+  EXPECT_EQ(std::string("None"), measurements.front().name);
+  EXPECT_EQ(measurements.front().rawBytes, measurements.front().encodedBytes);
+
+  for (const auto& m : measurements)
+    {
+      EXPECT_EQ(4U * 64U * 64U * 2U, m.rawBytes);
+      EXPECT_LT(0U, m.encodedBytes);
+      if (m.predictor == ome::files::tiff::HORIZONTAL)
+        EXPECT_LT(1.0, m.ratio());
+    }
+
+  // Restrict to a single unknown codec: only the baseline remains.
+  tuning.codecs.push_back("NoSuchCodec");
+  ASSERT_NO_THROW(measurements = ome::files::tiff::measureCodecs(buf, 64U, 64U, tuning));
+  ASSERT_EQ(1U, measurements.size());
+  EXPECT_EQ(std::string("None"), measurements.front().name);
+}
+
+TEST(TIFFCodec, SelectCodec)
+{
+  auto measurement = [](const std::string& name,
+                        ome::files::storage_size_type encodedBytes,
+                        double encodeSeconds)
+    {
+      CodecMeasurement m;
+      m.name = name;
+      m.rawBytes = 1000U;
+      m.encodedBytes = encodedBytes;
+      m.encodeSeconds = encodeSeconds;
+      return m;
+    };
+
+  const std::vector<CodecMeasurement> measurements
+    {
+      measurement("None", 1000U, 0.001),
+      measurement("Fast", 800U, 0.002),
+      measurement("Small", 400U, 0.010),
+      measurement("Smaller", 300U, 0.100)
+    };
+
+  CodecTuning tuning;
+
+  tuning.target = CodecTuning::MAX_THROUGHPUT;
+  EXPECT_EQ(std::string("Fast"), ome::files::tiff::selectCodec(measurements, tuning).name);
+
+  tuning.target = CodecTuning::MIN_SIZE;
+  EXPECT_EQ(std::string("Smaller"), ome::files::tiff::selectCodec(measurements, tuning).name);
+
+  tuning.minThroughput = 50000.0; // 50000 B/s excludes "Smaller" (10000 B/s).
+  EXPECT_EQ(std::string("Small"), ome::files::tiff::selectCodec(measurements, tuning).name);
+
+  tuning.minThroughput = 5000000.0; // Too fast for all; fall back to fastest.
+  EXPECT_EQ(std::string("None"), ome::files::tiff::selectCodec(measurements, tuning).name);
+
+  EXPECT_THROW(ome::files::tiff::selectCodec(std::vector<CodecMeasurement>(), tuning),
+               ome::files::tiff::Exception);
+}
+
 typedef std::tuple<uint32_t,uint32_t,PT,ome::files::tiff::PlanarConfiguration> plane_configuration;
 
 struct compare_tuple
@@ -1061,6 +1389,75 @@ TEST_P(TIFFVariantTest, TileInfo)
     ASSERT_EQ(ome::files::tiff::STRIP, info.tileType());
 }
 
+// Check tile offsets and tile index computation
+TEST_P(TIFFVariantTest, TileOffsets)
+{
+  TileInfo info = ifd->getTileInfo();
+
+  EXPECT_EQ(info.tileCount(), ifd->getTileOffsets().size());
+  EXPECT_EQ(info.tileCount(), ifd->getTileByteCounts().size());
+
+  dimension_size_type samplelimit = (planarconfig == ome::files::tiff::SEPARATE) ? samples : 1U;
+  for (dimension_size_type s = 0; s < samplelimit; ++s)
+    for (dimension_size_type row = 0; row < info.tileRowCount(); ++row)
+      for (dimension_size_type col = 0; col < info.tileColumnCount(); ++col)
+        {
+          dimension_size_type index = info.tileIndex(col * info.tileWidth(),
+                                                     row * info.tileHeight(),
+                                                     s);
+          EXPECT_EQ(s, info.tileSample(index));
+          EXPECT_EQ(row, info.tileRow(index));
+          EXPECT_EQ(col, info.tileColumn(index));
+        }
+}
+
+// Check that tiles read concurrently match tiles read serially.
+TEST_P(TIFFVariantTest, ConcurrentTileRead)
+{
+  TileInfo info = ifd->getTileInfo();
+  dimension_size_type ntiles = info.tileCount();
+
+  std::vector<std::vector<uint8_t>> expected(ntiles);
+  for (dimension_size_type i = 0; i < ntiles; ++i)
+    {
+      ome::files::TileBuffer buf(info.bufferSize());
+      dimension_size_type bytesread = 0;
+      ASSERT_NO_THROW(bytesread = ifd->readTile(i, buf));
+      expected[i].assign(buf.data(), buf.data() + bytesread);
+    }
+
+  const unsigned int nthreads = 4U;
+  std::vector<dimension_size_type> failures(nthreads, 0U);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < nthreads; ++t)
+    {
+      threads.emplace_back([&, t]{
+          ome::files::TileBuffer buf(info.bufferSize());
+          // Each thread reads the tiles in a different order.
+          for (dimension_size_type j = 0; j < ntiles; ++j)
+            {
+              dimension_size_type i = (j + (t * ntiles) / nthreads) % ntiles;
+              try
+                {
+                  dimension_size_type bytesread = ifd->readTile(i, buf);
+                  if (bytesread != expected[i].size() ||
+                      !std::equal(expected[i].begin(), expected[i].end(), buf.data()))
+                    ++failures[t];
+                }
+              catch (const std::exception&)
+                {
+                  ++failures[t];
+                }
+            }
+        });
+    }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (unsigned int t = 0; t < nthreads; ++t)
+    EXPECT_EQ(0U, failures[t]);
+}
+
 // Check that the first tile matches the expected tile size
 TEST_P(TIFFVariantTest, TilePlaneRegion0)
 {
@@ -1262,6 +1659,187 @@ TEST_P(TIFFVariantTest, PlaneRead)
   read_test(iwidth, iheight, params.file, buf);
 }
 
+TEST_P(TIFFVariantTest, PlaneReadSubchannel)
+{
+  VariantPixelBuffer full;
+  ASSERT_NO_THROW(ifd->readImage(full));
+  ASSERT_EQ(PT::UINT8, full.pixelType());
+
+  const dimension_size_type x = 3U;
+  const dimension_size_type y = 1U;
+  const dimension_size_type w = iwidth - x - 2U;
+  const dimension_size_type h = iheight - y;
+
+  for (dimension_size_type s = 0; s < samples; ++s)
+    {
+      VariantPixelBuffer vb;
+      ASSERT_NO_THROW(ifd->readImage(vb, x, y, w, h, s));
+      ASSERT_EQ(w, vb.shape()[ome::files::DIM_SPATIAL_X]);
+      ASSERT_EQ(h, vb.shape()[ome::files::DIM_SPATIAL_Y]);
+      ASSERT_EQ(1U, vb.shape()[ome::files::DIM_SUBCHANNEL]);
+
+      VariantPixelBuffer::indices_type sidx, didx;
+      sidx.fill(0);
+      didx.fill(0);
+      sidx[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+      for (dimension_size_type dy = 0; dy < h; ++dy)
+        for (dimension_size_type dx = 0; dx < w; ++dx)
+          {
+            sidx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(x + dx);
+            sidx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(y + dy);
+            didx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(dx);
+            didx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(dy);
+            ASSERT_EQ(full.array<uint8_t>()(sidx), vb.array<uint8_t>()(didx));
+          }
+    }
+
+  VariantPixelBuffer vb;
+  EXPECT_THROW(ifd->readImage(vb, 0U, 0U, iwidth, iheight, samples), ome::files::tiff::Exception);
+}
+
+TEST_P(TIFFVariantTest, TileCoverageCenter)
+{
+  TileInfo info = ifd->getTileInfo();
+
+  PlaneRegion full(0, 0, iwidth, iheight);
+  const dimension_size_type cx = iwidth / 3U;
+  const dimension_size_type cy = iheight / 3U;
+
+  std::vector<dimension_size_type> storage = info.tileCoverage(full);
+  std::vector<dimension_size_type> center = info.tileCoverage(full, cx, cy);
+  ASSERT_EQ(storage.size(), center.size());
+  EXPECT_TRUE(std::is_permutation(storage.begin(), storage.end(), center.begin()));
+
+  double prev = 0.0;
+  for (const auto& t : center)
+    {
+      PlaneRegion r = info.tileRegion(t);
+      const double dx = (static_cast<double>(r.x) + (static_cast<double>(r.w) / 2.0)) - static_cast<double>(cx);
+      const double dy = (static_cast<double>(r.y) + (static_cast<double>(r.h) / 2.0)) - static_cast<double>(cy);
+      const double dist = (dx * dx) + (dy * dy);
+      EXPECT_LE(prev, dist);
+      prev = dist;
+    }
+}
+
+TEST_P(TIFFVariantTest, PlaneReadScheduled)
+{
+  const dimension_size_type x = 3U;
+  const dimension_size_type y = 1U;
+  const dimension_size_type w = iwidth - x - 2U;
+  const dimension_size_type h = iheight - y;
+
+  VariantPixelBuffer expected;
+  ASSERT_NO_THROW(ifd->readImage(expected, x, y, w, h));
+
+  std::vector<TileSchedule> schedules;
+  schedules.push_back(TileSchedule(TileSchedule::STORAGE));
+  schedules.push_back(TileSchedule(TileSchedule::CENTER, x + (w / 2U), y + (h / 2U)));
+  schedules.push_back(TileSchedule(TileSchedule::OFFSET));
+
+  for (auto& schedule : schedules)
+    {
+      std::vector<PlaneRegion> completed;
+      schedule.callback = [&completed](const PlaneRegion& region)
+        {
+          completed.push_back(region);
+        };
+
+      VariantPixelBuffer vb;
+      ASSERT_NO_THROW(ifd->readImage(vb, x, y, w, h, schedule, CancellationToken()));
+      EXPECT_TRUE(expected == vb);
+
+      dimension_size_type area = 0U;
+      for (const auto& r : completed)
+        area += r.w * r.h;
+      if (planarconfig == ome::files::tiff::SEPARATE)
+        area /= samples;
+      EXPECT_EQ(w * h, area);
+    }
+
+  // Cancelling in the callback stops the read after the first tile.
+  CancellationToken token;
+  TileSchedule schedule;
+  dimension_size_type ntiles = 0U;
+  schedule.callback = [&token, &ntiles](const PlaneRegion&)
+    {
+      ++ntiles;
+      token.cancel();
+    };
+  VariantPixelBuffer vb;
+  if (ifd->getTileInfo().tileCoverage(PlaneRegion(x, y, w, h)).size() > 1U)
+    EXPECT_THROW(ifd->readImage(vb, x, y, w, h, schedule, token), ome::files::CancelledException);
+  else
+    EXPECT_NO_THROW(ifd->readImage(vb, x, y, w, h, schedule, token));
+  EXPECT_EQ(1U, ntiles);
+}
+
+TEST_P(TIFFVariantTest, PlaneReadDecimated)
+{
+  VariantPixelBuffer full;
+  ASSERT_NO_THROW(ifd->readImage(full));
+  ASSERT_EQ(PT::UINT8, full.pixelType());
+
+  const dimension_size_type x = 1U;
+  const dimension_size_type y = 2U;
+  const dimension_size_type w = iwidth - x;
+  const dimension_size_type h = iheight - y;
+
+  const std::array<std::array<dimension_size_type, 2>, 4> steps
+    {{{{2U, 2U}}, {{3U, 5U}}, {{16U, 7U}}, {{1U, 4U}}}};
+
+  for (const auto& step : steps)
+    {
+      for (const auto method : {ome::files::tiff::DECIMATE_NEAREST,
+                                ome::files::tiff::DECIMATE_AVERAGE})
+        {
+          VariantPixelBuffer vb;
+          ASSERT_NO_THROW(ifd->readImage(vb, x, y, w, h, step[0], step[1], method));
+
+          const dimension_size_type dw = (w + step[0] - 1) / step[0];
+          const dimension_size_type dh = (h + step[1] - 1) / step[1];
+          ASSERT_EQ(dw, vb.shape()[ome::files::DIM_SPATIAL_X]);
+          ASSERT_EQ(dh, vb.shape()[ome::files::DIM_SPATIAL_Y]);
+          ASSERT_EQ(samples, vb.shape()[ome::files::DIM_SUBCHANNEL]);
+
+          VariantPixelBuffer::indices_type sidx, didx;
+          sidx.fill(0);
+          didx.fill(0);
+          for (dimension_size_type dy = 0; dy < dh; ++dy)
+            for (dimension_size_type dx = 0; dx < dw; ++dx)
+              for (dimension_size_type s = 0; s < samples; ++s)
+                {
+                  double sum = 0.0;
+                  dimension_size_type count = 0U;
+                  for (dimension_size_type sy = y + dy * step[1];
+                       sy < std::min(y + (dy + 1) * step[1], y + h);
+                       ++sy)
+                    for (dimension_size_type sx = x + dx * step[0];
+                         sx < std::min(x + (dx + 1) * step[0], x + w);
+                         ++sx)
+                      {
+                        sidx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(sx);
+                        sidx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(sy);
+                        sidx[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+                        if (method == ome::files::tiff::DECIMATE_NEAREST && count)
+                          continue;
+                        sum += full.array<uint8_t>()(sidx);
+                        ++count;
+                      }
+
+                  didx[ome::files::DIM_SPATIAL_X] = static_cast<boost::multi_array_types::index>(dx);
+                  didx[ome::files::DIM_SPATIAL_Y] = static_cast<boost::multi_array_types::index>(dy);
+                  didx[ome::files::DIM_SUBCHANNEL] = static_cast<boost::multi_array_types::index>(s);
+                  ASSERT_EQ(static_cast<uint8_t>(std::floor(sum / static_cast<double>(count) + 0.5)),
+                            vb.array<uint8_t>()(didx));
+                }
+        }
+    }
+
+  VariantPixelBuffer vb;
+  EXPECT_THROW(ifd->readImage(vb, 0U, 0U, iwidth, iheight, 0U, 1U), ome::files::tiff::Exception);
+}
+
 TEST_P(TIFFVariantTest, PlaneReadAlignedTileOrdered)
 {
   TileInfo info = ifd->getTileInfo();
@@ -36,15 +36,23 @@
  * #L%
  */
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <vector>
 
+#include <boost/filesystem.hpp>
+
+#include <ome/files/FormatException.h>
+#include <ome/files/PixelProperties.h>
 #include <ome/files/VariantPixelBuffer.h>
 #include <ome/files/in/TIFFReader.h>
 
 #include <ome/test/test.h>
 
 using ome::files::dimension_size_type;
+using ome::files::PixelProperties;
 using ome::files::VariantPixelBuffer;
 using ome::files::in::TIFFReader;
 
@@ -147,6 +155,158 @@ TEST_P(TIFFTest, openBytes)
     }
 }
 
+namespace
+{
+
+  // Write a big-endian ImageJ hyperstack with a single IFD, followed
+  // by all planes stored contiguously.
+  void
+  writeContiguousImageJ(const boost::filesystem::path& filename,
+                        uint16_t                       width,
+                        uint16_t                       height,
+                        uint16_t                       channels,
+                        uint16_t                       slices,
+                        const std::vector<uint16_t>&   values)
+  {
+    const uint16_t images = channels * slices;
+    std::ostringstream ds;
+    ds << "ImageJ=1.51\nimages=" << images << "\nchannels=" << channels
+       << "\nslices=" << slices << "\nhyperstack=true\nmode=grayscale\n";
+    std::string desc(ds.str());
+    desc.push_back('\0');
+
+    const uint16_t nentries = 10U;
+    const uint32_t descoffset = 8U + 2U + (nentries * 12U) + 4U;
+    const uint32_t dataoffset = descoffset + static_cast<uint32_t>(desc.size());
+    const uint32_t planesize = width * height * 2U;
+
+    std::vector<uint8_t> data;
+    auto put16 = [&data](uint16_t v)
+      {
+        data.push_back(static_cast<uint8_t>(v >> 8));
+        data.push_back(static_cast<uint8_t>(v & 0xFFU));
+      };
+    auto put32 = [&put16](uint32_t v)
+      {
+        put16(static_cast<uint16_t>(v >> 16));
+        put16(static_cast<uint16_t>(v & 0xFFFFU));
+      };
+    auto entry = [&put16, &put32](uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+      {
+        put16(tag);
+        put16(type);
+        put32(count);
+        if (type == 3U) // SHORT
+          {
+            put16(static_cast<uint16_t>(value));
+            put16(0U);
+          }
+        else // LONG or ASCII offset
+          put32(value);
+      };
+
+    data.push_back('M');
+    data.push_back('M');
+    put16(42U);
+    put32(8U);
+    put16(nentries);
+    entry(256U, 3U, 1U, width);                                        // ImageWidth
+    entry(257U, 3U, 1U, height);                                       // ImageLength
+    entry(258U, 3U, 1U, 16U);                                          // BitsPerSample
+    entry(259U, 3U, 1U, 1U);                                           // Compression
+    entry(262U, 3U, 1U, 1U);                                           // PhotometricInterpretation
+    entry(270U, 2U, static_cast<uint32_t>(desc.size()), descoffset);   // ImageDescription
+    entry(273U, 4U, 1U, dataoffset);                                   // StripOffsets
+    entry(277U, 3U, 1U, 1U);                                           // SamplesPerPixel
+    entry(278U, 3U, 1U, height);                                       // RowsPerStrip
+    entry(279U, 4U, 1U, planesize);                                    // StripByteCounts
+    put32(0U);
+    data.insert(data.end(), desc.begin(), desc.end());
+    for (auto v : values)
+      put16(v);
+
+    std::ofstream out(filename.string().c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char *>(data.data()),
+              static_cast<std::streamsize>(data.size()));
+  }
+
+}
+
+TEST(TIFFImageJ, ContiguousHyperstack)
+{
+  boost::filesystem::path dir(PROJECT_BINARY_DIR "/test/ome-files/data");
+  if (!boost::filesystem::exists(dir))
+    boost::filesystem::create_directories(dir);
+  boost::filesystem::path file(dir / "imagej-contiguous.tif");
+
+  const uint16_t width = 7U;
+  const uint16_t height = 5U;
+  const uint16_t channels = 2U;
+  const uint16_t slices = 3U;
+  const dimension_size_type planesize = width * height;
+
+  std::vector<uint16_t> values;
+  for (dimension_size_type i = 0; i < planesize * channels * slices; ++i)
+    values.push_back(static_cast<uint16_t>((i * 263U) + 1000U));
+  writeContiguousImageJ(file, width, height, channels, slices, values);
+
+  TIFFReader reader;
+  ASSERT_NO_THROW(reader.setId(file));
+  EXPECT_EQ(width, reader.getSizeX());
+  EXPECT_EQ(height, reader.getSizeY());
+  EXPECT_EQ(channels, reader.getSizeC());
+  EXPECT_EQ(slices, reader.getSizeZ());
+  EXPECT_EQ(1U, reader.getSizeT());
+  ASSERT_EQ(channels * slices, reader.getImageCount());
+
+  typedef PixelProperties<ome::xml::model::enums::PixelType::UINT16>::std_type value_type;
+
+  // Read planes in reverse to check there is no dependency upon
+  // sequential access.
+  for (dimension_size_type p = reader.getImageCount(); p-- > 0;)
+    {
+      VariantPixelBuffer buf;
+      ASSERT_NO_THROW(reader.openBytes(p, buf));
+      ASSERT_EQ(planesize, buf.num_elements());
+
+      for (dimension_size_type y = 0; y < height; ++y)
+        for (dimension_size_type x = 0; x < width; ++x)
+          {
+            VariantPixelBuffer::indices_type idx;
+            std::fill(idx.begin(), idx.end(), 0);
+            idx[ome::files::DIM_SPATIAL_X] = x;
+            idx[ome::files::DIM_SPATIAL_Y] = y;
+            EXPECT_EQ(values[(p * planesize) + (y * width) + x],
+                      buf.array<value_type>()(idx));
+          }
+    }
+
+  // Region of the last plane.
+  VariantPixelBuffer region;
+  ASSERT_NO_THROW(reader.openBytes(5, region, 2, 1, 4, 3));
+  ASSERT_EQ(12U, region.num_elements());
+  for (dimension_size_type y = 0; y < 3U; ++y)
+    for (dimension_size_type x = 0; x < 4U; ++x)
+      {
+        VariantPixelBuffer::indices_type idx;
+        std::fill(idx.begin(), idx.end(), 0);
+        idx[ome::files::DIM_SPATIAL_X] = x;
+        idx[ome::files::DIM_SPATIAL_Y] = y;
+        EXPECT_EQ(values[(5U * planesize) + ((y + 1U) * width) + x + 2U],
+                  region.array<value_type>()(idx));
+      }
+
+  VariantPixelBuffer buf;
+  EXPECT_THROW(reader.openBytes(6, buf), std::logic_error);
+
+  // Every plane shares the first IFD, which has no colour map.
+  for (dimension_size_type p = 0; p < reader.getImageCount(); ++p)
+    {
+      VariantPixelBuffer lut;
+      EXPECT_THROW(reader.getLookupTable(p, lut), ome::files::FormatException);
+    }
+}
+
 namespace
 {
 